@@ -30,6 +30,7 @@
 #include "config.h"
 #include "address.h"
 #include "util.h"
+#include <stdlib.h>
 #include <string.h>
 #include <pcap.h>
 #include <sys/socket.h>
@@ -121,3 +122,50 @@ address_from_str(const char *ipport)
 
     return ret;
 }
+
+int
+address_prefix_from_str(const char *str, address_prefix_t *prefix)
+{
+    char ip[ADDRESSLEN + 1];
+    const char *bits;
+    char *end;
+    long num;
+    size_t len;
+
+    // Split address and prefix length
+    len = (bits = strchr(str, '/')) ? (size_t) (bits - str) : strlen(str);
+    if (len > ADDRESSLEN)
+        return 1;
+    memcpy(ip, str, len);
+    ip[len] = '\0';
+
+    memset(prefix, 0, sizeof(address_prefix_t));
+    prefix->family = strchr(ip, ':') ? AF_INET6 : AF_INET;
+    if (inet_pton(prefix->family, ip, prefix->addr) != 1)
+        return 1;
+
+    prefix->bits = (prefix->family == AF_INET6) ? 128 : 32;
+    if (bits) {
+        num = strtol(++bits, &end, 10);
+        if (!*bits || *end || num < 0 || num > prefix->bits)
+            return 1;
+        prefix->bits = num;
+    }
+
+    return 0;
+}
+
+bool
+address_in_prefix(address_t addr, const address_prefix_t *prefix)
+{
+    uint8_t ip[16];
+    int bytes = prefix->bits / 8, rest = prefix->bits % 8;
+
+    if (inet_pton(prefix->family, addr.ip, ip) != 1)
+        return false;
+
+    // Compare whole bytes and then the remaining prefix bits
+    if (memcmp(ip, prefix->addr, bytes) != 0)
+        return false;
+    return !rest || !((ip[bytes] ^ prefix->addr[bytes]) & (0xFF << (8 - rest)));
+}
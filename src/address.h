@@ -50,6 +50,8 @@
 
 //! Shorter declaration of address structure
 typedef struct address address_t;
+//! Shorter declaration of address_prefix structure
+typedef struct address_prefix address_prefix_t;
 
 /**
  * @brief Network address
@@ -61,6 +63,18 @@ struct address {
     uint16_t port;
 };
 
+/**
+ * @brief Network address prefix
+ */
+struct address_prefix {
+    //! Address family
+    int family;
+    //! Binary network address
+    uint8_t addr[16];
+    //! Prefix length in bits
+    int bits;
+};
+
 /**
  * @brief Check if two address are equal (including port)
  *
@@ -99,5 +113,25 @@ address_is_local(address_t addr);
 address_t
 address_from_str(const char *ipport);
 
+/**
+ * @brief Convert string IP or IP/BITS to address prefix structure
+ *
+ * @param str IP address with optional prefix length
+ * @param prefix Prefix structure to fill
+ * @return 0 if string is a valid prefix, 1 otherwise
+ */
+int
+address_prefix_from_str(const char *str, address_prefix_t *prefix);
+
+/**
+ * @brief Check if an address belongs to a network prefix
+ *
+ * @param addr Address structure
+ * @param prefix Prefix structure
+ * @return true if address belongs to the prefix, false otherwise
+ */
+bool
+address_in_prefix(address_t addr, const address_prefix_t *prefix);
+
 
 #endif /* __SNGREP_ADDRESS_H */
@@ -36,6 +36,9 @@
 #include <stdbool.h>
 #include <signal.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include "capture.h"
 #ifdef USE_EEP
 #include "capture_eep.h"
@@ -51,8 +54,16 @@
 #endif
 #include "sip.h"
 #include "rtp.h"
+#include "rtp_store.h"
 #include "setting.h"
 #include "util.h"
+#include "profile.h"
+#include "metrics.h"
+#include "storage.h"
+#include "epoch.h"
+#include "correlator.h"
+#include "capture_loader.h"
+#include "dedup.h"
 
 #if __STDC_VERSION__ >= 201112L && __STDC_NO_ATOMICS__ != 1
 // modern C with atomics
@@ -65,7 +76,7 @@ typedef volatile sig_atomic_t signal_flag_type;
 
 // Capture information
 capture_config_t capture_cfg =
-{ 0 };
+{ .notify = { -1, -1 }, .callid_lock = PTHREAD_MUTEX_INITIALIZER };
 
 signal_flag_type sigusr1_received = 0;
 
@@ -97,6 +108,8 @@ gzip_cookie_close(void *cookie)
 void
 capture_init(size_t limit, bool rtp_capture, bool rotate, size_t pcap_buffer_size)
 {
+    enum rtp_store_mode rtp_mode = RTP_STORE_FULL;
+
     capture_cfg.limit = limit;
     capture_cfg.pcap_buffer_size = pcap_buffer_size;
     capture_cfg.rtp_capture = rtp_capture;
@@ -118,7 +131,25 @@ capture_init(size_t limit, bool rtp_capture, bool rotate, size_t pcap_buffer_siz
         capture_cfg.storage = CAPTURE_STORAGE_MEMORY;
     } else if (setting_has_value(SETTING_CAPTURE_STORAGE, "disk")) {
         capture_cfg.storage = CAPTURE_STORAGE_DISK;
+        // Fallback to memory storage if segment files can not be created
+        if (storage_init(setting_get_value(SETTING_CAPTURE_DISKPATH)) != 0)
+            capture_cfg.storage = CAPTURE_STORAGE_MEMORY;
+    }
+
+    // Select how much of RTP packets is retained
+    if (setting_has_value(SETTING_CAPTURE_RTPMODE, "stats")) {
+        rtp_mode = RTP_STORE_STATS;
+    } else if (setting_has_value(SETTING_CAPTURE_RTPMODE, "headers")) {
+        rtp_mode = RTP_STORE_HEADERS;
+    } else if (capture_cfg.storage == CAPTURE_STORAGE_NONE) {
+        // Full packets can not be retained without storage
+        rtp_mode = RTP_STORE_HEADERS;
     }
+    rtp_store_init(rtp_mode, capture_cfg.storage == CAPTURE_STORAGE_DISK);
+
+#ifdef WITH_ZLIB
+    capture_cfg.compress = setting_enabled(SETTING_CAPTURE_COMPRESS);
+#endif
 
 #if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
     // Parse TLS Server setting
@@ -135,6 +166,24 @@ capture_init(size_t limit, bool rtp_capture, bool rotate, size_t pcap_buffer_siz
 #endif
     pthread_mutex_init(&capture_cfg.lock, &attr);
 
+    // Create notification pipe, writes must never block capture threads
+    if (pipe(capture_cfg.notify) == 0) {
+        fcntl(capture_cfg.notify[0], F_SETFL, O_NONBLOCK);
+        fcntl(capture_cfg.notify[1], F_SETFL, O_NONBLOCK);
+    } else {
+        capture_cfg.notify[0] = capture_cfg.notify[1] = -1;
+    }
+
+    // Discard packets received from several sources
+    if (dedup_init(setting_get_intvalue(SETTING_CAPTURE_DEDUP)) != 0)
+        fprintf(stderr, "Can't allocate memory for duplicated packets detection!\n");
+
+    // Start SIP correlation threads
+    correlator_init(sip_shard_count());
+
+    // Export capture sources stats
+    metrics_add_collector(capture_metrics_collect);
+    metrics_add_writer(capture_metrics_write);
 }
 
 void
@@ -143,12 +192,37 @@ capture_deinit()
     // Close pcap handler
     capture_close();
 
+    // Stop SIP correlation threads
+    correlator_deinit();
+
+    // Unmap loaded input files
+    capture_loader_deinit();
+
+    // Free duplicated packets ring
+    dedup_deinit();
+
+    // Stop writing frames to disk storage
+    if (capture_cfg.storage == CAPTURE_STORAGE_DISK)
+        storage_deinit();
+
+#ifdef WITH_ZLIB
+    // Free payload compression streams
+    compress_deinit();
+#endif
+
     // Deallocate vectors
     vector_set_destroyer(capture_cfg.sources, vector_generic_destroyer);
     vector_destroy(capture_cfg.sources);
 
     // Remove capture mutex
     pthread_mutex_destroy(&capture_cfg.lock);
+
+    // Close notification pipe
+    if (capture_cfg.notify[0] != -1) {
+        close(capture_cfg.notify[0]);
+        close(capture_cfg.notify[1]);
+        capture_cfg.notify[0] = capture_cfg.notify[1] = -1;
+    }
 }
 
 int
@@ -310,21 +384,259 @@ openerror:
     capinfo->tcp_reasm = vector_create(0, 10);
     capinfo->ip_reasm = vector_create(0, 10);
 
+    // Load pcap files records using several threads when possible
+    capture_loader_open(capinfo);
+
     // Add this capture information as packet source
     capture_add_source(capinfo);
 
     return 0;
 }
 
+/**
+ * @brief Check if an input file packet must be loaded
+ *
+ * Packets outside the requested time range are discarded before being
+ * decoded.
+ */
+static bool
+capture_packet_wanted(capture_info_t *capinfo, const struct pcap_pkthdr *header)
+{
+    struct timeval last;
+
+    if (timerisset(&capture_cfg.from) && timercmp(&header->ts, &capture_cfg.from, <))
+        return false;
+
+    if (timerisset(&capture_cfg.to) && timercmp(&header->ts, &capture_cfg.to, >)) {
+        // Stop reading files that are not mapped once far enough from the range
+        last = capture_cfg.to;
+        last.tv_sec += CAPTURE_WINDOW_SLACK;
+        if (!capinfo->loader && timercmp(&header->ts, &last, >))
+            pcap_breakloop(capinfo->handle);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Remember a media address of the requested Call-ID dialogs
+ *
+ * @note This function must be called with Call-ID lock held
+ */
+static void
+capture_callid_media_add(const char *ip, unsigned int port)
+{
+    address_t *media;
+    int count = capture_cfg.callid_media_count, i;
+
+    if (!*ip || port == 0 || port > 65535)
+        return;
+
+    for (i = 0; i < count; i++) {
+        if (capture_cfg.callid_media[i].port == port && !strcmp(capture_cfg.callid_media[i].ip, ip))
+            return;
+    }
+
+    if (count == CAPTURE_CALLID_MEDIA) {
+        __atomic_store_n(&capture_cfg.callid_media_full, true, __ATOMIC_RELEASE);
+        return;
+    }
+
+    // Publish the address once it is complete, readers do not lock
+    media = &capture_cfg.callid_media[count];
+    sng_strncpy(media->ip, ip, ADDRESSLEN);
+    media->port = port;
+    __atomic_store_n(&capture_cfg.callid_media_count, count + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Collect media addresses from the SDP of a requested Call-ID message
+ *
+ * Each media uses the session connection address, unless it has its own
+ * connection line.
+ */
+static void
+capture_callid_media_parse(const u_char *payload, uint32_t len)
+{
+    const char *line, *end = (const char *) payload + len;
+    char session[ADDRESSLEN] = "", media[ADDRESSLEN] = "", ip[ADDRESSLEN];
+    unsigned int port = 0, rtcp = 0;
+    int i;
+
+    // Most messages have no SDP
+    if (!memmem(payload, len, "\nm=", 3))
+        return;
+
+    pthread_mutex_lock(&capture_cfg.callid_lock);
+    for (line = (const char *) payload; line < end; line++) {
+        if (!strncmp(line, "c=IN IP4 ", 9) || !strncmp(line, "c=IN IP6 ", 9)) {
+            // Connection address, without multicast TTL or count
+            for (i = 0; i < ADDRESSLEN - 1 && line + 9 + i < end && !strchr("/\r\n ", line[9 + i]); i++)
+                ip[i] = line[9 + i];
+            ip[i] = '\0';
+            strcpy(port ? media : session, ip);
+        } else if (!strncmp(line, "m=", 2)) {
+            // Store previous media once all its lines have been read
+            capture_callid_media_add(*media ? media : session, port);
+            capture_callid_media_add(*media ? media : session, rtcp);
+            port = rtcp = 0;
+            media[0] = '\0';
+            if (sscanf(line, "m=%*s %u", &port) == 1 && port > 0 && port < 65535)
+                rtcp = port + 1;
+        } else if (!strncmp(line, "a=rtcp:", 7) && port) {
+            sscanf(line, "a=rtcp:%u", &rtcp);
+        }
+        if (!(line = memchr(line, '\n', end - line)))
+            break;
+    }
+    capture_callid_media_add(*media ? media : session, port);
+    capture_callid_media_add(*media ? media : session, rtcp);
+    pthread_mutex_unlock(&capture_cfg.callid_lock);
+}
+
+/**
+ * @brief Check if a decoded input file packet belongs to the requested Call-ID
+ *
+ * Packets are checked once IP fragments and TCP segments have been
+ * reassembled, so Call-ID headers in any piece of a message are found.
+ */
+static bool
+capture_packet_callid_wanted(packet_t *packet)
+{
+    const u_char *payload = packet_payload(packet);
+    uint32_t len = packet_payloadlen(packet), port;
+    char callid[MAX_CALLID_SIZE];
+    address_t *media;
+    int count, i;
+
+    if (!capture_cfg.callid)
+        return true;
+
+    if (payload && len && memmem(payload, len, "SIP/2.0", 7)) {
+        // Quick check before parsing the Call-ID header
+        if (!memmem(payload, len, capture_cfg.callid, capture_cfg.callid_len))
+            return false;
+
+        // Other Call-IDs can contain the requested one
+        callid[0] = '\0';
+        if (strcmp(sip_get_callid((const char *) payload, callid), capture_cfg.callid) != 0)
+            return false;
+
+        capture_callid_media_parse(payload, len);
+        return true;
+    }
+
+    if (__atomic_load_n(&capture_cfg.callid_media_full, __ATOMIC_ACQUIRE))
+        return true;
+
+    // Packets without SIP messages must be sent to a media address of the dialogs
+    count = __atomic_load_n(&capture_cfg.callid_media_count, __ATOMIC_ACQUIRE);
+    port = packet->dst.port;
+    for (i = 0; i < count; i++) {
+        media = &capture_cfg.callid_media[i];
+        if (media->port == port && !strcmp(media->ip, packet->dst.ip))
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Check if a captured frame must be decoded
+ *
+ * Captured packets are accounted here, once they are known to be in the
+ * requested time range.
+ */
+static bool
+capture_packet_accept(capture_info_t *capinfo, const struct pcap_pkthdr *header)
+{
+    // Ignore packets while capture is paused
+    if (capture_paused())
+        return false;
+
+    // Ignore input file packets not requested
+    if (capinfo->infile && !capture_packet_wanted(capinfo, header))
+        return false;
+
+    metrics_inc(METRIC_PACKETS);
+
+    // Check if we have reached capture limit
+    if (capture_cfg.limit && sip_calls_count() >= capture_cfg.limit) {
+        // If capture rotation is disabled, just skip this packet
+        if (!capture_cfg.rotate) {
+            metrics_inc(METRIC_DROP_LIMIT);
+            return false;
+        }
+    }
+
+    // Check maximum capture length
+    if (header->caplen > MAX_CAPTURE_LEN) {
+        metrics_inc(METRIC_DROP_CAPLEN);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Get the payload of an UDP packet and set its ports
+ *
+ * @param size_payload Packet size after IP headers, updated to payload size
+ * @return payload start
+ */
+static u_char *
+capture_packet_udp(packet_t *pkt, u_char *data, uint32_t size_capture, uint32_t *size_payload)
+{
+    // Get UDP header
+    struct udphdr *udp = (struct udphdr *)((u_char *)(data) + (size_capture - *size_payload));
+    uint16_t udp_off = sizeof(struct udphdr);
+
+    // Set packet ports
+    pkt->src.port = htons(udp->uh_sport);
+    pkt->dst.port = htons(udp->uh_dport);
+
+    // Remove UDP Header from payload
+    *size_payload -= udp_off;
+
+    if ((int32_t)*size_payload < 0)
+        *size_payload = 0;
+
+    return (u_char *) (udp) + udp_off;
+}
+
+/**
+ * @brief Send a decoded packet to be correlated or stored
+ */
+static void
+capture_packet_dispatch(capture_info_t *capinfo, packet_t *pkt)
+{
+    // Discard input file packets of other dialogs
+    if (capinfo->infile && !capture_packet_callid_wanted(pkt)) {
+        packet_destroy(pkt);
+        return;
+    }
+
+    // Discard packets already received from this or other sources
+    if (capture_packet_duplicate(capinfo, pkt)) {
+        packet_destroy(pkt);
+        return;
+    }
+
+    // Let SIP messages be correlated by their shard thread
+    if (correlator_enabled()) {
+        correlator_dispatch(pkt);
+        return;
+    }
+
+    capture_packet_commit(pkt, NULL);
+}
+
 void
 parse_packet(u_char *info, const struct pcap_pkthdr *header, const u_char *packet)
 {
     // Capture info
     capture_info_t *capinfo = (capture_info_t *) info;
-    // UDP header data
-    struct udphdr *udp;
-    // UDP header size
-    uint16_t udp_off;
     // TCP header data
     struct tcphdr *tcp;
     // TCP header size
@@ -344,47 +656,24 @@ parse_packet(u_char *info, const struct pcap_pkthdr *header, const u_char *packe
     packet_t *pkt_hep3;
 #endif
 
-    // Ignore packets while capture is paused
-    if (capture_paused())
-        return;
-
-    // Check if we have reached capture limit
-    if (capture_cfg.limit && sip_calls_count() >= capture_cfg.limit) {
-        // If capture rotation is disabled, just skip this packet
-        if (!capture_cfg.rotate) {
-            return;
-        }
-    }
-
-    // Check maximum capture length
-    if (header->caplen > MAX_CAPTURE_LEN)
+    if (!capture_packet_accept(capinfo, header))
         return;
 
     // Copy packet payload
     memcpy(data, packet, header->caplen);
 
     // Check if we have a complete IP packet
-    if (!(pkt = capture_packet_reasm_ip(capinfo, header, data, &size_payload, &size_capture)))
+    PROFILE_START(prof_ip);
+    pkt = capture_packet_reasm_ip(capinfo, header, data, &size_payload, &size_capture);
+    PROFILE_END(PROFILE_IP_REASM, prof_ip);
+    __atomic_store_n(&capinfo->ip_queue, vector_count(capinfo->ip_reasm), __ATOMIC_RELAXED);
+    if (!pkt)
         return;
 
     // Only interested in UDP packets
     if (pkt->proto == IPPROTO_UDP) {
-        // Get UDP header
-        udp = (struct udphdr *)((u_char *)(data) + (size_capture - size_payload));
-        udp_off = sizeof(struct udphdr);
-
-        // Set packet ports
-        pkt->src.port = htons(udp->uh_sport);
-        pkt->dst.port = htons(udp->uh_dport);
-
-        // Remove UDP Header from payload
-        size_payload -= udp_off;
-
-        if ((int32_t)size_payload < 0)
-            size_payload = 0;
-
-        // Remove TCP Header from payload
-        payload = (u_char *) (udp) + udp_off;
+        // Get UDP payload and ports
+        payload = capture_packet_udp(pkt, data, size_capture, &size_payload);
 
 #ifdef USE_EEP
         // check for HEP3 header and parse payload
@@ -398,7 +687,7 @@ parse_packet(u_char *info, const struct pcap_pkthdr *header, const u_char *packe
                 vector_set_destroyer(pkt->frames, vector_generic_destroyer);
                 vector_destroy(pkt->frames);
                 pkt->frames = vector_create(1, 1);
-                packet_add_frame(pkt, header, packet);
+                packet_add_frame(pkt, header, packet)->record = capinfo->record;
             } else {
                 // Complete packet with Transport information
                 packet_set_type(pkt, PACKET_SIP_UDP);
@@ -435,52 +724,138 @@ parse_packet(u_char *info, const struct pcap_pkthdr *header, const u_char *packe
         packet_set_payload(pkt, payload, size_payload);
 
         // Create a structure for this captured packet
-        if (!(pkt = capture_packet_reasm_tcp(capinfo, pkt, tcp, payload, size_payload)))
+        PROFILE_START(prof_tcp);
+        pkt = capture_packet_reasm_tcp(capinfo, pkt, tcp, payload, size_payload);
+        PROFILE_END(PROFILE_TCP_REASM, prof_tcp);
+        __atomic_store_n(&capinfo->tcp_queue, vector_count(capinfo->tcp_reasm), __ATOMIC_RELAXED);
+        if (!pkt)
             return;
 
 #if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
         // Check if packet is TLS
         if (capture_cfg.keyfile) {
+            PROFILE_START(prof_tls);
             tls_process_segment(pkt, tcp);
+            PROFILE_END(PROFILE_TLS, prof_tls);
         }
 #endif
 
         // Check if packet is WS or WSS
+        PROFILE_START(prof_ws);
         capture_ws_check_packet(pkt);
+        PROFILE_END(PROFILE_WS, prof_ws);
     } else {
         // Not handled protocol
         packet_destroy(pkt);
         return;
     }
 
+    capture_packet_dispatch(capinfo, pkt);
+}
+
+void
+capture_packet_process(capture_info_t *capinfo, const struct pcap_pkthdr *header, packet_t *pkt)
+{
+    if (!capture_packet_accept(capinfo, header)) {
+        packet_destroy(pkt);
+        return;
+    }
+
+    capture_packet_dispatch(capinfo, pkt);
+}
+
+/**
+ * @brief Add a prepared SIP message to its dialog without capture lock
+ */
+static sip_msg_t *
+capture_packet_correlate(packet_t *packet, sip_prepared_t *prep);
+
+/**
+ * @brief Store the SIP message of the given packet or check its RTP data
+ */
+static int
+capture_packet_store(packet_t *packet, sip_msg_t *msg);
+
+int
+capture_packet_commit(packet_t *pkt, sip_prepared_t *prep)
+{
+    sip_msg_t *msg = NULL;
+    int ret;
+
+    epoch_enter();
+    // Add prepared messages to their dialogs before taking capture lock
+    if (prep)
+        msg = capture_packet_correlate(pkt, prep);
+
     // Avoid parsing from multiples sources.
     // Avoid parsing while screen in being redrawn
+    PROFILE_START(prof_lock);
     capture_lock();
+    PROFILE_END(PROFILE_LOCK_WAIT, prof_lock);
+    // Store correlated message dialog
+    if (msg)
+        sip_publish_msg(msg);
+    ret = (prep) ? capture_packet_store(pkt, msg) : capture_packet_parse(pkt);
     // Check if we can handle this packet
-    if (capture_packet_parse(pkt) == 0) {
+    if (ret == 0) {
 #ifdef USE_EEP
         // Send this packet through eep
         capture_eep_send(pkt);
 #endif
         // Store this packets in output file
-        capture_dump_packet(pkt);;
-        // If storage is disabled, delete frames payload
-        if (capture_cfg.storage == 0) {
+        PROFILE_START(prof_dump);
+        capture_dump_packet(pkt);
+        PROFILE_END(PROFILE_DUMP, prof_dump);
+        // RTP packets data has already been retained by its stream
+        if (pkt->type == PACKET_RTP) {
+            packet_destroy(pkt);
+        } else if (capture_cfg.storage == CAPTURE_STORAGE_NONE) {
+            // If storage is disabled, delete frames payload
             packet_free_frames(pkt);
+        } else if (capture_cfg.storage == CAPTURE_STORAGE_DISK) {
+            PROFILE_START(prof_store);
+            packet_store_frames(pkt);
+            PROFILE_END(PROFILE_STORE, prof_store);
         }
         // Allow Interface refresh and user input actions
         capture_unlock();
-        return;
+        epoch_leave();
+        return 0;
     }
 
     // Not an interesting packet ...
+    metrics_inc(METRIC_PACKETS_IGNORED);
     packet_destroy(pkt);
     // Allow Interface refresh and user input actions
     capture_unlock();
+    epoch_leave();
+    return 1;
 }
 
-packet_t *
-capture_packet_reasm_ip(capture_info_t *capinfo, const struct pcap_pkthdr *header, u_char *packet, uint32_t *size, uint32_t *caplen)
+bool
+capture_packet_duplicate(capture_info_t *capinfo, packet_t *pkt)
+{
+    if (!dedup_enabled() || !dedup_check(pkt))
+        return false;
+
+    __atomic_add_fetch(&capinfo->duplicates, 1, __ATOMIC_RELAXED);
+    metrics_inc(METRIC_DROP_DUPLICATE);
+    return true;
+}
+
+/**
+ * @brief Decode IP headers of a captured frame
+ *
+ * Fragments are only stored for reassembly when requested, otherwise they
+ * are left to be decoded again by capture_packet_reasm_ip.
+ *
+ * @param record Position of the mapped input file record plus one, or 0
+ * @param reasm Store fragments and return reassembled packets
+ * @return a Packet structure when packet is not fragmented or fully reassembled
+ */
+static packet_t *
+capture_packet_decode_ip(capture_info_t *capinfo, const struct pcap_pkthdr *header, u_char *packet,
+                         uint32_t *size, uint32_t *caplen, size_t record, bool reasm)
 {
     // IP header data
     struct ip *ip4;
@@ -626,8 +1001,11 @@ capture_packet_reasm_ip(capture_info_t *capinfo, const struct pcap_pkthdr *heade
     }
 
     // Check maximum capture len
-    if (*caplen > MAX_CAPTURE_LEN)
+    if (*caplen > MAX_CAPTURE_LEN) {
+        if (reasm)
+            metrics_inc(METRIC_DROP_CAPLEN);
         return NULL;
+    }
 
     // Check frame has at least IP header length
     if (ip_ver == 4 && header->caplen < link_hl + sizeof(struct ip))
@@ -642,10 +1020,14 @@ capture_packet_reasm_ip(capture_info_t *capinfo, const struct pcap_pkthdr *heade
     if (ip_frag == 0) {
         // Just create a new packet with given network data
         pkt = packet_create(ip_ver, ip_proto, src, dst, ip_id);
-        packet_add_frame(pkt, header, packet);
+        packet_add_frame(pkt, header, packet)->record = record;
         return pkt;
     }
 
+    // Fragments can only be reassembled in capture order
+    if (!reasm)
+        return NULL;
+
     // Look for another packet with same id in IP reassembly vector
     it = vector_iterator(capinfo->ip_reasm);
     while ((pkt = vector_iterator_next(&it))) {
@@ -658,11 +1040,11 @@ capture_packet_reasm_ip(capture_info_t *capinfo, const struct pcap_pkthdr *heade
 
     // If we already have this packet stored, append this frames to existing one
     if (pkt) {
-        packet_add_frame(pkt, header, packet);
+        packet_add_frame(pkt, header, packet)->record = record;
     } else {
         // Add To the possible reassembly list
         pkt = packet_create(ip_ver, ip_proto, src, dst, ip_id);
-        packet_add_frame(pkt, header, packet);
+        packet_add_frame(pkt, header, packet)->record = record;
         vector_append(capinfo->ip_reasm, pkt);
     }
 
@@ -713,8 +1095,10 @@ capture_packet_reasm_ip(capture_info_t *capinfo, const struct pcap_pkthdr *heade
         }
 
         // Check packet content length
-        if (len_data > MAX_CAPTURE_LEN)
+        if (len_data > MAX_CAPTURE_LEN) {
+            metrics_inc(METRIC_DROP_REASM);
             return NULL;
+        }
 
         // Initialize memory for the assembly packet
         memset(packet, 0, link_hl + ip_hl + len_data);
@@ -765,6 +1149,55 @@ capture_packet_reasm_ip(capture_info_t *capinfo, const struct pcap_pkthdr *heade
     return NULL;
 }
 
+packet_t *
+capture_packet_reasm_ip(capture_info_t *capinfo, const struct pcap_pkthdr *header, u_char *packet, uint32_t *size, uint32_t *caplen)
+{
+    return capture_packet_decode_ip(capinfo, header, packet, size, caplen, capinfo->record, true);
+}
+
+packet_t *
+capture_packet_decode(capture_info_t *capinfo, const struct pcap_pkthdr *header, const u_char *packet, size_t record)
+{
+    // Packet data
+    u_char data[MAX_CAPTURE_LEN];
+    // Whole packet size
+    uint32_t size_capture = header->caplen;
+    // Packet payload size
+    uint32_t size_payload =  size_capture - capinfo->link_hl;
+    // Packet payload data
+    u_char *payload;
+    // Captured packet info
+    packet_t *pkt;
+
+    // Packets discarded before being decoded are left to parse_packet
+    if (header->caplen > MAX_CAPTURE_LEN || (capinfo->infile && !capture_packet_wanted(capinfo, header)))
+        return NULL;
+
+#ifdef USE_EEP
+    // HEP packets are decoded while parsing
+    if (setting_enabled(SETTING_CAPTURE_EEP))
+        return NULL;
+#endif
+
+    // Copy packet payload
+    memcpy(data, packet, header->caplen);
+
+    if (!(pkt = capture_packet_decode_ip(capinfo, header, data, &size_payload, &size_capture, record, false)))
+        return NULL;
+
+    // TCP segments can only be reassembled in capture order
+    if (pkt->proto != IPPROTO_UDP) {
+        packet_destroy(pkt);
+        return NULL;
+    }
+
+    // Complete packet with Transport information
+    payload = capture_packet_udp(pkt, data, size_capture, &size_payload);
+    packet_set_type(pkt, PACKET_SIP_UDP);
+    packet_set_payload(pkt, payload, size_payload);
+    return pkt;
+}
+
 packet_t *
 capture_packet_reasm_tcp(capture_info_t *capinfo, packet_t *packet, struct tcphdr *tcp, u_char *payload, int size_payload) {
 
@@ -790,7 +1223,7 @@ capture_packet_reasm_tcp(capture_info_t *capinfo, packet_t *packet, struct tcphd
         // Append this frames to the original packet
         vector_iter_t frames = vector_iterator(packet->frames);
         while ((frame = vector_iterator_next(&frames)))
-            packet_add_frame(pkt, frame->header, frame->data);
+            packet_add_frame(pkt, frame->header, frame->data)->record = frame->record;
         // Destroy current packet as its frames belong to the stored packet
         packet_destroy(packet);
     } else {
@@ -812,6 +1245,7 @@ capture_packet_reasm_tcp(capture_info_t *capinfo, packet_t *packet, struct tcphd
     } else {
         // Check payload length. Dont handle too big payload packets
         if (pkt->payload_len + size_payload > MAX_CAPTURE_LEN) {
+            metrics_inc(METRIC_DROP_REASM);
             packet_destroy(pkt);
             vector_remove(capinfo->tcp_reasm, pkt);
             return NULL;
@@ -833,6 +1267,7 @@ capture_packet_reasm_tcp(capture_info_t *capinfo, packet_t *packet, struct tcphd
 
     // Check if packet is too large after assembly
     if (pkt->payload_len > MAX_CAPTURE_LEN) {
+        metrics_inc(METRIC_DROP_REASM);
         vector_remove(capinfo->tcp_reasm, pkt);
         return NULL;
     }
@@ -843,7 +1278,9 @@ capture_packet_reasm_tcp(capture_info_t *capinfo, packet_t *packet, struct tcphd
 
     // This packet is ready to be parsed
     int original_size = pkt->payload_len;
+    PROFILE_START(prof_validate);
     int valid = sip_validate_packet(pkt);
+    PROFILE_END(PROFILE_SIP_VALIDATE, prof_validate);
     if (valid == VALIDATE_COMPLETE_SIP) {
         // Full SIP packet!
         vector_remove(capinfo->tcp_reasm, pkt);
@@ -984,29 +1421,148 @@ capture_ws_check_packet(packet_t *packet)
 
 int
 capture_packet_parse(packet_t *packet)
+{
+    // SIP message of this packet
+    sip_msg_t *msg;
+
+    // We're only interested in packets with payload
+    if (!packet_payloadlen(packet))
+        return 1;
+
+    // Remove expired dialogs before looking for this packet owner
+    sip_calls_expire(packet_time(packet));
+
+    // Parse this header and payload
+    PROFILE_START(prof_sip);
+    msg = sip_check_packet(packet);
+    PROFILE_END(PROFILE_SIP_PARSE, prof_sip);
+#ifdef WITH_ZLIB
+    if (msg && capture_cfg.compress) {
+        PROFILE_START(prof_compress);
+        packet_compress_payload(packet);
+        PROFILE_END(PROFILE_COMPRESS, prof_compress);
+    }
+#endif
+
+    return capture_packet_store(packet, msg);
+}
+
+static sip_msg_t *
+capture_packet_correlate(packet_t *packet, sip_prepared_t *prep)
+{
+    // SIP message of this packet
+    sip_msg_t *msg;
+
+    // Remove expired dialogs before looking for this packet owner
+    if (sip_calls_expire_pending(packet_time(packet))) {
+        capture_lock();
+        sip_calls_expire(packet_time(packet));
+        capture_unlock();
+    }
+
+    // Parse this header and payload
+    PROFILE_START(prof_sip);
+    msg = sip_correlate_packet(packet, prep);
+    PROFILE_END(PROFILE_SIP_PARSE, prof_sip);
+#ifdef WITH_ZLIB
+    // Uncompressed payload is kept until the message is stored
+    if (msg && capture_cfg.compress) {
+        PROFILE_START(prof_compress);
+        packet_compress_payload(packet);
+        PROFILE_END(PROFILE_COMPRESS, prof_compress);
+    }
+#endif
+
+    return msg;
+}
+
+static int
+capture_packet_store(packet_t *packet, sip_msg_t *msg)
 {
     // Media structure for RTP packets
     rtp_stream_t *stream;
+    sip_call_t *call;
 
-    // We're only interested in packets with payload
-    if (packet_payloadlen(packet)) {
-        // Parse this header and payload
-        if (sip_check_packet(packet)) {
+    if (msg) {
+        metrics_inc(METRIC_PACKETS_SIP);
+        // Remember this packet records for the input file index
+        capture_loader_keep(packet, false);
+#ifdef WITH_ZLIB
+        // Payload is still available in uncompressed payloads cache
+        packet_release_payload(packet);
+#endif
+        // Frames data is only kept in memory with memory storage
+        sip_calls_add_memory(msg->call, sizeof(sip_msg_t) +
+            packet_memory(packet, capture_cfg.storage == CAPTURE_STORAGE_MEMORY));
+        capture_notify();
+        return 0;
+    }
+
+    // Check if this packet belongs to a RTP stream
+    if (packet_payloadlen(packet) && (stream = rtp_check_packet(packet))) {
+        // We have an RTP packet!
+        packet_set_type(packet, PACKET_RTP);
+        capture_loader_keep(packet, true);
+        // Store this pacekt if capture rtp is enabled
+        if (capture_cfg.rtp_capture) {
+            metrics_inc(METRIC_PACKETS_RTP);
+            call = stream_get_call(stream);
+            sip_call_lock(call);
+            call_add_rtp_packet(call, stream, packet);
+            sip_call_unlock(call);
+            capture_notify();
             return 0;
         }
+    }
+    return 1;
+}
 
-        // Check if this packet belongs to a RTP stream
-        if ((stream = rtp_check_packet(packet))) {
-            // We have an RTP packet!
-            packet_set_type(packet, PACKET_RTP);
-            // Store this pacekt if capture rtp is enabled
-            if (capture_cfg.rtp_capture) {
-                call_add_rtp_packet(stream_get_call(stream), packet);
-                return 0;
-            }
+void
+capture_metrics_collect()
+{
+    capture_info_t *capinfo;
+    struct pcap_stat stats;
+    int64_t recv = 0, drop = 0, ifdrop = 0, ip_queue = 0, tcp_queue = 0;
+
+    // Sources are only added before capture starts. Reassembly queues are
+    // modified by capture threads, so only their published depth is read
+    vector_iter_t it = vector_iterator(capture_cfg.sources);
+    while ((capinfo = vector_iterator_next(&it))) {
+        // Only live captures have libpcap stats
+        if (capinfo->ispcap && !capinfo->infile && capinfo->running
+                && pcap_stats(capinfo->handle, &stats) == 0) {
+            recv += stats.ps_recv;
+            drop += stats.ps_drop;
+            ifdrop += stats.ps_ifdrop;
         }
+        ip_queue += __atomic_load_n(&capinfo->ip_queue, __ATOMIC_RELAXED);
+        tcp_queue += __atomic_load_n(&capinfo->tcp_queue, __ATOMIC_RELAXED);
+    }
+
+    metrics_set(METRIC_PCAP_RECV, recv);
+    metrics_set(METRIC_PCAP_DROP, drop);
+    metrics_set(METRIC_PCAP_IFDROP, ifdrop);
+    metrics_set(METRIC_IP_REASM_QUEUE, ip_queue);
+    metrics_set(METRIC_TCP_REASM_QUEUE, tcp_queue);
+}
+
+void
+capture_metrics_write(FILE *out)
+{
+    capture_info_t *capinfo;
+    vector_iter_t it;
+
+    if (!dedup_enabled())
+        return;
+
+    fprintf(out, "# HELP sngrep_source_duplicates_total Duplicated packets discarded by capture source\n");
+    fprintf(out, "# TYPE sngrep_source_duplicates_total counter\n");
+    it = vector_iterator(capture_cfg.sources);
+    while ((capinfo = vector_iterator_next(&it))) {
+        fprintf(out, "sngrep_source_duplicates_total{source=\"");
+        metrics_write_label(out, (capinfo->infile) ? capinfo->infile : (capinfo->device) ? capinfo->device : "hep");
+        fprintf(out, "\"} %" PRIu64 "\n", __atomic_load_n(&capinfo->duplicates, __ATOMIC_RELAXED));
     }
-    return 1;
 }
 
 void
@@ -1028,7 +1584,8 @@ capture_close()
     while ((capinfo = vector_iterator_next(&it))) {
         //Close PCAP file
         if (capinfo->handle) {
-            if (capinfo->running) {
+            // Mapped files are parsed by a single thread
+            if (capinfo->running && capinfo->capture_fn) {
                 /* We must cancel the thread here instead of joining because, according to pcap_breakloop man page,
                  * you can only break pcap_loop from within the same thread.
                  * @see: https://www.tcpdump.org/manpages/pcap_breakloop.3pcap.html
@@ -1057,6 +1614,9 @@ capture_launch_thread()
     while ((capinfo = vector_iterator_next(&it))) {
         // Mark capture as running
         capinfo->running = true;
+        // Mapped files are parsed by a single thread
+        if (!capinfo->capture_fn)
+            continue;
         if (pthread_create(&capinfo->capture_t, &attr, (void *) capinfo->capture_fn, capinfo)) {
             return 1;
         }
@@ -1073,8 +1633,13 @@ capture_thread(void *info)
 
     // Parse available packets
     pcap_loop(capinfo->handle, -1, parse_packet, (u_char *) capinfo);
+    // Wait until all read packets have been correlated
+    correlator_drain();
     capinfo->running = false;
 
+    // Let the interface know capture status has changed
+    capture_notify();
+
     return NULL;
 }
 
@@ -1114,6 +1679,13 @@ capture_set_bpf_filter(const char *filter)
         if (!capinfo->ispcap)
             continue;
 
+        // Mapped files records are filtered by scanner threads
+        if (capinfo->loader) {
+            if (capture_loader_set_filter(capinfo, filter) != 0)
+                return 1;
+            continue;
+        }
+
         //! Check if filter compiles
         if (pcap_compile(capinfo->handle, &capture_cfg.fp, filter, 0, capinfo->mask) == -1)
             return 1;
@@ -1153,6 +1725,10 @@ const char *
 capture_status_desc()
 {
     int online = 0, offline = 0, loading = 0;
+    //! Loading progress of mapped files
+    static char progress[80];
+    size_t loaded, total;
+    int eta;
 
 
     capture_info_t *capinfo;
@@ -1187,6 +1763,16 @@ capture_status_desc()
         if (online > 0 && offline == 0) {
             return "Online (Loading)";
         } else if (online == 0 && offline > 0) {
+            // Show mapped files loading progress
+            if (capture_loader_progress(&loaded, &total, &eta) == 0 && total > 0) {
+                if (eta >= 0) {
+                    snprintf(progress, sizeof(progress), "Offline (Loading %d%%, %zu/%zu MB, ETA %d:%02d)",
+                             (int) (loaded * 100 / total), loaded >> 20, total >> 20, eta / 60, eta % 60);
+                } else {
+                    snprintf(progress, sizeof(progress), "Offline (Loading 0%%, 0/%zu MB)", total >> 20);
+                }
+                return progress;
+            }
             return "Offline (Loading)";
         } else {
             return "Mixed (Loading)";
@@ -1245,6 +1831,34 @@ capture_set_keyfile(const char *keyfile)
     capture_cfg.keyfile = keyfile;
 }
 
+void
+capture_set_time_window(struct timeval from, struct timeval to)
+{
+    capture_cfg.from = from;
+    capture_cfg.to = to;
+}
+
+bool
+capture_time_window(struct timeval *from, struct timeval *to)
+{
+    *from = capture_cfg.from;
+    *to = capture_cfg.to;
+    return timerisset(from) || timerisset(to);
+}
+
+void
+capture_set_callid(const char *callid)
+{
+    capture_cfg.callid = callid;
+    capture_cfg.callid_len = callid ? strlen(callid) : 0;
+}
+
+const char *
+capture_callid()
+{
+    return capture_cfg.callid;
+}
+
 address_t
 capture_tls_server()
 {
@@ -1289,6 +1903,37 @@ capture_unlock()
     pthread_mutex_unlock(&capture_cfg.lock);
 }
 
+void
+capture_notify()
+{
+    // Interface has not read the previous notification yet
+    if (capture_cfg.notify[1] == -1 || __atomic_exchange_n(&capture_cfg.notified, true, __ATOMIC_ACQ_REL))
+        return;
+
+    if (write(capture_cfg.notify[1], "", 1) != 1)
+        __atomic_store_n(&capture_cfg.notified, false, __ATOMIC_RELEASE);
+}
+
+int
+capture_notify_fd()
+{
+    return capture_cfg.notify[0];
+}
+
+void
+capture_notify_clear()
+{
+    char buf[64];
+
+    if (capture_cfg.notify[0] == -1)
+        return;
+
+    // Allow new notifications once the pending ones have been read.
+    // Data changed before this point will be displayed on next redraw
+    while (read(capture_cfg.notify[0], buf, sizeof(buf)) > 0);
+    __atomic_store_n(&capture_cfg.notified, false, __ATOMIC_RELEASE);
+}
+
 
 
 void
@@ -1470,12 +2115,25 @@ dump_packet(pcap_dumper_t *pd, const packet_t *packet)
 
     vector_iter_t it = vector_iterator(packet->frames);
     frame_t *frame;
+    const u_char *data;
     while ((frame = vector_iterator_next(&it))) {
-        pcap_dump((u_char*) pd, frame->header, frame->data);
+        // Skip frames whose content is no longer available
+        if ((data = packet_frame_data(frame)))
+            pcap_dump((u_char*) pd, frame->header, data);
     }
     pcap_dump_flush(pd);
 }
 
+void
+dump_frame(pcap_dumper_t *pd, const struct pcap_pkthdr *header, const u_char *data)
+{
+    if (!pd || !header || !data)
+        return;
+
+    pcap_dump((u_char*) pd, header, data);
+    pcap_dump_flush(pd);
+}
+
 void
 dump_close(pcap_dumper_t *pd)
 {
@@ -77,6 +77,10 @@
 #define MAX_CAPTURE_LEN 20480
 //! Max allowed packet length
 #define MAXIMUM_SNAPLEN 262144
+//! Seconds input file packets can be out of order when looking for a time range
+#define CAPTURE_WINDOW_SLACK 5
+//! Max media addresses collected from the SDP of the requested Call-ID
+#define CAPTURE_CALLID_MEDIA 64
 
 //! Define VLAN 802.1Q Ethernet type
 #ifndef ETHERTYPE_8021Q
@@ -110,6 +114,10 @@ enum capture_storage {
 typedef struct capture_config capture_config_t;
 //; Shorter declaration of capture_info structure
 typedef struct capture_info capture_info_t;
+//! Forward declaration of SIP message prepared for correlation
+struct sip_prepared;
+//! Forward declaration of mapped input file
+struct loader_file;
 
 /**
  * @brief Capture common configuration
@@ -129,10 +137,30 @@ struct capture_config {
     int paused;
     //! Where should we store captured packets
     enum capture_storage storage;
+#ifdef WITH_ZLIB
+    //! Compress SIP messages payload
+    bool compress;
+#endif
     //! Key file for TLS decrypt
     const char *keyfile;
     //! TLS Server address
     address_t tlsserver;
+    //! Only load input file packets captured after this time
+    struct timeval from;
+    //! Only load input file packets captured before this time
+    struct timeval to;
+    //! Only load input file packets of dialogs with this Call-ID
+    const char *callid;
+    //! Call-ID length
+    size_t callid_len;
+    //! Media addresses announced in SDP of the requested Call-ID
+    address_t callid_media[CAPTURE_CALLID_MEDIA];
+    //! Number of collected media addresses
+    int callid_media_count;
+    //! Media addresses did not fit, all packets without SIP are loaded
+    bool callid_media_full;
+    //! Lock for adding media addresses
+    pthread_mutex_t callid_lock;
     //! capture filter expression text
     const char *filter;
     //! The compiled filter expression
@@ -147,6 +175,10 @@ struct capture_config {
     vector_t *sources;
     //! Capture Lock. Avoid parsing and handling data at the same time
     pthread_mutex_t lock;
+    //! Pipe to notify the interface about new captured data
+    int notify[2];
+    //! The interface has been notified and has not read notification yet
+    bool notified;
 };
 
 /**
@@ -178,6 +210,14 @@ struct capture_info
     vector_t *ip_reasm;
     //! Packets pending TCP reassembly
     vector_t *tcp_reasm;
+    //! Mapped input file in Offline capture
+    struct loader_file *loader;
+    //! Position of the mapped file record being parsed plus one
+    size_t record;
+    //! Packets discarded because they were already received
+    uint64_t duplicates;
+    //! Depth of IP and TCP reassembly queues, published for metrics
+    uint32_t ip_queue, tcp_queue;
     //! Capture thread function
     void *(*capture_fn)(void *data);
     //! Capture thread for online capturing
@@ -235,6 +275,36 @@ capture_offline(const char *infile);
 void
 parse_packet(u_char *capinfo, const struct pcap_pkthdr *header, const u_char *packet);
 
+/**
+ * @brief Parse a packet already decoded by capture_packet_decode
+ *
+ * Packets are checked and dispatched in capture order, as parse_packet
+ * would do after decoding them.
+ *
+ * @param capinfo Packet capture session information
+ * @param header Header of the decoded frame
+ * @param pkt Decoded packet
+ */
+void
+capture_packet_process(capture_info_t *capinfo, const struct pcap_pkthdr *header, packet_t *pkt);
+
+/**
+ * @brief Decode link, IP and UDP headers of a frame out of capture order
+ *
+ * Decoding unfragmented UDP frames does not depend on previous frames, so
+ * it can be done by any thread. IP fragments and TCP segments are left to
+ * be reassembled by parse_packet in capture order.
+ *
+ * @param capinfo Packet capture session information
+ * @param header Header of the frame
+ * @param packet Frame contents
+ * @param record Position of the mapped input file record plus one
+ * @return a Packet structure or NULL if the frame must be parsed by parse_packet
+ */
+packet_t *
+capture_packet_decode(capture_info_t *capinfo, const struct pcap_pkthdr *header,
+                      const u_char *packet, size_t record);
+
 /**
  * @brief Reassembly capture IP fragments
  *
@@ -307,6 +377,34 @@ capture_ws_check_packet(packet_t *packet);
 int
 capture_packet_parse(packet_t *pkt);
 
+/**
+ * @brief Parse, store and dump the given packet under capture lock
+ *
+ * SIP data already prepared by a correlation thread is used instead of
+ * parsing the packet payload again, and added to its dialog before taking
+ * capture lock. The packet is destroyed if it has no relevant data.
+ *
+ * @param pkt Captured packet
+ * @param prep Prepared SIP message data or NULL
+ * @return 0 in case this packets has SIP/RTP data
+ * @return 1 otherwise
+ */
+int
+capture_packet_commit(packet_t *pkt, struct sip_prepared *prep);
+
+/**
+ * @brief Check if a decoded packet has already been received
+ *
+ * Duplicated packets are accounted to the given source and must be
+ * discarded before being parsed.
+ *
+ * @param capinfo Source the packet has been received from
+ * @param pkt Decoded packet
+ * @return true if packet is a duplicate, false otherwise
+ */
+bool
+capture_packet_duplicate(capture_info_t *capinfo, packet_t *pkt);
+
 /**
  * @brief Create a capture thread for online mode
  *
@@ -419,6 +517,48 @@ capture_keyfile();
 void
 capture_set_keyfile(const char *keyfile);
 
+/**
+ * @brief Only load input file packets inside a time range
+ *
+ * Unset timestamps don't limit the range on that side.
+ *
+ * @param from First timestamp to load
+ * @param to Last timestamp to load
+ */
+void
+capture_set_time_window(struct timeval from, struct timeval to);
+
+/**
+ * @brief Get the time range of loaded input file packets
+ *
+ * @param from Filled with first timestamp to load
+ * @param to Filled with last timestamp to load
+ * @return true if a time range has been set, false otherwise
+ */
+bool
+capture_time_window(struct timeval *from, struct timeval *to);
+
+/**
+ * @brief Only load input file packets of dialogs with the given Call-ID
+ *
+ * Packets are checked once decoded and reassembled. SIP messages are only
+ * loaded if their Call-ID header is the given one, and other packets only
+ * if they are sent to a media address announced in the SDP of those
+ * messages, so RTP streams of the matching dialogs can be collected.
+ *
+ * @param callid Call-ID to search
+ */
+void
+capture_set_callid(const char *callid);
+
+/**
+ * @brief Get the Call-ID input file packets are being searched for
+ *
+ * @return Call-ID or NULL if all packets are loaded
+ */
+const char *
+capture_callid();
+
 /**
  * @brief Get TLS Server address if configured
  * @return address scructure
@@ -457,12 +597,52 @@ capture_lock();
 void
 capture_unlock();
 
+/**
+ * @brief Notify there is new captured data
+ *
+ * Only one notification is written until it has been cleared, so a
+ * burst of packets wakes up the interface just once.
+ */
+void
+capture_notify();
+
+/**
+ * @brief Get the file descriptor that becomes readable on notifications
+ *
+ * @return notification file descriptor or -1 if not available
+ */
+int
+capture_notify_fd();
+
+/**
+ * @brief Discard pending notifications
+ */
+void
+capture_notify_clear();
+
 /**
  * @brief Sorter by time for captured packets
  */
 void
 capture_packet_time_sorter(vector_t *vector, void *item);
 
+/**
+ * @brief Update capture sources metrics
+ *
+ * Set libpcap stats of all live sources and reassembly queues depth.
+ * This function is registered as metrics collector in capture_init.
+ */
+void
+capture_metrics_collect();
+
+/**
+ * @brief Print duplicated packets discarded from each source
+ *
+ * This function is registered as metrics writer in capture_init.
+ */
+void
+capture_metrics_write(FILE *out);
+
 /**
  * @brief Close pcap handler
  */
@@ -502,6 +682,14 @@ dump_open(const char *dumpfile, ino_t* dump_inode);
 void
 dump_packet(pcap_dumper_t *pd, const packet_t *packet);
 
+/**
+ * @brief Store a single frame in dump file
+ *
+ * File must be previously opened with dump_open
+ */
+void
+dump_frame(pcap_dumper_t *pd, const struct pcap_pkthdr *header, const u_char *data);
+
 /**
  * @brief Close a dump file
  */
@@ -171,16 +171,25 @@ accept_eep_client(void *info)
     // Begin accepting connections
     while (eep_cfg.server_sock > 0) {
         if ((pkt = capture_eep_receive())) {
+            // Discard packets already received from other sources
+            if (capture_packet_duplicate(capinfo, pkt)) {
+                packet_destroy(pkt);
+                continue;
+            }
+
             // Avoid parsing from multiples sources.
             // Avoid parsing while screen in being redrawn
             capture_lock();
-            if (capture_packet_parse(pkt) != 0) {
+            if (capture_packet_parse(pkt) == 0) {
+                // Store this packets in output file
+                capture_dump_packet(pkt);
+                // RTP packets data has already been retained by its stream
+                if (pkt->type == PACKET_RTP)
+                    packet_destroy(pkt);
+            } else {
                 packet_destroy(pkt);
             }
 
-            // Store this packets in output file
-            capture_dump_packet(pkt);
-
             capture_unlock();
         }
     }
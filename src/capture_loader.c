@@ -0,0 +1,1525 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file capture_loader.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in capture_loader.h
+ *
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "capture_loader.h"
+#include "correlator.h"
+#include "setting.h"
+#include "metrics.h"
+#include "epoch.h"
+#include "sip.h"
+#include "rtp.h"
+#include "vector.h"
+#include "util.h"
+
+//! Size of pcap file global header
+#define LOADER_FILE_HDR_LEN     24
+//! Size of pcap record header
+#define LOADER_RECORD_HDR_LEN   16
+//! Index file name suffix
+#define LOADER_INDEX_SUFFIX     ".sngidx"
+
+//! Index file magic
+static const char loader_index_magic[8] = "SNGIDX";
+
+/**
+ * @brief Index file header
+ */
+struct loader_index_hdr {
+    //! Index file magic
+    char magic[8];
+    //! Index format version
+    uint32_t version;
+    //! Size of stream entries, to detect files written by other builds
+    uint32_t layout;
+    //! Indexed file size
+    uint64_t size;
+    //! Indexed file modification time
+    int64_t mtime_sec, mtime_nsec;
+    //! Hash of the start and the end of the indexed file
+    uint64_t hash;
+    //! Hash of the options deciding which dialogs are stored
+    uint64_t options;
+    //! Timestamp of the last record of the file
+    int64_t last_sec, last_usec;
+    //! Number of records with SIP messages
+    uint64_t sip_count;
+    //! Number of records with RTP packets
+    uint64_t rtp_count;
+};
+
+/**
+ * @brief Index entry of a dialog RTP stream
+ */
+struct loader_index_stream {
+    //! Index of the message with the SDP media of this stream
+    uint32_t msg;
+    //! Index of the media in the message
+    uint32_t media;
+    //! Stream type
+    uint32_t type;
+    //! Number of telephone events entries after this one
+    uint32_t events;
+    //! Source address
+    address_t src;
+    //! Destination address
+    address_t dst;
+    //! Packet count
+    uint32_t pktcnt;
+    //! Stream carries telephone events
+    int32_t telephone_event;
+    //! Time of first packet
+    int64_t time_sec, time_usec;
+    //! Statistics observed from RTP packets
+    rtp_stats_t rtpstats;
+    //! RTP or RTCP stream information
+    u_char info[sizeof(((rtp_stream_t *) 0)->rtcpinfo)];
+};
+
+/**
+ * @brief Index entry of a stream telephone event
+ */
+struct loader_index_event {
+    //! Time of event
+    int64_t time_sec, time_usec;
+    //! Event duration
+    uint16_t duration;
+    //! Event error
+    uint8_t error;
+    //! Event volume
+    uint8_t volume;
+    //! Event end
+    uint8_t end;
+    //! Event dtmf digit
+    u_char dtmf;
+};
+
+/**
+ * @brief Mapped files loading status
+ */
+struct loader_status {
+    //! Mapped files
+    vector_t *files;
+    //! Scanner threads
+    pthread_t threads[LOADER_MAX_THREADS];
+    //! Number of scanner threads
+    int thread_count;
+    //! Scanner threads must finish
+    bool stop;
+    //! Time when files loading started
+    struct timeval started;
+    //! Lock for chunks status
+    pthread_mutex_t lock;
+    //! Signaled when a chunk has been scanned
+    pthread_cond_t scanned;
+    //! Signaled when a chunk has been parsed
+    pthread_cond_t parsed;
+    //! Parsed records are being stored for the file index
+    bool indexing;
+};
+
+//! Mapped files loading status
+static struct loader_status loader = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .scanned = PTHREAD_COND_INITIALIZER,
+    .parsed = PTHREAD_COND_INITIALIZER
+};
+
+/**
+ * @brief Read a 32 bits field from mapped file
+ */
+static uint32_t
+loader_read_uint32(loader_file_t *file, size_t offset)
+{
+    uint32_t value;
+
+    memcpy(&value, file->map + offset, sizeof(value));
+    if (file->swapped) {
+        value = ((value & 0xFF) << 24) | ((value & 0xFF00) << 8)
+                | ((value >> 8) & 0xFF00) | (value >> 24);
+    }
+    return value;
+}
+
+/**
+ * @brief Check there is a complete record at the given file offset
+ *
+ * @param file Mapped file
+ * @param offset Record header position
+ * @param strict Also check fields values are sensible
+ * @return record size including its header or 0 if not valid
+ */
+static size_t
+loader_record_size(loader_file_t *file, size_t offset, bool strict)
+{
+    uint32_t usec, caplen, len;
+    int64_t delta;
+
+    if (offset + LOADER_RECORD_HDR_LEN > file->size)
+        return 0;
+
+    caplen = loader_read_uint32(file, offset + 8);
+    if (caplen > LOADER_MAX_CAPLEN || offset + LOADER_RECORD_HDR_LEN + caplen > file->size)
+        return 0;
+
+    if (strict) {
+        usec = loader_read_uint32(file, offset + 4);
+        len = loader_read_uint32(file, offset + 12);
+        if (usec >= (file->nsec ? 1000000000 : 1000000) || caplen > len || len > LOADER_MAX_CAPLEN)
+            return 0;
+        // Records of the same capture are close in time
+        delta = (int64_t) loader_read_uint32(file, offset) - file->first_sec;
+        if (delta > 86400 * 31 || delta < -86400 * 31)
+            return 0;
+    }
+
+    return LOADER_RECORD_HDR_LEN + caplen;
+}
+
+/**
+ * @brief Get the header and data of the record at the given file offset
+ */
+static const u_char *
+loader_record_read(loader_file_t *file, size_t offset, struct pcap_pkthdr *header)
+{
+    header->ts.tv_sec = loader_read_uint32(file, offset);
+    header->ts.tv_usec = loader_read_uint32(file, offset + 4);
+    if (file->nsec)
+        header->ts.tv_usec /= 1000;
+    header->caplen = loader_read_uint32(file, offset + 8);
+    header->len = loader_read_uint32(file, offset + 12);
+
+    // Data after file snapshot length is discarded, as libpcap does
+    if (file->snaplen && header->caplen > file->snaplen)
+        header->caplen = file->snaplen;
+
+    return file->map + offset + LOADER_RECORD_HDR_LEN;
+}
+
+/**
+ * @brief Get the offset where the given chunk stops being scanned
+ */
+static size_t
+loader_chunk_limit(loader_file_t *file, int index)
+{
+    size_t limit = LOADER_FILE_HDR_LEN + (size_t) (index + 1) * LOADER_CHUNK_SIZE;
+    return (limit < file->size) ? limit : file->size;
+}
+
+/**
+ * @brief Guess the first record position after the given offset
+ *
+ * A position is considered a record start if it is followed by several
+ * valid records or by valid records until the end of the file.
+ */
+static size_t
+loader_chunk_guess(loader_file_t *file, size_t from, size_t to)
+{
+    size_t offset, next, size;
+    int i;
+
+    for (offset = from; offset < to; offset++) {
+        for (i = 0, next = offset; i < LOADER_SYNC_RECORDS && next < file->size; i++, next += size) {
+            if (!(size = loader_record_size(file, next, true)))
+                break;
+        }
+        if (i == LOADER_SYNC_RECORDS || next == file->size)
+            return offset;
+    }
+
+    return to;
+}
+
+/**
+ * @brief Guess the first record position of the given chunk
+ */
+static size_t
+loader_chunk_start(loader_file_t *file, int index)
+{
+    if (index == 0)
+        return LOADER_FILE_HDR_LEN;
+    return loader_chunk_guess(file, LOADER_FILE_HDR_LEN + (size_t) index * LOADER_CHUNK_SIZE,
+                              loader_chunk_limit(file, index));
+}
+
+/**
+ * @brief Destroy the decoded packets of a chunk not parsed yet
+ */
+static void
+loader_chunk_release(loader_chunk_t *chunk)
+{
+    uint32_t i;
+
+    for (i = 0; chunk->packets && i < chunk->count; i++) {
+        packet_destroy(chunk->packets[i]);
+        chunk->packets[i] = NULL;
+    }
+}
+
+/**
+ * @brief Store the records of a chunk kept by capture filter
+ *
+ * Scan continues until the first record starting after the chunk limit
+ * or the first invalid record. Records that can be decoded without
+ * previous records are decoded here, leaving only IP and TCP reassembly
+ * to the parsing thread.
+ */
+static void
+loader_chunk_scan(loader_file_t *file, loader_chunk_t *chunk, size_t start, size_t limit)
+{
+    struct pcap_pkthdr header;
+    const u_char *data;
+    size_t offset, size, *records;
+    packet_t **packets;
+
+    // Packets decoded from a wrongly guessed start are not valid
+    loader_chunk_release(chunk);
+    chunk->start = start;
+    chunk->count = 0;
+
+    for (offset = start; offset < limit; offset += size) {
+        if (!(size = loader_record_size(file, offset, false)))
+            break;
+
+        data = loader_record_read(file, offset, &header);
+        if (file->filtered && !pcap_offline_filter(&file->filter, &header, data))
+            continue;
+
+        if (chunk->count == chunk->size) {
+            if (!(records = realloc(chunk->records, sizeof(size_t) * (chunk->size ? chunk->size * 2 : 1024))))
+                break;
+            chunk->records = records;
+            if (!(packets = realloc(chunk->packets, sizeof(packet_t *) * (chunk->size ? chunk->size * 2 : 1024))))
+                break;
+            chunk->packets = packets;
+            chunk->size = chunk->size ? chunk->size * 2 : 1024;
+        }
+        chunk->records[chunk->count] = offset;
+        chunk->packets[chunk->count++] = capture_packet_decode(file->capinfo, &header, data, offset + 1);
+    }
+
+    chunk->end = offset;
+}
+
+/**
+ * @brief Get the next chunk to be scanned
+ *
+ * Only a limited number of chunks of each file is scanned ahead of the
+ * chunk being parsed, keeping used memory bounded.
+ *
+ * @return file of the chunk or NULL if there is no chunk to scan now
+ */
+static loader_file_t *
+loader_next_task(int *index, bool *pending)
+{
+    loader_file_t *file;
+    vector_iter_t it = vector_iterator(loader.files);
+
+    *pending = false;
+    while ((file = vector_iterator_next(&it))) {
+        if (file->scan_chunk >= file->chunk_count)
+            continue;
+        *pending = true;
+        if (file->scan_chunk < file->parse_chunk + LOADER_CHUNKS_AHEAD * loader.thread_count) {
+            *index = file->scan_chunk++;
+            return file;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Scanner thread
+ */
+static void *
+loader_scanner(void *data)
+{
+    loader_file_t *file;
+    loader_chunk_t *chunk;
+    bool pending, stop;
+    int index;
+
+    for (;;) {
+        pthread_mutex_lock(&loader.lock);
+        while (!(stop = loader.stop) && !(file = loader_next_task(&index, &pending)) && pending)
+            pthread_cond_wait(&loader.parsed, &loader.lock);
+        pthread_mutex_unlock(&loader.lock);
+
+        if (stop || !file)
+            break;
+
+        chunk = &file->chunks[index];
+        loader_chunk_scan(file, chunk, loader_chunk_start(file, index), loader_chunk_limit(file, index));
+
+        pthread_mutex_lock(&loader.lock);
+        chunk->ready = true;
+        pthread_cond_broadcast(&loader.scanned);
+        pthread_mutex_unlock(&loader.lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Stop and wait for scanner threads
+ */
+static void
+loader_stop(void *data)
+{
+    int i;
+
+    pthread_mutex_lock(&loader.lock);
+    loader.stop = true;
+    pthread_cond_broadcast(&loader.parsed);
+    pthread_mutex_unlock(&loader.lock);
+
+    for (i = 0; i < loader.thread_count; i++)
+        pthread_join(loader.threads[i], NULL);
+    loader.thread_count = 0;
+}
+
+/**
+ * @brief Unlock loader when a waiting capture thread is cancelled
+ */
+static void
+loader_unlock(void *data)
+{
+    pthread_mutex_unlock(&loader.lock);
+}
+
+/**
+ * @brief Get the timestamp of the first record of a chunk
+ *
+ * @return 0 if a record start has been found in the chunk, 1 otherwise
+ */
+static int
+loader_chunk_time(loader_file_t *file, int index, struct timeval *ts)
+{
+    struct pcap_pkthdr header;
+    size_t start = loader_chunk_start(file, index);
+
+    if (start >= loader_chunk_limit(file, index) || !loader_record_size(file, start, false))
+        return 1;
+
+    loader_record_read(file, start, &header);
+    *ts = header.ts;
+    return 0;
+}
+
+/**
+ * @brief Only scan the file chunks that can contain records of a time range
+ *
+ * Records of a chunk are expected to be captured between its first record
+ * and the first record of the next chunk. Chunks without a valid record
+ * start are kept.
+ */
+static void
+loader_window_seek(loader_file_t *file, struct timeval from, struct timeval to)
+{
+    struct timeval ts;
+    int lo, hi, mid, first = 0, end = file->chunk_count;
+
+    // Last chunk starting before the range
+    if (timerisset(&from)) {
+        from.tv_sec -= CAPTURE_WINDOW_SLACK;
+        for (lo = 0, hi = file->chunk_count; hi - lo > 1;) {
+            mid = lo + (hi - lo) / 2;
+            if (loader_chunk_time(file, mid, &ts) == 0 && !timercmp(&ts, &from, >)) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        first = lo;
+    }
+
+    // First chunk starting after the range
+    if (timerisset(&to)) {
+        to.tv_sec += CAPTURE_WINDOW_SLACK;
+        for (lo = first, hi = file->chunk_count; hi - lo > 1;) {
+            mid = lo + (hi - lo) / 2;
+            if (loader_chunk_time(file, mid, &ts) == 0 && timercmp(&ts, &to, >)) {
+                hi = mid;
+            } else {
+                lo = mid;
+            }
+        }
+        end = hi;
+    }
+
+    file->first_chunk = file->parse_chunk = file->scan_chunk = first;
+    file->chunk_count = end;
+    file->loaded = first ? LOADER_FILE_HDR_LEN + (size_t) first * LOADER_CHUNK_SIZE : 0;
+}
+
+/**
+ * @brief Wait until the chunk being parsed has been scanned
+ *
+ * If the chunk start was wrongly guessed, it is scanned again from the
+ * end of the previous chunk.
+ */
+static void
+loader_chunk_enter(loader_file_t *file)
+{
+    loader_chunk_t *chunk = &file->chunks[file->parse_chunk];
+    size_t prev_end;
+
+    // Without scanner threads, chunks are scanned while parsing
+    if (loader.thread_count == 0 && !chunk->ready) {
+        loader_chunk_scan(file, chunk,
+                          file->parse_chunk > file->first_chunk
+                          ? file->chunks[file->parse_chunk - 1].end : loader_chunk_start(file, file->parse_chunk),
+                          loader_chunk_limit(file, file->parse_chunk));
+        chunk->ready = true;
+    }
+
+    pthread_mutex_lock(&loader.lock);
+    pthread_cleanup_push(loader_unlock, NULL);
+    while (!chunk->ready)
+        pthread_cond_wait(&loader.scanned, &loader.lock);
+    pthread_cleanup_pop(1);
+
+    if (file->parse_chunk > file->first_chunk) {
+        prev_end = file->chunks[file->parse_chunk - 1].end;
+        if (chunk->start != prev_end)
+            loader_chunk_scan(file, chunk, prev_end, loader_chunk_limit(file, file->parse_chunk));
+    }
+}
+
+/**
+ * @brief Release a parsed chunk and start parsing the next one
+ */
+static void
+loader_chunk_leave(loader_file_t *file)
+{
+    loader_chunk_t *chunk = &file->chunks[file->parse_chunk];
+    bool last;
+
+    // File ends at its last chunk or at its first invalid record
+    last = file->parse_chunk == file->chunk_count - 1
+           || chunk->end < loader_chunk_limit(file, file->parse_chunk);
+
+    loader_chunk_release(chunk);
+    free(chunk->records);
+    free(chunk->packets);
+    chunk->records = NULL;
+    chunk->packets = NULL;
+    chunk->size = chunk->count = 0;
+    __atomic_store_n(&file->loaded, last ? file->size : chunk->end, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&loader.lock);
+    if (last) {
+        file->done = true;
+        file->scan_chunk = file->chunk_count;
+    } else {
+        file->parse_chunk++;
+        file->parse_record = 0;
+    }
+    pthread_cond_broadcast(&loader.parsed);
+    pthread_mutex_unlock(&loader.lock);
+
+    if (!last)
+        loader_chunk_enter(file);
+}
+
+/**
+ * @brief Get the next record to be parsed of a file
+ *
+ * @return record data or NULL if all file records have been parsed
+ */
+static const u_char *
+loader_file_peek(loader_file_t *file, struct pcap_pkthdr *header)
+{
+    loader_chunk_t *chunk;
+
+    while (!file->done) {
+        chunk = &file->chunks[file->parse_chunk];
+        if (file->parse_record < chunk->count)
+            return loader_record_read(file, chunk->records[file->parse_record], header);
+        loader_chunk_leave(file);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Take the decoded packet of the next record to be parsed of a file
+ *
+ * @return decoded packet or NULL if the record must be parsed
+ */
+static packet_t *
+loader_file_packet(loader_file_t *file)
+{
+    loader_chunk_t *chunk = &file->chunks[file->parse_chunk];
+    packet_t *packet;
+
+    if (!chunk->packets)
+        return NULL;
+
+    packet = chunk->packets[file->parse_record];
+    chunk->packets[file->parse_record] = NULL;
+    return packet;
+}
+
+/**
+ * @brief Add data to a FNV-1a hash
+ */
+static uint64_t
+loader_hash(uint64_t hash, const void *data, size_t len)
+{
+    const u_char *bytes = data;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Add a string to a FNV-1a hash, including its terminator
+ */
+static uint64_t
+loader_hash_string(uint64_t hash, const char *value)
+{
+    if (!value)
+        value = "";
+    return loader_hash(hash, value, strlen(value) + 1);
+}
+
+/**
+ * @brief Get a hash of the start and the end of a mapped file
+ *
+ * Hashing the whole file would take as long as loading it again.
+ */
+static uint64_t
+loader_index_content_hash(loader_file_t *file)
+{
+    size_t sample = (file->size < LOADER_INDEX_SAMPLE) ? file->size : LOADER_INDEX_SAMPLE;
+    uint64_t hash = 14695981039346656037ULL;
+
+    hash = loader_hash(hash, file->map, sample);
+    return loader_hash(hash, file->map + file->size - sample, sample);
+}
+
+/**
+ * @brief Get a hash of the options deciding which dialogs are stored
+ *
+ * Stored records and streams depend on which dialogs were stored when
+ * the index was written.
+ */
+static uint64_t
+loader_index_options()
+{
+    static const int ids[] = {
+        SETTING_CAPTURE_LIMIT,
+        SETTING_CAPTURE_ROTATE,
+        SETTING_CAPTURE_EXPIRE,
+        SETTING_CAPTURE_MAXMEMORY,
+        SETTING_CAPTURE_DEDUP,
+#ifdef USE_EEP
+        SETTING_CAPTURE_EEP,
+#endif
+        SETTING_SIP_NOINCOMPLETE,
+        SETTING_SIP_HEADER_X_CID,
+        SETTING_SIP_CALLS,
+        SETTING_TELEPHONE_EVENT,
+    };
+    uint64_t hash = 14695981039346656037ULL;
+    int insensitive, invert;
+    size_t i;
+
+    for (i = 0; i < sizeof(ids) / sizeof(ids[0]); i++)
+        hash = loader_hash_string(hash, setting_get_value(ids[i]));
+
+    sip_get_match_flags(&insensitive, &invert);
+    hash = loader_hash_string(hash, sip_get_match_expression());
+    hash = loader_hash(hash, &insensitive, sizeof(insensitive));
+    hash = loader_hash(hash, &invert, sizeof(invert));
+    hash = loader_hash_string(hash, sip_get_filter_expression());
+    return loader_hash_string(hash, capture_keyfile());
+}
+
+/**
+ * @brief Get the index file path of a mapped file
+ *
+ * @return 0 if the path fits in the buffer, 1 otherwise
+ */
+static int
+loader_index_path(loader_file_t *file, char *path, size_t len)
+{
+    const char *dir = setting_get_value(SETTING_CAPTURE_INDEXDIR);
+    const char *name = file->capinfo->infile, *base;
+    int written;
+
+    if (dir && *dir) {
+        if ((base = strrchr(name, '/')))
+            name = base + 1;
+        written = snprintf(path, len, "%s/%s" LOADER_INDEX_SUFFIX, dir, name);
+    } else {
+        written = snprintf(path, len, "%s" LOADER_INDEX_SUFFIX, name);
+    }
+
+    return written < 0 || (size_t) written >= len;
+}
+
+/**
+ * @brief Fill the header fields that identify a mapped file
+ */
+static int
+loader_index_header(loader_file_t *file, struct loader_index_hdr *hdr)
+{
+    struct stat st;
+
+    if (fstat(file->fd, &st) != 0)
+        return 1;
+
+    memset(hdr, 0, sizeof(struct loader_index_hdr));
+    memcpy(hdr->magic, loader_index_magic, sizeof(hdr->magic));
+    hdr->version = LOADER_INDEX_VERSION;
+    hdr->layout = sizeof(struct loader_index_stream) << 8 | sizeof(struct loader_index_event);
+    hdr->size = st.st_size;
+    hdr->mtime_sec = st.st_mtim.tv_sec;
+    hdr->mtime_nsec = st.st_mtim.tv_nsec;
+    hdr->hash = loader_index_content_hash(file);
+    hdr->options = loader_index_options();
+    return 0;
+}
+
+/**
+ * @brief Add a record position to a records list
+ */
+static void
+loader_records_add(loader_records_t *records, size_t offset)
+{
+    size_t *offsets;
+
+    if (records->count == records->size) {
+        if (!(offsets = realloc(records->offsets, sizeof(size_t) * (records->size ? records->size * 2 : 1024))))
+            return;
+        records->offsets = offsets;
+        records->size = records->size ? records->size * 2 : 1024;
+    }
+    records->offsets[records->count++] = offset;
+}
+
+/**
+ * @brief Compare two records positions
+ */
+static int
+loader_records_cmp(const void *one, const void *two)
+{
+    size_t a = *(const size_t *) one, b = *(const size_t *) two;
+    return (a > b) - (a < b);
+}
+
+/**
+ * @brief Sort a records list and remove repeated records
+ *
+ * Records are not stored in file order when SIP messages are correlated
+ * by several threads, and reassembled packets share records.
+ */
+static void
+loader_records_sort(loader_records_t *records)
+{
+    size_t i, count = 0;
+
+    qsort(records->offsets, records->count, sizeof(size_t), loader_records_cmp);
+    for (i = 0; i < records->count; i++) {
+        if (count == 0 || records->offsets[i] != records->offsets[count - 1])
+            records->offsets[count++] = records->offsets[i];
+    }
+    records->count = count;
+}
+
+/**
+ * @brief Free a records list
+ */
+static void
+loader_records_free(loader_records_t *records)
+{
+    free(records->offsets);
+    memset(records, 0, sizeof(loader_records_t));
+}
+
+/**
+ * @brief Write a records list, as variable length position deltas
+ */
+static void
+loader_index_write_records(FILE *fp, loader_records_t *records)
+{
+    u_char buf[10];
+    size_t i, prev = 0;
+    uint64_t value;
+    int len;
+
+    for (i = 0; i < records->count; i++) {
+        value = records->offsets[i] - prev;
+        prev = records->offsets[i];
+        for (len = 0; value >= 0x80; value >>= 7)
+            buf[len++] = (value & 0x7F) | 0x80;
+        buf[len++] = value;
+        fwrite(buf, 1, len, fp);
+    }
+}
+
+/**
+ * @brief Read a records list written by loader_index_write_records
+ *
+ * @return 0 if all records have been read, 1 otherwise
+ */
+static int
+loader_index_read_records(const u_char **pos, const u_char *end, uint64_t count,
+                          loader_file_t *file, loader_records_t *records)
+{
+    uint64_t value, i;
+    size_t prev = 0;
+    u_char byte;
+    int shift;
+
+    for (i = 0; i < count; i++) {
+        value = 0;
+        for (shift = 0;; shift += 7) {
+            if (*pos >= end || shift >= 64)
+                return 1;
+            byte = *(*pos)++;
+            value |= (uint64_t) (byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+        prev += value;
+        // Records must still be in the mapped file
+        if (prev < LOADER_FILE_HDR_LEN || !loader_record_size(file, prev, false))
+            return 1;
+        loader_records_add(records, prev);
+    }
+
+    return records->count != count;
+}
+
+/**
+ * @brief Write the index entries of a dialog streams
+ */
+static void
+loader_index_write_call(FILE *fp, sip_call_t *call)
+{
+    struct loader_index_stream entry;
+    struct loader_index_event evt;
+    rtp_stream_t *stream;
+    rtp_event_t *event;
+    vector_iter_t it, events;
+    uint16_t len = strlen(call->callid);
+    uint32_t count = vector_count(call->streams);
+
+    fwrite(&len, sizeof(len), 1, fp);
+    fwrite(call->callid, 1, len, fp);
+    fwrite(&count, sizeof(count), 1, fp);
+
+    it = vector_iterator(call->streams);
+    while ((stream = vector_iterator_next(&it))) {
+        memset(&entry, 0, sizeof(entry));
+        entry.msg = entry.media = UINT32_MAX;
+        if (stream->media && stream->media->msg) {
+            entry.msg = stream->media->msg->index;
+            entry.media = vector_index(stream->media->msg->medias, stream->media);
+        }
+        entry.type = stream->type;
+        entry.events = vector_count(stream->events);
+        entry.src = stream->src;
+        entry.dst = stream->dst;
+        entry.pktcnt = stream->pktcnt;
+        entry.telephone_event = stream->telephone_event;
+        entry.time_sec = stream->time.tv_sec;
+        entry.time_usec = stream->time.tv_usec;
+        entry.rtpstats = stream->rtpstats;
+        memcpy(entry.info, &stream->rtcpinfo, sizeof(entry.info));
+        fwrite(&entry, sizeof(entry), 1, fp);
+
+        events = vector_iterator(stream->events);
+        while ((event = vector_iterator_next(&events))) {
+            memset(&evt, 0, sizeof(evt));
+            evt.time_sec = event->time.tv_sec;
+            evt.time_usec = event->time.tv_usec;
+            evt.duration = event->duration;
+            evt.error = event->error;
+            evt.volume = event->volume;
+            evt.end = event->end;
+            evt.dtmf = event->dtmf;
+            fwrite(&evt, sizeof(evt), 1, fp);
+        }
+    }
+}
+
+/**
+ * @brief Write the index file of a completely parsed file
+ *
+ * The index is written to a temporary file and then renamed, so readers
+ * never find a partially written index.
+ */
+static void
+loader_index_write(loader_file_t *file)
+{
+    char path[PATH_MAX], tmp[PATH_MAX];
+    struct loader_index_hdr hdr;
+    sip_call_t *call;
+    vector_iter_t it;
+    FILE *fp;
+    int fd, failed;
+
+    if (loader_index_header(file, &hdr) != 0)
+        return;
+
+    loader_records_sort(&file->sip);
+    loader_records_sort(&file->rtp);
+    hdr.last_sec = file->last.tv_sec;
+    hdr.last_usec = file->last.tv_usec;
+    hdr.sip_count = file->sip.count;
+    hdr.rtp_count = file->rtp.count;
+
+    // Do not write the index if its path or temporary template does not fit
+    if (loader_index_path(file, path, sizeof(path)) != 0)
+        return;
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int) sizeof(tmp))
+        return;
+    if ((fd = mkstemp(tmp)) == -1)
+        return;
+    fchmod(fd, 0644);
+    if (!(fp = fdopen(fd, "w"))) {
+        close(fd);
+        unlink(tmp);
+        return;
+    }
+
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    loader_index_write_records(fp, &file->sip);
+    loader_index_write_records(fp, &file->rtp);
+
+    // Streams of stored dialogs
+    capture_lock();
+    it = sip_calls_iterator();
+    while ((call = vector_iterator_next(&it))) {
+        if (vector_count(call->streams))
+            loader_index_write_call(fp, call);
+    }
+    capture_unlock();
+
+    failed = ferror(fp);
+    if (fclose(fp) != 0 || failed || rename(tmp, path) != 0)
+        unlink(tmp);
+}
+
+/**
+ * @brief Merge two sorted records lists into chunk records
+ */
+static void
+loader_index_merge(loader_chunk_t *chunk, loader_records_t *one, loader_records_t *two)
+{
+    size_t i = 0, j = 0;
+
+    if (!(chunk->records = malloc(sizeof(size_t) * (one->count + two->count + 1))))
+        return;
+
+    while (i < one->count || j < two->count) {
+        if (j == two->count || (i < one->count && one->offsets[i] < two->offsets[j])) {
+            chunk->records[chunk->count++] = one->offsets[i++];
+        } else {
+            chunk->records[chunk->count++] = two->offsets[j++];
+        }
+    }
+    chunk->size = chunk->count;
+}
+
+/**
+ * @brief Only keep indexed records that can belong to a time range
+ */
+static void
+loader_window_trim(loader_file_t *file, loader_chunk_t *chunk, struct timeval from, struct timeval to)
+{
+    struct pcap_pkthdr header;
+    size_t lo, hi, mid, first = 0, end = chunk->count;
+
+    // First record captured after the range start
+    if (timerisset(&from)) {
+        from.tv_sec -= CAPTURE_WINDOW_SLACK;
+        for (lo = 0, hi = chunk->count; lo < hi;) {
+            mid = lo + (hi - lo) / 2;
+            loader_record_read(file, chunk->records[mid], &header);
+            if (timercmp(&header.ts, &from, <)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        first = lo;
+    }
+
+    // First record captured after the range end
+    if (timerisset(&to)) {
+        to.tv_sec += CAPTURE_WINDOW_SLACK;
+        for (lo = first, hi = chunk->count; lo < hi;) {
+            mid = lo + (hi - lo) / 2;
+            loader_record_read(file, chunk->records[mid], &header);
+            if (timercmp(&header.ts, &to, >)) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        end = lo;
+    }
+
+    memmove(chunk->records, chunk->records + first, (end - first) * sizeof(size_t));
+    chunk->count = end - first;
+}
+
+/**
+ * @brief Parse file records from its index file
+ *
+ * The only chunk of the file will contain the indexed records. If RTP
+ * packets are not being stored, RTP records are skipped and dialogs
+ * streams are restored from the index after parsing.
+ *
+ * @return 0 if the file has a valid index, 1 otherwise
+ */
+static int
+loader_index_load(loader_file_t *file)
+{
+    char path[PATH_MAX];
+    struct loader_index_hdr expected, hdr;
+    struct stat st;
+    loader_records_t sip = { 0 }, rtp = { 0 }, none = { 0 };
+    loader_chunk_t *chunk;
+    struct pcap_pkthdr header;
+    const u_char *pos, *end;
+    u_char *data = NULL;
+    struct timeval from, to;
+    FILE *fp;
+    size_t i, count;
+    bool streams, window;
+
+    if (loader_index_path(file, path, sizeof(path)) != 0 || !(fp = fopen(path, "r")))
+        return 1;
+
+    if (fstat(fileno(fp), &st) != 0 || (size_t) st.st_size < sizeof(hdr)
+        || !(data = malloc(st.st_size)) || fread(data, 1, st.st_size, fp) != (size_t) st.st_size) {
+        free(data);
+        fclose(fp);
+        return 1;
+    }
+    fclose(fp);
+
+    // Check the index belongs to this file and these options
+    memcpy(&hdr, data, sizeof(hdr));
+    if (loader_index_header(file, &expected) != 0
+        || memcmp(hdr.magic, expected.magic, sizeof(hdr.magic)) != 0
+        || hdr.version != expected.version || hdr.layout != expected.layout
+        || hdr.size != expected.size || hdr.mtime_sec != expected.mtime_sec
+        || hdr.mtime_nsec != expected.mtime_nsec || hdr.hash != expected.hash
+        || hdr.options != expected.options) {
+        free(data);
+        return 1;
+    }
+
+    pos = data + sizeof(hdr);
+    end = data + st.st_size;
+    if (loader_index_read_records(&pos, end, hdr.sip_count, file, &sip) != 0
+        || loader_index_read_records(&pos, end, hdr.rtp_count, file, &rtp) != 0) {
+        loader_records_free(&sip);
+        loader_records_free(&rtp);
+        free(data);
+        return 1;
+    }
+
+    // RTP records are only parsed when their packets must be stored or
+    // streams must only count packets of a time range
+    chunk = &file->chunks[0];
+    window = capture_time_window(&from, &to);
+    streams = !setting_enabled(SETTING_CAPTURE_RTP) && !window;
+    loader_index_merge(chunk, &sip, streams ? &none : &rtp);
+    loader_records_free(&sip);
+    loader_records_free(&rtp);
+
+    if (window)
+        loader_window_trim(file, chunk, from, to);
+
+    // Apply capture filter to indexed records
+    if (file->filtered) {
+        for (i = 0, count = 0; i < chunk->count; i++) {
+            if (pcap_offline_filter(&file->filter, &header, loader_record_read(file, chunk->records[i], &header)))
+                chunk->records[count++] = chunk->records[i];
+        }
+        chunk->count = count;
+    }
+
+    // Keep streams section to restore it after parsing
+    if (streams && pos < end && (file->streams = malloc(end - pos))) {
+        memcpy(file->streams, pos, end - pos);
+        file->streams_len = end - pos;
+    }
+    free(data);
+
+    chunk->start = LOADER_FILE_HDR_LEN;
+    chunk->end = file->size;
+    chunk->ready = true;
+    file->chunk_count = 1;
+    file->scan_chunk = 1;
+    file->indexed = true;
+    file->last.tv_sec = hdr.last_sec;
+    file->last.tv_usec = hdr.last_usec;
+    return 0;
+}
+
+/**
+ * @brief Free a replaced streams vector
+ */
+static void
+loader_streams_free(void *item)
+{
+    vector_destroy((vector_t *) item);
+}
+
+/**
+ * @brief Create a stream from its index entry
+ */
+static rtp_stream_t *
+loader_index_stream_create(sip_call_t *call, struct loader_index_stream *entry)
+{
+    rtp_stream_t *stream;
+    sip_msg_t *msg;
+    sdp_media_t *media;
+
+    if (!(msg = vector_item(call->msgs, entry->msg)) || !(media = vector_item(msg->medias, entry->media)))
+        return NULL;
+
+    if (!(stream = stream_create(media, entry->dst, entry->type)))
+        return NULL;
+
+    stream->src = entry->src;
+    stream->pktcnt = entry->pktcnt;
+    stream->telephone_event = entry->telephone_event;
+    stream->time.tv_sec = entry->time_sec;
+    stream->time.tv_usec = entry->time_usec;
+    stream->lasttm = (int) time(NULL);
+    stream->rtpstats = entry->rtpstats;
+    memcpy(&stream->rtcpinfo, entry->info, sizeof(entry->info));
+    return stream;
+}
+
+/**
+ * @brief Replace dialogs streams with the ones stored in the file index
+ *
+ * Dialogs streams were created from SIP messages SDP, without parsing
+ * any RTP packet. Replaced streams are released once the interface is
+ * no longer using them.
+ */
+static void
+loader_index_restore(loader_file_t *file)
+{
+    struct loader_index_stream entry;
+    struct loader_index_event evt;
+    char callid[MAX_CALLID_SIZE];
+    const u_char *pos = file->streams, *end = file->streams + file->streams_len;
+    rtp_stream_t *stream;
+    rtp_event_t *event;
+    sip_call_t *call;
+    vector_t *streams;
+    uint32_t count, i, j;
+    uint16_t len;
+
+    epoch_enter();
+    capture_lock();
+
+    while (pos + sizeof(len) <= end) {
+        memcpy(&len, pos, sizeof(len));
+        pos += sizeof(len);
+        if (len >= sizeof(callid) || pos + len + sizeof(count) > end)
+            break;
+        memcpy(callid, pos, len);
+        callid[len] = '\0';
+        pos += len;
+        memcpy(&count, pos, sizeof(count));
+        pos += sizeof(count);
+
+        // Remove streams created from SDP
+        if ((call = sip_find_by_callid(callid))) {
+            rtp_index_remove_call(call);
+            streams = call->streams;
+            metrics_add(METRIC_RTP_STREAMS, -vector_count(streams));
+            metrics_add(METRIC_MEM_STREAMS, -vector_count(streams) * (int64_t) sizeof(rtp_stream_t));
+            sip_calls_add_memory(call, -vector_count(streams) * (int64_t) sizeof(rtp_stream_t));
+            epoch_retire(streams, loader_streams_free, vector_count(streams) * sizeof(rtp_stream_t));
+            call->streams = vector_create(0, 2);
+            vector_set_destroyer(call->streams, stream_destroyer);
+        }
+
+        for (i = 0; i < count && pos + sizeof(entry) <= end; i++) {
+            memcpy(&entry, pos, sizeof(entry));
+            pos += sizeof(entry);
+
+            stream = (call) ? loader_index_stream_create(call, &entry) : NULL;
+            for (j = 0; j < entry.events && pos + sizeof(evt) <= end; j++) {
+                memcpy(&evt, pos, sizeof(evt));
+                pos += sizeof(evt);
+                if (!stream || !(event = sng_malloc(sizeof(rtp_event_t))))
+                    continue;
+                event->stream = stream;
+                event->time.tv_sec = evt.time_sec;
+                event->time.tv_usec = evt.time_usec;
+                event->duration = evt.duration;
+                event->error = evt.error;
+                event->volume = evt.volume;
+                event->end = evt.end;
+                event->dtmf = evt.dtmf;
+                if (!stream->events)
+                    stream->events = vector_create(0, 1);
+                vector_append(stream->events, event);
+            }
+
+            if (stream)
+                call_add_stream(call, stream);
+        }
+    }
+
+    // Remove dialogs that expired while the skipped records were captured
+    sip_calls_expire(file->last);
+
+    capture_unlock();
+    epoch_leave();
+
+    free(file->streams);
+    file->streams = NULL;
+    file->streams_len = 0;
+}
+
+int
+capture_loader_open(capture_info_t *capinfo)
+{
+    loader_file_t *file;
+    struct stat st;
+    void *map;
+    uint32_t magic;
+    int fd;
+
+    if ((fd = open(capinfo->infile, O_RDONLY)) == -1)
+        return 1;
+
+    // Only regular files can be mapped
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < LOADER_FILE_HDR_LEN) {
+        close(fd);
+        return 1;
+    }
+
+    if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return 1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    if (!(file = sng_malloc(sizeof(loader_file_t)))) {
+        munmap(map, st.st_size);
+        close(fd);
+        return 1;
+    }
+
+    file->capinfo = capinfo;
+    file->fd = fd;
+    file->map = map;
+    file->size = st.st_size;
+
+    // Check this is a classic pcap file
+    memcpy(&magic, file->map, sizeof(magic));
+    switch (magic) {
+        case 0xa1b2c3d4:
+            break;
+        case 0xd4c3b2a1:
+            file->swapped = true;
+            break;
+        case 0xa1b23c4d:
+            file->nsec = true;
+            break;
+        case 0x4d3cb2a1:
+            file->swapped = file->nsec = true;
+            break;
+        default:
+            munmap(map, st.st_size);
+            close(fd);
+            sng_free(file);
+            return 1;
+    }
+
+    file->snaplen = loader_read_uint32(file, 16);
+    if (loader_record_size(file, LOADER_FILE_HDR_LEN, false))
+        file->first_sec = loader_read_uint32(file, LOADER_FILE_HDR_LEN);
+
+    // Split file records data into chunks
+    file->chunk_count = (file->size - LOADER_FILE_HDR_LEN + LOADER_CHUNK_SIZE - 1) / LOADER_CHUNK_SIZE;
+    if (file->chunk_count == 0)
+        file->chunk_count = 1;
+    if (!(file->chunks = calloc(file->chunk_count, sizeof(loader_chunk_t)))) {
+        munmap(map, st.st_size);
+        close(fd);
+        sng_free(file);
+        return 1;
+    }
+
+    if (!loader.files)
+        loader.files = vector_create(1, 1);
+
+    // All mapped files are parsed by the thread of the first one
+    capinfo->loader = file;
+    capinfo->capture_fn = (vector_count(loader.files) == 0) ? capture_loader_thread : NULL;
+    vector_append(loader.files, file);
+
+    return 0;
+}
+
+int
+capture_loader_set_filter(capture_info_t *capinfo, const char *filter)
+{
+    loader_file_t *file = capinfo->loader;
+
+    if (file->filtered) {
+        pcap_freecode(&file->filter);
+        file->filtered = false;
+    }
+
+    if (pcap_compile(capinfo->handle, &file->filter, filter, 0, capinfo->mask) == -1)
+        return 1;
+
+    file->filtered = true;
+    return 0;
+}
+
+void *
+capture_loader_thread(void *info)
+{
+    loader_file_t *file, *next;
+    struct pcap_pkthdr header, next_header;
+    const u_char *data = NULL, *next_data;
+    packet_t *packet;
+    vector_iter_t it;
+    struct timeval from, to;
+    int64_t packets, drops;
+    size_t parsed = 0;
+    bool window;
+    long cpus;
+
+    gettimeofday(&loader.started, NULL);
+
+    // Parse a single input file using its index, or write it
+    loader.indexing = false;
+    window = capture_time_window(&from, &to);
+    if (setting_enabled(SETTING_CAPTURE_INDEX) && vector_count(loader.files) == 1
+        && capture_sources_count() == 1) {
+        file = vector_first(loader.files);
+        if (loader_index_load(file) != 0 && !file->filtered && !window && !capture_callid())
+            loader.indexing = true;
+    }
+
+    // Skip chunks outside requested time range
+    if (window) {
+        it = vector_iterator(loader.files);
+        while ((file = vector_iterator_next(&it))) {
+            if (!file->indexed)
+                loader_window_seek(file, from, to);
+        }
+    }
+    packets = metrics_get(METRIC_PACKETS);
+    drops = metrics_get(METRIC_DROP_LIMIT);
+
+    // Start scanner threads
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+        cpus = 1;
+    if (cpus > LOADER_MAX_THREADS)
+        cpus = LOADER_MAX_THREADS;
+    // Scanners must not check how many chunks can be read ahead until all have been started
+    pthread_mutex_lock(&loader.lock);
+    loader.stop = false;
+    for (loader.thread_count = 0; loader.thread_count < cpus; loader.thread_count++) {
+        if (pthread_create(&loader.threads[loader.thread_count], NULL, loader_scanner, NULL) != 0)
+            break;
+    }
+    pthread_mutex_unlock(&loader.lock);
+
+    pthread_cleanup_push(loader_stop, NULL);
+
+    // Wait for first chunk of each file
+    it = vector_iterator(loader.files);
+    while ((file = vector_iterator_next(&it)))
+        loader_chunk_enter(file);
+
+    for (;;) {
+        // Parse files records in timestamp order
+        file = NULL;
+        it = vector_iterator(loader.files);
+        while ((next = vector_iterator_next(&it))) {
+            if (!(next_data = loader_file_peek(next, &next_header)))
+                continue;
+            if (!file || timercmp(&next_header.ts, &header.ts, <)) {
+                file = next;
+                header = next_header;
+                data = next_data;
+            }
+        }
+
+        if (!file)
+            break;
+
+        file->capinfo->record = data - file->map - LOADER_RECORD_HDR_LEN + 1;
+        if (!file->indexed)
+            file->last = header.ts;
+        // Only records not decoded by scanner threads are decoded here
+        if ((packet = loader_file_packet(file))) {
+            capture_packet_process(file->capinfo, &header, packet);
+        } else {
+            parse_packet((u_char *) file->capinfo, &header, data);
+        }
+        file->parse_record++;
+        parsed++;
+
+        // Indexed files are parsed as a single chunk
+        if (file->indexed && (file->parse_record & 0x3FF) == 0)
+            __atomic_store_n(&file->loaded, file->capinfo->record, __ATOMIC_RELAXED);
+    }
+
+    pthread_cleanup_pop(1);
+
+    // Wait until all read packets have been correlated
+    correlator_drain();
+
+    // Restore indexed streams or write the index if all records were parsed
+    file = vector_first(loader.files);
+    if (file->streams) {
+        loader_index_restore(file);
+    } else if (loader.indexing && metrics_get(METRIC_PACKETS) - packets == (int64_t) parsed
+               && metrics_get(METRIC_DROP_LIMIT) == drops) {
+        loader_index_write(file);
+    }
+    loader.indexing = false;
+
+    it = vector_iterator(loader.files);
+    while ((file = vector_iterator_next(&it)))
+        file->capinfo->running = false;
+
+    // Let the interface know capture status has changed
+    capture_notify();
+
+    return NULL;
+}
+
+void
+capture_loader_keep(packet_t *packet, bool rtp)
+{
+    loader_file_t *file;
+    frame_t *frame;
+    vector_iter_t it;
+
+    if (!loader.indexing)
+        return;
+
+    file = vector_first(loader.files);
+    it = vector_iterator(packet->frames);
+    while ((frame = vector_iterator_next(&it))) {
+        if (frame->record)
+            loader_records_add(rtp ? &file->rtp : &file->sip, frame->record - 1);
+    }
+}
+
+int
+capture_loader_progress(size_t *loaded, size_t *total, int *eta)
+{
+    loader_file_t *file;
+    vector_iter_t it;
+    struct timeval now, elapsed;
+
+    if (!loader.files)
+        return 1;
+
+    *loaded = *total = 0;
+    it = vector_iterator(loader.files);
+    while ((file = vector_iterator_next(&it))) {
+        *loaded += __atomic_load_n(&file->loaded, __ATOMIC_RELAXED);
+        *total += file->size;
+    }
+
+    // Estimate remaining time from current loading speed
+    *eta = -1;
+    if (*loaded > 0) {
+        gettimeofday(&now, NULL);
+        timersub(&now, &loader.started, &elapsed);
+        *eta = (elapsed.tv_sec + elapsed.tv_usec / 1000000.0) * (*total - *loaded) / *loaded;
+    }
+
+    return 0;
+}
+
+void
+capture_loader_deinit()
+{
+    loader_file_t *file;
+    vector_iter_t it;
+    int i;
+
+    if (!loader.files)
+        return;
+
+    it = vector_iterator(loader.files);
+    while ((file = vector_iterator_next(&it))) {
+        for (i = 0; i < file->chunk_count; i++) {
+            loader_chunk_release(&file->chunks[i]);
+            free(file->chunks[i].records);
+            free(file->chunks[i].packets);
+        }
+        free(file->chunks);
+        loader_records_free(&file->sip);
+        loader_records_free(&file->rtp);
+        free(file->streams);
+        if (file->filtered)
+            pcap_freecode(&file->filter);
+        munmap((void *) file->map, file->size);
+        close(file->fd);
+        file->capinfo->loader = NULL;
+    }
+
+    vector_set_destroyer(loader.files, vector_generic_destroyer);
+    vector_destroy(loader.files);
+    loader.files = NULL;
+}
@@ -0,0 +1,231 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file capture_loader.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to load pcap files using several threads
+ *
+ * Input files in classic pcap format are mapped into memory and split
+ * into chunks. Scanner threads find the records of each chunk and apply
+ * the capture filter, while a single thread feeds the kept records to the
+ * capture parser, in file order.
+ *
+ * Chunks after the first one start at a guessed record position. The
+ * guess is checked against the end of the previous chunk before using
+ * it, and the chunk is scanned again from the right position if wrong,
+ * so packets are always parsed exactly as reading the file sequentially.
+ *
+ * When several files are loaded, their records are merged in timestamp
+ * order, using the files order for packets with the same timestamp.
+ *
+ * With capture.index enabled, loading a single file writes an index file
+ * with the position of the records that contained SIP messages or RTP
+ * packets of known streams, and the final state of dialogs RTP streams.
+ * Next time the file is loaded, only those records are parsed. If RTP
+ * packets are not being stored, only SIP records are parsed and streams
+ * are restored from the index. The index is discarded when the file size,
+ * modification time, sampled content or dialog storing options change.
+ *
+ * When only a time range of the files is requested, chunks are binary
+ * searched by the timestamp of their first record and only the chunks
+ * that can contain records of that range are scanned. Indexed records are
+ * searched the same way.
+ *
+ */
+#ifndef __SNGREP_CAPTURE_LOADER_H
+#define __SNGREP_CAPTURE_LOADER_H
+
+#include "config.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "capture.h"
+
+//! Size of the file range handled by each scanner task
+#define LOADER_CHUNK_SIZE       (4 * 1024 * 1024)
+//! Max number of scanner threads
+#define LOADER_MAX_THREADS      16
+//! Max number of scanned chunks not yet parsed, per scanner thread
+#define LOADER_CHUNKS_AHEAD     2
+//! Consecutive valid records required to guess a chunk start
+#define LOADER_SYNC_RECORDS     8
+//! Max captured length of a record
+#define LOADER_MAX_CAPLEN       262144
+//! Bytes hashed from the start and the end of indexed files
+#define LOADER_INDEX_SAMPLE     65536
+//! Index file format version
+#define LOADER_INDEX_VERSION    1
+
+//! Shorter declaration of loader_file structure
+typedef struct loader_file loader_file_t;
+//! Shorter declaration of loader_chunk structure
+typedef struct loader_chunk loader_chunk_t;
+//! Shorter declaration of loader_records structure
+typedef struct loader_records loader_records_t;
+
+/**
+ * @brief Range of a mapped file scanned by a single thread
+ */
+struct loader_chunk {
+    //! Offset of the first record of the chunk
+    size_t start;
+    //! Offset after the last record of the chunk
+    size_t end;
+    //! Offset of records kept by capture filter
+    size_t *records;
+    //! Packets decoded from kept records, NULL if they must be parsed
+    packet_t **packets;
+    //! Number of kept records
+    uint32_t count;
+    //! Kept records allocated space
+    uint32_t size;
+    //! Chunk has been scanned
+    bool ready;
+};
+
+/**
+ * @brief List of records positions of a mapped file
+ */
+struct loader_records {
+    //! Records offsets
+    size_t *offsets;
+    //! Number of records
+    size_t count;
+    //! Allocated offsets space
+    size_t size;
+};
+
+/**
+ * @brief Input file loaded by scanner threads
+ */
+struct loader_file {
+    //! Capture source of this file
+    capture_info_t *capinfo;
+    //! File descriptor
+    int fd;
+    //! Mapped file content
+    const u_char *map;
+    //! File size
+    size_t size;
+    //! Records header fields are in non native byte order
+    bool swapped;
+    //! Records timestamps have nanosecond resolution
+    bool nsec;
+    //! Max captured length of file records
+    uint32_t snaplen;
+    //! Timestamp of the first record, used to guess chunk starts
+    uint32_t first_sec;
+    //! Compiled capture filter for this file link type
+    struct bpf_program filter;
+    //! Capture filter has been set
+    bool filtered;
+    //! File chunks
+    loader_chunk_t *chunks;
+    //! Number of file chunks
+    int chunk_count;
+    //! First chunk inside the requested time range
+    int first_chunk;
+    //! Next chunk to be scanned
+    int scan_chunk;
+    //! Chunk being parsed
+    int parse_chunk;
+    //! Next record of the parsed chunk
+    uint32_t parse_record;
+    //! Parsed file bytes
+    size_t loaded;
+    //! All file records have been parsed
+    bool done;
+    //! Records are being parsed from the file index
+    bool indexed;
+    //! Records with SIP messages, stored for the file index
+    loader_records_t sip;
+    //! Records with RTP packets, stored for the file index
+    loader_records_t rtp;
+    //! Streams section of the file index, restored after parsing
+    u_char *streams;
+    //! Streams section length
+    size_t streams_len;
+    //! Timestamp of the last record of the file
+    struct timeval last;
+};
+
+/**
+ * @brief Load an offline capture source using scanner threads
+ *
+ * Only uncompressed files in classic pcap format can be mapped, other
+ * files are still read by libpcap.
+ *
+ * @param capinfo Offline capture source with an open pcap handler
+ * @return 0 if the file will be loaded by scanner threads, 1 otherwise
+ */
+int
+capture_loader_open(capture_info_t *capinfo);
+
+/**
+ * @brief Compile the capture filter for a mapped file
+ *
+ * @param capinfo Offline capture source
+ * @param filter BPF filter expression
+ * @return 0 if the filter is valid, 1 otherwise
+ */
+int
+capture_loader_set_filter(capture_info_t *capinfo, const char *filter);
+
+/**
+ * @brief Parse the records of all mapped files
+ *
+ * This is the capture thread of the first mapped file, and it parses
+ * the records of every mapped file.
+ */
+void *
+capture_loader_thread(void *info);
+
+/**
+ * @brief Store the records of a packet for the file index
+ *
+ * Must be called with the capture lock held.
+ *
+ * @param packet Packet with a SIP message or a RTP stream packet
+ * @param rtp The packet belongs to a RTP stream
+ */
+void
+capture_loader_keep(packet_t *packet, bool rtp);
+
+/**
+ * @brief Get the loading progress of all mapped files
+ *
+ * @param loaded Filled with parsed bytes
+ * @param total Filled with files size
+ * @param eta Filled with estimated seconds to finish or -1 if unknown
+ * @return 0 if there are mapped files, 1 otherwise
+ */
+int
+capture_loader_progress(size_t *loaded, size_t *total, int *eta);
+
+/**
+ * @brief Unmap all files and free their chunks
+ */
+void
+capture_loader_deinit();
+
+#endif /* __SNGREP_CAPTURE_LOADER_H */
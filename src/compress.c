@@ -0,0 +1,393 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file compress.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in compress.h
+ *
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "compress.h"
+#include "metrics.h"
+
+/**
+ * @brief Common SIP and SDP content
+ *
+ * Deflate finds matches at shorter distances cheaper, so most frequent
+ * strings are placed at the end.
+ */
+static const char compress_sip_dict[] =
+    "Authorization: Digest username=\"\", realm=\"\", nonce=\"\", uri=\"sip:\", "
+    "response=\"\", algorithm=MD5, qop=auth, cnonce=\"\", nc=00000001\r\n"
+    "WWW-Authenticate: Digest realm=\"\", nonce=\"\", algorithm=MD5\r\n"
+    "Proxy-Authenticate: Digest realm=\"\", nonce=\"\"\r\n"
+    "SIP/2.0 401 Unauthorized\r\nSIP/2.0 407 Proxy Authentication Required\r\n"
+    "SIP/2.0 486 Busy Here\r\nSIP/2.0 487 Request Terminated\r\n"
+    "SIP/2.0 183 Session Progress\r\nSIP/2.0 180 Ringing\r\n"
+    "Reason: SIP;cause=200;text=\"Call completed elsewhere\"\r\n"
+    "Event: presence\r\nEvent: message-summary\r\nSubscription-State: active;expires=\r\n"
+    "REGISTER sip:OPTIONS sip:NOTIFY sip:SUBSCRIBE sip:CANCEL sip:PRACK sip:UPDATE sip:"
+    "Expires: 3600\r\nExpires: \r\nRSeq: \r\nRAck: \r\nRequire: 100rel\r\n"
+    "Session-Expires: 1800;refresher=uac\r\nMin-SE: 90\r\n"
+    "Accept: application/sdp\r\nAccept-Language: en\r\n"
+    "Allow-Events: talk, hold, conference, refer, check-sync\r\n"
+    "Supported: replaces, timer, path, outbound\r\n"
+    "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE, SUBSCRIBE, INFO, UPDATE, PRACK\r\n"
+    "Record-Route: <sip:;lr>\r\nRoute: <sip:;lr>\r\n"
+    "User-Agent: Server: \r\nP-Asserted-Identity: <sip:@>\r\n"
+    "a=rtpmap:18 G729/8000\r\na=fmtp:18 annexb=no\r\na=rtpmap:9 G722/8000\r\n"
+    "a=rtpmap:111 opus/48000/2\r\na=rtcp:\r\na=sendonly\r\na=recvonly\r\na=inactive\r\n"
+    "a=rtpmap:0 PCMU/8000\r\na=rtpmap:8 PCMA/8000\r\n"
+    "a=rtpmap:101 telephone-event/8000\r\na=fmtp:101 0-16\r\na=ptime:20\r\na=sendrecv\r\n"
+    "v=0\r\no=- 0 0 IN IP4 \r\ns=-\r\nc=IN IP4 \r\nt=0 0\r\nm=audio  RTP/AVP 0 8 101\r\n"
+    "Content-Type: application/sdp\r\n"
+    "ACK sip:BYE sip:INVITE sip:SIP/2.0 100 Trying\r\nSIP/2.0 200 OK\r\n"
+    "Via: SIP/2.0/TCP Via: SIP/2.0/UDP ;rport;branch=z9hG4bK\r\n"
+    "Max-Forwards: 70\r\nContact: <sip:@>\r\n"
+    "From: <sip:@>;tag=\r\nTo: <sip:@>\r\nCall-ID: \r\n"
+    "CSeq: 1 INVITE\r\nCSeq: 1 ACK\r\nCSeq: 2 BYE\r\nContent-Length: 0\r\n\r\n";
+
+/**
+ * @brief Compression status
+ */
+struct compress_status {
+    //! Initial dictionary has been created
+    bool init;
+    //! Dictionary used for new compressed payloads
+    compress_dict_t *dict;
+    //! Sample of recently compressed payloads
+    u_char sample[COMPRESS_DICT_SIZE];
+    //! Sampled bytes
+    uint32_t sample_len;
+    //! Number of compressed payloads
+    uint64_t count;
+    //! Number of compressed payloads when dictionary was trained
+    uint64_t trained;
+    //! Streams of threads that have compressed or uncompressed payloads
+    compress_stream_t *streams;
+    //! Lock for dictionaries, samples and streams list
+    pthread_mutex_t lock;
+};
+
+//! Compression status
+static struct compress_status compressor = { .lock = PTHREAD_MUTEX_INITIALIZER };
+//! Current thread streams
+static __thread compress_stream_t *compress_local = NULL;
+
+/**
+ * @brief Create a new dictionary with current payload samples
+ *
+ * The dictionary deflate stream is primed once here, and copied later
+ * for each compressed payload.
+ */
+static compress_dict_t *
+compress_dict_create()
+{
+    compress_dict_t *dict;
+    uint32_t sample_len;
+
+    if (!(dict = malloc(sizeof(compress_dict_t))))
+        return NULL;
+
+    dict->refs = 0;
+    dict->len = sizeof(compress_sip_dict) - 1;
+    memcpy(dict->data, compress_sip_dict, dict->len);
+
+    // Most recent samples are placed at the end of the dictionary
+    sample_len = compressor.sample_len;
+    if (sample_len > COMPRESS_DICT_SIZE - dict->len)
+        sample_len = COMPRESS_DICT_SIZE - dict->len;
+    memcpy(dict->data + dict->len, compressor.sample + compressor.sample_len - sample_len, sample_len);
+    dict->len += sample_len;
+
+    // Use raw deflate streams, there is no need for headers or checksums
+    memset(&dict->primed, 0, sizeof(z_stream));
+    if (deflateInit2(&dict->primed, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -COMPRESS_WINDOW_BITS,
+                     COMPRESS_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(dict);
+        return NULL;
+    }
+
+    if (deflateSetDictionary(&dict->primed, dict->data, dict->len) != Z_OK) {
+        deflateEnd(&dict->primed);
+        free(dict);
+        return NULL;
+    }
+
+    return dict;
+}
+
+/**
+ * @brief Free a dictionary and its primed stream
+ */
+static void
+compress_dict_free(compress_dict_t *dict)
+{
+    deflateEnd(&dict->primed);
+    free(dict);
+}
+
+/**
+ * @brief Drop a payload reference to a dictionary
+ *
+ * Old dictionaries are freed when no longer used.
+ */
+static void
+compress_dict_release(compress_dict_t *dict)
+{
+    pthread_mutex_lock(&compressor.lock);
+    if (--dict->refs == 0 && dict != compressor.dict)
+        compress_dict_free(dict);
+    pthread_mutex_unlock(&compressor.lock);
+}
+
+/**
+ * @brief Replace current dictionary
+ *
+ * Previous dictionary is freed if no payload is using it.
+ */
+static void
+compress_dict_train()
+{
+    compress_dict_t *dict;
+
+    if (!(dict = compress_dict_create()))
+        return;
+
+    if (compressor.dict && compressor.dict->refs == 0)
+        compress_dict_free(compressor.dict);
+
+    compressor.dict = dict;
+    compressor.trained = compressor.count;
+}
+
+/**
+ * @brief Add payload data to dictionary training sample
+ */
+static void
+compress_sample_add(const u_char *payload, uint32_t len)
+{
+    if (len > COMPRESS_SAMPLE_LEN)
+        len = COMPRESS_SAMPLE_LEN;
+
+    // Discard oldest sampled data
+    if (compressor.sample_len + len > sizeof(compressor.sample)) {
+        uint32_t discard = compressor.sample_len + len - sizeof(compressor.sample);
+        memmove(compressor.sample, compressor.sample + discard, compressor.sample_len - discard);
+        compressor.sample_len -= discard;
+    }
+
+    memcpy(compressor.sample + compressor.sample_len, payload, len);
+    compressor.sample_len += len;
+}
+
+/**
+ * @brief Create the initial dictionary
+ *
+ * @note This function must be called with compressor lock held
+ *
+ * @return 0 if a dictionary is ready, 1 otherwise
+ */
+static int
+compress_init()
+{
+    if (compressor.init)
+        return 0;
+
+    // Start with common SIP content dictionary
+    if (!(compressor.dict = compress_dict_create()))
+        return 1;
+
+    compressor.init = true;
+    return 0;
+}
+
+/**
+ * @brief Get compression streams of the calling thread
+ *
+ * @return thread streams or NULL if they can not be created
+ */
+static compress_stream_t *
+compress_stream_get()
+{
+    compress_stream_t *stream = compress_local;
+
+    if (stream)
+        return stream;
+
+    if (!(stream = malloc(sizeof(compress_stream_t))))
+        return NULL;
+    memset(stream, 0, sizeof(compress_stream_t));
+
+    if (inflateInit2(&stream->inflater, -MAX_WBITS) != Z_OK) {
+        free(stream);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&compressor.lock);
+    stream->next = compressor.streams;
+    compressor.streams = stream;
+    pthread_mutex_unlock(&compressor.lock);
+
+    return compress_local = stream;
+}
+
+compress_data_t *
+compress_payload(const u_char *payload, uint32_t len)
+{
+    compress_data_t *zdata, *shrunk;
+    compress_stream_t *stream;
+    compress_dict_t *dict;
+    z_stream *deflater;
+    uLong bound;
+
+    if (!(stream = compress_stream_get()))
+        return NULL;
+    deflater = &stream->deflater;
+
+    pthread_mutex_lock(&compressor.lock);
+
+    if (compress_init() != 0) {
+        pthread_mutex_unlock(&compressor.lock);
+        return NULL;
+    }
+
+    // Sample some payloads for next dictionary
+    if (++compressor.count % COMPRESS_SAMPLE_RATE == 0)
+        compress_sample_add(payload, len);
+
+    // Train a new dictionary if enough payloads have been compressed
+    if (compressor.count - compressor.trained >= COMPRESS_TRAIN_INTERVAL)
+        compress_dict_train();
+
+    // Keep the dictionary while it is being used
+    dict = compressor.dict;
+    dict->refs++;
+
+    pthread_mutex_unlock(&compressor.lock);
+
+    // Start from the dictionary primed stream instead of priming it again
+    if (stream->deflating)
+        deflateEnd(deflater);
+    if (!(stream->deflating = (deflateCopy(deflater, &dict->primed) == Z_OK)))
+        goto failed;
+
+    bound = deflateBound(deflater, len);
+    if (!(zdata = malloc(sizeof(compress_data_t) + bound)))
+        goto failed;
+
+    deflater->next_in = (Bytef *) payload;
+    deflater->avail_in = len;
+    deflater->next_out = zdata->data;
+    deflater->avail_out = bound;
+
+    // Keep the original payload if compression does not save anything
+    if (deflate(deflater, Z_FINISH) != Z_STREAM_END || bound - deflater->avail_out >= len) {
+        free(zdata);
+        goto failed;
+    }
+
+    // Free unused compression buffer space
+    zdata->len = bound - deflater->avail_out;
+    if ((shrunk = realloc(zdata, sizeof(compress_data_t) + zdata->len)))
+        zdata = shrunk;
+
+    zdata->dict = dict;
+    metrics_add(METRIC_MEM_COMPRESSED, compress_size(zdata));
+    return zdata;
+
+failed:
+    compress_dict_release(dict);
+    return NULL;
+}
+
+int
+uncompress_payload(compress_data_t *zdata, u_char *out, uint32_t len)
+{
+    compress_stream_t *stream;
+    z_stream *inflater;
+
+    if (!(stream = compress_stream_get()))
+        return 1;
+    inflater = &stream->inflater;
+
+    // Dictionary content does not change while payloads reference it
+    inflateReset(inflater);
+    inflateSetDictionary(inflater, zdata->dict->data, zdata->dict->len);
+    inflater->next_in = zdata->data;
+    inflater->avail_in = zdata->len;
+    inflater->next_out = out;
+    inflater->avail_out = len;
+
+    if (inflate(inflater, Z_FINISH) == Z_STREAM_END && inflater->total_out == len)
+        return 0;
+
+    return 1;
+}
+
+void
+compress_free(compress_data_t *zdata)
+{
+    if (!zdata)
+        return;
+
+    metrics_add(METRIC_MEM_COMPRESSED, -(int64_t) compress_size(zdata));
+    compress_dict_release(zdata->dict);
+    free(zdata);
+}
+
+size_t
+compress_size(compress_data_t *zdata)
+{
+    return sizeof(compress_data_t) + zdata->len;
+}
+
+void
+compress_deinit()
+{
+    compress_stream_t *stream, *next;
+
+    pthread_mutex_lock(&compressor.lock);
+    for (stream = compressor.streams; stream; stream = next) {
+        next = stream->next;
+        if (stream->deflating)
+            deflateEnd(&stream->deflater);
+        inflateEnd(&stream->inflater);
+        free(stream);
+    }
+    compressor.streams = NULL;
+    compress_local = NULL;
+
+    if (compressor.init) {
+        if (compressor.dict->refs == 0)
+            compress_dict_free(compressor.dict);
+        compressor.dict = NULL;
+        compressor.init = false;
+    }
+    pthread_mutex_unlock(&compressor.lock);
+}
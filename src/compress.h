@@ -0,0 +1,152 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file compress.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to compress SIP payloads in memory
+ *
+ * SIP messages are small and compress poorly on their own, but they share
+ * most of their content with other messages of the same capture. Payloads
+ * are deflated using a preset dictionary made of common SIP header lines
+ * followed by a sample of recently compressed payloads.
+ *
+ * The dictionary is trained again from time to time with newer payloads.
+ * Each compressed payload references the dictionary used to compress it,
+ * and dictionaries are freed when no payload references them.
+ *
+ * Each dictionary keeps a deflate stream already primed with its content.
+ * Payloads are compressed from a per thread copy of that stream, so the
+ * dictionary is not processed again for every payload.
+ *
+ */
+#ifndef __SNGREP_COMPRESS_H
+#define __SNGREP_COMPRESS_H
+
+#include "config.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+//! Max size of compression dictionaries
+#define COMPRESS_DICT_SIZE      16384
+//! Only sample one of every N compressed payloads for training
+#define COMPRESS_SAMPLE_RATE    8
+//! Max bytes sampled from each payload
+#define COMPRESS_SAMPLE_LEN     1024
+//! Compressed payloads between dictionary trainings
+#define COMPRESS_TRAIN_INTERVAL 512
+//! Deflate window size (log2), enough to reference the whole dictionary
+#define COMPRESS_WINDOW_BITS    14
+//! Deflate hash tables memory level, smaller tables are faster to copy
+#define COMPRESS_MEM_LEVEL      6
+
+//! Shorter declaration of compress_dict structure
+typedef struct compress_dict compress_dict_t;
+//! Shorter declaration of compress_data structure
+typedef struct compress_data compress_data_t;
+//! Shorter declaration of compress_stream structure
+typedef struct compress_stream compress_stream_t;
+
+/**
+ * @brief Compression preset dictionary
+ */
+struct compress_dict {
+    //! Number of payloads compressed with this dictionary
+    int refs;
+    //! Deflate stream primed with this dictionary, copied for each payload
+    z_stream primed;
+    //! Dictionary length
+    uint32_t len;
+    //! Dictionary content
+    u_char data[COMPRESS_DICT_SIZE];
+};
+
+/**
+ * @brief Compressed payload
+ */
+struct compress_data {
+    //! Dictionary used to compress this payload
+    compress_dict_t *dict;
+    //! Compressed data length
+    uint32_t len;
+    //! Compressed data
+    u_char data[];
+};
+
+/**
+ * @brief Compression streams of a thread
+ */
+struct compress_stream {
+    //! Compression stream, copied from a dictionary primed stream
+    z_stream deflater;
+    //! Compression stream holds a copied state
+    bool deflating;
+    //! Decompression stream
+    z_stream inflater;
+    //! Next thread streams
+    compress_stream_t *next;
+};
+
+/**
+ * @brief Compress the given payload
+ *
+ * @param payload Payload to compress
+ * @param len Payload length
+ * @return compressed payload or NULL if it can not be compressed
+ */
+compress_data_t *
+compress_payload(const u_char *payload, uint32_t len);
+
+/**
+ * @brief Uncompress a compressed payload
+ *
+ * @param zdata Compressed payload
+ * @param out Buffer to store uncompressed payload
+ * @param len Uncompressed payload length
+ * @return 0 if payload has been uncompressed, 1 otherwise
+ */
+int
+uncompress_payload(compress_data_t *zdata, u_char *out, uint32_t len);
+
+/**
+ * @brief Free a compressed payload
+ */
+void
+compress_free(compress_data_t *zdata);
+
+/**
+ * @brief Get memory used by a compressed payload
+ */
+size_t
+compress_size(compress_data_t *zdata);
+
+/**
+ * @brief Free compression resources
+ *
+ * Must only be called when no other thread is compressing, like on exit.
+ */
+void
+compress_deinit();
+
+#endif /* __SNGREP_COMPRESS_H */
@@ -0,0 +1,455 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file correlator.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in correlator.h
+ *
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include "correlator.h"
+#include "capture.h"
+#include "sip.h"
+#include "rtp.h"
+#include "util.h"
+
+/**
+ * @brief Queued packets for a media port
+ */
+struct correlator_port {
+    //! Queued packets marking this port as pending
+    uint32_t count;
+    //! Shards with queued packets marking this port as pending
+    uint64_t shards;
+};
+
+/**
+ * @brief Correlation threads status
+ */
+struct correlator_status {
+    //! Correlation shards
+    correlator_shard_t *shards[SIP_MAX_SHARDS];
+    //! Number of correlation shards
+    int count;
+    //! Correlation threads are running
+    bool running;
+    //! Queued packets not yet handled
+    int pending;
+    //! Lock for drained condition
+    pthread_mutex_t lock;
+    //! Signaled when there are no pending packets
+    pthread_cond_t drained;
+    //! Pending media ports
+    struct correlator_port *ports;
+    //! Lock for pending media ports
+    pthread_mutex_t ports_lock;
+};
+
+//! Correlation threads status
+static struct correlator_status correlator = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .drained = PTHREAD_COND_INITIALIZER,
+    .ports_lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+/**
+ * @brief Unlock a mutex when a waiting capture thread is cancelled
+ */
+static void
+correlator_unlock(void *lock)
+{
+    pthread_mutex_unlock((pthread_mutex_t *) lock);
+}
+
+/**
+ * @brief Parse a port number of a SDP line
+ *
+ * @param value Port start, after any spaces
+ * @param eol End of the SDP line
+ * @return port number or 0 if there is no valid port
+ */
+static unsigned int
+correlator_parse_port(const char *value, const char *eol)
+{
+    unsigned int port = 0;
+
+    while (value < eol && *value == ' ')
+        value++;
+    for (; value < eol && *value >= '0' && *value <= '9' && port <= 65535; value++)
+        port = port * 10 + (*value - '0');
+
+    return (port <= 65535) ? port : 0;
+}
+
+/**
+ * @brief Get RTP and RTCP ports of SDP media in a SIP payload
+ *
+ * Payload is not null terminated, so lines are parsed with their length.
+ *
+ * @param ports Array to store found ports
+ * @return number of found ports
+ */
+static int
+correlator_media_ports(const u_char *payload, uint32_t len, uint16_t *ports)
+{
+    const char *line, *eol, *value, *end = (const char *) payload + len;
+    unsigned int port;
+    int count = 0;
+
+    // Most messages have no SDP
+    if (!(line = memmem(payload, len, "\nm=", 3)))
+        return 0;
+
+    for (line++; line < end && count < CORRELATOR_MEDIA_PORTS; line = eol + 1) {
+        if (!(eol = memchr(line, '\n', end - line)))
+            eol = end;
+
+        if (eol - line > 2 && !memcmp(line, "m=", 2)) {
+            // Media type followed by the RTP port, RTCP uses next port
+            for (value = line + 2; value < eol && *value != ' '; value++);
+            if ((port = correlator_parse_port(value, eol)) > 0 && port < 65535) {
+                ports[count++] = port;
+                if (count < CORRELATOR_MEDIA_PORTS)
+                    ports[count++] = port + 1;
+            }
+        } else if (eol - line > 7 && !memcmp(line, "a=rtcp:", 7)) {
+            if ((port = correlator_parse_port(line + 7, eol)) > 0)
+                ports[count++] = port;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief Mark media ports as pending in a shard
+ */
+static void
+correlator_mark_ports(correlator_shard_t *shard, uint16_t *ports, int count)
+{
+    int i;
+
+    pthread_mutex_lock(&correlator.ports_lock);
+    for (i = 0; i < count; i++) {
+        correlator.ports[ports[i]].count++;
+        correlator.ports[ports[i]].shards |= 1ULL << shard->id;
+    }
+    pthread_mutex_unlock(&correlator.ports_lock);
+}
+
+/**
+ * @brief Unmark media ports of a handled packet
+ */
+static void
+correlator_unmark_ports(uint16_t *ports, int count)
+{
+    int i;
+
+    if (!count)
+        return;
+
+    pthread_mutex_lock(&correlator.ports_lock);
+    for (i = 0; i < count; i++) {
+        if (--correlator.ports[ports[i]].count == 0)
+            correlator.ports[ports[i]].shards = 0;
+    }
+    pthread_mutex_unlock(&correlator.ports_lock);
+}
+
+/**
+ * @brief Get shards with queued packets for a media port
+ *
+ * If the port is pending in a single shard, it is marked again for a
+ * packet that will be queued to that shard.
+ *
+ * @return shards mask or 0 if port is not pending
+ */
+static uint64_t
+correlator_port_shards(uint16_t port)
+{
+    uint64_t shards;
+
+    // Avoid locking for ports without queued packets
+    if (!__atomic_load_n(&correlator.ports[port].count, __ATOMIC_ACQUIRE))
+        return 0;
+
+    pthread_mutex_lock(&correlator.ports_lock);
+    shards = correlator.ports[port].shards;
+    if (shards && !(shards & (shards - 1)))
+        correlator.ports[port].count++;
+    pthread_mutex_unlock(&correlator.ports_lock);
+
+    return shards;
+}
+
+/**
+ * @brief Get next queued packet of a shard
+ *
+ * @return false if correlation threads are stopping
+ */
+static bool
+correlator_pop(correlator_shard_t *shard, correlator_entry_t *entry)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&shard->lock);
+    while (shard->count == 0 && correlator.running)
+        pthread_cond_wait(&shard->not_empty, &shard->lock);
+
+    if (shard->count > 0) {
+        *entry = shard->queue[shard->head];
+        shard->head = (shard->head + 1) % CORRELATOR_QUEUE_SIZE;
+        shard->count--;
+        pthread_cond_signal(&shard->not_full);
+        found = true;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return found;
+}
+
+/**
+ * @brief Queue a packet to a shard, waiting if its queue is full
+ */
+static void
+correlator_push(correlator_shard_t *shard, correlator_entry_t *entry)
+{
+    __atomic_add_fetch(&correlator.pending, 1, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&shard->lock);
+    pthread_cleanup_push(correlator_unlock, &shard->lock);
+    while (shard->count == CORRELATOR_QUEUE_SIZE)
+        pthread_cond_wait(&shard->not_full, &shard->lock);
+
+    shard->queue[(shard->head + shard->count) % CORRELATOR_QUEUE_SIZE] = *entry;
+    shard->count++;
+    shard->pending++;
+    pthread_cond_signal(&shard->not_empty);
+    pthread_cleanup_pop(1);
+}
+
+/**
+ * @brief Mark a queued packet as handled
+ *
+ * Must be called with shard lock held.
+ */
+static void
+correlator_done(correlator_shard_t *shard, correlator_entry_t *entry)
+{
+    correlator_unmark_ports(entry->ports, entry->port_count);
+
+    if (--shard->pending == 0)
+        pthread_cond_broadcast(&shard->drained);
+
+    if (__atomic_sub_fetch(&correlator.pending, 1, __ATOMIC_SEQ_CST) == 0) {
+        pthread_mutex_lock(&correlator.lock);
+        pthread_cond_broadcast(&correlator.drained);
+        pthread_mutex_unlock(&correlator.lock);
+    }
+}
+
+/**
+ * @brief Wait until a shard has handled all its queued packets
+ */
+static void
+correlator_shard_drain(correlator_shard_t *shard)
+{
+    pthread_mutex_lock(&shard->lock);
+    pthread_cleanup_push(correlator_unlock, &shard->lock);
+    while (shard->pending > 0)
+        pthread_cond_wait(&shard->drained, &shard->lock);
+    pthread_cleanup_pop(1);
+}
+
+/**
+ * @brief Correlation thread
+ *
+ * SIP payload is parsed and added to its dialog holding only this shard
+ * lock, so shards threads only wait for each other while storing them.
+ */
+static void *
+correlator_thread(void *info)
+{
+    correlator_shard_t *shard = (correlator_shard_t *) info;
+    correlator_entry_t entry;
+    sip_prepared_t prep;
+
+    // Use this shard regular expressions
+    sip_shard_attach(shard->id);
+
+    while (correlator_pop(shard, &entry)) {
+        if (entry.media) {
+            capture_packet_commit(entry.pkt, NULL);
+        } else {
+            sip_prepare_packet(entry.pkt, &prep);
+            capture_packet_commit(entry.pkt, &prep);
+            sip_prepared_clear(&prep);
+        }
+        pthread_mutex_lock(&shard->lock);
+        correlator_done(shard, &entry);
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    return NULL;
+}
+
+void
+correlator_init(int count)
+{
+    correlator_shard_t *shard;
+    int i;
+
+    // Correlate in capture threads
+    if (count <= 1)
+        return;
+
+    // Pending queued packets for each media port
+    if (!(correlator.ports = calloc(65536, sizeof(struct correlator_port))))
+        return;
+
+    correlator.running = true;
+
+    for (i = 0; i < count && i < SIP_MAX_SHARDS; i++) {
+        if (!(shard = calloc(1, sizeof(correlator_shard_t))))
+            break;
+        shard->id = i;
+        pthread_mutex_init(&shard->lock, NULL);
+        pthread_cond_init(&shard->not_empty, NULL);
+        pthread_cond_init(&shard->not_full, NULL);
+        pthread_cond_init(&shard->drained, NULL);
+        if (pthread_create(&shard->thread, NULL, correlator_thread, shard) != 0) {
+            free(shard);
+            break;
+        }
+        correlator.shards[i] = shard;
+    }
+
+    correlator.count = i;
+
+    // Call-IDs are hashed to all shards, correlate in capture threads if
+    // any of them has no thread
+    if (correlator.count != count)
+        correlator_deinit();
+}
+
+void
+correlator_deinit()
+{
+    correlator_shard_t *shard;
+    correlator_entry_t *entry;
+    int i;
+
+    // Wake up all threads and wait for them to finish
+    for (i = 0; i < correlator.count; i++) {
+        shard = correlator.shards[i];
+        pthread_mutex_lock(&shard->lock);
+        correlator.running = false;
+        // Discard packets not yet correlated
+        while (shard->count > 0) {
+            entry = &shard->queue[shard->head];
+            packet_destroy(entry->pkt);
+            correlator_done(shard, entry);
+            shard->head = (shard->head + 1) % CORRELATOR_QUEUE_SIZE;
+            shard->count--;
+        }
+        pthread_cond_signal(&shard->not_empty);
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    for (i = 0; i < correlator.count; i++) {
+        shard = correlator.shards[i];
+        pthread_join(shard->thread, NULL);
+        pthread_mutex_destroy(&shard->lock);
+        pthread_cond_destroy(&shard->not_empty);
+        pthread_cond_destroy(&shard->not_full);
+        pthread_cond_destroy(&shard->drained);
+        free(shard);
+        correlator.shards[i] = NULL;
+    }
+
+    correlator.count = 0;
+    free(correlator.ports);
+    correlator.ports = NULL;
+}
+
+bool
+correlator_enabled()
+{
+    return correlator.count > 1;
+}
+
+void
+correlator_dispatch(packet_t *pkt)
+{
+    u_char *payload = packet_payload(pkt);
+    uint32_t len = packet_payloadlen(pkt);
+    correlator_entry_t entry = { .pkt = pkt };
+    uint64_t shards;
+    int id;
+
+    // Queue SIP messages to the thread of their shard
+    if (len && (id = sip_shard_from_payload(payload, len)) >= 0) {
+        // Media sent to SDP ports must wait for this message
+        entry.port_count = correlator_media_ports(payload, len, entry.ports);
+        correlator_mark_ports(correlator.shards[id], entry.ports, entry.port_count);
+        correlator_push(correlator.shards[id], &entry);
+        return;
+    }
+
+    // Media packets can belong to a dialog stream still being created
+    if (len && (data_is_rtp(payload, len) == 0 || data_is_rtcp(payload, len) == 0)
+        && (shards = correlator_port_shards(pkt->dst.port))) {
+
+        // Queue the packet behind the messages of its only pending shard
+        if (!(shards & (shards - 1))) {
+            entry.media = true;
+            entry.ports[0] = pkt->dst.port;
+            entry.port_count = 1;
+            correlator_push(correlator.shards[__builtin_ctzll(shards)], &entry);
+            return;
+        }
+
+        // Wait for all shards with messages for this port
+        for (id = 0; id < correlator.count; id++) {
+            if (shards & (1ULL << id))
+                correlator_shard_drain(correlator.shards[id]);
+        }
+    }
+
+    capture_packet_commit(pkt, NULL);
+}
+
+void
+correlator_drain()
+{
+    if (!correlator.count)
+        return;
+
+    pthread_mutex_lock(&correlator.lock);
+    pthread_cleanup_push(correlator_unlock, &correlator.lock);
+    while (__atomic_load_n(&correlator.pending, __ATOMIC_SEQ_CST) > 0)
+        pthread_cond_wait(&correlator.drained, &correlator.lock);
+    pthread_cleanup_pop(1);
+}
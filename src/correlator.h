@@ -0,0 +1,146 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file correlator.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to correlate SIP messages in several threads
+ *
+ * When capture.shards is greater than one, each shard has a thread that
+ * correlates the SIP messages whose Call-ID hash maps to it. Capture
+ * threads only extract the Call-ID header and queue the packet to its
+ * shard, whose thread parses the payload and adds the message to its
+ * dialog holding only the shard lock. Capture lock is only taken to store
+ * new dialogs in calls list.
+ *
+ * Messages of the same dialog are always handled by the same thread, in
+ * capture order. Packets that are not SIP are handled by capture threads.
+ *
+ * Media ports of queued messages with SDP are marked as pending until the
+ * message is handled. Media packets sent to a pending port are queued
+ * behind the message in its shard, so streams created by SDP are never
+ * missed. If the port is pending in several shards, the capture thread
+ * waits until those shards have handled their queued packets.
+ *
+ */
+#ifndef __SNGREP_CORRELATOR_H
+#define __SNGREP_CORRELATOR_H
+
+#include "config.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include "packet.h"
+
+//! Max number of queued packets per shard
+#define CORRELATOR_QUEUE_SIZE   4096
+//! Max media ports marked as pending per queued message
+#define CORRELATOR_MEDIA_PORTS  8
+
+//! Shorter declaration of correlator_entry structure
+typedef struct correlator_entry correlator_entry_t;
+//! Shorter declaration of correlator_shard structure
+typedef struct correlator_shard correlator_shard_t;
+
+/**
+ * @brief Packet queued to a correlation thread
+ */
+struct correlator_entry {
+    //! Queued packet
+    packet_t *pkt;
+    //! Packet is not a SIP message
+    bool media;
+    //! Media ports pending until this packet is handled
+    uint16_t ports[CORRELATOR_MEDIA_PORTS];
+    //! Number of pending media ports
+    int port_count;
+};
+
+/**
+ * @brief Correlation thread and its queue of packets
+ */
+struct correlator_shard {
+    //! Shard number
+    int id;
+    //! Correlation thread
+    pthread_t thread;
+    //! Queued packets
+    correlator_entry_t queue[CORRELATOR_QUEUE_SIZE];
+    //! Position of the first queued packet
+    uint32_t head;
+    //! Number of queued packets
+    uint32_t count;
+    //! Queued packets not yet handled
+    uint32_t pending;
+    //! Lock for queue access from capture and correlation threads
+    pthread_mutex_t lock;
+    //! Signaled when a packet is queued
+    pthread_cond_t not_empty;
+    //! Signaled when a packet is dequeued
+    pthread_cond_t not_full;
+    //! Signaled when there are no pending packets
+    pthread_cond_t drained;
+};
+
+/**
+ * @brief Start correlation threads
+ *
+ * No thread is started if there is a single shard, correlating SIP
+ * messages in capture threads. The same is done if a thread can not be
+ * started for every shard.
+ *
+ * @param count Number of shards
+ */
+void
+correlator_init(int count);
+
+/**
+ * @brief Stop correlation threads
+ *
+ * Packets still queued are discarded.
+ */
+void
+correlator_deinit();
+
+/**
+ * @brief Check if SIP messages are correlated in their own threads
+ */
+bool
+correlator_enabled();
+
+/**
+ * @brief Handle a captured packet
+ *
+ * SIP messages are queued to the thread of their Call-ID shard. Any
+ * other packet is handled in the calling thread.
+ *
+ * @param pkt Captured packet
+ */
+void
+correlator_dispatch(packet_t *pkt);
+
+/**
+ * @brief Wait until all queued packets have been handled
+ */
+void
+correlator_drain();
+
+#endif /* __SNGREP_CORRELATOR_H */
@@ -51,6 +51,7 @@
  */
 ui_t ui_call_list = {
     .type = PANEL_CALL_LIST,
+    .lockless = true,
     .create = call_list_create,
     .destroy = call_list_destroy,
     .redraw = call_list_redraw,
@@ -141,6 +142,7 @@ call_list_destroy(ui_t *ui)
         // Deallocate group data
         call_group_destroy(info->group);
         vector_destroy(info->dcalls);
+        sng_free(info->rows);
 
         // Deallocate panel windows
         delwin(info->list_win);
@@ -159,7 +161,16 @@ call_list_info(ui_t *ui)
 bool
 call_list_redraw(ui_t *ui)
 {
-    return sip_calls_has_changed();
+    // Get panel info
+    call_list_info_t *info = call_list_info(ui);
+
+    // This is only queried when there is no user input, so only the
+    // rows of changed calls need to be drawn again
+    if (sip_calls_has_changed()) {
+        info->damaged = true;
+        return true;
+    }
+    return false;
 }
 
 int
@@ -338,29 +349,19 @@ call_list_draw_footer(ui_t *ui)
 }
 
 void
-call_list_draw_list(ui_t *ui)
+call_list_update_calls(ui_t *ui)
 {
-    WINDOW *list_win;
-    int listh, listw, cline = 0;
-    struct sip_call *call = NULL;
-    int i, collen;
-    char coltext[SIP_ATTR_MAXLEN];
-    int colid;
-    int colpos;
-    int color;
+    sip_call_t *call = NULL;
 
     // Get panel info
     call_list_info_t *info = call_list_info(ui);
 
-    // Get window of call list panel
-    list_win = info->list_win;
-    getmaxyx(list_win, listh, listw);
-
     // Store selected call
     if (info->cur_call >= 0)
         call = vector_item(info->dcalls, info->cur_call);
 
     // Get the list of calls that are goint to be displayed
+    info->removed = sip_calls_count_removed();
     vector_destroy(info->dcalls);
     info->dcalls = vector_copy_if(sip_calls_vector(), filter_check_call);
 
@@ -380,9 +381,50 @@ call_list_draw_list(ui_t *ui)
     } else if (call) {
         call_list_move(ui, vector_index(info->dcalls, call));
     }
+}
+
+void
+call_list_draw_list(ui_t *ui)
+{
+    WINDOW *list_win;
+    int listh, listw, cline = 0;
+    struct sip_call *call = NULL;
+    int i, collen;
+    const char *coltext;
+    int colid;
+    int colpos;
+    int color;
+    int flags;
+    bool damaged;
+    call_list_row_t *row;
+
+    // Get panel info
+    call_list_info_t *info = call_list_info(ui);
+
+    // Get window of call list panel
+    list_win = info->list_win;
+    getmaxyx(list_win, listh, listw);
+
+    // Keep unchanged rows only if nothing but captured data has changed
+    damaged = info->damaged && info->rowcnt == listh;
+    info->damaged = false;
+
+    // Allocate drawn rows information for current window height
+    if (info->rowcnt != listh) {
+        sng_free(info->rows);
+        info->rows = sng_malloc(sizeof(call_list_row_t) * listh);
+        info->rowcnt = (info->rows) ? listh : 0;
+    }
+
+    // Get the list of calls that are goint to be displayed
+    call_list_update_calls(ui);
 
     // Clear call list before redrawing
-    werase(list_win);
+    if (!damaged) {
+        werase(list_win);
+        if (info->rows)
+            memset(info->rows, 0, sizeof(call_list_row_t) * info->rowcnt);
+    }
 
     // Set the iterator position to the first call
     vector_iter_t it = vector_iterator(info->dcalls);
@@ -398,6 +440,18 @@ call_list_draw_list(ui_t *ui)
         if (!call_msg_count(call))
             continue;
 
+        // Skip rows whose call has not changed since last drawn
+        flags = call_group_exists(info->group, call) | (info->cur_call == vector_iterator_current(&it)) << 1;
+        if ((row = (info->rows) ? &info->rows[cline] : NULL)) {
+            if (damaged && row->call == call && row->version == call->version && row->flags == flags) {
+                cline++;
+                continue;
+            }
+            row->call = call;
+            row->version = call->version;
+            row->flags = flags;
+        }
+
         // Show bold selected rows
         if (call_group_exists(info->group, call))
             wattron(list_win, A_BOLD | COLOR_PAIR(CP_DEFAULT));
@@ -425,11 +479,8 @@ call_list_draw_list(ui_t *ui)
             if (colpos + collen >= listw)
                 break;
 
-            // Initialize column text
-            memset(coltext, 0, sizeof(coltext));
-
-            // Get call attribute for current column
-            if (!call_get_attribute(call, colid, coltext)) {
+            // Get cached call attribute for current column
+            if (!(coltext = call_get_attribute_text(call, colid))) {
                 colpos += collen + 1;
                 continue;
             }
@@ -443,7 +494,7 @@ call_list_draw_list(ui_t *ui)
             }
 
             // Add the column text to the existing columns
-            mvwprintw(list_win, cline, colpos, "%.*s", collen, coltext);
+            mvwaddnstr(list_win, cline, colpos, coltext, collen);
             colpos += collen + 1;
 
             // Disable attribute color
@@ -457,6 +508,15 @@ call_list_draw_list(ui_t *ui)
         wattroff(list_win, A_BOLD | A_REVERSE);
     }
 
+    // Clear remaining rows that were drawn before
+    for (; damaged && cline < info->rowcnt; cline++) {
+        if (info->rows[cline].call) {
+            wmove(list_win, cline, 0);
+            wclrtoeol(list_win);
+            info->rows[cline].call = NULL;
+        }
+    }
+
     // Draw scrollbar to the right
     info->scroll.max = vector_count(info->dcalls);
     ui_scrollbar_draw(info->scroll);
@@ -516,7 +576,7 @@ const char *
 call_list_line_text(ui_t *ui, sip_call_t *call, char *text)
 {
     int i, collen;
-    char call_attr[SIP_ATTR_MAXLEN];
+    const char *call_attr;
     char coltext[SIP_ATTR_MAXLEN];
     int colid;
 
@@ -542,10 +602,9 @@ call_list_line_text(ui_t *ui, sip_call_t *call, char *text)
 
         // Initialize column text
         memset(coltext, 0, sizeof(coltext));
-        memset(call_attr, 0, sizeof(call_attr));
 
         // Get call attribute for current column
-        if (call_get_attribute(call, colid, call_attr)) {
+        if ((call_attr = call_get_attribute_text(call, colid))) {
             sprintf(coltext, "%.*s", collen, call_attr);
         }
         // Add the column text to the existing columns
@@ -577,6 +636,10 @@ call_list_handle_key(ui_t *ui, int key)
     if (info->menu_active)
         return call_list_handle_menu_key(ui, key);
 
+    // Displayed calls may have been removed since last drawn
+    if (info->removed != sip_calls_count_removed())
+        call_list_update_calls(ui);
+
     // Check actions for this key
     while ((action = key_find_action(key, action)) != ERR) {
         // Check if we handle this action
@@ -660,6 +723,9 @@ call_list_handle_key(ui_t *ui, int key)
             case ACTION_SHOW_STATS:
                 ui_create_panel(PANEL_STATS);
                 break;
+            case ACTION_SHOW_PROFILE:
+                ui_create_panel(PANEL_PROFILE);
+                break;
             case ACTION_SAVE:
                 if (capture_sources_count() > 1) {
                     dialog_run("Saving is not possible when multiple input sources are specified.");
@@ -962,6 +1028,7 @@ call_list_help(ui_t *ui)
     mvwprintw(help_win, 21, 2, "F10/t       Select displayed columns");
     mvwprintw(help_win, 22, 2, "i/I         Set display filter to invite");
     mvwprintw(help_win, 23, 2, "p           Stop/Resume packet capture");
+    mvwprintw(help_win, 24, 2, "P           Show processing stages profile");
 
     // Press any key to close
     wgetch(help_win);
@@ -999,9 +1066,12 @@ call_list_clear(ui_t *ui)
     // Initialize structures
     info->scroll.pos = info->cur_call = -1;
     vector_clear(info->group->calls);
+    // Displayed calls may have been removed
+    vector_clear(info->dcalls);
 
     // Clear Displayed lines
     werase(info->list_win);
+    info->rowcnt = 0;
 }
 
 void
@@ -50,6 +50,8 @@ enum call_list_field_list {
 typedef struct call_list_column call_list_column_t;
 //! Sorter declaration of call_list_info struct
 typedef struct call_list_info call_list_info_t;
+//! Sorter declaration of call_list_row struct
+typedef struct call_list_row call_list_row_t;
 
 /**
  * @brief Call List column information
@@ -65,6 +67,21 @@ struct call_list_column {
     int width;
 };
 
+/**
+ * @brief Call List drawn row information
+ *
+ * Used to only redraw the rows whose call has changed since the last
+ * time the list was drawn.
+ */
+struct call_list_row {
+    //! Call drawn in this row
+    sip_call_t *call;
+    //! Call version when the row was drawn
+    uint32_t version;
+    //! Row was drawn selected or highlighted
+    int flags;
+};
+
 /**
  * @brief Call List panel status information
  *
@@ -74,6 +91,8 @@ struct call_list_column {
 struct call_list_info {
     //! Displayed calls vector
     vector_t *dcalls;
+    //! Removed calls count when displayed calls were copied
+    unsigned int removed;
     //! Selected call in the list
     int cur_call;
     //! Selected calls with space
@@ -100,6 +119,12 @@ struct call_list_info {
     int autoscroll;
     //! List scrollbar
     scrollbar_t scroll;
+    //! Rows drawn in the list window
+    call_list_row_t *rows;
+    //! Number of rows in rows array
+    int rowcnt;
+    //! Only captured data has changed, rows without changes can be kept
+    bool damaged;
 };
 
 /**
@@ -191,6 +216,16 @@ call_list_draw_footer(ui_t *ui);
 void
 call_list_draw_list(ui_t *ui);
 
+/**
+ * @brief Update displayed calls
+ *
+ * Copy the calls matching current filters and keep the selected call
+ *
+ * @param ui UI structure pointer
+ */
+void
+call_list_update_calls(ui_t *ui);
+
 /**
  * @brief Draw the Call list panel
  *
@@ -35,6 +35,9 @@
 #include <math.h>
 #include <stdlib.h>
 #include <locale.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/time.h>
 #include "setting.h"
 #include "ui_manager.h"
 #include "capture.h"
@@ -46,6 +49,9 @@
 #include "ui_column_select.h"
 #include "ui_save.h"
 #include "ui_settings.h"
+#include "ui_profile.h"
+#include "profile.h"
+#include "epoch.h"
 
 /**
  * @brief Available panel windows list
@@ -63,7 +69,8 @@ static ui_t *panel_pool[] = {
     &ui_msg_diff,
     &ui_column_select,
     &ui_settings,
-    &ui_stats
+    &ui_stats,
+    &ui_profile
 };
 
 int
@@ -188,9 +195,19 @@ ui_find_by_type(enum panel_types type)
 int
 ui_wait_for_input()
 {
-    ui_t *ui;
+    ui_t *ui, *last = NULL;
     WINDOW *win;
     PANEL *panel;
+    struct pollfd fds[2];
+    struct timeval now, next = { 0 };
+    bool pending = true, input = true;
+    int timeout;
+
+    // Wait for pressed keys and captured data notifications
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = capture_notify_fd();
+    fds[1].events = POLLIN;
 
     // While there are still panels
     while ((panel = panel_below(NULL))) {
@@ -201,24 +218,78 @@ ui_wait_for_input()
         // Get panel interface structure
         ui = ui_find_by_panel(panel);
 
-        // Set character input timeout 200 ms
-        halfdelay(REFRESHTHSECS);
+        // Panels are fully redrawn when they become the topmost one
+        if (ui != last) {
+            ui->changed = true;
+            last = ui;
+        }
 
-        // Avoid parsing any packet while UI is being drawn
-        capture_lock();
-        // Query the interface if it needs to be redrawn
-        if (ui_draw_redraw(ui)) {
-            // Redraw this panel
-            if (ui_draw_panel(ui) != 0) {
+        // Redraw after user input or when captured data has changed,
+        // but no more often than the refresh interval
+        gettimeofday(&now, NULL);
+        if (ui->changed || (pending && timercmp(&now, &next, >=))) {
+            capture_notify_clear();
+
+            // Captured data can not be released while UI is being drawn.
+            // Avoid parsing any packet unless panel can be drawn meanwhile
+            epoch_enter();
+            if (!ui->lockless)
+                capture_lock();
+            // Query the interface if it needs to be redrawn
+            int drawn = 0;
+            if (ui_draw_redraw(ui)) {
+                // Redraw this panel
+                PROFILE_START(prof_redraw);
+                drawn = ui_draw_panel(ui);
+                PROFILE_END(PROFILE_UI_REDRAW, prof_redraw);
+            }
+            if (!ui->lockless)
                 capture_unlock();
+            epoch_leave();
+            if (drawn != 0)
                 return -1;
+
+            // Update panel stack
+            update_panels();
+            doupdate();
+
+            pending = false;
+            next = now;
+            next.tv_usec += REFRESHMSECS * 1000;
+            if (next.tv_usec >= 1000000) {
+                next.tv_sec++;
+                next.tv_usec -= 1000000;
             }
         }
-        capture_unlock();
 
-        // Update panel stack
-        update_panels();
-        doupdate();
+        // Check for more pressed keys without waiting
+        if (input) {
+            timeout = 0;
+        } else if (pending) {
+            // Wait until next redraw is allowed
+            timeout = (next.tv_sec - now.tv_sec) * 1000 + (next.tv_usec - now.tv_usec) / 1000;
+            if (timeout < 0)
+                timeout = 0;
+        } else {
+            // Nothing to draw, wait for keys or notifications
+            timeout = -1;
+        }
+
+        // Notifications are not checked while a redraw is pending
+        fds[0].revents = fds[1].revents = 0;
+        if (poll(fds, (pending || fds[1].fd == -1) ? 1 : 2, timeout) < 0) {
+            // Interrupted by a signal, may be a terminal resize
+            input = true;
+            continue;
+        }
+
+        if (fds[1].revents & POLLIN)
+            pending = true;
+        if (fds[0].revents)
+            input = true;
+
+        if (!input)
+            continue;
 
         // Get topmost panel
         panel = panel_below(NULL);
@@ -226,14 +297,18 @@ ui_wait_for_input()
         // Enable key input on current panel
         win = panel_window(panel);
         keypad(win, TRUE);
+        nodelay(win, TRUE);
 
         // Get pressed key
         int c = wgetch(win);
 
-        // Timeout, no key pressed
-        if (c == ERR)
+        // No more pressed keys
+        if (c == ERR) {
+            input = false;
             continue;
+        }
 
+        epoch_enter();
         capture_lock();
         // Handle received key
         int hld = KEY_NOT_HANDLED;
@@ -255,6 +330,7 @@ ui_wait_for_input()
             }
         }
         capture_unlock();
+        epoch_leave();
     }
 
     return 0;
@@ -43,8 +43,8 @@
 #include "keybinding.h"
 #include "setting.h"
 
-//! Refresh UI every 200 ms
-#define REFRESHTHSECS   2
+//! Redraw UI at most every 50 ms (20 fps) when captured data changes
+#define REFRESHMSECS    50
 //! Default dialog dimensions
 #define DIALOG_MAX_WIDTH 100
 #define DIALOG_MIN_WIDTH 40
@@ -61,6 +61,7 @@ extern ui_t ui_msg_diff;
 extern ui_t ui_column_select;
 extern ui_t ui_settings;
 extern ui_t ui_stats;
+extern ui_t ui_profile;
 
 /**
  * @brief Initialize ncurses mode
@@ -74,6 +74,8 @@ enum panel_types {
     PANEL_SETTINGS,
     //! Stats panel
     PANEL_STATS,
+    //! Processing stages profile panel
+    PANEL_PROFILE,
     //! Panel Counter
     PANEL_COUNT,
 };
@@ -104,6 +106,8 @@ struct ui {
     enum panel_types type;
     //! Flag this panel as redraw required
     bool changed;
+    //! Panel can be drawn without holding capture lock
+    bool lockless;
 
     //! Constructor for this panel
     void (*create)(ui_t *);
@@ -0,0 +1,125 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file ui_profile.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in ui_profile.h
+ *
+ * This panel displays the time spent in each packet processing stage,
+ * refreshed on every screen update.
+ *
+ * +-------------------------------------------------------------------------+
+ * |                        Processing Stages Profile                        |
+ * +-------------------------------------------------------------------------+
+ * |  Stage                   Count  Mean (us)   p50 (us)   p99 (us)  Max (us) |
+ * |  IP reassembly           12345      0.210      0.180      1.020     12.400 |
+ * |  ...                                                                     |
+ * +-------------------------------------------------------------------------+
+ * |                 Press ESC to leave, F5 to reset counters                |
+ * +-------------------------------------------------------------------------+
+ *
+ */
+#include "config.h"
+#include "profile.h"
+#include "ui_manager.h"
+#include "ui_profile.h"
+
+/**
+ * Ui Structure definition for Profile panel
+ */
+ui_t ui_profile = {
+    .type = PANEL_PROFILE,
+    .panel = NULL,
+    .create = profile_panel_create,
+    .destroy = ui_panel_destroy,
+    .draw = profile_panel_draw,
+    .handle_key = profile_panel_handle_key
+};
+
+void
+profile_panel_create(ui_t *ui)
+{
+    // Calculate window dimensions
+    ui_panel_create(ui, PROFILE_STAGE_COUNT + 8, 82);
+
+    // Set the window title and boxes
+    mvwprintw(ui->win, 1, ui->width / 2 - 13, "Processing Stages Profile");
+    wattron(ui->win, COLOR_PAIR(CP_BLUE_ON_DEF));
+    title_foot_box(ui->panel);
+    mvwprintw(ui->win, ui->height - 2, ui->width / 2 - 20,
+              "Press ESC to leave, %s to reset counters",
+              key_action_key_str(ACTION_CLEAR_CALLS));
+    wattroff(ui->win, COLOR_PAIR(CP_BLUE_ON_DEF));
+}
+
+int
+profile_panel_draw(ui_t *ui)
+{
+    profile_summary_t summary;
+    int i;
+
+    if (!profile_enabled()) {
+        mvwprintw(ui->win, 3, 3, "Profiling support not compiled (--enable-profiling)");
+        return 0;
+    }
+
+    wattron(ui->win, A_BOLD);
+    mvwprintw(ui->win, 3, 3, "%-18s %10s %11s %11s %11s %11s",
+              "Stage", "Count", "Mean (us)", "p50 (us)", "p99 (us)", "Max (us)");
+    wattroff(ui->win, A_BOLD);
+
+    for (i = 0; i < PROFILE_STAGE_COUNT; i++) {
+        profile_get_summary(i, &summary);
+        mvwprintw(ui->win, 4 + i, 3, "%-18s %10lu %11.3f %11.3f %11.3f %11.3f",
+                  profile_stage_name(i), (unsigned long) summary.count,
+                  summary.mean / 1000.0, summary.p50 / 1000.0,
+                  summary.p99 / 1000.0, summary.max / 1000.0);
+    }
+
+    return 0;
+}
+
+int
+profile_panel_handle_key(ui_t *ui, int key)
+{
+    int action = -1;
+
+    // Check actions for this key
+    while ((action = key_find_action(key, action)) != ERR) {
+        // Check if we handle this action
+        switch (action) {
+            case ACTION_CLEAR_CALLS:
+                profile_reset();
+                break;
+            default:
+                // Parse next action
+                continue;
+        }
+
+        // This panel has handled the key successfully
+        break;
+    }
+
+    // Return if this panel has handled or not the key
+    return (action == ERR) ? KEY_NOT_HANDLED : KEY_HANDLED;
+}
@@ -0,0 +1,61 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file ui_profile.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to manage ui window for processing stages profile
+ */
+#ifndef __SNGREP_UI_PROFILE_H
+#define __SNGREP_UI_PROFILE_H
+
+/**
+ * @brief Creates a new profile panel
+ *
+ * This function draws the static information of the panel.
+ * Stage measures are redrawn on every refresh.
+ *
+ * @param ui UI structure pointer
+ */
+void
+profile_panel_create(ui_t *ui);
+
+/**
+ * @brief Draw the current stage measures
+ *
+ * @param ui UI structure pointer
+ * @return 0 if the panel has been drawn, -1 otherwise
+ */
+int
+profile_panel_draw(ui_t *ui);
+
+/**
+ * @brief Manage pressed keys for profile panel
+ *
+ * @param ui UI structure pointer
+ * @param key   key code
+ * @return enum @key_handler_ret
+ */
+int
+profile_panel_handle_key(ui_t *ui, int key);
+
+#endif /* __SNGREP_UI_PROFILE_H */
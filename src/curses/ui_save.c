@@ -36,6 +36,7 @@
 #include "ui_save.h"
 #include "setting.h"
 #include "capture.h"
+#include "rtp.h"
 #include "filter.h"
 
 /**
@@ -410,6 +411,37 @@ save_set_msg(ui_t *ui, sip_msg_t *msg)
     field_opts_on(info->fields[FLD_SAVE_MESSAGE], O_VISIBLE);
 }
 
+/**
+ * @brief Get the RTP frames iterator with the oldest pending frame
+ */
+static rtp_store_iter_t *
+save_rtp_first(vector_t *rtps)
+{
+    rtp_store_iter_t *rtp, *first = NULL;
+    vector_iter_t it = vector_iterator(rtps);
+
+    while ((rtp = vector_iterator_next(&it))) {
+        if (!first || timercmp(&rtp->header.ts, &first->header.ts, <))
+            first = rtp;
+    }
+    return first;
+}
+
+/**
+ * @brief Dump current RTP frame and move its iterator to the next one
+ */
+static void
+save_rtp_frame(pcap_dumper_t *pd, vector_t *rtps, rtp_store_iter_t *rtp)
+{
+    dump_frame(pd, &rtp->header, rtp->data);
+
+    // Remove iterator once all its frames have been saved
+    if (rtp_store_iterator_next(rtp) != 0) {
+        vector_remove(rtps, rtp);
+        rtp_store_iterator_destroy(rtp);
+    }
+}
+
 int
 save_to_file(ui_t *ui)
 {
@@ -422,9 +454,11 @@ save_to_file(ui_t *ui)
     FILE *f = NULL;
     int cur = 0, total = 0;
     WINDOW *progress;
-    vector_iter_t calls, msgs, rtps, packets;
+    vector_iter_t calls, msgs, streams, packets;
     packet_t *packet;
-    vector_t *sorted;
+    vector_t *sorted, *rtps;
+    rtp_stream_t *stream;
+    rtp_store_iter_t *rtp;
 
     // Get panel information
     save_info_t *info = save_info(ui);
@@ -521,12 +555,17 @@ save_to_file(ui_t *ui)
         // Store all messages in a time sorted vector
         sorted = vector_create(100, 50);
         vector_set_sorter(sorted, capture_packet_time_sorter);
+        // Retained RTP frames iterators, one per stream
+        rtps = vector_create(0, 10);
 
         // Count packages for progress bar
         while ((call = vector_iterator_next(&calls))) {
             total += vector_count(call->msgs);
-            if (info->saveformat == SAVE_PCAP_RTP)
-                total += vector_count(call->rtp_packets);
+            if (info->saveformat == SAVE_PCAP_RTP) {
+                streams = vector_iterator(call->streams);
+                while ((stream = vector_iterator_next(&streams)))
+                    total += rtp_store_count(stream->store);
+            }
         }
         vector_iterator_reset(&calls);
 
@@ -543,23 +582,41 @@ save_to_file(ui_t *ui)
                 vector_append(sorted, msg->packet);
             }
 
-            // Save RTP packets
+            // Save RTP frames retained in call streams
             if (info->saveformat == SAVE_PCAP_RTP) {
-                rtps = vector_iterator(call->rtp_packets);
-                while ((packet = vector_iterator_next(&rtps))) {
-                    // Update progress bar dialog
-                    dialog_progress_set_value(progress, (++cur * 100) / total);
-                    vector_append(sorted, packet);
+                streams = vector_iterator(call->streams);
+                while ((stream = vector_iterator_next(&streams))) {
+                    if (!rtp_store_count(stream->store))
+                        continue;
+                    rtp = rtp_store_iterator(stream->store);
+                    if (rtp_store_iterator_next(rtp) == 0) {
+                        vector_append(rtps, rtp);
+                    } else {
+                        rtp_store_iterator_destroy(rtp);
+                    }
                 }
             }
         }
 
-        // Save sorted packets
+        // Save sorted packets, merging RTP frames by time
         packets = vector_iterator(sorted);
         while ((packet = vector_iterator_next(&packets))) {
+            struct timeval time = packet_time(packet);
+            while ((rtp = save_rtp_first(rtps)) && timercmp(&rtp->header.ts, &time, <)) {
+                dialog_progress_set_value(progress, (++cur * 100) / total);
+                save_rtp_frame(pd, rtps, rtp);
+            }
             dump_packet(pd, packet);
         }
 
+        // Save RTP frames after last SIP packet
+        while ((rtp = save_rtp_first(rtps))) {
+            dialog_progress_set_value(progress, (++cur * 100) / total);
+            save_rtp_frame(pd, rtps, rtp);
+        }
+
+        vector_destroy(rtps);
+        vector_destroy(sorted);
         dialog_progress_destroy(progress);
     }
 
@@ -49,6 +49,10 @@
  * |  BYE:       10 (0.5%)                                   |
  * |  CANCEL:    0 (0.0%)                                    |
  * +---------------------------------------------------------+
+ * |  Setup time: p50 120ms  p90 350ms  p99 900ms            |
+ * |  Post dial:  p50 80ms  p90 200ms  p99 600ms             |
+ * |  UDP: 180  TCP: 20  TLS: 0  WS: 0  WSS: 0               |
+ * +---------------------------------------------------------+
  * |               Press any key to continue                 |
  * +---------------------------------------------------------+
  *
@@ -56,6 +60,7 @@
 #include "config.h"
 #include "vector.h"
 #include "sip.h"
+#include "sip_counters.h"
 #include "ui_manager.h"
 #include "ui_stats.h"
 
@@ -70,25 +75,44 @@ ui_t ui_stats = {
     .handle_key = NULL
 };
 
+static void
+stats_print_state(ui_t *ui, int line, const char *label, int state)
+{
+    const sip_counters_t *stats = sip_counters();
+    mvwprintw(ui->win, line, 33, "%s%d (%.1f%%)", label, stats->states[state],
+              (float) stats->states[state] * 100 / stats->calls);
+}
+
+static void
+stats_print_method(ui_t *ui, int line, const char *label, int method)
+{
+    const sip_counters_t *stats = sip_counters();
+    mvwprintw(ui->win, line, 3, "%s%d (%.1f%%)", label, stats->methods[method],
+              (float) stats->methods[method] * 100 / stats->messages);
+}
+
+static void
+stats_print_times(ui_t *ui, int line, const char *label, const histogram_t *times)
+{
+    if (!times->count) {
+        mvwprintw(ui->win, line, 3, "%s-", label);
+        return;
+    }
+
+    mvwprintw(ui->win, line, 3, "%sp50 %.0fms  p90 %.0fms  p99 %.0fms", label,
+              histogram_percentile(times, 50) / 1000.0,
+              histogram_percentile(times, 90) / 1000.0,
+              histogram_percentile(times, 99) / 1000.0);
+}
+
 void
 stats_create(ui_t *ui)
 {
-    vector_iter_t calls;
-    vector_iter_t msgs;
-    sip_call_t *call;
-    sip_msg_t *msg;
-
-    // Counters!
-    struct {
-        int dtotal, dcalls, completed, cancelled, incall, rejected, setup, busy, diverted;
-        int mtotal, invite, regist, subscribe, update, notify, options;
-        int publish, message, info, ack, bye, cancel;
-        int r100, r200, r300, r400, r500, r600, r700, r800;
-    } stats;
-    memset(&stats, 0, sizeof(stats));
+    const sip_counters_t *stats = sip_counters();
+    int dtotal, class, count;
 
     // Calculate window dimensions
-    ui_panel_create(ui, 25, 60);
+    ui_panel_create(ui, 29, 60);
 
     // Set the window title and boxes
     mvwprintw(ui->win, 1, ui->width / 2 - 9, "Stats Information");
@@ -97,104 +121,60 @@ stats_create(ui_t *ui)
     mvwhline(ui->win, 10, 1, ACS_HLINE, ui->width - 1);
     mvwaddch(ui->win, 10, 0, ACS_LTEE);
     mvwaddch(ui->win, 10, ui->width - 1, ACS_RTEE);
+    mvwhline(ui->win, 22, 1, ACS_HLINE, ui->width - 1);
+    mvwaddch(ui->win, 22, 0, ACS_LTEE);
+    mvwaddch(ui->win, 22, ui->width - 1, ACS_RTEE);
     mvwprintw(ui->win, ui->height - 2, ui->width / 2 - 9, "Press ESC to leave");
     wattroff(ui->win, COLOR_PAIR(CP_BLUE_ON_DEF));
 
-    // Parse the data
-    calls = sip_calls_iterator();
-    stats.dtotal = vector_iterator_count(&calls);
+    // Counters are updated while capturing, no need to parse the data
+    dtotal = sip_calls_count();
 
     // Ignore this screen when no dialog exists
-    if (!stats.dtotal) {
+    if (!dtotal || !stats->messages) {
         mvwprintw(ui->win, 3, 3, "No information to display");
         return;
     }
 
-    while ((call = vector_iterator_next(&calls))) {
-        // If this dialog is a call
-        if (call->state) {
-            // Increase call counter
-            stats.dcalls++;
-            // Increase call status counter
-            switch (call->state) {
-                case SIP_CALLSTATE_CALLSETUP: stats.setup++; break;
-                case SIP_CALLSTATE_INCALL: stats.incall++; break;
-                case SIP_CALLSTATE_CANCELLED: stats.cancelled++; break;
-                case SIP_CALLSTATE_REJECTED: stats.rejected++; break;
-                case SIP_CALLSTATE_BUSY: stats.busy++; break;
-                case SIP_CALLSTATE_DIVERTED: stats.diverted++; break;
-                case SIP_CALLSTATE_COMPLETED: stats.completed++; break;
-            }
-        }
-        // For each message in call
-        msgs = vector_iterator(call->msgs);
-        while ((msg = vector_iterator_next(&msgs))) {
-            // Increase message counter
-            stats.mtotal++;
-            // Check message type
-            switch (msg->reqresp) {
-                case SIP_METHOD_REGISTER: stats.regist++; break;
-                case SIP_METHOD_INVITE: stats.invite++; break;
-                case SIP_METHOD_SUBSCRIBE: stats.subscribe++; break;
-                case SIP_METHOD_NOTIFY: stats.notify++; break;
-                case SIP_METHOD_OPTIONS: stats.options++; break;
-                case SIP_METHOD_PUBLISH: stats.publish++; break;
-                case SIP_METHOD_MESSAGE: stats.message++; break;
-                case SIP_METHOD_CANCEL: stats.cancel++; break;
-                case SIP_METHOD_BYE: stats.bye++; break;
-                case SIP_METHOD_ACK: stats.ack++; break;
-                // case SIP_METHOD_PRACK:
-                case SIP_METHOD_INFO: stats.info++; break;
-                // case SIP_METHOD_REFER:
-                case SIP_METHOD_UPDATE: stats.update++; break;
-                default:
-                    if (msg->reqresp >= 800) stats.r800++;
-                    else if (msg->reqresp >= 700) stats.r700++;
-                    else if (msg->reqresp >= 600) stats.r600++;
-                    else if (msg->reqresp >= 500) stats.r500++;
-                    else if (msg->reqresp >= 400) stats.r400++;
-                    else if (msg->reqresp >= 300) stats.r300++;
-                    else if (msg->reqresp >= 200) stats.r200++;
-                    else if (msg->reqresp >= 100) stats.r100++;
-            }
-        }
-
-
-    }
-
     // Print parses data
-    mvwprintw(ui->win, 3,  3,  "Dialogs: %d", stats.dtotal);
-    mvwprintw(ui->win, 4,  3,  "Calls: %d (%.1f%%)", stats.dcalls, (float) stats.dcalls * 100 / stats.dtotal);
-    mvwprintw(ui->win, 5,  3,  "Messages: %d", stats.mtotal);
+    mvwprintw(ui->win, 3,  3,  "Dialogs: %d", dtotal);
+    mvwprintw(ui->win, 4,  3,  "Calls: %d (%.1f%%)", stats->calls, (float) stats->calls * 100 / dtotal);
+    mvwprintw(ui->win, 5,  3,  "Messages: %d", stats->messages);
     // Print status of calls if any
-    if (stats.dcalls) {
-        mvwprintw(ui->win, 3,  33, "COMPLETED:  %d (%.1f%%)", stats.completed, (float) stats.completed * 100 / stats.dcalls);
-        mvwprintw(ui->win, 4,  33, "CANCELLED:  %d (%.1f%%)", stats.cancelled, (float) stats.cancelled * 100 / stats.dcalls);
-        mvwprintw(ui->win, 5,  33, "IN CALL:    %d (%.1f%%)", stats.incall,    (float) stats.incall * 100 / stats.dcalls);
-        mvwprintw(ui->win, 6,  33, "REJECTED:   %d (%.1f%%)", stats.rejected,  (float) stats.rejected * 100 / stats.dcalls);
-        mvwprintw(ui->win, 7,  33, "BUSY:       %d (%.1f%%)", stats.busy,      (float) stats.busy * 100 / stats.dcalls);
-        mvwprintw(ui->win, 8,  33, "DIVERTED:   %d (%.1f%%)", stats.diverted,  (float) stats.diverted * 100 / stats.dcalls);
-        mvwprintw(ui->win, 9,  33, "CALL SETUP: %d (%.1f%%)", stats.setup,     (float) stats.setup * 100 / stats.dcalls);
+    if (stats->calls) {
+        stats_print_state(ui, 3, "COMPLETED:  ", SIP_CALLSTATE_COMPLETED);
+        stats_print_state(ui, 4, "CANCELLED:  ", SIP_CALLSTATE_CANCELLED);
+        stats_print_state(ui, 5, "IN CALL:    ", SIP_CALLSTATE_INCALL);
+        stats_print_state(ui, 6, "REJECTED:   ", SIP_CALLSTATE_REJECTED);
+        stats_print_state(ui, 7, "BUSY:       ", SIP_CALLSTATE_BUSY);
+        stats_print_state(ui, 8, "DIVERTED:   ", SIP_CALLSTATE_DIVERTED);
+        stats_print_state(ui, 9, "CALL SETUP: ", SIP_CALLSTATE_CALLSETUP);
+    }
+
+    stats_print_method(ui, 11, "INVITE:    ", SIP_METHOD_INVITE);
+    stats_print_method(ui, 12, "REGISTER:  ", SIP_METHOD_REGISTER);
+    stats_print_method(ui, 13, "SUBSCRIBE: ", SIP_METHOD_SUBSCRIBE);
+    stats_print_method(ui, 14, "UPDATE:    ", SIP_METHOD_UPDATE);
+    stats_print_method(ui, 15, "NOTIFY:    ", SIP_METHOD_NOTIFY);
+    stats_print_method(ui, 16, "OPTIONS:   ", SIP_METHOD_OPTIONS);
+    stats_print_method(ui, 17, "PUBLISH:   ", SIP_METHOD_PUBLISH);
+    stats_print_method(ui, 18, "MESSAGE:   ", SIP_METHOD_MESSAGE);
+    stats_print_method(ui, 19, "INFO:      ", SIP_METHOD_INFO);
+    stats_print_method(ui, 20, "BYE:       ", SIP_METHOD_BYE);
+    stats_print_method(ui, 21, "CANCEL:    ", SIP_METHOD_CANCEL);
+
+    for (class = 1; class <= 8; class++) {
+        count = sip_counters_responses(stats, class);
+        mvwprintw(ui->win, 10 + class, 33, "%dXX: %d (%.1f%%)", class, count, (float) count * 100 / stats->messages);
     }
 
-    mvwprintw(ui->win, 11, 3, "INVITE:    %d (%.1f%%)", stats.invite,    (float) stats.invite * 100 / stats.mtotal);
-    mvwprintw(ui->win, 12, 3, "REGISTER:  %d (%.1f%%)", stats.regist,    (float) stats.regist * 100 / stats.mtotal);
-    mvwprintw(ui->win, 13, 3, "SUBSCRIBE: %d (%.1f%%)", stats.subscribe, (float) stats.subscribe * 100 / stats.mtotal);
-    mvwprintw(ui->win, 14, 3, "UPDATE:    %d (%.1f%%)", stats.update,    (float) stats.update * 100 / stats.mtotal);
-    mvwprintw(ui->win, 15, 3, "NOTIFY:    %d (%.1f%%)", stats.notify,    (float) stats.notify * 100 / stats.mtotal);
-    mvwprintw(ui->win, 16, 3, "OPTIONS:   %d (%.1f%%)", stats.options,   (float) stats.options * 100 / stats.mtotal);
-    mvwprintw(ui->win, 17, 3, "PUBLISH:   %d (%.1f%%)", stats.publish,   (float) stats.publish * 100 / stats.mtotal);
-    mvwprintw(ui->win, 18, 3, "MESSAGE:   %d (%.1f%%)", stats.message,   (float) stats.message * 100 / stats.mtotal);
-    mvwprintw(ui->win, 19, 3, "INFO:      %d (%.1f%%)", stats.info,      (float) stats.info * 100 / stats.mtotal);
-    mvwprintw(ui->win, 20, 3, "BYE:       %d (%.1f%%)", stats.bye,       (float) stats.bye * 100 / stats.mtotal);
-    mvwprintw(ui->win, 21, 3, "CANCEL:    %d (%.1f%%)", stats.cancel,    (float) stats.cancel * 100 / stats.mtotal);
+    // Print call setup times
+    stats_print_times(ui, 23, "Setup time: ", &stats->setup);
+    stats_print_times(ui, 24, "Post dial:  ", &stats->pdd);
 
-    mvwprintw(ui->win, 11, 33, "1XX: %d (%.1f%%)", stats.r100, (float) stats.r100 * 100 / stats.mtotal);
-    mvwprintw(ui->win, 12, 33, "2XX: %d (%.1f%%)", stats.r200, (float) stats.r200 * 100 / stats.mtotal);
-    mvwprintw(ui->win, 13, 33, "3XX: %d (%.1f%%)", stats.r300, (float) stats.r300 * 100 / stats.mtotal);
-    mvwprintw(ui->win, 14, 33, "4XX: %d (%.1f%%)", stats.r400, (float) stats.r400 * 100 / stats.mtotal);
-    mvwprintw(ui->win, 15, 33, "5XX: %d (%.1f%%)", stats.r500, (float) stats.r500 * 100 / stats.mtotal);
-    mvwprintw(ui->win, 16, 33, "6XX: %d (%.1f%%)", stats.r600, (float) stats.r600 * 100 / stats.mtotal);
-    mvwprintw(ui->win, 17, 33, "7XX: %d (%.1f%%)", stats.r700, (float) stats.r700 * 100 / stats.mtotal);
-    mvwprintw(ui->win, 18, 33, "8XX: %d (%.1f%%)", stats.r800, (float) stats.r800 * 100 / stats.mtotal);
+    // Print messages transport
+    mvwprintw(ui->win, 25, 3, "UDP: %d  TCP: %d  TLS: %d  WS: %d  WSS: %d",
+              stats->transports[PACKET_SIP_UDP], stats->transports[PACKET_SIP_TCP],
+              stats->transports[PACKET_SIP_TLS], stats->transports[PACKET_SIP_WS],
+              stats->transports[PACKET_SIP_WSS]);
 }
@@ -0,0 +1,165 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file dedup.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in dedup.h
+ *
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include "dedup.h"
+
+//! Mask of the time stored in a slot
+#define DEDUP_TIME_MASK         ((1ULL << DEDUP_TIME_BITS) - 1)
+
+/**
+ * @brief Duplicated packets ring
+ */
+struct dedup_ring {
+    //! Ring slots: hash in high bits, time in low bits, 0 if empty
+    uint64_t *slots;
+    //! Milliseconds between two equal packets to be duplicates
+    uint64_t window;
+};
+
+//! Duplicated packets ring
+static struct dedup_ring dedup = { 0 };
+
+int
+dedup_init(int window)
+{
+    if (window <= 0)
+        return 0;
+
+    // Buckets are aligned to cache lines
+    if (posix_memalign((void **) &dedup.slots, 64, DEDUP_RING_SIZE * sizeof(uint64_t)) != 0) {
+        dedup.slots = NULL;
+        return 1;
+    }
+
+    memset(dedup.slots, 0, DEDUP_RING_SIZE * sizeof(uint64_t));
+    dedup.window = window;
+    return 0;
+}
+
+void
+dedup_deinit()
+{
+    free(dedup.slots);
+    dedup.slots = NULL;
+}
+
+bool
+dedup_enabled()
+{
+    return dedup.slots != NULL;
+}
+
+/**
+ * @brief Add data to a packet hash, a word at a time
+ */
+static uint64_t
+dedup_hash(uint64_t hash, const void *data, size_t len)
+{
+    const u_char *bytes = data;
+    uint64_t word;
+
+    for (; len >= sizeof(word); bytes += sizeof(word), len -= sizeof(word)) {
+        memcpy(&word, bytes, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ULL;
+        hash ^= hash >> 29;
+    }
+
+    for (word = len; len > 0; len--)
+        word = (word << 8) | bytes[len - 1];
+
+    return (hash ^ word) * 1099511628211ULL;
+}
+
+/**
+ * @brief Milliseconds between two slot times, in any order
+ */
+static uint64_t
+dedup_age(uint64_t now, uint64_t slot)
+{
+    uint64_t age = (now - slot) & DEDUP_TIME_MASK;
+
+    // Packets from other sources can be older than the stored one
+    if (age > (DEDUP_TIME_MASK >> 1))
+        age = (DEDUP_TIME_MASK + 1) - age;
+    return age;
+}
+
+bool
+dedup_check(packet_t *packet)
+{
+    struct timeval ts = packet_time(packet);
+    uint64_t hash, now, entry, slot, victim_slot, age, victim_age;
+    uint64_t *bucket, *victim;
+    int i;
+
+    // Hash everything that is equal in both copies of the packet
+    hash = dedup_hash(14695981039346656037ULL, &packet->ip_id, sizeof(packet->ip_id));
+    hash = dedup_hash(hash, &packet->proto, sizeof(packet->proto));
+    hash = dedup_hash(hash, packet->src.ip, strlen(packet->src.ip));
+    hash = dedup_hash(hash, &packet->src.port, sizeof(packet->src.port));
+    hash = dedup_hash(hash, packet->dst.ip, strlen(packet->dst.ip));
+    hash = dedup_hash(hash, &packet->dst.port, sizeof(packet->dst.port));
+    hash = dedup_hash(hash, packet->payload, packet->payload_len);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+
+    // Low bits select the bucket, high bits are stored in the slot
+    bucket = dedup.slots + (hash & (DEDUP_RING_SIZE - DEDUP_BUCKET_SIZE));
+    now = ((uint64_t) ts.tv_sec * 1000 + ts.tv_usec / 1000) & DEDUP_TIME_MASK;
+    entry = (hash & ~DEDUP_TIME_MASK) | now;
+    if (!entry)
+        entry = 1;
+
+    for (;;) {
+        victim = NULL;
+        victim_slot = victim_age = 0;
+
+        for (i = 0; i < DEDUP_BUCKET_SIZE; i++) {
+            slot = __atomic_load_n(&bucket[i], __ATOMIC_ACQUIRE);
+            age = (slot) ? dedup_age(now, slot & DEDUP_TIME_MASK) : DEDUP_TIME_MASK;
+
+            if (slot && (slot & ~DEDUP_TIME_MASK) == (entry & ~DEDUP_TIME_MASK) && age <= dedup.window)
+                return true;
+
+            // Replace the empty or oldest slot
+            if (!victim || age > victim_age) {
+                victim = &bucket[i];
+                victim_slot = slot;
+                victim_age = age;
+            }
+        }
+
+        // If the bucket changed meanwhile, check again: it may contain this packet
+        if (__atomic_compare_exchange_n(victim, &victim_slot, entry, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return false;
+    }
+}
@@ -0,0 +1,90 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file dedup.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to discard duplicated packets
+ *
+ * When capturing from several interfaces (for example, both sides of a
+ * port mirror) or receiving HEP from several proxies, the same packet can
+ * be received more than once. Duplicates are discarded before being parsed
+ * so they are not stored nor reported as retransmissions.
+ *
+ * Received packets are identified by a hash of their IP id, addresses,
+ * ports and payload. Hashes are stored along with the packet time in a
+ * fixed size ring of slots, grouped in buckets that fit a cache line.
+ * A packet is a duplicate if its bucket contains the same hash with a time
+ * inside the configured window. Otherwise, it replaces the oldest slot of
+ * the bucket.
+ *
+ * Slots are updated with atomic compare and swap, so capture threads can
+ * check packets concurrently without locking.
+ *
+ */
+#ifndef __SNGREP_DEDUP_H
+#define __SNGREP_DEDUP_H
+
+#include "config.h"
+#include <stdbool.h>
+#include "packet.h"
+
+//! Number of slots of the packets ring (power of two)
+#define DEDUP_RING_SIZE         65536
+//! Slots in each bucket
+#define DEDUP_BUCKET_SIZE       8
+//! Bits of the slot used to store packet time in milliseconds
+#define DEDUP_TIME_BITS         24
+
+/**
+ * @brief Start discarding duplicated packets
+ *
+ * @param window Milliseconds between two equal packets to be duplicates
+ * @return 0 if ring has been allocated, 1 otherwise
+ */
+int
+dedup_init(int window);
+
+/**
+ * @brief Free ring memory
+ */
+void
+dedup_deinit();
+
+/**
+ * @brief Check if duplicated packets are being discarded
+ */
+bool
+dedup_enabled();
+
+/**
+ * @brief Check if a packet has already been received
+ *
+ * Packets that are not duplicates are added to the ring.
+ *
+ * @param packet Decoded packet, before being parsed
+ * @return true if an equal packet was received inside the window
+ */
+bool
+dedup_check(packet_t *packet);
+
+#endif /* __SNGREP_DEDUP_H */
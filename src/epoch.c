@@ -0,0 +1,310 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file epoch.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in epoch.h
+ *
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#endif
+#include "epoch.h"
+#include "metrics.h"
+
+/**
+ * @brief Epoch reclamation status
+ */
+struct epoch_status {
+    //! Global epoch counter
+    uint64_t epoch;
+    //! Registered reader threads
+    epoch_reader_t *readers;
+    //! Retired objects of last epochs
+    epoch_retired_t *retired[EPOCH_LISTS];
+    //! Number of retired objects pending to be released
+    int pending;
+    //! Reclaimer thread
+    pthread_t thread;
+    //! Reclaimer thread is running
+    bool running;
+    //! Wakes up the reclaimer thread
+    pthread_cond_t cond;
+    //! Lock for readers and retired lists
+    pthread_mutex_t lock;
+};
+
+//! Epoch reclamation status
+static struct epoch_status epochs = {
+    .cond = PTHREAD_COND_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+//! Current thread reader
+static __thread epoch_reader_t *epoch_local = NULL;
+
+static epoch_reader_t *
+epoch_reader_create()
+{
+    epoch_reader_t *reader;
+
+    if (!(reader = malloc(sizeof(epoch_reader_t))))
+        return NULL;
+    memset(reader, 0, sizeof(epoch_reader_t));
+
+    pthread_mutex_lock(&epochs.lock);
+    reader->next = epochs.readers;
+    epochs.readers = reader;
+    pthread_mutex_unlock(&epochs.lock);
+
+    return reader;
+}
+
+void
+epoch_enter()
+{
+    epoch_reader_t *reader = epoch_local;
+
+    if (!reader && !(reader = epoch_local = epoch_reader_create()))
+        return;
+
+    if (reader->nested++ > 0)
+        return;
+
+    // Announce the read section before checking the epoch, so no thread
+    // can advance it twice without seeing this reader
+    __atomic_store_n(&reader->active, true, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&reader->epoch, __atomic_load_n(&epochs.epoch, __ATOMIC_SEQ_CST),
+                     __ATOMIC_SEQ_CST);
+}
+
+void
+epoch_leave()
+{
+    epoch_reader_t *reader = epoch_local;
+
+    if (!reader || reader->nested == 0)
+        return;
+
+    if (--reader->nested == 0)
+        __atomic_store_n(&reader->active, false, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Check if any registered thread is inside a read section
+ *
+ * @note This function must be called with epochs lock held
+ */
+static bool
+epoch_readers_active()
+{
+    epoch_reader_t *reader;
+
+    for (reader = epochs.readers; reader; reader = reader->next) {
+        if (__atomic_load_n(&reader->active, __ATOMIC_SEQ_CST))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Release all objects in a retired objects list
+ */
+static void
+epoch_release(epoch_retired_t *retired)
+{
+    epoch_retired_t *next;
+
+    for (; retired; retired = next) {
+        next = retired->next;
+        retired->destroyer(retired->item);
+        metrics_add(METRIC_RECLAIM_BYTES, -(int64_t) retired->size);
+        free(retired);
+        __atomic_sub_fetch(&epochs.pending, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Detach retired objects that are no longer reachable
+ *
+ * Tries to advance the global epoch and returns the objects retired
+ * in the oldest epoch, or all of them if there are no readers.
+ *
+ * @note This function must be called with epochs lock held
+ */
+static epoch_retired_t *
+epoch_collect()
+{
+    epoch_reader_t *reader;
+    epoch_retired_t *retired = NULL, *last;
+    uint64_t epoch = epochs.epoch;
+    int i;
+
+    // Nobody is reading, all retired objects are unreachable
+    if (!epoch_readers_active()) {
+        for (i = 0; i < EPOCH_LISTS; i++) {
+            if (!(last = epochs.retired[i]))
+                continue;
+            while (last->next)
+                last = last->next;
+            last->next = retired;
+            retired = epochs.retired[i];
+            epochs.retired[i] = NULL;
+        }
+        return retired;
+    }
+
+    // Epoch can only advance when all readers have seen the current one
+    for (reader = epochs.readers; reader; reader = reader->next) {
+        if (__atomic_load_n(&reader->active, __ATOMIC_SEQ_CST)
+            && __atomic_load_n(&reader->epoch, __ATOMIC_SEQ_CST) != epoch)
+            return NULL;
+    }
+    __atomic_store_n(&epochs.epoch, ++epoch, __ATOMIC_SEQ_CST);
+
+    // Reuse the oldest list, no reader can reach its objects anymore
+    retired = epochs.retired[epoch % EPOCH_LISTS];
+    epochs.retired[epoch % EPOCH_LISTS] = NULL;
+    return retired;
+}
+
+/**
+ * @brief Release retired objects in background
+ */
+static void *
+epoch_reclaimer(void *arg)
+{
+    epoch_retired_t *retired;
+    struct timespec wait;
+
+#ifdef __linux__
+    // Releasing memory is less urgent than capturing or drawing
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 10);
+#endif
+
+    pthread_mutex_lock(&epochs.lock);
+    while (epochs.running) {
+        if (!__atomic_load_n(&epochs.pending, __ATOMIC_RELAXED)) {
+            // Wait until something is retired
+            pthread_cond_wait(&epochs.cond, &epochs.lock);
+        } else {
+            // Give readers some time to leave their sections
+            clock_gettime(CLOCK_REALTIME, &wait);
+            wait.tv_nsec += EPOCH_RECLAIM_MSECS * 1000000L;
+            if (wait.tv_nsec >= 1000000000L) {
+                wait.tv_sec++;
+                wait.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&epochs.cond, &epochs.lock, &wait);
+        }
+
+        // Release objects without blocking readers or retiring threads
+        if ((retired = epoch_collect())) {
+            pthread_mutex_unlock(&epochs.lock);
+            epoch_release(retired);
+            pthread_mutex_lock(&epochs.lock);
+        }
+    }
+    pthread_mutex_unlock(&epochs.lock);
+
+    return NULL;
+}
+
+int
+epoch_init()
+{
+    pthread_mutex_lock(&epochs.lock);
+    epochs.running = true;
+    if (pthread_create(&epochs.thread, NULL, epoch_reclaimer, NULL) != 0)
+        epochs.running = false;
+    pthread_mutex_unlock(&epochs.lock);
+
+    return epochs.running ? 0 : 1;
+}
+
+void
+epoch_retire(void *item, void (*destroyer)(void *item), size_t size)
+{
+    epoch_retired_t *retired;
+
+    if (!item)
+        return;
+
+    // Object must be unreachable before checking the readers
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&epochs.lock);
+
+    // Without reclaimer thread, release the object now if nobody can be
+    // reading it
+    if ((!epochs.running && !epoch_readers_active())
+        || !(retired = malloc(sizeof(epoch_retired_t)))) {
+        pthread_mutex_unlock(&epochs.lock);
+        destroyer(item);
+        return;
+    }
+
+    retired->item = item;
+    retired->destroyer = destroyer;
+    retired->size = size;
+    retired->next = epochs.retired[epochs.epoch % EPOCH_LISTS];
+    epochs.retired[epochs.epoch % EPOCH_LISTS] = retired;
+    metrics_add(METRIC_RECLAIM_BYTES, size);
+
+    // Wake up the reclaimer if it was idle
+    if (__atomic_add_fetch(&epochs.pending, 1, __ATOMIC_RELAXED) == 1)
+        pthread_cond_signal(&epochs.cond);
+
+    pthread_mutex_unlock(&epochs.lock);
+}
+
+void
+epoch_deinit()
+{
+    epoch_retired_t *retired[EPOCH_LISTS];
+    bool running;
+    int i;
+
+    // Stop the reclaimer thread
+    pthread_mutex_lock(&epochs.lock);
+    running = epochs.running;
+    epochs.running = false;
+    pthread_cond_signal(&epochs.cond);
+    pthread_mutex_unlock(&epochs.lock);
+    if (running)
+        pthread_join(epochs.thread, NULL);
+
+    pthread_mutex_lock(&epochs.lock);
+    memcpy(retired, epochs.retired, sizeof(retired));
+    memset(epochs.retired, 0, sizeof(epochs.retired));
+    pthread_mutex_unlock(&epochs.lock);
+
+    for (i = 0; i < EPOCH_LISTS; i++)
+        epoch_release(retired[i]);
+}
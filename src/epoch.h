@@ -0,0 +1,137 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file epoch.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to defer memory release until no thread can use it
+ *
+ * Threads reading captured data without holding the capture lock do it
+ * inside a read section. Objects removed while some thread could still be
+ * reading them are retired instead of being freed, and they are released
+ * once every thread that was inside a read section has left it.
+ *
+ * Read sections and retired objects are tracked using a global epoch
+ * counter. The epoch can only advance when all threads inside a read
+ * section have seen the current epoch, so objects retired in older epochs
+ * are no longer reachable by any reader.
+ *
+ * Retired objects are released by a low priority reclaimer thread, so
+ * removing large amounts of captured data doesn't stall the capture nor
+ * the interface threads.
+ *
+ */
+#ifndef __SNGREP_EPOCH_H
+#define __SNGREP_EPOCH_H
+
+#include "config.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+//! Number of retired objects lists (current and two previous epochs)
+#define EPOCH_LISTS         3
+//! Reclaimer thread interval while there are retired objects
+#define EPOCH_RECLAIM_MSECS 10
+
+//! Shorter declaration of epoch_reader structure
+typedef struct epoch_reader epoch_reader_t;
+//! Shorter declaration of epoch_retired structure
+typedef struct epoch_retired epoch_retired_t;
+
+/**
+ * @brief Thread reading data protected by epochs
+ */
+struct epoch_reader {
+    //! Epoch when the thread entered its read section
+    uint64_t epoch;
+    //! Thread is inside a read section
+    bool active;
+    //! Nested read sections count
+    int nested;
+    //! Next registered reader
+    epoch_reader_t *next;
+};
+
+/**
+ * @brief Object waiting to be released
+ */
+struct epoch_retired {
+    //! Retired object
+    void *item;
+    //! Function to release the object
+    void (*destroyer)(void *item);
+    //! Memory released with the object
+    size_t size;
+    //! Next retired object in the same list
+    epoch_retired_t *next;
+};
+
+/**
+ * @brief Start the reclaimer thread
+ *
+ * Until this is called, retired objects are released by the thread
+ * retiring them when there are no readers.
+ *
+ * @return 0 if the thread has been started, 1 otherwise
+ */
+int
+epoch_init();
+
+/**
+ * @brief Enter a read section
+ *
+ * Objects retired after this point will not be released until the
+ * calling thread leaves the section. Read sections can be nested.
+ */
+void
+epoch_enter();
+
+/**
+ * @brief Leave a read section
+ */
+void
+epoch_leave();
+
+/**
+ * @brief Release an object once no reader can be using it
+ *
+ * The object must no longer be reachable from shared data. It will be
+ * released by the reclaimer thread or, if it's not running and there
+ * are no threads reading, immediately.
+ *
+ * @param item Object to release
+ * @param destroyer Function to release the object
+ * @param size Memory released with the object, for metrics
+ */
+void
+epoch_retire(void *item, void (*destroyer)(void *item), size_t size);
+
+/**
+ * @brief Stop the reclaimer thread and release all retired objects
+ *
+ * Must only be called when no other thread is reading, like on exit.
+ */
+void
+epoch_deinit();
+
+#endif /* __SNGREP_EPOCH_H */
@@ -29,80 +29,75 @@
 #include <stdlib.h>
 #include <string.h>
 #include "sip.h"
+#include "capture.h"
 #include "curses/ui_call_list.h"
 #include "filter.h"
 
 //! Storage of filter information
 filter_t filters[FILTER_COUNT] = { };
 
+/**
+ * @brief Find dialogs that may match a filter in the dialogs index
+ */
+static void
+filter_find_candidates(int type)
+{
+    filter_t *filter = &filters[type];
+    const regexp_t *regex = (filter->network) ? NULL : &filter->regex;
+
+    sip_index_set_free(filter->candidates);
+    filter->candidates = NULL;
+
+    if (!filter->expr || !sip_index_enabled())
+        return;
+
+    switch (type) {
+        case FILTER_SIPFROM:
+            filter->candidates = sip_index_find_text(SIP_INDEX_FROM, &filter->search);
+            break;
+        case FILTER_SIPTO:
+            filter->candidates = sip_index_find_text(SIP_INDEX_TO, &filter->search);
+            break;
+        case FILTER_SOURCE:
+            filter->candidates = sip_index_find_address(SIP_INDEX_SRC, regex, &filter->prefix);
+            break;
+        case FILTER_DESTINATION:
+            filter->candidates = sip_index_find_address(SIP_INDEX_DST, regex, &filter->prefix);
+            break;
+        default:
+            break;
+    }
+}
+
 int
 filter_set(int type, const char *expr)
 {
-#ifdef WITH_PCRE
-    pcre *regex = NULL;
+    regexp_t regex;
 
     // If we have an expression, check if compiles before changing the filter
-    if (expr) {
-        const char *re_err = NULL;
-        int32_t err_offset;
-        int32_t pcre_options = PCRE_UNGREEDY | PCRE_CASELESS;
-
-        // Check if we have a valid expression
-        if (!(regex = pcre_compile(expr, pcre_options, &re_err, &err_offset, 0)))
-            return 1;
-    }
+    if (expr && regexp_compile(&regex, expr, REGEXP_CASELESS) != 0)
+        return 1;
 
     // Remove previous value
     if (filters[type].expr) {
         sng_free(filters[type].expr);
-        pcre_free(filters[type].regex);
+        regexp_free(&filters[type].regex);
     }
 
     // Set new expresion values
     filters[type].expr = (expr) ? strdup(expr) : NULL;
-    filters[type].regex = regex;
-#elif defined(WITH_PCRE2)
-    pcre2_code *regex = NULL;
+    if (expr)
+        memcpy(&filters[type].regex, &regex, sizeof(regex));
 
-    // If we have an expression, check if compiles before changing the filter
-    if (expr) {
-        int re_err = 0;
-        PCRE2_SIZE err_offset = 0;
-        uint32_t pcre_options = PCRE2_UNGREEDY | PCRE2_CASELESS;
-
-        // Check if we have a valid expression
-        if (!(regex = pcre2_compile((PCRE2_SPTR) expr, PCRE2_ZERO_TERMINATED, pcre_options, &re_err, &err_offset, NULL)))
-            return 1;
-    }
+    // Extract literal text to skip data that can not match
+    search_compile(&filters[type].search, expr, true);
 
-    // Remove previous value
-    if (filters[type].expr) {
-        sng_free(filters[type].expr);
-        pcre2_code_free(filters[type].regex);
-    }
+    // Address filters can be network prefixes
+    filters[type].network = (type == FILTER_SOURCE || type == FILTER_DESTINATION)
+        && expr && strchr(expr, '/') && address_prefix_from_str(expr, &filters[type].prefix) == 0;
 
-    // Set new expresion values
-    filters[type].expr = (expr) ? strdup(expr) : NULL;
-    filters[type].regex = regex;
-#else
-    regex_t regex;
-    // If we have an expression, check if compiles before changing the filter
-    if (expr) {
-        // Check if we have a valid expression
-        if (regcomp(&regex, expr, REG_EXTENDED | REG_ICASE) != 0)
-            return 1;
-    }
-
-    // Remove previous value
-    if (filters[type].expr) {
-        sng_free(filters[type].expr);
-        regfree(&filters[type].regex);
-    }
-
-    // Set new expresion values
-    filters[type].expr = (expr) ? strdup(expr) : NULL;
-    memcpy(&filters[type].regex, &regex, sizeof(regex));
-#endif
+    // Find dialogs that may match this filter
+    filter_find_candidates(type);
 
     return 0;
 }
@@ -118,8 +113,10 @@ filter_check_call(void *item)
 {
     int i;
     char data[MAX_SIP_PAYLOAD];
+    const char *payload;
     sip_call_t *call = (sip_call_t*) item;
     sip_msg_t *msg;
+    address_t addr;
     vector_iter_t it;
 
     // Dont filter calls without messages
@@ -139,6 +136,12 @@ filter_check_call(void *item)
         if (!filters[i].expr)
             continue;
 
+        // Dialogs not found in the index can not match the filter
+        if (filters[i].candidates && !sip_index_set_contains(filters[i].candidates, call->index)) {
+            call->filtered = 1;
+            break;
+        }
+
         // Initialize
         memset(data, 0, sizeof(data));
 
@@ -174,22 +177,31 @@ filter_check_call(void *item)
         if (i == FILTER_PAYLOAD) {
             // Assume this call doesn't match the filter
             call->filtered = 1;
+            // Payloads can not be read while packets are being parsed
+            capture_lock();
             // Create an iterator for the call messages
             it = vector_iterator(call->msgs);
             while ((msg = vector_iterator_next(&it))) {
-                // Copy message payload
-                sng_strncpy(data, msg_get_payload(msg), sizeof(data));
-                // Check if this payload matches the filter
-                if (filter_check_expr(filters[i], data) == 0) {
+                // Check if this payload matches the filter, without copying it
+                if ((payload = msg_get_payload(msg)) && filter_check_expr(&filters[i], payload) == 0) {
                     call->filtered = 0;
                     break;
                 }
             }
+            capture_unlock();
             if (call->filtered == 1)
                 break;
+        } else if (filters[i].network) {
+            // Check the first message address against the network prefix
+            msg = vector_first(call->msgs);
+            addr = (i == FILTER_SOURCE) ? msg->packet->src : msg->packet->dst;
+            if (!address_in_prefix(addr, &filters[i].prefix)) {
+                call->filtered = 1;
+                break;
+            }
         } else {
             // Check the filter against given data
-            if (filter_check_expr(filters[i], data) != 0) {
+            if (filter_check_expr(&filters[i], data) != 0) {
                 // The data didn't matched the filter
                 call->filtered = 1;
                 break;
@@ -202,19 +214,16 @@ filter_check_call(void *item)
 }
 
 int
-filter_check_expr(filter_t filter, const char *data)
+filter_check_expr(filter_t *filter, const char *data)
 {
-#ifdef WITH_PCRE
-        return pcre_exec(filter.regex, 0, data, strlen(data), 0, 0, 0, 0);
-#elif defined(WITH_PCRE2)
-    pcre2_match_data *match_data = pcre2_match_data_create_from_pattern(filter.regex, NULL);
-    int ret = pcre2_match(filter.regex, (PCRE2_SPTR) data, (PCRE2_SIZE) strlen(data), 0, 0, match_data, NULL);
-    pcre2_match_data_free(match_data);
-    return (ret == PCRE2_ERROR_NOMATCH) ? 1 : 0;
-#else
-        // Call doesn't match this filter
-        return regexec(&filter.regex, data, 0, NULL, 0);
-#endif
+    size_t len = strlen(data);
+
+    // Data without any required literal can not match
+    if (!search_candidate(&filter->search, data, len))
+        return 1;
+
+    // Check if data matches the filter expression
+    return (regexp_match(&filter->regex, data, len)) ? 0 : 1;
 }
 
 void
@@ -222,6 +231,11 @@ filter_reset_calls()
 {
     sip_call_t *call;
     vector_iter_t calls = sip_calls_iterator();
+    int i;
+
+    // Find again dialogs that may match, including the new ones
+    for (i = 0; i < FILTER_COUNT; i++)
+        filter_find_candidates(i);
 
     // Force filter evaluation
     while ((call = vector_iterator_next(&calls)))
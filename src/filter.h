@@ -35,20 +35,20 @@
  * set at the same time. In order to be valid, a call MUST match all the
  * enabled filters to be shown.
  *
+ * Source and destination filters can also be given as network prefixes
+ * (IP/BITS). When dialogs index is enabled, filters on indexed attributes
+ * only check the dialogs found in the index.
+ *
  */
 
 #ifndef __SNGREP_FILTER_H_
 #define __SNGREP_FILTER_H_
 
 #include "config.h"
-#ifdef WITH_PCRE
-#include <pcre.h>
-#elif defined(WITH_PCRE2)
-#include <pcre2.h>
-#else
-#include <regex.h>
-#endif
 #include "sip.h"
+#include "regexp.h"
+#include "search.h"
+#include "sip_index.h"
 
 //! Shorter declaration of sip_call_group structure
 typedef struct filter filter_t;
@@ -81,16 +81,16 @@ enum filter_type {
 struct filter {
     //! The filter text
     char *expr;
-#ifdef WITH_PCRE
-    //! The filter compiled expression
-    pcre *regex;
-#elif defined(WITH_PCRE2)
     //! The filter compiled expression
-    pcre2_code *regex;
-#else
-    //! The filter compiled expression
-    regex_t regex;
-#endif
+    regexp_t regex;
+    //! Literals required to match the expression
+    search_t search;
+    //! Address filter is a network prefix instead of an expression
+    bool network;
+    //! Network prefix of address filters
+    address_prefix_t prefix;
+    //! Dialogs found in the index that may match the filter
+    sip_index_set_t *candidates;
 };
 
 /**
@@ -128,10 +128,13 @@ filter_check_call(void *item);
 /**
  * @brief Check if data matches the filter regexp
  *
+ * The regexp is only run if data contains any of the literals extracted
+ * from the filter expression.
+ *
  * @return 0 if the given data matches the filter
  */
 int
-filter_check_expr(filter_t filter, const char *data);
+filter_check_expr(filter_t *filter, const char *data);
 
 /**
  * @brief Reset filtered flag in all calls
@@ -49,7 +49,7 @@ typedef struct sip_call_group sip_call_group_t;
  */
 struct sip_call_group {
     //! For extended display, main call-id
-    char *callid;
+    const char *callid;
     //! Calls array in the group
     vector_t *calls;
     //! Messages from calls in the group
@@ -0,0 +1,102 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file histogram.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in histogram.h
+ *
+ */
+#include "config.h"
+#include "histogram.h"
+
+uint64_t
+histogram_bucket_value(int bucket)
+{
+    int exp, sub;
+
+    if (bucket < HISTOGRAM_LINEAR)
+        return bucket;
+
+    exp = (bucket - HISTOGRAM_LINEAR) / HISTOGRAM_SUBBUCKETS + 4;
+    sub = (bucket - HISTOGRAM_LINEAR) % HISTOGRAM_SUBBUCKETS;
+    // Middle point of the bucket
+    return ((uint64_t) (HISTOGRAM_SUBBUCKETS + sub) << (exp - 3))
+           + ((uint64_t) 1 << (exp - 4));
+}
+
+uint64_t
+histogram_percentile_buckets(const uint64_t *buckets, uint64_t count, double percent)
+{
+    uint64_t seen = 0;
+    int i;
+
+    if (!count)
+        return 0;
+
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += buckets[i];
+        if (buckets[i] && seen * 100.0 >= count * percent)
+            return histogram_bucket_value(i);
+    }
+
+    return 0;
+}
+
+void
+histogram_add(histogram_t *histogram, uint64_t value)
+{
+    histogram->count++;
+    histogram->sum += value;
+    histogram->buckets[histogram_bucket(value)]++;
+}
+
+void
+histogram_remove(histogram_t *histogram, uint64_t value)
+{
+    int bucket = histogram_bucket(value);
+
+    // Ignore values never added
+    if (!histogram->buckets[bucket])
+        return;
+
+    histogram->count--;
+    histogram->sum -= value;
+    histogram->buckets[bucket]--;
+}
+
+void
+histogram_merge(histogram_t *histogram, const histogram_t *other)
+{
+    int i;
+
+    histogram->count += other->count;
+    histogram->sum += other->sum;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+        histogram->buckets[i] += other->buckets[i];
+}
+
+uint64_t
+histogram_percentile(const histogram_t *histogram, double percent)
+{
+    return histogram_percentile_buckets(histogram->buckets, histogram->count, percent);
+}
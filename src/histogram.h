@@ -0,0 +1,123 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file histogram.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to estimate percentiles of a stream of values
+ *
+ * Histogram buckets are log-linear: values below 16 have their own bucket,
+ * bigger values are stored in 8 sub-buckets per power of two, so any value
+ * is reported with less than 12.5% error using a fixed amount of memory.
+ *
+ * Unlike most quantile sketches, values can also be removed from the
+ * histogram, and histograms can be merged just adding their buckets.
+ *
+ */
+#ifndef __SNGREP_HISTOGRAM_H
+#define __SNGREP_HISTOGRAM_H
+
+#include "config.h"
+#include <stdint.h>
+
+//! Values with their own bucket
+#define HISTOGRAM_LINEAR      16
+//! Buckets per power of two
+#define HISTOGRAM_SUBBUCKETS  8
+//! Total number of buckets for 64 bit values
+#define HISTOGRAM_BUCKETS     (HISTOGRAM_LINEAR + (64 - 4) * HISTOGRAM_SUBBUCKETS)
+
+//! Shorter declaration of histogram structure
+typedef struct histogram histogram_t;
+
+/**
+ * @brief Distribution of a set of values
+ */
+struct histogram {
+    //! Number of values
+    uint64_t count;
+    //! Sum of all values
+    uint64_t sum;
+    //! Number of values per bucket
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+/**
+ * @brief Get the bucket index for the given value
+ */
+static inline int
+histogram_bucket(uint64_t value)
+{
+    int exp;
+
+    if (value < HISTOGRAM_LINEAR)
+        return (int) value;
+
+    exp = 63 - __builtin_clzll(value);
+    return HISTOGRAM_LINEAR + (exp - 4) * HISTOGRAM_SUBBUCKETS
+           + (int) ((value >> (exp - 3)) & (HISTOGRAM_SUBBUCKETS - 1));
+}
+
+/**
+ * @brief Get the value represented by a bucket
+ *
+ * @return Middle point of the values stored in the bucket
+ */
+uint64_t
+histogram_bucket_value(int bucket);
+
+/**
+ * @brief Get the value below which the given percent of values fall
+ *
+ * @param buckets Array of HISTOGRAM_BUCKETS counters
+ * @param count Number of values in the buckets
+ * @param percent Requested percentile (0-100)
+ * @return Estimated value or 0 if there are no values
+ */
+uint64_t
+histogram_percentile_buckets(const uint64_t *buckets, uint64_t count, double percent);
+
+/**
+ * @brief Add a value to the histogram
+ */
+void
+histogram_add(histogram_t *histogram, uint64_t value);
+
+/**
+ * @brief Remove a previously added value from the histogram
+ */
+void
+histogram_remove(histogram_t *histogram, uint64_t value);
+
+/**
+ * @brief Add all values of other histogram
+ */
+void
+histogram_merge(histogram_t *histogram, const histogram_t *other);
+
+/**
+ * @brief Get the value below which the given percent of values fall
+ */
+uint64_t
+histogram_percentile(const histogram_t *histogram, double percent);
+
+#endif /* __SNGREP_HISTOGRAM_H */
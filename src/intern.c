@@ -0,0 +1,193 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file intern.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in intern.h
+ *
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "intern.h"
+#include "metrics.h"
+
+/**
+ * @brief Interned strings table
+ */
+struct intern_table {
+    //! Table buckets
+    intern_entry_t **buckets;
+    //! Number of buckets (power of two)
+    uint32_t size;
+    //! Number of interned strings
+    uint32_t count;
+    //! Lock for table access from capture and interface threads
+    pthread_mutex_t lock;
+};
+
+//! Interned strings table
+static struct intern_table interned = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/**
+ * @brief Get the interned entry of a string
+ */
+static intern_entry_t *
+intern_entry(const char *str)
+{
+    return (intern_entry_t *) (str - offsetof(intern_entry_t, str));
+}
+
+/**
+ * @brief FNV-1a hash of the given string
+ */
+static uint32_t
+intern_hash(const char *str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char) str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Double the number of buckets of the table
+ *
+ * @return 0 if table has been resized, 1 otherwise
+ */
+static int
+intern_table_grow()
+{
+    intern_entry_t **buckets, *entry, *next;
+    uint32_t size, i;
+
+    size = (interned.size) ? interned.size * 2 : INTERN_INITIAL_SIZE;
+    if (!(buckets = calloc(size, sizeof(intern_entry_t *))))
+        return 1;
+
+    // Move existing entries to their new bucket
+    for (i = 0; i < interned.size; i++) {
+        for (entry = interned.buckets[i]; entry; entry = next) {
+            next = entry->next;
+            entry->next = buckets[entry->hash & (size - 1)];
+            buckets[entry->hash & (size - 1)] = entry;
+        }
+    }
+
+    free(interned.buckets);
+    interned.buckets = buckets;
+    interned.size = size;
+    return 0;
+}
+
+const char *
+intern_string(const char *str, size_t len)
+{
+    intern_entry_t *entry;
+    uint32_t hash;
+
+    hash = intern_hash(str, len);
+
+    pthread_mutex_lock(&interned.lock);
+
+    // Check if this string is already interned
+    if (interned.size) {
+        for (entry = interned.buckets[hash & (interned.size - 1)]; entry; entry = entry->next) {
+            if (entry->hash == hash && entry->len == len && !memcmp(entry->str, str, len)) {
+                entry->refs++;
+                pthread_mutex_unlock(&interned.lock);
+                return entry->str;
+            }
+        }
+    }
+
+    // Keep an average of one entry per bucket
+    if (interned.count >= interned.size && intern_table_grow() != 0 && !interned.size) {
+        pthread_mutex_unlock(&interned.lock);
+        return NULL;
+    }
+
+    if (!(entry = malloc(sizeof(intern_entry_t) + len + 1))) {
+        pthread_mutex_unlock(&interned.lock);
+        return NULL;
+    }
+
+    entry->hash = hash;
+    entry->len = len;
+    entry->refs = 1;
+    memcpy(entry->str, str, len);
+    entry->str[len] = '\0';
+
+    // Add the new string to its bucket
+    entry->next = interned.buckets[hash & (interned.size - 1)];
+    interned.buckets[hash & (interned.size - 1)] = entry;
+    interned.count++;
+
+    metrics_inc(METRIC_STRINGS);
+    metrics_add(METRIC_MEM_STRINGS, sizeof(intern_entry_t) + len + 1);
+
+    pthread_mutex_unlock(&interned.lock);
+    return entry->str;
+}
+
+const char *
+intern_ref(const char *str)
+{
+    pthread_mutex_lock(&interned.lock);
+    intern_entry(str)->refs++;
+    pthread_mutex_unlock(&interned.lock);
+    return str;
+}
+
+void
+intern_release(const char *str)
+{
+    intern_entry_t *entry, **prev;
+
+    if (!str)
+        return;
+
+    pthread_mutex_lock(&interned.lock);
+
+    entry = intern_entry(str);
+    if (--entry->refs == 0) {
+        // Remove the string from its bucket
+        for (prev = &interned.buckets[entry->hash & (interned.size - 1)]; *prev; prev = &(*prev)->next) {
+            if (*prev == entry) {
+                *prev = entry->next;
+                break;
+            }
+        }
+        interned.count--;
+        metrics_dec(METRIC_STRINGS);
+        metrics_add(METRIC_MEM_STRINGS, -(int64_t) (sizeof(intern_entry_t) + entry->len + 1));
+        free(entry);
+    }
+
+    pthread_mutex_unlock(&interned.lock);
+}
@@ -0,0 +1,98 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file intern.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to share repeated strings
+ *
+ * Header values like From, To or Contact are repeated in lots of messages.
+ * Instead of storing a copy for each message, strings are interned: all
+ * equal strings share the same stored copy, so they can be compared by
+ * pointer.
+ *
+ * Each interned string counts its references and it's freed when the last
+ * one is released.
+ *
+ */
+#ifndef __SNGREP_INTERN_H
+#define __SNGREP_INTERN_H
+
+#include "config.h"
+#include <stdint.h>
+#include <stddef.h>
+
+//! Initial number of buckets of the interned strings table
+#define INTERN_INITIAL_SIZE     1024
+
+//! Shorter declaration of intern_entry structure
+typedef struct intern_entry intern_entry_t;
+
+/**
+ * @brief Interned string
+ */
+struct intern_entry {
+    //! Next entry in the same bucket
+    intern_entry_t *next;
+    //! String hash value
+    uint32_t hash;
+    //! String length
+    uint32_t len;
+    //! Number of references to this string
+    int refs;
+    //! String content
+    char str[];
+};
+
+/**
+ * @brief Get the interned copy of a string
+ *
+ * If the string has not been interned yet, a new copy is stored.
+ * Each call adds a reference that must be released with intern_release.
+ *
+ * @param str String to intern (not required to be null-terminated)
+ * @param len String length
+ * @return interned null-terminated string or NULL on error
+ */
+const char *
+intern_string(const char *str, size_t len);
+
+/**
+ * @brief Add a reference to an interned string
+ *
+ * @param str String returned by intern_string
+ * @return the same interned string
+ */
+const char *
+intern_ref(const char *str);
+
+/**
+ * @brief Release a reference to an interned string
+ *
+ * The string is freed when its last reference is released.
+ *
+ * @param str String returned by intern_string or NULL
+ */
+void
+intern_release(const char *str);
+
+#endif /* __SNGREP_INTERN_H */
@@ -44,6 +44,20 @@
 #include "capture_openssl.h"
 #endif
 #include "curses/ui_manager.h"
+#include "profile.h"
+#include "metrics.h"
+#include "epoch.h"
+#include "util.h"
+#include "report.h"
+
+//! Command line options without short equivalent
+enum main_long_option {
+    OPT_FROM = 256,
+    OPT_TO,
+    OPT_CALLID,
+    OPT_REPORT,
+    OPT_FILTER
+};
 
 /**
  * @brief Usage function
@@ -53,7 +67,7 @@
 void
 usage()
 {
-    printf("Usage: %s [-hVcivNqrD] [-IO pcap_dump] [-d dev] [-l limit] [-B buffer]"
+    printf("Usage: %s [-hVcivNqrD] [-IO pcap_dump] [-d dev] [-l limit] [-B buffer] [-e seconds] [-m megabytes] [-M metrics_url]"
 #if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
            " [-k keyfile]"
 #endif
@@ -79,7 +93,15 @@ usage()
            "    -F --no-config\t Do not read configuration from default config file\n"
            "    -T --text\t Save pcap to text file\n"
            "    -R --rotate\t\t Rotate calls when capture limit have been reached\n"
+           "    -e --expire\t\t Remove dialogs N seconds after they have finished\n"
+           "    -m --max-memory\t Set max memory in MB used by stored dialogs\n"
            "    -T --telephone-event\t\t capture and parse RTP telephone-event packets\n"
+           "    -M --metrics\t Export capture metrics (unix:/path, tcp:X.X.X.X:XXXX or file:/path)\n"
+           "    --from\t\t Only load input file packets captured after this time\n"
+           "    --to\t\t Only load input file packets captured before this time\n"
+           "    --callid\t\t Only load input file dialogs with this Call-ID and their RTP\n"
+           "    --report\t\t Write a report of analyzed dialogs to file (- for stdout) without interface\n"
+           "    --filter\t\t Only store dialogs whose first message matches this filter expression\n"
 #ifdef USE_EEP
            "    -H --eep-send\t Homer sipcapture url (udp:X.X.X.X:XXXX)\n"
            "    -L --eep-listen\t Listen for encapsulated packets (udp:X.X.X.X:XXXX)\n"
@@ -131,7 +153,7 @@ int
 main(int argc, char* argv[])
 {
     int opt, idx, limit, only_calls, no_incomplete, pcap_buffer_size, i;
-    const char *device, *outfile, *text_outfile = NULL;
+    const char *device, *outfile, *text_outfile = NULL, *metrics_url = NULL, *report_file = NULL;
     char bpf[512];
 #if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
     const char *keyfile;
@@ -139,6 +161,9 @@ main(int argc, char* argv[])
     const char *match_expr;
     int match_insensitive = 0, match_invert = 0;
     int no_interface = 0, quiet = 0, rtp_capture = 0, rotate = 0, no_config = 0;
+    struct timeval from = { 0 }, to = { 0 };
+    const char *callid = NULL, *filter_expr = NULL;
+    char filter_error[256];
     vector_t *infiles = vector_create(0, 1);
     vector_t *indevices = vector_create(0, 1);
     char *token;
@@ -162,21 +187,29 @@ main(int argc, char* argv[])
         { "no-interface", no_argument, 0, 'N' },
         { "dump-config", no_argument, 0, 'D' },
         { "rotate", no_argument, 0, 'R' },
+        { "expire", required_argument, 0, 'e' },
+        { "max-memory", required_argument, 0, 'm' },
         { "config", required_argument, 0, 'f' },
         { "no-config", no_argument, 0, 'F' },
         { "text", required_argument, 0, 'T' },
         { "telephone-event", no_argument, 0, 't' },
+        { "metrics", required_argument, 0, 'M' },
 #ifdef USE_EEP
         { "eep-listen", required_argument, 0, 'L' },
         { "eep-send", required_argument, 0, 'H' },
         { "eep-parse", required_argument, 0, 'E' },
 #endif
         { "quiet", no_argument, 0, 'q' },
+        { "from", required_argument, 0, OPT_FROM },
+        { "to", required_argument, 0, OPT_TO },
+        { "callid", required_argument, 0, OPT_CALLID },
+        { "report", required_argument, 0, OPT_REPORT },
+        { "filter", required_argument, 0, OPT_FILTER },
     };
 
     // Parse command line arguments that have high priority
     opterr = 0;
-    char *options = "hVd:I:O:B:pqtW:k:crl:ivNqDL:H:ERf:FT:t";
+    char *options = "hVd:I:O:B:pqtW:k:crl:ivNqDL:H:ERf:FT:tM:e:m:";
     while ((opt = getopt_long(argc, argv, options, long_options, &idx)) != -1) {
         switch (opt) {
             case 'h':
@@ -251,6 +284,7 @@ main(int argc, char* argv[])
                     fprintf(stderr, "Invalid limit value.\n");
                     return 0;
                 }
+                setting_set_value(SETTING_CAPTURE_LIMIT, optarg);
                 break;
             case 'k':
 #if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
@@ -297,6 +331,48 @@ main(int argc, char* argv[])
             case 't':
                 setting_set_value(SETTING_TELEPHONE_EVENT, SETTING_ON);
                 break;
+            case 'M':
+                metrics_url = optarg;
+                break;
+            case 'e':
+                if (atoi(optarg) <= 0) {
+                    fprintf(stderr, "Invalid expire value.\n");
+                    return 0;
+                }
+                setting_set_value(SETTING_CAPTURE_EXPIRE, optarg);
+                break;
+            case 'm':
+                if (atoi(optarg) <= 0) {
+                    fprintf(stderr, "Invalid max memory value.\n");
+                    return 0;
+                }
+                setting_set_value(SETTING_CAPTURE_MAXMEMORY, optarg);
+                break;
+            case OPT_FROM:
+                if (timeval_from_string(optarg, &from) != 0) {
+                    fprintf(stderr, "Invalid from time value.\n");
+                    return 0;
+                }
+                break;
+            case OPT_TO:
+                if (timeval_from_string(optarg, &to) != 0) {
+                    fprintf(stderr, "Invalid to time value.\n");
+                    return 0;
+                }
+                break;
+            case OPT_CALLID:
+                callid = optarg;
+                break;
+            case OPT_FILTER:
+                filter_expr = optarg;
+                break;
+            case OPT_REPORT:
+                report_file = optarg;
+                no_interface = 1;
+                quiet = 1;
+                setting_set_value(SETTING_CAPTURE_STORAGE, "none");
+                setting_set_value(SETTING_CAPTURE_RTPMODE, "stats");
+                break;
                 // Dark options for dummy ones
             case 'p':
             case 'W':
@@ -339,8 +415,31 @@ main(int argc, char* argv[])
         }
     }
 
+    // Batch reports only keep dialogs until they finish
+    if (report_file) {
+        if (setting_get_intvalue(SETTING_CAPTURE_EXPIRE) <= 0)
+            setting_set_value(SETTING_CAPTURE_EXPIRE, STRINGIFY(REPORT_EXPIRE));
+
+        // Analyze each input file in its own process
+        if (vector_count(infiles) > 1) {
+            if ((i = report_fork(infiles)) < 0)
+                return report_finish(report_file);
+            token = vector_item(infiles, i);
+            vector_clear(infiles);
+            vector_append(infiles, token);
+        }
+
+        report_init();
+    }
+
     setup_sigterm_handler();
 
+    // Initialize processing stages profile
+    profile_init();
+    // Profile dumps are only printed without interface
+    if (no_interface)
+        profile_setup_dump_handler();
+
 #if defined(WITH_GNUTLS) || defined(WITH_OPENSSL)
     // Set capture decrypt key file
     capture_set_keyfile(keyfile);
@@ -361,8 +460,20 @@ main(int argc, char* argv[])
     // Initialize SIP Messages Storage
     sip_init(limit, only_calls, no_incomplete);
 
+    // Without interface, headers not used for correlation can be parsed later
+    if (no_interface)
+        sip_set_lazy_parse(setting_enabled(SETTING_SIP_LAZYPARSE));
+
+    // Set dialogs filter expression
+    if (filter_expr && sip_set_filter_expression(filter_expr, filter_error, sizeof(filter_error)) != 0) {
+        fprintf(stderr, "Invalid filter expression: %s\n", filter_error);
+        return 1;
+    }
+
     // Set capture options
     capture_init(limit, rtp_capture, rotate, pcap_buffer_size);
+    capture_set_time_window(from, to);
+    capture_set_callid(callid);
 
 #ifdef USE_EEP
     // Disable HEP listen when input files are specified in command line, otherwise online and offline packets
@@ -472,6 +583,17 @@ main(int argc, char* argv[])
             }
     }
 
+    // Start exporting capture metrics
+    if (metrics_url && metrics_init(metrics_url) != 0) {
+        return 1;
+    }
+
+    // Start releasing removed dialogs in background
+    if (epoch_init() != 0) {
+        fprintf(stderr, "Failed to launch reclaimer thread.\n");
+        return 1;
+    }
+
     // Start a capture thread
     if (capture_launch_thread() != 0) {
         ncurses_deinit();
@@ -491,6 +613,8 @@ main(int argc, char* argv[])
         while(capture_is_running() && !was_sigterm_received()) {
             if (!quiet)
                 printf("\rDialog count: %d", sip_calls_count_unrotated());
+            // Print stages profile if requested with SIGUSR2
+            profile_check_dump(stdout);
             usleep(500 * 1000);
         }
         if (!quiet)
@@ -523,6 +647,9 @@ main(int argc, char* argv[])
         }
         fclose(f);
     }
+    // Stop exporting metrics
+    metrics_deinit();
+
     // Capture deinit
     capture_deinit();
 
@@ -535,6 +662,13 @@ main(int argc, char* argv[])
     // Deallocate sip stored messages
     sip_deinit();
 
+    // Write the report with all removed dialogs
+    if (report_file && report_finish(report_file) != 0)
+        return 1;
+
+    // Deallocate data pending to be released
+    epoch_deinit();
+
     // Leaving!
     return 0;
 }
@@ -0,0 +1,633 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file metrics.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in metrics.h
+ *
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "metrics.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+//! Max number of registered collectors
+#define METRICS_MAX_COLLECTORS  8
+
+//! Shorter declaration of metric description structure
+typedef struct metric_desc metric_desc_t;
+//! Shorter declaration of metrics thread structure
+typedef struct metrics_thread metrics_thread_t;
+
+/**
+ * @brief Exported metric information
+ *
+ * Metrics sharing the same name must be consecutive in metric_id order
+ */
+struct metric_desc {
+    //! Exported name
+    const char *name;
+    //! Exported labels (or NULL)
+    const char *labels;
+    //! Prometheus metric type
+    const char *type;
+    //! Metric description
+    const char *help;
+};
+
+/**
+ * @brief Metrics updated by a single thread
+ */
+struct metrics_thread {
+    //! Metric values
+    int64_t values[METRIC_COUNT];
+    //! Next thread in the list
+    metrics_thread_t *next;
+};
+
+/**
+ * @brief Metrics exporter configuration
+ */
+struct metrics_config {
+    //! Exporter thread is running
+    bool running;
+    //! Listening socket (or -1 when exporting to a file)
+    int sock;
+    //! UNIX socket or output file path
+    char path[256];
+    //! Exporter thread
+    pthread_t thread;
+    //! Collector functions
+    metrics_collector_fn collectors[METRICS_MAX_COLLECTORS];
+    //! Number of registered collectors
+    int collector_cnt;
+    //! Writer functions
+    metrics_writer_fn writers[METRICS_MAX_COLLECTORS];
+    //! Number of registered writers
+    int writer_cnt;
+    //! Calls created in the previous rate calculation
+    int64_t rate_calls;
+    //! Time of the previous rate calculation
+    struct timespec rate_ts;
+    //! Last calculated calls rate
+    double rate;
+};
+
+//! Metrics descriptions, in metric_id order
+static metric_desc_t metric_descs[METRIC_COUNT] = {
+    { "sngrep_packets_total", NULL, "counter",
+      "Packets received from capture sources" },
+    { "sngrep_packets_dropped_total", "reason=\"limit\"", "counter",
+      "Packets discarded by sngrep" },
+    { "sngrep_packets_dropped_total", "reason=\"caplen\"", "counter",
+      "Packets discarded by sngrep" },
+    { "sngrep_packets_dropped_total", "reason=\"reassembly\"", "counter",
+      "Packets discarded by sngrep" },
+    { "sngrep_packets_dropped_total", "reason=\"duplicate\"", "counter",
+      "Packets discarded by sngrep" },
+    { "sngrep_packets_dropped_total", "reason=\"filter\"", "counter",
+      "Packets discarded by sngrep" },
+    { "sngrep_packets_dropped_total", "reason=\"rejected\"", "counter",
+      "Packets discarded by sngrep" },
+    { "sngrep_packets_parsed_total", "type=\"sip\"", "counter",
+      "Packets stored as SIP messages or RTP packets" },
+    { "sngrep_packets_parsed_total", "type=\"rtp\"", "counter",
+      "Packets stored as SIP messages or RTP packets" },
+    { "sngrep_packets_ignored_total", NULL, "counter",
+      "Packets not belonging to any dialog or stream" },
+    { "sngrep_calls_total", NULL, "counter",
+      "Dialogs created" },
+    { "sngrep_calls_rotated_total", NULL, "counter",
+      "Dialogs removed by capture rotation" },
+    { "sngrep_calls_removed_total", "reason=\"expire\"", "counter",
+      "Dialogs removed after finishing or exceeding memory limit" },
+    { "sngrep_calls_removed_total", "reason=\"memory\"", "counter",
+      "Dialogs removed after finishing or exceeding memory limit" },
+    { "sngrep_pcap_received_total", NULL, "counter",
+      "Packets received by libpcap" },
+    { "sngrep_pcap_dropped_total", NULL, "counter",
+      "Packets dropped by libpcap because there was no room in the buffer" },
+    { "sngrep_pcap_ifdropped_total", NULL, "counter",
+      "Packets dropped by the network interface" },
+    { "sngrep_calls", NULL, "gauge",
+      "Stored dialogs" },
+    { "sngrep_calls_active", NULL, "gauge",
+      "Dialogs in progress" },
+    { "sngrep_calls_per_second", NULL, "gauge",
+      "Dialogs created per second" },
+    { "sngrep_rtp_streams", NULL, "gauge",
+      "Stored RTP streams" },
+    { "sngrep_interned_strings", NULL, "gauge",
+      "Distinct header values stored" },
+    { "sngrep_queue_depth", "queue=\"ip_reassembly\"", "gauge",
+      "Packets waiting in reassembly queues" },
+    { "sngrep_queue_depth", "queue=\"tcp_reassembly\"", "gauge",
+      "Packets waiting in reassembly queues" },
+    { "sngrep_memory_bytes", "subsystem=\"frames\"", "gauge",
+      "Memory used by stored data" },
+    { "sngrep_memory_bytes", "subsystem=\"payloads\"", "gauge",
+      "Memory used by stored data" },
+    { "sngrep_memory_bytes", "subsystem=\"calls\"", "gauge",
+      "Memory used by stored data" },
+    { "sngrep_memory_bytes", "subsystem=\"streams\"", "gauge",
+      "Memory used by stored data" },
+    { "sngrep_memory_bytes", "subsystem=\"compressed\"", "gauge",
+      "Memory used by stored data" },
+    { "sngrep_memory_bytes", "subsystem=\"strings\"", "gauge",
+      "Memory used by stored data" },
+    { "sngrep_memory_bytes", "subsystem=\"rtp\"", "gauge",
+      "Memory used by stored data" },
+    { "sngrep_calls_memory_bytes", NULL, "gauge",
+      "Memory accounted to stored dialogs for memory limit" },
+    { "sngrep_storage_bytes", NULL, "gauge",
+      "Disk space used by segment files of disk storage" },
+    { "sngrep_storage_segments", NULL, "gauge",
+      "Open segment files of disk storage" },
+    { "sngrep_reclaim_pending_bytes", NULL, "gauge",
+      "Memory of removed data waiting to be released" },
+};
+
+//! Current thread metrics
+static __thread metrics_thread_t *metrics_local = NULL;
+//! All threads metrics
+static metrics_thread_t *metrics_threads = NULL;
+//! Values set by collectors
+static int64_t metrics_collected[METRIC_COUNT];
+//! Lock for threads list
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+//! Lock for collectors execution
+static pthread_mutex_t metrics_collect_lock = PTHREAD_MUTEX_INITIALIZER;
+//! Exporter configuration
+static struct metrics_config metrics_cfg = { .sock = -1 };
+
+static metrics_thread_t *
+metrics_thread_create()
+{
+    metrics_thread_t *thread;
+
+    if (!(thread = malloc(sizeof(metrics_thread_t))))
+        return NULL;
+    memset(thread, 0, sizeof(metrics_thread_t));
+
+    pthread_mutex_lock(&metrics_lock);
+    thread->next = metrics_threads;
+    metrics_threads = thread;
+    pthread_mutex_unlock(&metrics_lock);
+
+    return thread;
+}
+
+void
+metrics_add(enum metric_id id, int64_t value)
+{
+    metrics_thread_t *thread = metrics_local;
+
+    if (!thread && !(thread = metrics_local = metrics_thread_create()))
+        return;
+
+    // Only this thread writes its counters, readers only need untorn values
+    __atomic_store_n(&thread->values[id], __atomic_load_n(&thread->values[id], __ATOMIC_RELAXED) + value,
+                     __ATOMIC_RELAXED);
+}
+
+void
+metrics_set(enum metric_id id, int64_t value)
+{
+    __atomic_store_n(&metrics_collected[id], value, __ATOMIC_RELAXED);
+}
+
+int64_t
+metrics_get(enum metric_id id)
+{
+    metrics_thread_t *thread;
+    int64_t value = __atomic_load_n(&metrics_collected[id], __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&metrics_lock);
+    for (thread = metrics_threads; thread; thread = thread->next) {
+        value += __atomic_load_n(&thread->values[id], __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&metrics_lock);
+
+    return value;
+}
+
+int
+metrics_add_collector(metrics_collector_fn collector)
+{
+    int ret = 1;
+
+    pthread_mutex_lock(&metrics_collect_lock);
+    if (metrics_cfg.collector_cnt < METRICS_MAX_COLLECTORS) {
+        metrics_cfg.collectors[metrics_cfg.collector_cnt++] = collector;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&metrics_collect_lock);
+
+    return ret;
+}
+
+int
+metrics_add_writer(metrics_writer_fn writer)
+{
+    int ret = 1;
+
+    pthread_mutex_lock(&metrics_collect_lock);
+    if (metrics_cfg.writer_cnt < METRICS_MAX_COLLECTORS) {
+        metrics_cfg.writers[metrics_cfg.writer_cnt++] = writer;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&metrics_collect_lock);
+
+    return ret;
+}
+
+void
+metrics_write_label(FILE *out, const char *value)
+{
+    for (; *value; value++) {
+        switch (*value) {
+            case '\\':
+                fputs("\\\\", out);
+                break;
+            case '"':
+                fputs("\\\"", out);
+                break;
+            case '\n':
+                fputs("\\n", out);
+                break;
+            default:
+                fputc(*value, out);
+                break;
+        }
+    }
+}
+
+/**
+ * @brief Update collected metrics and calls rate
+ */
+static void
+metrics_collect()
+{
+    struct timespec now;
+    int64_t calls;
+    double elapsed;
+    int i;
+
+    // Request current values to all collectors
+    for (i = 0; i < metrics_cfg.collector_cnt; i++) {
+        metrics_cfg.collectors[i]();
+    }
+
+    // Calculate calls rate since previous calculation
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    calls = metrics_get(METRIC_CALLS_CREATED);
+    elapsed = (now.tv_sec - metrics_cfg.rate_ts.tv_sec)
+              + (now.tv_nsec - metrics_cfg.rate_ts.tv_nsec) / 1e9;
+
+    if (metrics_cfg.rate_ts.tv_sec == 0) {
+        metrics_cfg.rate_ts = now;
+        metrics_cfg.rate_calls = calls;
+    } else if (elapsed >= 1) {
+        metrics_cfg.rate = (calls - metrics_cfg.rate_calls) / elapsed;
+        metrics_cfg.rate_ts = now;
+        metrics_cfg.rate_calls = calls;
+    }
+    metrics_set(METRIC_CALLS_RATE, (int64_t) metrics_cfg.rate);
+}
+
+void
+metrics_write(FILE *out)
+{
+    const char *prev = NULL;
+    int i;
+
+    pthread_mutex_lock(&metrics_collect_lock);
+    metrics_collect();
+
+    for (i = 0; i < METRIC_COUNT; i++) {
+        metric_desc_t *desc = &metric_descs[i];
+
+        // Print metric information once per metric name
+        if (!prev || strcmp(prev, desc->name)) {
+            fprintf(out, "# HELP %s %s\n", desc->name, desc->help);
+            fprintf(out, "# TYPE %s %s\n", desc->name, desc->type);
+            prev = desc->name;
+        }
+
+        fprintf(out, "%s", desc->name);
+        if (desc->labels)
+            fprintf(out, "{%s}", desc->labels);
+
+        if (i == METRIC_CALLS_RATE) {
+            fprintf(out, " %.3f\n", metrics_cfg.rate);
+        } else {
+            fprintf(out, " %" PRId64 "\n", metrics_get(i));
+        }
+    }
+
+    // Print additional metrics
+    for (i = 0; i < metrics_cfg.writer_cnt; i++) {
+        metrics_cfg.writers[i](out);
+    }
+    pthread_mutex_unlock(&metrics_collect_lock);
+}
+
+/**
+ * @brief Replace metrics file contents
+ */
+static void
+metrics_write_file()
+{
+    char tmpfile[sizeof(metrics_cfg.path) + 5];
+    FILE *f;
+
+    // Write a temporal file and rename it, so readers never get partial data
+    snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", metrics_cfg.path);
+    if (!(f = fopen(tmpfile, "w")))
+        return;
+    metrics_write(f);
+    fclose(f);
+    rename(tmpfile, metrics_cfg.path);
+}
+
+/**
+ * @brief Send all data to a socket client
+ */
+static void
+metrics_send(int fd, const char *data, size_t len)
+{
+    ssize_t sent;
+
+    while (len > 0) {
+        if ((sent = send(fd, data, len, MSG_NOSIGNAL)) <= 0) {
+            if (sent < 0 && errno == EINTR)
+                continue;
+            return;
+        }
+        data += sent;
+        len -= sent;
+    }
+}
+
+/**
+ * @brief Send current metrics to a connected client
+ *
+ * Clients sending an HTTP request get an HTTP response, so the socket can
+ * be directly scraped. Any other client gets the plain metrics text.
+ */
+static void
+metrics_serve_client(int fd)
+{
+    char request[1024], header[256];
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    char *body = NULL;
+    size_t body_len = 0, req_len = 0;
+    ssize_t rcvd;
+    FILE *f;
+
+    // Read request headers (if any)
+    while (req_len < sizeof(request) - 1 && poll(&pfd, 1, 200) > 0) {
+        if ((rcvd = recv(fd, request + req_len, sizeof(request) - 1 - req_len, 0)) <= 0)
+            break;
+        req_len += rcvd;
+        request[req_len] = '\0';
+        if (strstr(request, "\r\n\r\n"))
+            break;
+    }
+
+    // Format metrics into memory
+    if (!(f = open_memstream(&body, &body_len)))
+        return;
+    metrics_write(f);
+    fclose(f);
+
+    if (req_len >= 4 && !strncmp(request, "GET ", 4)) {
+        snprintf(header, sizeof(header),
+                 "HTTP/1.0 200 OK\r\n"
+                 "Content-Type: text/plain; version=0.0.4\r\n"
+                 "Content-Length: %zu\r\n"
+                 "Connection: close\r\n\r\n", body_len);
+        metrics_send(fd, header, strlen(header));
+    }
+    metrics_send(fd, body, body_len);
+    free(body);
+
+    shutdown(fd, SHUT_WR);
+}
+
+static void *
+metrics_thread(void *arg)
+{
+    struct pollfd pfd = { .fd = metrics_cfg.sock, .events = POLLIN };
+    time_t last = 0;
+    int client;
+
+    while (__atomic_load_n(&metrics_cfg.running, __ATOMIC_RELAXED)) {
+        if (metrics_cfg.sock >= 0) {
+            // Wait for new clients
+            if (poll(&pfd, 1, 500) > 0 && (pfd.revents & POLLIN)) {
+                if ((client = accept(metrics_cfg.sock, NULL, NULL)) >= 0) {
+                    metrics_serve_client(client);
+                    close(client);
+                }
+            }
+        } else {
+            // Periodically update metrics file
+            if (time(NULL) - last >= METRICS_FILE_INTERVAL) {
+                metrics_write_file();
+                last = time(NULL);
+            }
+            poll(NULL, 0, 500);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Create a listening UNIX socket in the given path
+ */
+static int
+metrics_listen_unix(const char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    int sock;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Metrics socket path too long: %s\n", path);
+        return -1;
+    }
+
+    // Remove stale sockets from previous executions
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        fprintf(stderr, "Error creating metrics socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "Error binding metrics socket %s: %s\n", path, strerror(errno));
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+/**
+ * @brief Create a listening TCP socket in the given address and port
+ */
+static int
+metrics_listen_tcp(char *address)
+{
+    struct addrinfo *ai, hints[1] = { { 0 } };
+    char *port;
+    int sock, on = 1;
+
+    // Port is after the last colon, so IPv6 addresses can be used
+    if (!(port = strrchr(address, ':'))) {
+        fprintf(stderr, "Missing port in metrics address %s\n", address);
+        return -1;
+    }
+    *port++ = '\0';
+
+    hints->ai_flags = AI_NUMERICSERV | AI_PASSIVE;
+    hints->ai_family = AF_UNSPEC;
+    hints->ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(strlen(address) ? address : NULL, port, hints, &ai)) {
+        fprintf(stderr, "Metrics: failed getaddrinfo() for %s:%s\n", address, port);
+        return -1;
+    }
+
+    if ((sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0) {
+        fprintf(stderr, "Error creating metrics socket: %s\n", strerror(errno));
+        freeaddrinfo(ai);
+        return -1;
+    }
+
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    if (bind(sock, ai->ai_addr, ai->ai_addrlen) == -1) {
+        fprintf(stderr, "Error binding metrics address %s:%s: %s\n", address, port, strerror(errno));
+        freeaddrinfo(ai);
+        close(sock);
+        return -1;
+    }
+
+    freeaddrinfo(ai);
+    return sock;
+}
+
+int
+metrics_init(const char *url)
+{
+    char urlstr[256];
+    FILE *f;
+
+    strncpy(urlstr, url, sizeof(urlstr) - 1);
+    urlstr[sizeof(urlstr) - 1] = '\0';
+
+    if (!strncmp(urlstr, "unix:", 5)) {
+        strcpy(metrics_cfg.path, urlstr + 5);
+        metrics_cfg.sock = metrics_listen_unix(metrics_cfg.path);
+    } else if (!strncmp(urlstr, "tcp:", 4)) {
+        metrics_cfg.sock = metrics_listen_tcp(urlstr + 4);
+    } else if (!strncmp(urlstr, "file:", 5)) {
+        strcpy(metrics_cfg.path, urlstr + 5);
+        // Check we can write the output file
+        if (!(f = fopen(metrics_cfg.path, "w"))) {
+            fprintf(stderr, "Unable to open metrics file %s: %s\n", metrics_cfg.path, strerror(errno));
+            return 1;
+        }
+        fclose(f);
+    } else {
+        fprintf(stderr, "Invalid metrics url %s\n", url);
+        return 1;
+    }
+
+    // Start listening for clients
+    if (strncmp(urlstr, "file:", 5) != 0) {
+        if (metrics_cfg.sock < 0)
+            return 1;
+        if (listen(metrics_cfg.sock, 8) == -1) {
+            fprintf(stderr, "Error listening metrics socket: %s\n", strerror(errno));
+            close(metrics_cfg.sock);
+            metrics_cfg.sock = -1;
+            return 1;
+        }
+    }
+
+    metrics_cfg.running = true;
+    if (pthread_create(&metrics_cfg.thread, NULL, metrics_thread, NULL)) {
+        fprintf(stderr, "Failed to launch metrics thread.\n");
+        metrics_cfg.running = false;
+        return 1;
+    }
+
+    return 0;
+}
+
+void
+metrics_deinit()
+{
+    if (!metrics_cfg.running)
+        return;
+
+    // Stop exporter thread
+    __atomic_store_n(&metrics_cfg.running, false, __ATOMIC_RELAXED);
+    pthread_join(metrics_cfg.thread, NULL);
+
+    if (metrics_cfg.sock >= 0) {
+        close(metrics_cfg.sock);
+        metrics_cfg.sock = -1;
+        // Remove UNIX socket file
+        if (strlen(metrics_cfg.path))
+            unlink(metrics_cfg.path);
+    } else {
+        // Store final values
+        metrics_write_file();
+    }
+}
@@ -0,0 +1,188 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file metrics.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to manage capture health metrics
+ *
+ * Counters and gauges are updated by each thread in its own storage, so
+ * updating a metric does not require any lock. All threads values are
+ * added when metrics are read.
+ *
+ * Values that are already available somewhere else (like libpcap stats or
+ * stored dialogs count) are not tracked on each update. Instead, modules
+ * register a collector function that sets them just before exporting.
+ *
+ * Metrics are exported in Prometheus text format through a local UNIX or
+ * TCP socket, or periodically written to a file.
+ *
+ */
+#ifndef __SNGREP_METRICS_H
+#define __SNGREP_METRICS_H
+
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+
+//! Seconds between metrics file updates
+#define METRICS_FILE_INTERVAL   1
+
+/**
+ * @brief Available metrics
+ */
+enum metric_id {
+    METRIC_PACKETS = 0,
+    METRIC_DROP_LIMIT,
+    METRIC_DROP_CAPLEN,
+    METRIC_DROP_REASM,
+    METRIC_DROP_DUPLICATE,
+    METRIC_DROP_FILTER,
+    METRIC_DROP_REJECTED,
+    METRIC_PACKETS_SIP,
+    METRIC_PACKETS_RTP,
+    METRIC_PACKETS_IGNORED,
+    METRIC_CALLS_CREATED,
+    METRIC_CALLS_ROTATED,
+    METRIC_CALLS_EXPIRED,
+    METRIC_CALLS_EVICTED,
+    METRIC_PCAP_RECV,
+    METRIC_PCAP_DROP,
+    METRIC_PCAP_IFDROP,
+    METRIC_CALLS,
+    METRIC_CALLS_ACTIVE,
+    METRIC_CALLS_RATE,
+    METRIC_RTP_STREAMS,
+    METRIC_STRINGS,
+    METRIC_IP_REASM_QUEUE,
+    METRIC_TCP_REASM_QUEUE,
+    METRIC_MEM_FRAMES,
+    METRIC_MEM_PAYLOADS,
+    METRIC_MEM_CALLS,
+    METRIC_MEM_STREAMS,
+    METRIC_MEM_COMPRESSED,
+    METRIC_MEM_STRINGS,
+    METRIC_MEM_RTP,
+    METRIC_MEM_DIALOGS,
+    METRIC_STORAGE_BYTES,
+    METRIC_STORAGE_SEGMENTS,
+    METRIC_RECLAIM_BYTES,
+    METRIC_COUNT
+};
+
+/**
+ * @brief Function called before exporting metrics
+ *
+ * Collectors update the metrics that are not tracked on each change
+ * using metrics_set.
+ */
+typedef void (*metrics_collector_fn)();
+
+/**
+ * @brief Function called to export additional metrics
+ *
+ * Writers print metrics that can not be described by a metric_id, like
+ * those with variable labels, in Prometheus text format.
+ */
+typedef void (*metrics_writer_fn)(FILE *out);
+
+//! Increase a metric by one
+#define metrics_inc(id)         metrics_add(id, 1)
+//! Decrease a metric by one
+#define metrics_dec(id)         metrics_add(id, -1)
+
+/**
+ * @brief Add a value to a metric in current thread storage
+ *
+ * @param id One of metric_id values
+ * @param value Value to add (negative values are allowed for gauges)
+ */
+void
+metrics_add(enum metric_id id, int64_t value);
+
+/**
+ * @brief Set the value of a collected metric
+ *
+ * This is meant to be called from collector functions
+ */
+void
+metrics_set(enum metric_id id, int64_t value);
+
+/**
+ * @brief Get the current value of a metric
+ *
+ * Values of all threads are added.
+ */
+int64_t
+metrics_get(enum metric_id id);
+
+/**
+ * @brief Register a function to be called before exporting metrics
+ *
+ * @return 0 if the collector has been registered, 1 otherwise
+ */
+int
+metrics_add_collector(metrics_collector_fn collector);
+
+/**
+ * @brief Register a function to export additional metrics
+ *
+ * @return 0 if the writer has been registered, 1 otherwise
+ */
+int
+metrics_add_writer(metrics_writer_fn writer);
+
+/**
+ * @brief Print a label value escaped as required by Prometheus text format
+ *
+ * Backslashes, double quotes and line feeds are escaped.
+ */
+void
+metrics_write_label(FILE *out, const char *value);
+
+/**
+ * @brief Print all metrics in Prometheus text format
+ */
+void
+metrics_write(FILE *out);
+
+/**
+ * @brief Start exporting metrics to the given url
+ *
+ * Allowed urls are unix:/path/to/socket, tcp:address:port and
+ * file:/path/to/file. A new thread is launched to serve socket clients
+ * or to update the metrics file.
+ *
+ * @return 0 if exporter has been started, 1 otherwise
+ */
+int
+metrics_init(const char *url);
+
+/**
+ * @brief Stop exporting metrics
+ *
+ * When exporting to a file, latest metrics are written before leaving.
+ */
+void
+metrics_deinit();
+
+#endif /* __SNGREP_METRICS_H */
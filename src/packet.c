@@ -29,7 +29,85 @@
 #include "config.h"
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "packet.h"
+#include "metrics.h"
+
+//! Memory used by a frame without its data
+#define FRAME_SIZE  (sizeof(frame_t) + sizeof(struct pcap_pkthdr))
+
+#ifdef WITH_ZLIB
+/**
+ * @brief Recently used uncompressed payloads
+ *
+ * Compressed payloads are uncompressed into this cache when requested.
+ * Returned payloads are only valid until PACKET_PAYLOAD_CACHE different
+ * compressed payloads have been requested.
+ */
+static struct packet_payload_cache {
+    //! Packet owning the payload
+    packet_t *packet;
+    //! Uncompressed payload
+    u_char *payload;
+    //! Last time this entry was used
+    uint64_t used;
+} payload_cache[PACKET_PAYLOAD_CACHE];
+
+//! Payload cache access counter
+static uint64_t payload_cache_clock = 0;
+
+//! Payload cache lock, packets can be destroyed by reclaimer thread
+static pthread_mutex_t payload_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Get a free entry in uncompressed payload cache
+ *
+ * The least recently used entry is freed if there are none available.
+ *
+ * @note This function must be called with payload cache lock held
+ */
+static struct packet_payload_cache *
+packet_payload_cache_entry()
+{
+    struct packet_payload_cache *entry = &payload_cache[0];
+    int i;
+
+    for (i = 1; i < PACKET_PAYLOAD_CACHE && entry->packet; i++) {
+        if (!payload_cache[i].packet || payload_cache[i].used < entry->used)
+            entry = &payload_cache[i];
+    }
+
+    if (entry->packet) {
+        metrics_add(METRIC_MEM_PAYLOADS, -(int64_t) (entry->packet->payload_len + 1));
+        free(entry->payload);
+        entry->packet = NULL;
+        entry->payload = NULL;
+    }
+
+    return entry;
+}
+
+/**
+ * @brief Remove a packet from uncompressed payload cache
+ */
+static void
+packet_payload_cache_remove(packet_t *packet)
+{
+    int i;
+
+    pthread_mutex_lock(&payload_cache_lock);
+    for (i = 0; i < PACKET_PAYLOAD_CACHE; i++) {
+        if (payload_cache[i].packet == packet) {
+            metrics_add(METRIC_MEM_PAYLOADS, -(int64_t) (packet->payload_len + 1));
+            free(payload_cache[i].payload);
+            payload_cache[i].packet = NULL;
+            payload_cache[i].payload = NULL;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&payload_cache_lock);
+}
+#endif
 
 packet_t *
 packet_create(uint8_t ip_ver, uint8_t proto, address_t src, address_t dst, uint32_t id)
@@ -61,7 +139,7 @@ packet_clone(packet_t *packet)
     // Append this frames to the original packet
     vector_iter_t frames = vector_iterator(packet->frames);
     while ((frame = vector_iterator_next(&frames)))
-        packet_add_frame(clone, frame->header, frame->data);
+        packet_add_frame(clone, frame->header, packet_frame_data(frame))->record = frame->record;
 
     return clone;
 }
@@ -77,6 +155,9 @@ packet_destroy(packet_t *packet)
     // Destroy frames
     vector_iter_t it = vector_iterator(packet->frames);
     while ((frame = vector_iterator_next(&it))) {
+        metrics_add(METRIC_MEM_FRAMES, -(int64_t) (FRAME_SIZE + (frame->data ? frame->header->caplen : 0)));
+        if (frame->segment)
+            storage_release(frame->segment);
         free(frame->header);
         free(frame->data);
     }
@@ -84,7 +165,15 @@ packet_destroy(packet_t *packet)
     // TODO Free remaining packet data
     vector_set_destroyer(packet->frames, vector_generic_destroyer);
     vector_destroy(packet->frames);
+    if (packet->payload)
+        metrics_add(METRIC_MEM_PAYLOADS, -(int64_t) (packet->payload_len + 1));
     free(packet->payload);
+#ifdef WITH_ZLIB
+    if (packet->zpayload) {
+        packet_payload_cache_remove(packet);
+        compress_free(packet->zpayload);
+    }
+#endif
     free(packet);
 }
 
@@ -101,11 +190,44 @@ packet_free_frames(packet_t *pkt)
     vector_iter_t it = vector_iterator(pkt->frames);
 
     while ((frame = vector_iterator_next(&it))) {
+        if (frame->data)
+            metrics_add(METRIC_MEM_FRAMES, -(int64_t) frame->header->caplen);
         free(frame->data);
         frame->data = NULL;
     }
 }
 
+int
+packet_store_frames(packet_t *pkt)
+{
+    frame_t *frame;
+    int ret = 0;
+    vector_iter_t it = vector_iterator(pkt->frames);
+
+    while ((frame = vector_iterator_next(&it))) {
+        if (!frame->data)
+            continue;
+        // Keep frame in memory if it can not be written
+        if (!(frame->segment = storage_write(frame->data, frame->header->caplen, &frame->offset))) {
+            ret = 1;
+            continue;
+        }
+        metrics_add(METRIC_MEM_FRAMES, -(int64_t) frame->header->caplen);
+        free(frame->data);
+        frame->data = NULL;
+    }
+
+    return ret;
+}
+
+const u_char *
+packet_frame_data(frame_t *frame)
+{
+    if (frame->segment)
+        return storage_read(frame->segment, frame->offset, frame->header->caplen);
+    return frame->data;
+}
+
 packet_t *
 packet_set_transport_data(packet_t *pkt, uint16_t sport, uint16_t dport)
 {
@@ -118,11 +240,13 @@ frame_t *
 packet_add_frame(packet_t *pkt, const struct pcap_pkthdr *header, const u_char *packet)
 {
     frame_t *frame = malloc(sizeof(frame_t));
+    memset(frame, 0, sizeof(frame_t));
     frame->header = malloc(sizeof(struct pcap_pkthdr));
     memcpy(frame->header, header, sizeof(struct pcap_pkthdr));
     frame->data = malloc(header->caplen);
     memcpy(frame->data, packet, header->caplen);
     vector_append(pkt->frames, frame);
+    metrics_add(METRIC_MEM_FRAMES, FRAME_SIZE + header->caplen);
     return frame;
 }
 
@@ -136,8 +260,18 @@ void
 packet_set_payload(packet_t *packet, u_char *payload, uint32_t payload_len)
 {
     // Free previous payload
-    if (packet->payload)
+    if (packet->payload) {
+        metrics_add(METRIC_MEM_PAYLOADS, -(int64_t) (packet->payload_len + 1));
         free(packet->payload);
+    }
+#ifdef WITH_ZLIB
+    if (packet->zpayload) {
+        packet_payload_cache_remove(packet);
+        compress_free(packet->zpayload);
+        packet->zpayload = NULL;
+    }
+#endif
+    packet->payload = NULL;
     packet->payload_len = 0;
 
     // Set new payload
@@ -147,6 +281,7 @@ packet_set_payload(packet_t *packet, u_char *payload, uint32_t payload_len)
         memcpy(packet->payload, payload, payload_len);
         packet->payload[payload_len] = '\0';
         packet->payload_len = payload_len;
+        metrics_add(METRIC_MEM_PAYLOADS, payload_len + 1);
     }
 }
 
@@ -159,9 +294,92 @@ packet_payloadlen(packet_t *packet)
 u_char *
 packet_payload(packet_t *packet)
 {
+#ifdef WITH_ZLIB
+    struct packet_payload_cache *entry;
+    u_char *payload = NULL;
+    int i;
+
+    if (!packet->payload && packet->zpayload) {
+        pthread_mutex_lock(&payload_cache_lock);
+
+        // Check if payload has been recently uncompressed
+        for (i = 0; i < PACKET_PAYLOAD_CACHE; i++) {
+            if (payload_cache[i].packet == packet) {
+                payload_cache[i].used = ++payload_cache_clock;
+                payload = payload_cache[i].payload;
+                pthread_mutex_unlock(&payload_cache_lock);
+                return payload;
+            }
+        }
+
+        // Uncompress payload into the cache
+        entry = packet_payload_cache_entry();
+        if ((entry->payload = malloc(packet->payload_len + 1))) {
+            if (uncompress_payload(packet->zpayload, entry->payload, packet->payload_len) == 0) {
+                entry->payload[packet->payload_len] = '\0';
+                entry->packet = packet;
+                entry->used = ++payload_cache_clock;
+                metrics_add(METRIC_MEM_PAYLOADS, packet->payload_len + 1);
+                payload = entry->payload;
+            } else {
+                free(entry->payload);
+                entry->payload = NULL;
+            }
+        }
+
+        pthread_mutex_unlock(&payload_cache_lock);
+        return payload;
+    }
+#endif
     return packet->payload;
 }
 
+const u_char *
+packet_payload_copy(packet_t *packet, u_char *buffer)
+{
+#ifdef WITH_ZLIB
+    if (!packet->payload && packet->zpayload) {
+        if (uncompress_payload(packet->zpayload, buffer, packet->payload_len) != 0)
+            return NULL;
+        buffer[packet->payload_len] = '\0';
+        return buffer;
+    }
+#endif
+    return packet->payload;
+}
+
+#ifdef WITH_ZLIB
+int
+packet_compress_payload(packet_t *packet)
+{
+    if (!packet->payload || packet->zpayload)
+        return 1;
+
+    if (!(packet->zpayload = compress_payload(packet->payload, packet->payload_len)))
+        return 1;
+
+    return 0;
+}
+
+void
+packet_release_payload(packet_t *packet)
+{
+    struct packet_payload_cache *entry;
+
+    if (!packet->payload || !packet->zpayload)
+        return;
+
+    // Keep uncompressed payload in the cache, it will be likely requested soon
+    pthread_mutex_lock(&payload_cache_lock);
+    entry = packet_payload_cache_entry();
+    entry->packet = packet;
+    entry->payload = packet->payload;
+    entry->used = ++payload_cache_clock;
+    packet->payload = NULL;
+    pthread_mutex_unlock(&payload_cache_lock);
+}
+#endif
+
 struct timeval
 packet_time(packet_t *packet)
 {
@@ -178,3 +396,25 @@ packet_time(packet_t *packet)
     return ts;
 }
 
+size_t
+packet_memory(packet_t *packet, bool data)
+{
+    frame_t *frame;
+    size_t memory = sizeof(packet_t);
+
+    if (packet->payload)
+        memory += packet->payload_len + 1;
+#ifdef WITH_ZLIB
+    if (packet->zpayload)
+        memory += compress_size(packet->zpayload);
+#endif
+
+    vector_iter_t it = vector_iterator(packet->frames);
+    while ((frame = vector_iterator_next(&it))) {
+        memory += FRAME_SIZE;
+        if (data && frame->data)
+            memory += frame->header->caplen;
+    }
+
+    return memory;
+}
@@ -37,10 +37,18 @@
 #define __SNGREP_CAPTURE_PACKET_H
 
 #include <time.h>
+#include <stdbool.h>
 #include <sys/types.h>
 #include <pcap.h>
 #include "address.h"
 #include "vector.h"
+#include "storage.h"
+#ifdef WITH_ZLIB
+#include "compress.h"
+
+//! Number of uncompressed payloads kept in memory
+#define PACKET_PAYLOAD_CACHE 16
+#endif
 
 //! Stored packet types
 enum packet_type {
@@ -92,6 +100,10 @@ struct packet {
     u_char *payload;
     //! Payload length
     uint32_t payload_len;
+#ifdef WITH_ZLIB
+    //! Compressed payload, replacing payload once compressed
+    compress_data_t *zpayload;
+#endif
     //! Packet frame list (frame_t)
     vector_t *frames;
 };
@@ -107,6 +119,12 @@ struct frame {
     struct pcap_pkthdr *header;
     //! PCAP Frame content
     u_char *data;
+    //! Segment storing frame content when stored on disk
+    storage_segment_t *segment;
+    //! Frame content position in the segment
+    off_t offset;
+    //! Position of the mapped input file record of this frame plus one, or 0
+    size_t record;
 };
 
 /**
@@ -153,6 +171,27 @@ packet_destroyer(void *packet);
 void
 packet_free_frames(packet_t *pkt);
 
+/**
+ * @brief Move packet frames data to disk storage
+ *
+ * Frames data is written to storage segments and removed from memory.
+ * Frames that can not be written are kept in memory.
+ *
+ * @return 0 if all frames have been stored, 1 otherwise
+ */
+int
+packet_store_frames(packet_t *pkt);
+
+/**
+ * @brief Get frame content, either from memory or disk storage
+ *
+ * Data read from disk storage is only valid until next frame read.
+ *
+ * @return frame content or NULL if it is not available
+ */
+const u_char *
+packet_frame_data(frame_t *frame);
+
 /**
  * @brief Set packet type
  */
@@ -173,14 +212,65 @@ packet_payloadlen(packet_t *packet);
 
 /**
  * @brief Getter for capture payload pointer
+ *
+ * Compressed payloads are uncompressed on demand. In that case, the
+ * returned pointer is only valid until PACKET_PAYLOAD_CACHE other
+ * compressed payloads have been requested.
  */
 u_char *
 packet_payload(packet_t *packet);
 
+/**
+ * @brief Get packet payload without using uncompressed payloads cache
+ *
+ * Compressed payloads are uncompressed into the given buffer, so this
+ * can be used without capture lock once the packet has been stored.
+ *
+ * @param packet Packet structure pointer
+ * @param buffer Buffer with room for payload length plus null terminator
+ * @return payload pointer or NULL if it can not be uncompressed
+ */
+const u_char *
+packet_payload_copy(packet_t *packet, u_char *buffer);
+
+#ifdef WITH_ZLIB
+/**
+ * @brief Compress packet payload
+ *
+ * Uncompressed payload is kept until packet_release_payload is called,
+ * so this can be used without capture lock.
+ *
+ * @return 0 if payload has been compressed, 1 otherwise
+ */
+int
+packet_compress_payload(packet_t *packet);
+
+/**
+ * @brief Replace packet payload with its compressed version
+ *
+ * Uncompressed payload is moved to uncompressed payloads cache, as it
+ * will be likely requested soon.
+ *
+ * @note This function must be called with the capture lock held
+ */
+void
+packet_release_payload(packet_t *packet);
+#endif
+
 /**
  * @brief Get The timestamp for a packet.
  */
 struct timeval
 packet_time(packet_t *packet);
 
+/**
+ * @brief Get memory used by a packet
+ *
+ * @param packet Packet to check
+ * @param data Include frames data
+ * @return memory in bytes used by packet, payload and frames
+ */
+size_t
+packet_memory(packet_t *packet, bool data);
+
 #endif /* __SNGREP_CAPTURE_PACKET_H */
@@ -0,0 +1,311 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file profile.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in profile.h
+ *
+ */
+#include "config.h"
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include "profile.h"
+#include "histogram.h"
+
+#if __STDC_VERSION__ >= 201112L && __STDC_NO_ATOMICS__ != 1
+// modern C with atomics
+#include <stdatomic.h>
+typedef atomic_int signal_flag_type;
+#else
+// no atomics available
+typedef volatile sig_atomic_t signal_flag_type;
+#endif
+
+//! Stage names, in profile_stage order
+static const char *profile_stage_names[PROFILE_STAGE_COUNT] = {
+    "IP reassembly",
+    "TCP reassembly",
+    "WebSocket unmask",
+    "TLS decrypt",
+    "Capture lock wait",
+    "SIP validation",
+    "SIP parsing",
+    "Call-ID lookup",
+    "SDP parsing",
+    "RTP stream lookup",
+    "RTP stats",
+    "Dump writing",
+    "Disk storage",
+    "Payload compression",
+    "UI redraw",
+};
+
+static signal_flag_type sigusr2_received = 0;
+
+#ifdef USE_PROFILE
+
+//! Shorter declaration of profile thread structure
+typedef struct profile_thread profile_thread_t;
+
+/**
+ * @brief Samples recorded by a single thread
+ */
+struct profile_thread {
+    //! Number of samples per stage
+    uint64_t count[PROFILE_STAGE_COUNT];
+    //! Sum of samples per stage
+    uint64_t sum[PROFILE_STAGE_COUNT];
+    //! Max sample per stage
+    uint64_t max[PROFILE_STAGE_COUNT];
+    //! Samples histogram per stage
+    uint64_t buckets[PROFILE_STAGE_COUNT][HISTOGRAM_BUCKETS];
+    //! Next thread in the list
+    profile_thread_t *next;
+};
+
+//! Current thread samples
+static __thread profile_thread_t *profile_local = NULL;
+//! All threads samples
+static profile_thread_t *profile_threads = NULL;
+//! Lock for threads list
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+//! Reference time to convert ticks into nanoseconds
+static uint64_t profile_ref_ticks = 0;
+static uint64_t profile_ref_ns = 0;
+
+static uint64_t
+profile_clock_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t
+profile_clock_ticks()
+{
+    return profile_clock_ns();
+}
+
+static profile_thread_t *
+profile_thread_create()
+{
+    profile_thread_t *thread;
+
+    if (!(thread = malloc(sizeof(profile_thread_t))))
+        return NULL;
+    memset(thread, 0, sizeof(profile_thread_t));
+
+    pthread_mutex_lock(&profile_lock);
+    thread->next = profile_threads;
+    profile_threads = thread;
+    pthread_mutex_unlock(&profile_lock);
+
+    return thread;
+}
+
+void
+profile_record(enum profile_stage stage, uint64_t ticks)
+{
+    profile_thread_t *thread = profile_local;
+
+    if (!thread && !(thread = profile_local = profile_thread_create()))
+        return;
+
+    thread->count[stage]++;
+    thread->sum[stage] += ticks;
+    if (ticks > thread->max[stage])
+        thread->max[stage] = ticks;
+    thread->buckets[stage][histogram_bucket(ticks)]++;
+}
+
+/**
+ * @brief Nanoseconds per tick since profile_init
+ */
+static double
+profile_tick_ns()
+{
+    uint64_t ticks = profile_ticks() - profile_ref_ticks;
+    uint64_t ns = profile_clock_ns() - profile_ref_ns;
+
+    if (!profile_ref_ticks || ticks == 0 || ns < 1000000)
+        return 1.0;
+
+    return (double) ns / ticks;
+}
+
+void
+profile_init()
+{
+    profile_ref_ticks = profile_ticks();
+    profile_ref_ns = profile_clock_ns();
+}
+
+bool
+profile_enabled()
+{
+    return true;
+}
+
+void
+profile_get_summary(enum profile_stage stage, profile_summary_t *summary)
+{
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+    uint64_t sum = 0, p50, p99;
+    profile_thread_t *thread;
+    double tick_ns = profile_tick_ns();
+    int i;
+
+    memset(summary, 0, sizeof(profile_summary_t));
+    memset(buckets, 0, sizeof(buckets));
+
+    // Merge all threads samples
+    pthread_mutex_lock(&profile_lock);
+    for (thread = profile_threads; thread; thread = thread->next) {
+        summary->count += thread->count[stage];
+        sum += thread->sum[stage];
+        if (thread->max[stage] > summary->max)
+            summary->max = thread->max[stage];
+        for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+            buckets[i] += thread->buckets[stage][i];
+    }
+    pthread_mutex_unlock(&profile_lock);
+
+    if (!summary->count)
+        return;
+
+    // Find requested percentiles
+    p50 = histogram_percentile_buckets(buckets, summary->count, 50);
+    p99 = histogram_percentile_buckets(buckets, summary->count, 99);
+
+    // Bucket middle points can not exceed the real max value
+    if (p50 > summary->max)
+        p50 = summary->max;
+    if (p99 > summary->max)
+        p99 = summary->max;
+
+    summary->mean = (uint64_t) (sum * tick_ns / summary->count);
+    summary->p50 = (uint64_t) (p50 * tick_ns);
+    summary->p99 = (uint64_t) (p99 * tick_ns);
+    summary->max = (uint64_t) (summary->max * tick_ns);
+}
+
+void
+profile_reset()
+{
+    profile_thread_t *thread;
+
+    // Samples recorded while resetting may be partially lost
+    pthread_mutex_lock(&profile_lock);
+    for (thread = profile_threads; thread; thread = thread->next) {
+        memset(thread, 0, offsetof(profile_thread_t, next));
+    }
+    pthread_mutex_unlock(&profile_lock);
+}
+
+#else
+
+void
+profile_init()
+{
+}
+
+bool
+profile_enabled()
+{
+    return false;
+}
+
+void
+profile_get_summary(enum profile_stage stage, profile_summary_t *summary)
+{
+    memset(summary, 0, sizeof(profile_summary_t));
+}
+
+void
+profile_reset()
+{
+}
+
+#endif
+
+const char *
+profile_stage_name(enum profile_stage stage)
+{
+    if (stage < 0 || stage >= PROFILE_STAGE_COUNT)
+        return "";
+    return profile_stage_names[stage];
+}
+
+void
+profile_dump(FILE *out)
+{
+    profile_summary_t summary;
+    int i;
+
+    if (!profile_enabled()) {
+        fprintf(out, "Profiling support not compiled (--enable-profiling)\n");
+        return;
+    }
+
+    fprintf(out, "%-20s %12s %12s %12s %12s %12s\n",
+            "Stage", "Count", "Mean (us)", "p50 (us)", "p99 (us)", "Max (us)");
+    for (i = 0; i < PROFILE_STAGE_COUNT; i++) {
+        profile_get_summary(i, &summary);
+        fprintf(out, "%-20s %12lu %12.3f %12.3f %12.3f %12.3f\n",
+                profile_stage_name(i), (unsigned long) summary.count,
+                summary.mean / 1000.0, summary.p50 / 1000.0,
+                summary.p99 / 1000.0, summary.max / 1000.0);
+    }
+    fflush(out);
+}
+
+#ifdef USE_PROFILE
+static void
+profile_sigusr2_handler(int signum)
+{
+    sigusr2_received = 1;
+}
+#endif
+
+void
+profile_setup_dump_handler()
+{
+#ifdef USE_PROFILE
+    signal(SIGUSR2, profile_sigusr2_handler);
+#endif
+}
+
+void
+profile_check_dump(FILE *out)
+{
+    if (sigusr2_received) {
+        sigusr2_received = 0;
+        fprintf(out, "\n");
+        profile_dump(out);
+    }
+}
@@ -0,0 +1,189 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file profile.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to measure time spent in packet processing stages
+ *
+ * Hot path stages are wrapped with PROFILE_START/PROFILE_END macros. Each
+ * sample is stored in a per-thread log-linear histogram, so recording does
+ * not require any lock. Histograms of all threads are merged when read.
+ *
+ * Profiling is only available when sngrep is compiled with USE_PROFILE
+ * (--enable-profiling). Otherwise the macros expand to nothing.
+ *
+ */
+#ifndef __SNGREP_PROFILE_H
+#define __SNGREP_PROFILE_H
+
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Measured processing stages
+ */
+enum profile_stage {
+    PROFILE_IP_REASM = 0,
+    PROFILE_TCP_REASM,
+    PROFILE_WS,
+    PROFILE_TLS,
+    PROFILE_LOCK_WAIT,
+    PROFILE_SIP_VALIDATE,
+    PROFILE_SIP_PARSE,
+    PROFILE_CALLID_LOOKUP,
+    PROFILE_SDP_PARSE,
+    PROFILE_RTP_LOOKUP,
+    PROFILE_RTP_STATS,
+    PROFILE_DUMP,
+    PROFILE_STORE,
+    PROFILE_COMPRESS,
+    PROFILE_UI_REDRAW,
+    PROFILE_STAGE_COUNT
+};
+
+//! Shorter declaration of profile summary structure
+typedef struct profile_summary profile_summary_t;
+
+/**
+ * @brief Aggregated measures of a stage
+ *
+ * All times are in nanoseconds
+ */
+struct profile_summary {
+    //! Number of samples
+    uint64_t count;
+    //! Mean time
+    uint64_t mean;
+    //! Median time
+    uint64_t p50;
+    //! 99th percentile time
+    uint64_t p99;
+    //! Max time
+    uint64_t max;
+};
+
+#ifdef USE_PROFILE
+
+//! Start measuring a stage
+#define PROFILE_START(var)          uint64_t var = profile_ticks()
+//! Stop measuring a stage and store the sample
+#define PROFILE_END(stage, var)     profile_record(stage, profile_ticks() - (var))
+
+/**
+ * @brief Monotonic clock in nanoseconds, used when no TSC is available
+ */
+uint64_t
+profile_clock_ticks();
+
+/**
+ * @brief Read the CPU timestamp counter (or monotonic clock)
+ */
+static inline uint64_t
+profile_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+#else
+    return profile_clock_ticks();
+#endif
+}
+
+/**
+ * @brief Store a stage sample in current thread histogram
+ *
+ * @param stage One of profile_stage values
+ * @param ticks Measured ticks
+ */
+void
+profile_record(enum profile_stage stage, uint64_t ticks);
+
+#else
+
+#define PROFILE_START(var)
+#define PROFILE_END(stage, var)
+
+#endif
+
+/**
+ * @brief Initialize profiling data
+ *
+ * Stores the reference time used to convert ticks into nanoseconds
+ */
+void
+profile_init();
+
+/**
+ * @brief Check if profiling support has been compiled
+ */
+bool
+profile_enabled();
+
+/**
+ * @brief Get the display name of a stage
+ */
+const char *
+profile_stage_name(enum profile_stage stage);
+
+/**
+ * @brief Merge all threads samples of a stage
+ *
+ * @param stage One of profile_stage values
+ * @param summary Output aggregated measures
+ */
+void
+profile_get_summary(enum profile_stage stage, profile_summary_t *summary);
+
+/**
+ * @brief Discard all stored samples
+ */
+void
+profile_reset();
+
+/**
+ * @brief Print all stages summary to the given stream
+ */
+void
+profile_dump(FILE *out);
+
+/**
+ * @brief Install SIGUSR2 handler to request a profile dump
+ *
+ * The handler is only installed when compiled with USE_PROFILE, so
+ * SIGUSR2 keeps its default action otherwise.
+ */
+void
+profile_setup_dump_handler();
+
+/**
+ * @brief Dump profile data if SIGUSR2 has been received
+ *
+ * This is meant to be called from the main loop in no interface mode.
+ */
+void
+profile_check_dump(FILE *out);
+
+#endif /* __SNGREP_PROFILE_H */
@@ -0,0 +1,225 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file regexp.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in regexp.h
+ *
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "regexp.h"
+
+#if defined(WITH_PCRE) || defined(WITH_PCRE2)
+/**
+ * @brief Matching resources of a thread
+ */
+struct regexp_thread {
+#ifdef WITH_PCRE
+#ifdef PCRE_STUDY_JIT_COMPILE
+    //! JIT stack used by all expressions
+    pcre_jit_stack *stack;
+#endif
+#else
+    //! Match results, only the first pair is stored
+    pcre2_match_data *match_data;
+    //! Match context using the thread JIT stack
+    pcre2_match_context *context;
+    //! JIT stack used by all expressions
+    pcre2_jit_stack *stack;
+#endif
+};
+
+//! Key to release thread resources when threads exit
+static pthread_key_t regexp_key;
+//! Create the key only once
+static pthread_once_t regexp_key_once = PTHREAD_ONCE_INIT;
+//! Resources of the current thread
+static __thread struct regexp_thread *regexp_thread = NULL;
+
+/**
+ * @brief Free matching resources of an exiting thread
+ */
+static void
+regexp_thread_free(void *data)
+{
+    struct regexp_thread *thread = data;
+
+#ifdef WITH_PCRE
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if (thread->stack)
+        pcre_jit_stack_free(thread->stack);
+#endif
+#else
+    pcre2_match_data_free(thread->match_data);
+    pcre2_match_context_free(thread->context);
+    pcre2_jit_stack_free(thread->stack);
+#endif
+    free(thread);
+}
+
+static void
+regexp_key_create()
+{
+    pthread_key_create(&regexp_key, regexp_thread_free);
+}
+
+/**
+ * @brief Get matching resources of the current thread, allocating them once
+ *
+ * @return thread resources or NULL if they can not be allocated
+ */
+static struct regexp_thread *
+regexp_thread_get()
+{
+    struct regexp_thread *thread;
+
+    if (regexp_thread)
+        return regexp_thread;
+
+    if (!(thread = calloc(1, sizeof(struct regexp_thread))))
+        return NULL;
+
+#ifdef WITH_PCRE
+#ifdef PCRE_STUDY_JIT_COMPILE
+    thread->stack = pcre_jit_stack_alloc(REGEXP_JIT_STACK_MIN, REGEXP_JIT_STACK_MAX);
+#endif
+#else
+    if (!(thread->match_data = pcre2_match_data_create(1, NULL))) {
+        regexp_thread_free(thread);
+        return NULL;
+    }
+
+    // Without a JIT stack, JIT code uses a small stack on the machine stack
+    thread->context = pcre2_match_context_create(NULL);
+    thread->stack = pcre2_jit_stack_create(REGEXP_JIT_STACK_MIN, REGEXP_JIT_STACK_MAX, NULL);
+    if (thread->context && thread->stack)
+        pcre2_jit_stack_assign(thread->context, NULL, thread->stack);
+#endif
+
+    pthread_once(&regexp_key_once, regexp_key_create);
+    pthread_setspecific(regexp_key, thread);
+    return regexp_thread = thread;
+}
+#endif
+
+#if defined(WITH_PCRE) && defined(PCRE_STUDY_JIT_COMPILE)
+/**
+ * @brief Get the JIT stack of the thread running an expression
+ */
+static pcre_jit_stack *
+regexp_jit_stack(void *data)
+{
+    struct regexp_thread *thread = regexp_thread_get();
+    (void) data;
+    return (thread) ? thread->stack : NULL;
+}
+#endif
+
+int
+regexp_compile(regexp_t *re, const char *expr, int flags)
+{
+#ifdef WITH_PCRE
+    const char *re_err = NULL;
+    int32_t err_offset;
+    int32_t options = PCRE_UNGREEDY;
+
+    if (flags & REGEXP_CASELESS)
+        options |= PCRE_CASELESS;
+    if (flags & REGEXP_DOTALL)
+        options |= PCRE_DOTALL;
+
+    if (!(re->regex = pcre_compile(expr, options, &re_err, &err_offset, 0)))
+        return 1;
+
+    // Study failures only mean the expression will not be optimized
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if ((re->extra = pcre_study(re->regex, PCRE_STUDY_JIT_COMPILE, &re_err)))
+        pcre_assign_jit_stack(re->extra, regexp_jit_stack, NULL);
+#else
+    re->extra = pcre_study(re->regex, 0, &re_err);
+#endif
+    return 0;
+#elif defined(WITH_PCRE2)
+    int re_err = 0;
+    PCRE2_SIZE err_offset = 0;
+    uint32_t options = PCRE2_UNGREEDY;
+
+    if (flags & REGEXP_CASELESS)
+        options |= PCRE2_CASELESS;
+    if (flags & REGEXP_DOTALL)
+        options |= PCRE2_DOTALL;
+
+    if (!(re->regex = pcre2_compile((PCRE2_SPTR) expr, PCRE2_ZERO_TERMINATED, options, &re_err, &err_offset, NULL)))
+        return 1;
+
+    // If JIT is not supported, the expression is interpreted
+    pcre2_jit_compile(re->regex, PCRE2_JIT_COMPLETE);
+    return 0;
+#else
+    int cflags = REG_EXTENDED | REG_NOSUB;
+
+    if (flags & REGEXP_CASELESS)
+        cflags |= REG_ICASE;
+
+    return regcomp(&re->regex, expr, cflags) != 0;
+#endif
+}
+
+bool
+regexp_match(const regexp_t *re, const char *data, size_t len)
+{
+#ifdef WITH_PCRE
+    return pcre_exec(re->regex, re->extra, data, len, 0, 0, NULL, 0) >= 0;
+#elif defined(WITH_PCRE2)
+    struct regexp_thread *thread;
+
+    if (!(thread = regexp_thread_get()))
+        return false;
+
+    return pcre2_match(re->regex, (PCRE2_SPTR) data, (PCRE2_SIZE) len, 0, 0,
+                       thread->match_data, thread->context) >= 0;
+#else
+    (void) len;
+    return regexec(&re->regex, data, 0, NULL, 0) == 0;
+#endif
+}
+
+void
+regexp_free(regexp_t *re)
+{
+#ifdef WITH_PCRE
+#ifdef PCRE_STUDY_JIT_COMPILE
+    pcre_free_study(re->extra);
+#else
+    pcre_free(re->extra);
+#endif
+    pcre_free(re->regex);
+#elif defined(WITH_PCRE2)
+    pcre2_code_free(re->regex);
+#else
+    regfree(&re->regex);
+#endif
+}
@@ -0,0 +1,118 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file regexp.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to match regular expressions with the configured library
+ *
+ * Expressions are compiled with PCRE, PCRE2 or POSIX regex depending on
+ * build options. Perl compatible expressions are JIT compiled when the
+ * library supports it.
+ *
+ * Expressions are matched from capture, correlation and interface threads.
+ * Match data and JIT stacks are allocated once per thread and reused for
+ * every match, instead of being allocated for each one.
+ *
+ */
+#ifndef __SNGREP_REGEXP_H
+#define __SNGREP_REGEXP_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <stddef.h>
+#ifdef WITH_PCRE
+#include <pcre.h>
+#elif defined(WITH_PCRE2)
+#include <pcre2.h>
+#else
+#include <regex.h>
+#endif
+
+//! Initial size of per thread JIT stacks
+#define REGEXP_JIT_STACK_MIN    (32 * 1024)
+//! Max size of per thread JIT stacks
+#define REGEXP_JIT_STACK_MAX    (1024 * 1024)
+
+//! Shorter declaration of regexp structure
+typedef struct regexp regexp_t;
+
+/**
+ * @brief Regular expression compile flags
+ */
+enum regexp_flags {
+    //! Ignore case
+    REGEXP_CASELESS = 1 << 0,
+    //! Dot matches any character, including newlines
+    REGEXP_DOTALL = 1 << 1,
+};
+
+/**
+ * @brief Compiled regular expression
+ */
+struct regexp {
+#ifdef WITH_PCRE
+    //! Compiled expression
+    pcre *regex;
+    //! Study data, including JIT compiled code
+    pcre_extra *extra;
+#elif defined(WITH_PCRE2)
+    //! Compiled expression, including JIT compiled code
+    pcre2_code *regex;
+#else
+    //! Compiled expression
+    regex_t regex;
+#endif
+};
+
+/**
+ * @brief Compile a regular expression
+ *
+ * Perl compatible expressions are always ungreedy. POSIX expressions use
+ * extended syntax, where dot always matches newlines.
+ *
+ * @param re Expression to fill
+ * @param expr Expression text
+ * @param flags Compile flags from regexp_flags
+ * @return 0 if expression has been compiled, 1 otherwise
+ */
+int
+regexp_compile(regexp_t *re, const char *expr, int flags);
+
+/**
+ * @brief Check if data matches a compiled expression
+ *
+ * @param re Compiled expression
+ * @param data Null-terminated data
+ * @param len Data length
+ * @return true if data matches, false otherwise
+ */
+bool
+regexp_match(const regexp_t *re, const char *data, size_t len);
+
+/**
+ * @brief Free a compiled expression
+ */
+void
+regexp_free(regexp_t *re);
+
+#endif /* __SNGREP_REGEXP_H */
@@ -0,0 +1,518 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file report.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in report.h
+ *
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "report.h"
+#include "sip.h"
+#include "rtp.h"
+#include "hash.h"
+
+/**
+ * @brief Batch report status
+ */
+struct report_status {
+    //! Removed dialogs are being accounted
+    bool enabled;
+    //! Aggregated data
+    report_t data;
+    //! Tracked talkers by IP address
+    htable_t *talkers;
+    //! Pipe to send the report to the parent process or -1
+    int parent;
+};
+
+/**
+ * @brief Analysis process of an input file
+ */
+struct report_worker {
+    //! Process id
+    pid_t pid;
+    //! Pipe to receive the process report
+    int fd;
+};
+
+//! Batch report status
+static struct report_status report = { .parent = -1 };
+
+void
+report_init()
+{
+    report.enabled = true;
+    report.data.files = 1;
+}
+
+/**
+ * @brief Add packets sent by an address to top talkers
+ */
+static void
+report_add_talker(const char *ip, uint64_t packets)
+{
+    report_talker_t *talker;
+    int i;
+
+    if (!*ip || !packets)
+        return;
+
+    if (!report.talkers && !(report.talkers = htable_create(REPORT_TALKERS * 2)))
+        return;
+
+    if ((talker = htable_find(report.talkers, ip))) {
+        talker->packets += packets;
+        return;
+    }
+
+    if (report.data.talker_count < REPORT_TALKERS) {
+        talker = &report.data.talkers[report.data.talker_count++];
+    } else {
+        // Replace the address with less packets, inheriting its count
+        talker = &report.data.talkers[0];
+        for (i = 1; i < REPORT_TALKERS; i++) {
+            if (report.data.talkers[i].packets < talker->packets)
+                talker = &report.data.talkers[i];
+        }
+        htable_remove(report.talkers, talker->ip);
+        packets += talker->packets;
+    }
+
+    strcpy(talker->ip, ip);
+    talker->packets = packets;
+    htable_insert(report.talkers, talker->ip, talker);
+}
+
+/**
+ * @brief Add a stream to the list of worst quality streams
+ */
+static void
+report_add_worst(const report_stream_t *stream)
+{
+    report_stream_t *worst = report.data.worst;
+    int pos;
+
+    // Streams are sorted by MOS, worst first
+    for (pos = report.data.worst_count; pos > 0 && worst[pos - 1].mos > stream->mos; pos--);
+    if (pos == REPORT_WORST_STREAMS)
+        return;
+
+    if (report.data.worst_count < REPORT_WORST_STREAMS)
+        report.data.worst_count++;
+    memmove(&worst[pos + 1], &worst[pos], sizeof(report_stream_t) * (report.data.worst_count - pos - 1));
+    worst[pos] = *stream;
+}
+
+/**
+ * @brief Estimate the MOS of a stream from its loss and jitter
+ *
+ * Uses the simplified E-model, with jitter as the only delay source.
+ */
+static double
+report_stream_mos(double loss, double jitter)
+{
+    double latency = jitter * 2 + 10, r;
+
+    r = (latency < 160) ? 93.2 - latency / 40 : 93.2 - (latency - 120) / 10;
+    r -= loss * 2.5;
+    if (r < 0)
+        r = 0;
+    if (r > 100)
+        r = 100;
+
+    return 1 + 0.035 * r + 0.000007 * r * (r - 60) * (100 - r);
+}
+
+/**
+ * @brief Count a value in a table of fixed resolution values
+ *
+ * @param steps Table of counters, one per value
+ * @param count Number of counters in the table
+ * @param value Value in table units, clamped to the table limits
+ */
+static void
+report_steps_add(uint64_t *steps, int count, double value)
+{
+    int step = (int) (value + 0.5);
+
+    if (step < 0)
+        step = 0;
+    if (step >= count)
+        step = count - 1;
+    steps[step]++;
+}
+
+/**
+ * @brief Get the value below which the given percent of values fall
+ *
+ * @param steps Table of counters, one per hundredth of value
+ * @param count Number of counters in the table
+ * @param min Value of the first counter, multiplied by 100
+ * @param total Number of counted values
+ * @param percent Requested percentile (0-100)
+ * @return Value or 0 if there are no values
+ */
+static double
+report_steps_percentile(const uint64_t *steps, int count, int min, uint64_t total, double percent)
+{
+    uint64_t seen = 0;
+    int i;
+
+    for (i = 0; total && i < count; i++) {
+        seen += steps[i];
+        if (steps[i] && seen * 100.0 >= total * percent)
+            return (i + min) / 100.0;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Account the quality of a dialog RTP stream
+ */
+static void
+report_add_stream(sip_call_t *call, rtp_stream_t *stream)
+{
+    report_stream_t entry;
+    double loss;
+
+    // Packets of all streams are accounted for top talkers
+    report_add_talker(stream->src.ip, stream_get_count(stream));
+
+    if (stream->type != PACKET_RTP || !stream->rtpstats.initialized)
+        return;
+
+    memset(&entry, 0, sizeof(entry));
+    snprintf(entry.callid, sizeof(entry.callid), "%s", call->callid);
+    entry.src = stream->src;
+    entry.dst = stream->dst;
+    entry.expected = stream_get_expected_count(stream);
+    entry.lost = stream_get_lost_count(stream);
+    entry.jitter = stream->rtpstats.mean_jitter;
+    loss = entry.expected ? entry.lost * 100.0 / entry.expected : 0;
+    entry.mos = report_stream_mos(loss, entry.jitter);
+
+    report.data.streams++;
+    report.data.expected += entry.expected;
+    report.data.lost += entry.lost;
+    report_steps_add(report.data.loss, REPORT_LOSS_STEPS, loss * 100);
+    histogram_add(&report.data.jitter, (uint64_t) (entry.jitter * 1000));
+    report_steps_add(report.data.mos, REPORT_MOS_STEPS, entry.mos * 100 - REPORT_MOS_MIN);
+    report_add_worst(&entry);
+}
+
+void
+report_add_call(sip_call_t *call)
+{
+    sip_msg_t *msg;
+    rtp_stream_t *stream;
+    vector_iter_t it;
+
+    if (!report.enabled)
+        return;
+
+    report.data.dialogs++;
+    sip_counters_account_call(&report.data.sip, call);
+
+    it = vector_iterator(call->msgs);
+    while ((msg = vector_iterator_next(&it))) {
+        if (msg->packet)
+            report_add_talker(msg->packet->src.ip, 1);
+    }
+
+    it = vector_iterator(call->streams);
+    while ((stream = vector_iterator_next(&it)))
+        report_add_stream(call, stream);
+}
+
+/**
+ * @brief Add the report of an input file to the current one
+ */
+static void
+report_merge(const report_t *other)
+{
+    int i;
+
+    report.data.files += other->files;
+    report.data.dialogs += other->dialogs;
+    sip_counters_merge(&report.data.sip, &other->sip);
+    report.data.streams += other->streams;
+    report.data.expected += other->expected;
+    report.data.lost += other->lost;
+    for (i = 0; i < REPORT_LOSS_STEPS; i++)
+        report.data.loss[i] += other->loss[i];
+    histogram_merge(&report.data.jitter, &other->jitter);
+    for (i = 0; i < REPORT_MOS_STEPS; i++)
+        report.data.mos[i] += other->mos[i];
+    for (i = 0; i < other->worst_count; i++)
+        report_add_worst(&other->worst[i]);
+    for (i = 0; i < other->talker_count; i++)
+        report_add_talker(other->talkers[i].ip, other->talkers[i].packets);
+}
+
+/**
+ * @brief Read the report of an input file from its analysis process
+ *
+ * @return 0 if the whole report has been read, 1 otherwise
+ */
+static int
+report_receive(int fd, report_t *other)
+{
+    size_t pos;
+    ssize_t len;
+
+    for (pos = 0; pos < sizeof(report_t); pos += len) {
+        len = read(fd, (char *) other + pos, sizeof(report_t) - pos);
+        if (len < 0 && errno == EINTR) {
+            len = 0;
+            continue;
+        }
+        if (len <= 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Send the report to the parent process
+ *
+ * @return 0 if the whole report has been sent, 1 otherwise
+ */
+static int
+report_send(int fd)
+{
+    size_t pos;
+    ssize_t len;
+
+    for (pos = 0; pos < sizeof(report_t); pos += len) {
+        len = write(fd, (char *) &report.data + pos, sizeof(report_t) - pos);
+        if (len < 0 && errno == EINTR) {
+            len = 0;
+            continue;
+        }
+        if (len <= 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+int
+report_fork(vector_t *files)
+{
+    struct report_worker *workers;
+    report_t *other;
+    int count = vector_count(files), started, finished, i, fd[2], status;
+    long jobs;
+
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1)
+        jobs = 1;
+
+    if (!(workers = calloc(count, sizeof(struct report_worker))) || !(other = malloc(sizeof(report_t)))) {
+        free(workers);
+        fprintf(stderr, "Can't allocate memory for report data!\n");
+        return -1;
+    }
+
+    for (started = 0, finished = 0; finished < count; finished++) {
+        // Start one process per CPU
+        for (; started < count && started - finished < jobs; started++) {
+            workers[started].pid = -1;
+            workers[started].fd = -1;
+            if (pipe(fd) != 0) {
+                fprintf(stderr, "Unable to analyze %s: %s\n", (char *) vector_item(files, started), strerror(errno));
+                continue;
+            }
+
+            if ((workers[started].pid = fork()) == 0) {
+                // Only the pipe to send the report is required
+                for (i = finished; i < started; i++) {
+                    if (workers[i].fd != -1)
+                        close(workers[i].fd);
+                }
+                close(fd[0]);
+                free(workers);
+                free(other);
+                // Reports of already finished processes are sent by the parent
+                if (report.talkers) {
+                    htable_destroy(report.talkers);
+                    report.talkers = NULL;
+                }
+                memset(&report.data, 0, sizeof(report_t));
+                report.parent = fd[1];
+                return started;
+            }
+
+            close(fd[1]);
+            if (workers[started].pid == -1) {
+                fprintf(stderr, "Unable to analyze %s: %s\n", (char *) vector_item(files, started), strerror(errno));
+                close(fd[0]);
+                continue;
+            }
+            workers[started].fd = fd[0];
+        }
+
+        // Merge the report of the oldest running process
+        if (workers[finished].pid == -1)
+            continue;
+        if (report_receive(workers[finished].fd, other) == 0) {
+            report_merge(other);
+        } else {
+            fprintf(stderr, "Unable to analyze %s\n", (char *) vector_item(files, finished));
+        }
+        close(workers[finished].fd);
+        waitpid(workers[finished].pid, &status, 0);
+    }
+
+    free(workers);
+    free(other);
+    return -1;
+}
+
+/**
+ * @brief Compare talkers by sent packets, most packets first
+ */
+static int
+report_talker_cmp(const void *one, const void *two)
+{
+    const report_talker_t *a = one, *b = two;
+    return (a->packets < b->packets) - (a->packets > b->packets);
+}
+
+/**
+ * @brief Print percentiles of a histogram with the given scale
+ */
+static void
+report_write_percentiles(FILE *out, const char *title, const histogram_t *histogram, double scale)
+{
+    fprintf(out, "  %-20s p50 %-9.2f p90 %-9.2f p95 %-9.2f p99 %-9.2f\n", title,
+            histogram_percentile(histogram, 50) / scale, histogram_percentile(histogram, 90) / scale,
+            histogram_percentile(histogram, 95) / scale, histogram_percentile(histogram, 99) / scale);
+}
+
+/**
+ * @brief Print the report in text format
+ */
+static void
+report_write_text(FILE *out)
+{
+    report_t *data = &report.data;
+    report_stream_t *stream;
+    int i;
+
+    fprintf(out, "Analyzed files: %d\n", data->files);
+    fprintf(out, "Dialogs: %lu\n", (unsigned long) data->dialogs);
+    fprintf(out, "Messages: %d\n", data->sip.messages);
+    fprintf(out, "Calls: %d\n", data->sip.calls);
+
+    fprintf(out, "\nCalls by state:\n");
+    for (i = 1; i < SIP_COUNTERS_STATES; i++)
+        fprintf(out, "  %-20s %d\n", call_state_to_str(i), data->sip.states[i]);
+
+    fprintf(out, "\nRequests by method:\n");
+    for (i = 1; i < SIP_COUNTERS_METHODS; i++) {
+        if (data->sip.methods[i])
+            fprintf(out, "  %-20s %d\n", sip_method_str(i), data->sip.methods[i]);
+    }
+
+    fprintf(out, "\nResponses by code:\n");
+    for (i = 100; i < SIP_COUNTERS_CODES; i++) {
+        if (data->sip.responses[i])
+            fprintf(out, "  %-20d %d\n", i, data->sip.responses[i]);
+    }
+
+    fprintf(out, "\nCall times (ms):\n");
+    report_write_percentiles(out, "Setup time", &data->sip.setup, 1000);
+    report_write_percentiles(out, "Post dial delay", &data->sip.pdd, 1000);
+
+    fprintf(out, "\nRTP streams: %lu\n", (unsigned long) data->streams);
+    fprintf(out, "  %-20s %lu\n", "Expected packets", (unsigned long) data->expected);
+    fprintf(out, "  %-20s %lu (%.2f%%)\n", "Lost packets", (unsigned long) data->lost,
+            data->expected ? data->lost * 100.0 / data->expected : 0);
+    fprintf(out, "  %-20s p50 %-9.2f p90 %-9.2f p95 %-9.2f p99 %-9.2f\n", "Packet loss (%)",
+            report_steps_percentile(data->loss, REPORT_LOSS_STEPS, 0, data->streams, 50),
+            report_steps_percentile(data->loss, REPORT_LOSS_STEPS, 0, data->streams, 90),
+            report_steps_percentile(data->loss, REPORT_LOSS_STEPS, 0, data->streams, 95),
+            report_steps_percentile(data->loss, REPORT_LOSS_STEPS, 0, data->streams, 99));
+    report_write_percentiles(out, "Mean jitter (ms)", &data->jitter, 1000);
+    fprintf(out, "  %-20s p50 %-9.2f p10 %-9.2f p5  %-9.2f p1  %-9.2f\n", "Estimated MOS",
+            report_steps_percentile(data->mos, REPORT_MOS_STEPS, REPORT_MOS_MIN, data->streams, 50),
+            report_steps_percentile(data->mos, REPORT_MOS_STEPS, REPORT_MOS_MIN, data->streams, 10),
+            report_steps_percentile(data->mos, REPORT_MOS_STEPS, REPORT_MOS_MIN, data->streams, 5),
+            report_steps_percentile(data->mos, REPORT_MOS_STEPS, REPORT_MOS_MIN, data->streams, 1));
+
+    if (data->worst_count) {
+        fprintf(out, "\nWorst RTP streams:\n");
+        for (i = 0; i < data->worst_count; i++) {
+            stream = &data->worst[i];
+            fprintf(out, "  MOS %.2f loss %.2f%% jitter %.2fms %s:%u -> %s:%u %s\n", stream->mos,
+                    stream->expected ? stream->lost * 100.0 / stream->expected : 0, stream->jitter,
+                    stream->src.ip, stream->src.port, stream->dst.ip, stream->dst.port, stream->callid);
+        }
+    }
+
+    if (data->talker_count) {
+        qsort(data->talkers, data->talker_count, sizeof(report_talker_t), report_talker_cmp);
+        fprintf(out, "\nTop talkers (packets):\n");
+        for (i = 0; i < data->talker_count && i < REPORT_TOP_TALKERS; i++)
+            fprintf(out, "  %-40s %lu\n", data->talkers[i].ip, (unsigned long) data->talkers[i].packets);
+    }
+}
+
+int
+report_finish(const char *path)
+{
+    FILE *out;
+    int ret = 0;
+
+    // Stop accounting dialogs removed from now on
+    report.enabled = false;
+
+    if (report.parent != -1) {
+        ret = report_send(report.parent);
+        close(report.parent);
+        return ret;
+    }
+
+    if (!strcmp(path, "-")) {
+        out = stdout;
+    } else if (!(out = fopen(path, "w"))) {
+        fprintf(stderr, "Couldn't open report file %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    report_write_text(out);
+
+    if (out != stdout && fclose(out) != 0)
+        ret = 1;
+    return ret;
+}
@@ -0,0 +1,181 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file report.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to build aggregate reports of analyzed dialogs
+ *
+ * In batch report mode dialogs are accounted in the report when they are
+ * removed, so they can be expired as soon as they finish and only dialogs
+ * in progress are kept in memory.
+ *
+ * When several input files are given, each one is analyzed by its own
+ * process. Reports of all files are sent to the first process and merged
+ * before being written: all report data is made of counters, histograms
+ * and fixed size tables that can be added together. Packet loss and MOS
+ * are bounded values, so they are counted with their exact reported
+ * resolution instead of using a histogram.
+ *
+ * Top talkers are tracked with a fixed size table. When the table is full,
+ * the address with less packets is replaced and its count inherited, so
+ * reported counts can be overestimated when there are many addresses.
+ *
+ */
+#ifndef __SNGREP_REPORT_H
+#define __SNGREP_REPORT_H
+
+#include "config.h"
+#include <stdint.h>
+#include "address.h"
+#include "histogram.h"
+#include "sip_counters.h"
+#include "vector.h"
+
+//! Seconds finished dialogs are kept before being reported, if not configured
+#define REPORT_EXPIRE           2
+//! Addresses tracked for top talkers
+#define REPORT_TALKERS          256
+//! Top talkers written in the report
+#define REPORT_TOP_TALKERS      10
+//! Streams with worst quality written in the report
+#define REPORT_WORST_STREAMS    10
+//! Max Call-ID length stored for worst streams
+#define REPORT_CALLID_LEN       128
+//! Packet loss values, in hundredths of percent from 0% to 100%
+#define REPORT_LOSS_STEPS       10001
+//! Lowest estimated MOS value, multiplied by 100
+#define REPORT_MOS_MIN          100
+//! Estimated MOS values, in hundredths from 1.00 to 5.00
+#define REPORT_MOS_STEPS        401
+
+//! Shorter declaration of report_talker structure
+typedef struct report_talker report_talker_t;
+//! Shorter declaration of report_stream structure
+typedef struct report_stream report_stream_t;
+//! Shorter declaration of report structure
+typedef struct report report_t;
+
+/**
+ * @brief Packets sent by an address
+ */
+struct report_talker {
+    //! Source IP address
+    char ip[ADDRESSLEN];
+    //! Sent SIP messages and RTP packets
+    uint64_t packets;
+};
+
+/**
+ * @brief Quality of a RTP stream
+ */
+struct report_stream {
+    //! Call-ID of the stream dialog
+    char callid[REPORT_CALLID_LEN];
+    //! Source address
+    address_t src;
+    //! Destination address
+    address_t dst;
+    //! Expected RTP packets
+    uint32_t expected;
+    //! Lost RTP packets
+    uint32_t lost;
+    //! Mean jitter, in ms
+    double jitter;
+    //! Estimated MOS
+    double mos;
+};
+
+/**
+ * @brief Aggregated data of analyzed dialogs
+ */
+struct report {
+    //! Number of analyzed input files
+    int files;
+    //! Number of analyzed dialogs
+    uint64_t dialogs;
+    //! Messages, responses, states and setup times of analyzed dialogs
+    sip_counters_t sip;
+    //! Number of RTP streams with received packets
+    uint64_t streams;
+    //! Expected RTP packets of all streams
+    uint64_t expected;
+    //! Lost RTP packets of all streams
+    uint64_t lost;
+    //! Streams per packet loss, in hundredths of percent
+    uint64_t loss[REPORT_LOSS_STEPS];
+    //! Streams mean jitter, in microseconds
+    histogram_t jitter;
+    //! Streams per estimated MOS, in hundredths from REPORT_MOS_MIN
+    uint64_t mos[REPORT_MOS_STEPS];
+    //! Streams with worst estimated MOS, worst first
+    report_stream_t worst[REPORT_WORST_STREAMS];
+    //! Number of worst streams
+    int worst_count;
+    //! Tracked talkers
+    report_talker_t talkers[REPORT_TALKERS];
+    //! Number of tracked talkers
+    int talker_count;
+};
+
+/**
+ * @brief Start accounting removed dialogs in the report
+ */
+void
+report_init();
+
+/**
+ * @brief Analyze each input file in its own process
+ *
+ * Child processes continue analyzing their file and send their report
+ * when finished. The calling process waits for them, running up to one
+ * process per CPU, and merges their reports.
+ *
+ * @param files Input files to analyze
+ * @return index of the file to analyze or -1 in the calling process
+ */
+int
+report_fork(vector_t *files);
+
+/**
+ * @brief Account a dialog being removed
+ *
+ * Must be called with the capture lock held.
+ *
+ * @param call Removed dialog
+ */
+void
+report_add_call(sip_call_t *call);
+
+/**
+ * @brief Write the report of all analyzed dialogs
+ *
+ * Processes analyzing one of several input files send the report to the
+ * process that started them instead.
+ *
+ * @param path Report file or - for standard output
+ * @return 0 if report has been written, 1 otherwise
+ */
+int
+report_finish(const char *path);
+
+#endif /* __SNGREP_REPORT_H */
@@ -34,9 +34,24 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 #include "rtp.h"
 #include "sip.h"
 #include "vector.h"
+#include "profile.h"
+
+/**
+ * @brief Dialog streams indexed by destination address
+ */
+struct rtp_index {
+    //! Streams of each bucket, most recently added first
+    rtp_stream_t *buckets[RTP_INDEX_SIZE];
+    //! Lock for index access from capture and correlation threads
+    pthread_rwlock_t lock;
+};
+
+//! Dialog streams index
+static struct rtp_index rtp_index = { .lock = PTHREAD_RWLOCK_INITIALIZER };
 
 /**
  * @brief Known RTP encodings
@@ -331,6 +346,20 @@ stream_create(sdp_media_t *media, address_t dst, int type)
     return stream;
 }
 
+void
+stream_destroy(rtp_stream_t *stream)
+{
+    rtp_store_destroy(stream->store);
+    vector_destroy_items(stream->events);
+    sng_free(stream);
+}
+
+void
+stream_destroyer(void *stream)
+{
+    stream_destroy((rtp_stream_t *) stream);
+}
+
 rtp_stream_t *
 stream_complete(rtp_stream_t *stream, address_t src)
 {
@@ -541,6 +570,7 @@ rtp_check_packet(packet_t *packet)
     address_t src, dst;
     rtp_stream_t *stream;
     rtp_stream_t *reverse;
+    sip_call_t *call;
     u_char format = 0;
     u_char *payload;
     uint32_t size, bsize;
@@ -565,12 +595,18 @@ rtp_check_packet(packet_t *packet)
         format = RTP_PAYLOAD_TYPE(*(payload + 1));
 
         // Find the matching stream
+        PROFILE_START(prof_lookup);
         stream = rtp_find_stream_format(src, dst, format);
+        PROFILE_END(PROFILE_RTP_LOOKUP, prof_lookup);
 
         // Check if a valid stream has been found
         if (!stream)
             return NULL;
 
+        // Its dialog can be updated by its correlation worker meanwhile
+        call = msg_get_call(stream->media->msg);
+        sip_call_lock(call);
+
         // We have found a stream, but with different format
         if (stream_is_complete(stream) && stream->rtpinfo.fmtcode != format) {
             // Create a new stream for this new format
@@ -628,12 +664,16 @@ rtp_check_packet(packet_t *packet)
             }
         }
 
+        sip_call_unlock(call);
+
         if (stream->telephone_event) {
             stream_add_event(stream, packet);
         }
 
         // Add packet to stream
+        PROFILE_START(prof_stats);
         stream_add_packet(stream, packet);
+        PROFILE_END(PROFILE_RTP_STATS, prof_stats);
     } else if (data_is_rtcp(payload, size) == 0) {
         // Find the matching stream
         if ((stream = rtp_find_rtcp_stream(src, dst))) {
@@ -736,54 +776,96 @@ rtp_check_packet(packet_t *packet)
     return stream;
 }
 
+/**
+ * @brief Get the streams index bucket for a destination address
+ */
+static rtp_stream_t **
+rtp_index_bucket(address_t dst)
+{
+    // FNV-1a hash of destination address and port
+    uint32_t hash = 2166136261u;
+    const char *ip;
+
+    for (ip = dst.ip; *ip; ip++) {
+        hash ^= (u_char) *ip;
+        hash *= 16777619u;
+    }
+    hash ^= dst.port;
+    hash *= 16777619u;
+
+    return &rtp_index.buckets[hash % RTP_INDEX_SIZE];
+}
+
+void
+rtp_index_add(rtp_stream_t *stream)
+{
+    rtp_stream_t **bucket = rtp_index_bucket(stream->dst);
+
+    pthread_rwlock_wrlock(&rtp_index.lock);
+    stream->index_next = *bucket;
+    *bucket = stream;
+    pthread_rwlock_unlock(&rtp_index.lock);
+}
+
+void
+rtp_index_remove_call(struct sip_call *call)
+{
+    rtp_stream_t *stream, **item;
+    vector_iter_t it = vector_iterator(call->streams);
+
+    pthread_rwlock_wrlock(&rtp_index.lock);
+    while ((stream = vector_iterator_next(&it))) {
+        for (item = rtp_index_bucket(stream->dst); *item; item = &(*item)->index_next) {
+            if (*item == stream) {
+                *item = stream->index_next;
+                break;
+            }
+        }
+        stream->index_next = NULL;
+    }
+    pthread_rwlock_unlock(&rtp_index.lock);
+}
+
 rtp_stream_t *
 rtp_find_stream_format(address_t src, address_t dst, uint32_t format)
 {
     // Structure for RTP packet streams
     rtp_stream_t *stream;
-    // Check if this is a RTP packet from active calls
-    sip_call_t *call;
-    // Iterator for active calls
-    vector_iter_t calls;
-    // Iterator for call streams
-    vector_iter_t streams;
     // Candiate stream
     rtp_stream_t *candidate = NULL;
 
-    // Get active calls (during conversation)
-    calls = sip_active_calls_iterator();
-    vector_iterator_set_current(&calls, vector_iterator_count(&calls));
-
-    while ((call = vector_iterator_prev(&calls))) {
-        streams = vector_iterator(call->streams);
-        vector_iterator_set_last(&streams);
-        while ((stream = vector_iterator_prev(&streams))) {
-            // Only look RTP packets
-            if (stream->type != PACKET_RTP)
-                continue;
-
-            // Stream complete, check source, dst
-            if (stream_is_complete(stream)) {
-                if (addressport_equals(stream->src, src) &&
-                    addressport_equals(stream->dst, dst)) {
-                    // Exact searched stream format
-                    if (stream->rtpinfo.fmtcode == format) {
-                        return stream;
-                    } else {
-                        // Matching addresses but different format
-                        candidate = stream;
-                    }
-                }
-            } else {
-                // Incomplete stream, if dst match is enough
-                if (addressport_equals(stream->dst, dst)) {
-                       return stream;
+    pthread_rwlock_rdlock(&rtp_index.lock);
+
+    // Check streams with this destination, newest first
+    for (stream = *rtp_index_bucket(dst); stream; stream = stream->index_next) {
+        // Only look RTP packets
+        if (stream->type != PACKET_RTP)
+            continue;
+
+        // Only look streams of active calls (during conversation)
+        if (!addressport_equals(stream->dst, dst) || !stream_get_call(stream)->active)
+            continue;
+
+        // Stream complete, check source
+        if (stream_is_complete(stream)) {
+            if (addressport_equals(stream->src, src)) {
+                // Exact searched stream format
+                if (stream->rtpinfo.fmtcode == format) {
+                    break;
+                } else {
+                    // Matching addresses but different format
+                    candidate = stream;
                 }
             }
+        } else {
+            // Incomplete stream, if dst match is enough
+            break;
         }
     }
 
-    return candidate;
+    pthread_rwlock_unlock(&rtp_index.lock);
+
+    return stream ? stream : candidate;
 }
 
 rtp_stream_t *
@@ -791,27 +873,23 @@ rtp_find_rtcp_stream(address_t src, address_t dst)
 {
     // Structure for RTP packet streams
     rtp_stream_t *stream;
-    // Check if this is a RTP packet from active calls
-    sip_call_t *call;
-    // Iterator for active calls
-    vector_iter_t calls;
-
-    // Get active calls (during conversation)
-    calls = sip_calls_iterator();
-    vector_iterator_set_current(&calls, vector_iterator_count(&calls));
-
-    while ((call = vector_iterator_prev(&calls))) {
-        // Check if this call has an RTP stream for current packet data
-        if ((stream = rtp_find_call_stream(call, src, dst))) {
-            if (stream->type != PACKET_RTCP)
-                continue;
-            return stream;
-        }
+
+    pthread_rwlock_rdlock(&rtp_index.lock);
+
+    // Check streams with this destination, newest first
+    for (stream = *rtp_index_bucket(dst); stream; stream = stream->index_next) {
+        if (stream->type != PACKET_RTCP || !addressport_equals(stream->dst, dst))
+            continue;
+
+        // Stream with this destination not yet completed or from this source
+        if (!stream->pktcnt || addressport_equals(stream->src, src))
+            break;
     }
 
-    return NULL;
-}
+    pthread_rwlock_unlock(&rtp_index.lock);
 
+    return stream;
+}
 
 rtp_stream_t *
 rtp_find_call_stream(struct sip_call *call, address_t src, address_t dst)
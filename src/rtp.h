@@ -35,6 +35,7 @@
 #include "config.h"
 #include "capture.h"
 #include "media.h"
+#include "rtp_store.h"
 
 // Version is the first 2 bits of the first octet
 #define RTP_VERSION(octet) ((octet) >> 6)
@@ -55,6 +56,9 @@
 // If stream does not receive a packet in this seconds, we consider it inactive
 #define STREAM_INACTIVE_SECS 3
 
+// Number of buckets of streams index by destination address
+#define RTP_INDEX_SIZE 16384
+
 // RTCP header types
 //! http://www.iana.org/assignments/rtp-parameters/rtp-parameters.xhtml
 enum rtcp_header_types
@@ -196,6 +200,10 @@ struct rtp_stream {
     vector_t *events;
     //! Statistics observed from RTP packets
     rtp_stats_t rtpstats;
+    //! Retained packets of this stream
+    rtp_store_t *store;
+    //! Next stream in the same streams index bucket
+    rtp_stream_t *index_next;
 
     // Stream information (depending on type)
     union {
@@ -384,6 +392,18 @@ struct rtcp_blk_xr_voip
 rtp_stream_t *
 stream_create(sdp_media_t *media, address_t dst, int type);
 
+/**
+ * @brief Free stream memory, including its retained packets
+ */
+void
+stream_destroy(rtp_stream_t *stream);
+
+/**
+ * @brief Wrapper around stream destroyer to clear streams vectors
+ */
+void
+stream_destroyer(void *stream);
+
 rtp_stream_t *
 stream_complete(rtp_stream_t *stream, address_t src);
 
@@ -435,6 +455,22 @@ rtp_find_call_exact_stream(struct sip_call *call, address_t src, address_t dst);
 rtp_stream_t *
 rtp_find_related_rtcp_stream(rtp_stream_t *rtp);
 
+/**
+ * @brief Add a dialog stream to the streams index
+ *
+ * RTP packets are matched against streams with their same destination
+ * address, instead of looking through all active dialogs streams.
+ * Streams must not change their destination after being indexed.
+ */
+void
+rtp_index_add(rtp_stream_t *stream);
+
+/**
+ * @brief Remove all streams of a dialog from the streams index
+ */
+void
+rtp_index_remove_call(struct sip_call *call);
+
 /**
  * @brief Check if a message is older than other
  *
@@ -0,0 +1,530 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file rtp_store.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in rtp_store.h
+ *
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "rtp_store.h"
+#include "rtp.h"
+#include "metrics.h"
+
+//! Max trailing bytes after RTP packet in a frame (Ethernet padding)
+#define RTP_STORE_MAX_PADDING   64
+//! Bytes accounted for each ring entry
+#define RTP_STORE_ENTRY_SIZE    (sizeof(uint16_t) * 2 + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint8_t))
+
+/**
+ * @brief Frame header stored in chunks before its content
+ */
+struct rtp_store_record {
+    //! Capture time seconds
+    uint32_t sec;
+    //! Capture time microseconds
+    uint32_t usec;
+    //! Captured length
+    uint32_t caplen;
+    //! Wire length
+    uint32_t len;
+};
+
+/**
+ * @brief RTP retention configuration
+ */
+struct rtp_store_config {
+    //! Retention mode
+    enum rtp_store_mode mode;
+    //! Store full chunks in disk storage
+    bool disk;
+};
+
+//! RTP retention configuration
+static struct rtp_store_config rtp_store_cfg = { .mode = RTP_STORE_FULL };
+
+void
+rtp_store_init(enum rtp_store_mode mode, bool disk)
+{
+    rtp_store_cfg.mode = mode;
+    rtp_store_cfg.disk = disk;
+}
+
+/**
+ * @brief Update store and global memory counters
+ */
+static void
+rtp_store_add_memory(rtp_store_t *store, int64_t bytes)
+{
+    store->memory += bytes;
+    metrics_add(METRIC_MEM_RTP, bytes);
+}
+
+/**
+ * @brief Copy the headers before RTP packet of the first stored frame
+ *
+ * @return 0 if headers have been found in the frame, 1 otherwise
+ */
+static int
+rtp_store_set_prefix(rtp_store_t *store, const u_char *data, uint32_t caplen,
+                     const u_char *payload, uint32_t len)
+{
+    int32_t off, hl;
+
+    // Find where RTP packet starts, frames can have trailing padding
+    for (off = (int32_t) caplen - (int32_t) len;
+         off >= 8 && off >= (int32_t) (caplen - len - RTP_STORE_MAX_PADDING); off--) {
+        if (memcmp(data + off, payload, RTP_HDR_LENGTH) == 0)
+            break;
+    }
+    if (off < 8 || memcmp(data + off, payload, RTP_HDR_LENGTH) != 0)
+        return 1;
+
+    if (!(store->prefix = malloc(off)))
+        return 1;
+    memcpy(store->prefix, data, off);
+    store->prefixlen = off;
+    store->ssrc = ntohl(*(uint32_t *) (payload + 8));
+    rtp_store_add_memory(store, off);
+
+    // Find IP header before UDP header to fix its length in rebuilt frames
+    store->ipoff = -1;
+    for (hl = 20; hl <= 60; hl += 4) {
+        if (off - 8 - hl >= 0 && data[off - 8 - hl] == (0x40 | (hl / 4))) {
+            store->ipoff = off - 8 - hl;
+            break;
+        }
+    }
+    if (store->ipoff == -1 && off - 48 >= 0 && (data[off - 48] >> 4) == 6)
+        store->ipoff = off - 48;
+
+    return 0;
+}
+
+/**
+ * @brief Increase ring size
+ *
+ * @return 0 if ring has been resized, 1 otherwise
+ */
+static int
+rtp_store_ring_grow(rtp_store_t *store)
+{
+    uint32_t size = (store->size) ? store->size * 2 : RTP_STORE_RING_MIN;
+    void *seq, *ts, *arrival, *len, *flags;
+
+    if (size > RTP_STORE_RING_MAX)
+        size = RTP_STORE_RING_MAX;
+
+    // Keep old arrays if any of them can not be resized
+    if ((seq = realloc(store->seq, size * sizeof(uint16_t))))
+        store->seq = seq;
+    if ((ts = realloc(store->ts, size * sizeof(uint32_t))))
+        store->ts = ts;
+    if ((arrival = realloc(store->arrival, size * sizeof(uint64_t))))
+        store->arrival = arrival;
+    if ((len = realloc(store->len, size * sizeof(uint16_t))))
+        store->len = len;
+    if ((flags = realloc(store->flags, size * sizeof(uint8_t))))
+        store->flags = flags;
+    if (!seq || !ts || !arrival || !len || !flags)
+        return 1;
+
+    rtp_store_add_memory(store, (int64_t) (size - store->size) * RTP_STORE_ENTRY_SIZE);
+    store->size = size;
+    return 0;
+}
+
+/**
+ * @brief Store RTP packet headers in the ring
+ *
+ * @return memory accounted to the stored headers
+ */
+static size_t
+rtp_store_ring_add(rtp_store_t *store, packet_t *packet)
+{
+    frame_t *frame;
+    const u_char *data, *payload = packet_payload(packet);
+    uint32_t len = packet_payloadlen(packet), pos;
+    struct timeval ts = packet_time(packet);
+    size_t added = 0;
+
+    // Only RTP packets in a single frame can be rebuilt from headers
+    if (vector_count(packet->frames) != 1 || len < RTP_HDR_LENGTH || len > UINT16_MAX)
+        return 0;
+
+    if (!store->prefix) {
+        frame = vector_first(packet->frames);
+        if (!(data = packet_frame_data(frame)))
+            return 0;
+        if (rtp_store_set_prefix(store, data, frame->header->caplen, payload, len) != 0)
+            return 0;
+        added += store->prefixlen;
+    }
+
+    if (store->count == store->size && store->size < RTP_STORE_RING_MAX) {
+        if (rtp_store_ring_grow(store) != 0)
+            return added;
+    }
+
+    if (store->count < store->size) {
+        pos = store->first + store->count++;
+        added += RTP_STORE_ENTRY_SIZE;
+    } else {
+        // Ring is full, replace the oldest entry
+        pos = store->first;
+        store->first = (store->first + 1) % store->size;
+    }
+
+    store->flags[pos] = payload[1];
+    store->seq[pos] = (payload[2] << 8) | payload[3];
+    store->ts[pos] = ntohl(*(uint32_t *) (payload + 4));
+    store->len[pos] = len;
+    store->arrival[pos] = (uint64_t) ts.tv_sec * 1000000 + ts.tv_usec;
+    return added;
+}
+
+/**
+ * @brief Write a full chunk to disk storage
+ */
+static void
+rtp_store_chunk_flush(rtp_store_t *store, rtp_store_chunk_t *chunk)
+{
+    if (!chunk->data)
+        return;
+
+    if (rtp_store_cfg.disk) {
+        // Keep the chunk in memory if it can not be written
+        if (!(chunk->segment = storage_write(chunk->data, chunk->len, &chunk->offset)))
+            return;
+        free(chunk->data);
+        chunk->data = NULL;
+        rtp_store_add_memory(store, -(int64_t) chunk->size);
+    } else if (chunk->len < chunk->size) {
+        // Release unused chunk space
+        u_char *data = realloc(chunk->data, chunk->len);
+        if (data || chunk->len == 0) {
+            chunk->data = data;
+            rtp_store_add_memory(store, -(int64_t) (chunk->size - chunk->len));
+            chunk->size = chunk->len;
+        }
+    }
+}
+
+/**
+ * @brief Append a new chunk with room for at least given bytes
+ */
+static rtp_store_chunk_t *
+rtp_store_chunk_create(rtp_store_t *store, uint32_t need)
+{
+    rtp_store_chunk_t *chunk;
+    uint32_t size = RTP_STORE_CHUNK_MIN;
+
+    // Each chunk doubles the size of the previous one
+    if (store->last)
+        size = store->last->size * 2;
+    if (size > RTP_STORE_CHUNK_MAX)
+        size = RTP_STORE_CHUNK_MAX;
+    if (size < need)
+        size = need;
+
+    if (!(chunk = malloc(sizeof(rtp_store_chunk_t))))
+        return NULL;
+    memset(chunk, 0, sizeof(rtp_store_chunk_t));
+
+    if (!(chunk->data = malloc(size))) {
+        free(chunk);
+        return NULL;
+    }
+    chunk->size = size;
+    rtp_store_add_memory(store, sizeof(rtp_store_chunk_t) + size);
+
+    // Previous chunk is complete
+    if (store->last) {
+        rtp_store_chunk_flush(store, store->last);
+        store->last->next = chunk;
+    } else {
+        store->chunks = chunk;
+    }
+    store->last = chunk;
+    return chunk;
+}
+
+/**
+ * @brief Append packet frames to the stream chunks
+ *
+ * @return memory accounted to the stored frames
+ */
+static size_t
+rtp_store_chunk_add(rtp_store_t *store, packet_t *packet)
+{
+    rtp_store_chunk_t *chunk;
+    struct rtp_store_record record;
+    frame_t *frame;
+    const u_char *data;
+    uint32_t need;
+    size_t added = 0;
+
+    vector_iter_t it = vector_iterator(packet->frames);
+    while ((frame = vector_iterator_next(&it))) {
+        if (!(data = packet_frame_data(frame)))
+            continue;
+
+        need = sizeof(record) + frame->header->caplen;
+        chunk = store->last;
+        if (!chunk || !chunk->data || chunk->len + need > chunk->size) {
+            if (!(chunk = rtp_store_chunk_create(store, need)))
+                return added;
+            added += sizeof(rtp_store_chunk_t);
+        }
+
+        record.sec = frame->header->ts.tv_sec;
+        record.usec = frame->header->ts.tv_usec;
+        record.caplen = frame->header->caplen;
+        record.len = frame->header->len;
+        memcpy(chunk->data + chunk->len, &record, sizeof(record));
+        memcpy(chunk->data + chunk->len + sizeof(record), data, record.caplen);
+        chunk->len += need;
+        store->frames++;
+
+        // Frames data in disk storage is not accounted as memory
+        if (!rtp_store_cfg.disk)
+            added += need;
+    }
+
+    return added;
+}
+
+size_t
+rtp_store_packet(rtp_store_t **store, packet_t *packet, bool rtcp)
+{
+    size_t added = 0;
+
+    if (rtp_store_cfg.mode == RTP_STORE_STATS)
+        return 0;
+
+    if (!*store) {
+        if (!(*store = malloc(sizeof(rtp_store_t))))
+            return 0;
+        memset(*store, 0, sizeof(rtp_store_t));
+        rtp_store_add_memory(*store, sizeof(rtp_store_t));
+        added += sizeof(rtp_store_t);
+    }
+
+    // RTCP packets are rare enough to be kept in full
+    if (rtp_store_cfg.mode == RTP_STORE_HEADERS && !rtcp) {
+        added += rtp_store_ring_add(*store, packet);
+    } else {
+        added += rtp_store_chunk_add(*store, packet);
+    }
+
+    return added;
+}
+
+void
+rtp_store_destroy(rtp_store_t *store)
+{
+    rtp_store_chunk_t *chunk, *next;
+
+    if (!store)
+        return;
+
+    for (chunk = store->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        if (chunk->segment)
+            storage_release(chunk->segment);
+        free(chunk->data);
+        free(chunk);
+    }
+
+    free(store->prefix);
+    free(store->seq);
+    free(store->ts);
+    free(store->arrival);
+    free(store->len);
+    free(store->flags);
+    metrics_add(METRIC_MEM_RTP, -(int64_t) store->memory);
+    free(store);
+}
+
+uint32_t
+rtp_store_count(rtp_store_t *store)
+{
+    return (store) ? store->count + store->frames : 0;
+}
+
+rtp_store_iter_t *
+rtp_store_iterator(rtp_store_t *store)
+{
+    rtp_store_iter_t *it;
+
+    if (!(it = malloc(sizeof(rtp_store_iter_t))))
+        return NULL;
+    memset(it, 0, sizeof(rtp_store_iter_t));
+    it->store = store;
+    it->chunk = (store) ? store->chunks : NULL;
+    return it;
+}
+
+/**
+ * @brief Make sure iterator buffer can hold given bytes
+ */
+static int
+rtp_store_iterator_reserve(rtp_store_iter_t *it, uint32_t len)
+{
+    u_char *buffer;
+
+    if (len <= it->buflen)
+        return 0;
+    if (!(buffer = realloc(it->buffer, len)))
+        return 1;
+    it->buffer = buffer;
+    it->buflen = len;
+    return 0;
+}
+
+/**
+ * @brief Rebuild a frame from ring entry headers
+ */
+static int
+rtp_store_iterator_rebuild(rtp_store_iter_t *it, uint32_t pos)
+{
+    rtp_store_t *store = it->store;
+    u_char *frame, *rtp;
+    uint16_t len = store->len[pos];
+    uint32_t ts = htonl(store->ts[pos]), ssrc = htonl(store->ssrc), sum = 0;
+    int i;
+
+    if (rtp_store_iterator_reserve(it, store->prefixlen + RTP_HDR_LENGTH) != 0)
+        return 1;
+
+    frame = it->buffer;
+    memcpy(frame, store->prefix, store->prefixlen);
+
+    // Fix IP and UDP lengths for this packet
+    if (store->ipoff >= 0) {
+        u_char *ip = frame + store->ipoff;
+        if ((ip[0] >> 4) == 4) {
+            uint16_t total = store->prefixlen - store->ipoff + len;
+            ip[2] = total >> 8;
+            ip[3] = total & 0xFF;
+            ip[10] = ip[11] = 0;
+            for (i = 0; i < (ip[0] & 0x0F) * 4; i += 2)
+                sum += (ip[i] << 8) | ip[i + 1];
+            while (sum >> 16)
+                sum = (sum & 0xFFFF) + (sum >> 16);
+            ip[10] = (~sum >> 8) & 0xFF;
+            ip[11] = ~sum & 0xFF;
+        } else {
+            ip[4] = (8 + len) >> 8;
+            ip[5] = (8 + len) & 0xFF;
+        }
+    }
+    frame[store->prefixlen - 4] = (8 + len) >> 8;
+    frame[store->prefixlen - 3] = (8 + len) & 0xFF;
+    frame[store->prefixlen - 2] = frame[store->prefixlen - 1] = 0;
+
+    // Rebuild RTP header without CSRC list or extensions
+    rtp = frame + store->prefixlen;
+    rtp[0] = RTP_VERSION_RFC1889 << 6;
+    rtp[1] = store->flags[pos];
+    rtp[2] = store->seq[pos] >> 8;
+    rtp[3] = store->seq[pos] & 0xFF;
+    memcpy(rtp + 4, &ts, sizeof(ts));
+    memcpy(rtp + 8, &ssrc, sizeof(ssrc));
+
+    it->header.ts.tv_sec = store->arrival[pos] / 1000000;
+    it->header.ts.tv_usec = store->arrival[pos] % 1000000;
+    it->header.caplen = store->prefixlen + RTP_HDR_LENGTH;
+    it->header.len = store->prefixlen + len;
+    it->data = frame;
+    return 0;
+}
+
+/**
+ * @brief Read next frame stored in chunks
+ */
+static int
+rtp_store_iterator_read(rtp_store_iter_t *it)
+{
+    rtp_store_chunk_t *chunk;
+    struct rtp_store_record record;
+    const u_char *data;
+
+    // Skip completely read chunks
+    while ((chunk = it->chunk) && it->offset >= chunk->len) {
+        it->chunk = chunk->next;
+        it->offset = 0;
+    }
+    if (!chunk)
+        return 1;
+
+    if (chunk->data) {
+        memcpy(&record, chunk->data + it->offset, sizeof(record));
+        it->data = chunk->data + it->offset + sizeof(record);
+    } else {
+        // Data read from disk is only valid until next storage read
+        if (!(data = storage_read(chunk->segment, chunk->offset + it->offset, sizeof(record))))
+            return 1;
+        memcpy(&record, data, sizeof(record));
+        if (rtp_store_iterator_reserve(it, record.caplen) != 0)
+            return 1;
+        if (!(data = storage_read(chunk->segment, chunk->offset + it->offset + sizeof(record), record.caplen)))
+            return 1;
+        memcpy(it->buffer, data, record.caplen);
+        it->data = it->buffer;
+    }
+
+    it->header.ts.tv_sec = record.sec;
+    it->header.ts.tv_usec = record.usec;
+    it->header.caplen = record.caplen;
+    it->header.len = record.len;
+    it->offset += sizeof(record) + record.caplen;
+    return 0;
+}
+
+int
+rtp_store_iterator_next(rtp_store_iter_t *it)
+{
+    rtp_store_t *store;
+
+    if (!it || !(store = it->store))
+        return 1;
+
+    // Ring headers are rebuilt first, then chunks are read
+    if (it->entry < store->count)
+        return rtp_store_iterator_rebuild(it, (store->first + it->entry++) % store->size);
+
+    return rtp_store_iterator_read(it);
+}
+
+void
+rtp_store_iterator_destroy(rtp_store_iter_t *it)
+{
+    if (!it)
+        return;
+    free(it->buffer);
+    free(it);
+}
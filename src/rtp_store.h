@@ -0,0 +1,212 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file rtp_store.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to retain captured RTP packets of each stream
+ *
+ * RTP packets are not stored as captured packets. Depending on the
+ * capture.rtpmode setting, each stream retains:
+ *
+ *  - stats: nothing, only stream statistics are kept
+ *  - headers: RTP headers and capture times in a ring of arrays, with a
+ *    single copy of the link, IP and UDP headers of the stream
+ *  - full: complete frames appended to contiguous chunks of memory
+ *
+ * Retained packets can be written to pcap files again. In headers mode,
+ * frames are rebuilt from the stream headers and truncated after the RTP
+ * header, keeping their original length.
+ *
+ */
+#ifndef __SNGREP_RTP_STORE_H
+#define __SNGREP_RTP_STORE_H
+
+#include "config.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+#include <pcap.h>
+#include "packet.h"
+#include "storage.h"
+
+//! Initial number of headers of each stream ring
+#define RTP_STORE_RING_MIN      64
+//! Max number of headers of each stream ring, oldest are replaced
+#define RTP_STORE_RING_MAX      65536
+//! Size of first chunk of each stream
+#define RTP_STORE_CHUNK_MIN     4096
+//! Max size of each chunk
+#define RTP_STORE_CHUNK_MAX     (256 * 1024)
+
+//! RTP retention modes
+enum rtp_store_mode {
+    RTP_STORE_STATS = 0,
+    RTP_STORE_HEADERS,
+    RTP_STORE_FULL,
+};
+
+//! Shorter declaration of rtp_store structure
+typedef struct rtp_store rtp_store_t;
+//! Shorter declaration of rtp_store_chunk structure
+typedef struct rtp_store_chunk rtp_store_chunk_t;
+//! Shorter declaration of rtp_store_iter structure
+typedef struct rtp_store_iter rtp_store_iter_t;
+
+/**
+ * @brief Contiguous buffer of retained frames
+ *
+ * Each frame is stored as its capture time, captured and wire lengths,
+ * followed by the frame content.
+ */
+struct rtp_store_chunk {
+    //! Next chunk of the stream
+    rtp_store_chunk_t *next;
+    //! Chunk allocated size
+    uint32_t size;
+    //! Chunk used bytes
+    uint32_t len;
+    //! Chunk content, NULL once stored on disk
+    u_char *data;
+    //! Segment storing chunk content when stored on disk
+    storage_segment_t *segment;
+    //! Chunk content position in the segment
+    off_t offset;
+};
+
+/**
+ * @brief Retained packets of a RTP stream
+ */
+struct rtp_store {
+    //! Link, IP and UDP headers of the first packet
+    u_char *prefix;
+    //! Prefix length
+    uint16_t prefixlen;
+    //! IP header position in prefix, -1 if unknown
+    int16_t ipoff;
+    //! RTP synchronization source of the first packet
+    uint32_t ssrc;
+    //! Allocated ring entries
+    uint32_t size;
+    //! Stored ring entries
+    uint32_t count;
+    //! Position of the oldest ring entry
+    uint32_t first;
+    //! RTP sequence numbers
+    uint16_t *seq;
+    //! RTP timestamps
+    uint32_t *ts;
+    //! Capture times in microseconds
+    uint64_t *arrival;
+    //! RTP packet lengths
+    uint16_t *len;
+    //! RTP marker bit and payload type
+    uint8_t *flags;
+    //! Retained frames chunks
+    rtp_store_chunk_t *chunks;
+    //! Last chunk, where new frames are appended
+    rtp_store_chunk_t *last;
+    //! Number of frames in chunks
+    uint32_t frames;
+    //! Memory used by retained packets
+    size_t memory;
+};
+
+/**
+ * @brief Iterator over retained frames of a stream
+ */
+struct rtp_store_iter {
+    //! Iterated store
+    rtp_store_t *store;
+    //! Current ring entry
+    uint32_t entry;
+    //! Current chunk
+    rtp_store_chunk_t *chunk;
+    //! Current position in chunk
+    uint32_t offset;
+    //! Current frame header
+    struct pcap_pkthdr header;
+    //! Current frame content
+    const u_char *data;
+    //! Buffer for rebuilt or read frames
+    u_char *buffer;
+    //! Buffer size
+    uint32_t buflen;
+};
+
+/**
+ * @brief Set RTP retention mode
+ *
+ * @param mode Retention mode for new packets
+ * @param disk Store full chunks in disk storage
+ */
+void
+rtp_store_init(enum rtp_store_mode mode, bool disk);
+
+/**
+ * @brief Retain a RTP or RTCP packet
+ *
+ * Store is created with the first retained packet.
+ *
+ * @param store Stream packets store
+ * @param packet Captured packet
+ * @param rtcp Packet belongs to a RTCP stream
+ * @return memory added to the store
+ */
+size_t
+rtp_store_packet(rtp_store_t **store, packet_t *packet, bool rtcp);
+
+/**
+ * @brief Free all retained packets
+ */
+void
+rtp_store_destroy(rtp_store_t *store);
+
+/**
+ * @brief Get number of retained frames
+ */
+uint32_t
+rtp_store_count(rtp_store_t *store);
+
+/**
+ * @brief Create an iterator over retained frames, oldest first
+ */
+rtp_store_iter_t *
+rtp_store_iterator(rtp_store_t *store);
+
+/**
+ * @brief Move the iterator to the next retained frame
+ *
+ * Frame content is valid until next iterator call.
+ *
+ * @return 0 if iterator header and data have been filled, 1 otherwise
+ */
+int
+rtp_store_iterator_next(rtp_store_iter_t *it);
+
+/**
+ * @brief Free iterator memory
+ */
+void
+rtp_store_iterator_destroy(rtp_store_iter_t *it);
+
+#endif /* __SNGREP_RTP_STORE_H */
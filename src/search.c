@@ -0,0 +1,386 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file search.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in search.h
+ *
+ */
+#include "config.h"
+#include <ctype.h>
+#include <string.h>
+#include "search.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_X86
+#include <immintrin.h>
+#endif
+
+//! Function to find a literal in data
+typedef bool (*search_find_fn)(const char *data, size_t len, const search_literal_t *literal, bool caseless);
+
+/**
+ * @brief Lowercase an ASCII character
+ */
+static inline char
+search_lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/**
+ * @brief Check if data starts with the given literal
+ */
+static inline bool
+search_equal(const char *data, const search_literal_t *literal, bool caseless)
+{
+    uint32_t i;
+
+    if (!caseless)
+        return memcmp(data, literal->str, literal->len) == 0;
+
+    for (i = 0; i < literal->len; i++) {
+        if (search_lower(data[i]) != literal->str[i])
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Find a literal in data, one byte at a time
+ */
+static bool
+search_find_scalar(const char *data, size_t len, const search_literal_t *literal, bool caseless)
+{
+    size_t i;
+
+    if (len < literal->len)
+        return false;
+
+    if (!caseless)
+        return memmem(data, len, literal->str, literal->len) != NULL;
+
+    for (i = 0; i + literal->len <= len; i++) {
+        if (search_lower(data[i]) == literal->str[0] && search_equal(data + i, literal, true))
+            return true;
+    }
+    return false;
+}
+
+#ifdef SEARCH_X86
+/**
+ * @brief Find a literal in data, 16 bytes at a time
+ *
+ * Setting the 0x20 bit lowercases letters. Other bytes may also match
+ * after setting it, but positions are verified before returning.
+ */
+__attribute__((target("sse2")))
+static bool
+search_find_sse2(const char *data, size_t len, const search_literal_t *literal, bool caseless)
+{
+    const char fold = (caseless) ? 0x20 : 0;
+    const __m128i vfold = _mm_set1_epi8(fold);
+    const __m128i first = _mm_set1_epi8(literal->str[0] | fold);
+    const __m128i last = _mm_set1_epi8(literal->str[literal->len - 1] | fold);
+    size_t i, last_pos = literal->len - 1;
+    __m128i block_first, block_last;
+    uint32_t mask;
+
+    for (i = 0; i + last_pos + 16 <= len; i += 16) {
+        block_first = _mm_or_si128(_mm_loadu_si128((const __m128i *) (data + i)), vfold);
+        block_last = _mm_or_si128(_mm_loadu_si128((const __m128i *) (data + i + last_pos)), vfold);
+        mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                               _mm_cmpeq_epi8(block_last, last)));
+        for (; mask; mask &= mask - 1) {
+            if (search_equal(data + i + __builtin_ctz(mask), literal, caseless))
+                return true;
+        }
+    }
+
+    return search_find_scalar(data + i, len - i, literal, caseless);
+}
+
+/**
+ * @brief Find a literal in data, 32 bytes at a time
+ */
+__attribute__((target("avx2")))
+static bool
+search_find_avx2(const char *data, size_t len, const search_literal_t *literal, bool caseless)
+{
+    const char fold = (caseless) ? 0x20 : 0;
+    const __m256i vfold = _mm256_set1_epi8(fold);
+    const __m256i first = _mm256_set1_epi8(literal->str[0] | fold);
+    const __m256i last = _mm256_set1_epi8(literal->str[literal->len - 1] | fold);
+    size_t i, last_pos = literal->len - 1;
+    __m256i block_first, block_last;
+    uint32_t mask;
+
+    for (i = 0; i + last_pos + 32 <= len; i += 32) {
+        block_first = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) (data + i)), vfold);
+        block_last = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) (data + i + last_pos)), vfold);
+        mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                                                     _mm256_cmpeq_epi8(block_last, last)));
+        for (; mask; mask &= mask - 1) {
+            if (search_equal(data + i + __builtin_ctz(mask), literal, caseless))
+                return true;
+        }
+    }
+
+    return search_find_sse2(data + i, len - i, literal, caseless);
+}
+#endif
+
+/**
+ * @brief Get the fastest find function supported by this CPU
+ */
+static search_find_fn
+search_find_impl()
+{
+    static search_find_fn find = NULL;
+    search_find_fn impl;
+
+    if ((impl = __atomic_load_n(&find, __ATOMIC_RELAXED)))
+        return impl;
+
+    impl = search_find_scalar;
+#ifdef SEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        impl = search_find_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        impl = search_find_sse2;
+    }
+#endif
+
+    __atomic_store_n(&find, impl, __ATOMIC_RELAXED);
+    return impl;
+}
+
+/**
+ * @brief Skip a bracket expression
+ *
+ * @return position after the closing bracket or NULL if there is none
+ */
+static const char *
+search_skip_class(const char *p)
+{
+    char end;
+
+    // Closing bracket is a member if it's the first one
+    p++;
+    if (*p == '^')
+        p++;
+    if (*p == ']')
+        p++;
+
+    while (*p && *p != ']') {
+        // POSIX classes like [:digit:] can contain a closing bracket
+        if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+            end = p[1];
+            for (p += 2; *p && !(*p == end && p[1] == ']'); p++);
+            if (*p)
+                p += 2;
+            continue;
+        }
+        if (*p == '\\' && p[1])
+            p++;
+        p++;
+    }
+
+    return (*p) ? p + 1 : NULL;
+}
+
+/**
+ * @brief Skip a parenthesized group, including nested ones
+ *
+ * @return position after the closing parenthesis or NULL if there is none
+ */
+static const char *
+search_skip_group(const char *p)
+{
+    int depth = 0;
+
+    while (*p) {
+        if (*p == '\\') {
+            if (!*++p)
+                return NULL;
+        } else if (*p == '[') {
+            if (!(p = search_skip_class(p)))
+                return NULL;
+            continue;
+        } else if (*p == '(') {
+            depth++;
+        } else if (*p == ')' && --depth == 0) {
+            return p + 1;
+        }
+        p++;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Skip an escape sequence that is not a literal character
+ *
+ * Escape arguments (like hex codes or property names) are skipped too.
+ * When not sure where an argument ends, following characters are skipped,
+ * so they are not taken as literals.
+ */
+static const char *
+search_skip_escape(const char *p)
+{
+    char end, type = p[1];
+
+    p += 2;
+    if (*p == '{' || *p == '<' || *p == '\'') {
+        end = (*p == '{') ? '}' : (*p == '<') ? '>' : '\'';
+        for (p++; *p && *p != end; p++);
+        return (*p) ? p + 1 : p;
+    }
+
+    // Control characters and single letter properties
+    if ((type == 'c' || type == 'p' || type == 'P') && *p)
+        return p + 1;
+
+    while (isxdigit((unsigned char) *p))
+        p++;
+    return p;
+}
+
+/**
+ * @brief Keep the current run of literal characters if it's the longest
+ */
+static void
+search_end_run(search_literal_t *run, search_literal_t *best)
+{
+    if (run->len > best->len)
+        *best = *run;
+    run->len = 0;
+}
+
+void
+search_compile(search_t *search, const char *expr, bool caseless)
+{
+    search_literal_t run, best;
+    const char *p = expr;
+    char c;
+
+    memset(search, 0, sizeof(search_t));
+    search->caseless = caseless;
+
+    // Inline options and quoted text change how literals are matched
+    if (!expr || strstr(expr, "(?") || strstr(expr, "\\Q"))
+        return;
+
+    for (;;) {
+        run.len = best.len = 0;
+
+        // Find the longest literal of this alternative
+        while (*p && *p != '|') {
+            if (*p == '\\' && isalnum((unsigned char) p[1])) {
+                search_end_run(&run, &best);
+                p = search_skip_escape(p);
+                continue;
+            } else if (*p == '\\') {
+                // Escaped punctuation is literal, except GNU word and buffer anchors
+                if (!p[1] || strchr("<>`'", p[1])) {
+                    search_end_run(&run, &best);
+                    p += (p[1]) ? 2 : 1;
+                    continue;
+                }
+                c = p[1];
+                p += 2;
+            } else if (*p == '[' || *p == '(') {
+                search_end_run(&run, &best);
+                if (!(p = (*p == '[') ? search_skip_class(p) : search_skip_group(p))) {
+                    search->count = 0;
+                    return;
+                }
+                continue;
+            } else if (*p == '{') {
+                // Repetition counts are not literals
+                search_end_run(&run, &best);
+                for (; *p && *p != '}'; p++);
+                if (*p)
+                    p++;
+                continue;
+            } else if (strchr(".^$*+?)", *p)) {
+                search_end_run(&run, &best);
+                p++;
+                continue;
+            } else {
+                c = *p++;
+            }
+
+            // Optional or repeated a given times, the character may not be there
+            if (*p == '*' || *p == '?' || *p == '{') {
+                search_end_run(&run, &best);
+                continue;
+            }
+
+            // Non ASCII characters may have case variants with other lengths
+            if (caseless && (unsigned char) c >= 0x80) {
+                search_end_run(&run, &best);
+                continue;
+            }
+
+            if (run.len < SEARCH_LITERAL_LEN - 1)
+                run.str[run.len++] = (caseless) ? search_lower(c) : c;
+
+            // Repeated characters can be followed by more copies of them
+            if (*p == '+')
+                search_end_run(&run, &best);
+        }
+        search_end_run(&run, &best);
+
+        // Every alternative must have a literal to prefilter
+        if (best.len < SEARCH_LITERAL_MIN || search->count == SEARCH_MAX_LITERALS) {
+            search->count = 0;
+            return;
+        }
+        best.str[best.len] = '\0';
+        search->literals[search->count++] = best;
+
+        if (!*p)
+            break;
+        p++;
+    }
+}
+
+bool
+search_candidate(const search_t *search, const char *data, size_t len)
+{
+    search_find_fn find;
+    int i;
+
+    if (!search->count)
+        return true;
+
+    find = search_find_impl();
+    for (i = 0; i < search->count; i++) {
+        if (find(data, len, &search->literals[i], search->caseless))
+            return true;
+    }
+
+    return false;
+}
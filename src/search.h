@@ -0,0 +1,108 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file search.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to prefilter regular expression matches
+ *
+ * Most filter and match expressions are plain text, like a phone number or
+ * a domain. Running the regular expression engine over every payload is far
+ * more expensive than looking for that text.
+ *
+ * When an expression is compiled, the longest literal text that any match
+ * must contain is extracted from each of its top level alternatives. Data
+ * that contains none of them can not match the expression, so the regular
+ * expression is only run on data that contains any.
+ *
+ * Literals are searched comparing their first and last bytes against 16 or
+ * 32 bytes of data at once, using SSE2 or AVX2 when the CPU supports them,
+ * and only verifying the whole literal on positions where both match.
+ *
+ */
+#ifndef __SNGREP_SEARCH_H
+#define __SNGREP_SEARCH_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//! Max number of alternatives with literals
+#define SEARCH_MAX_LITERALS     8
+//! Max stored length of each literal
+#define SEARCH_LITERAL_LEN      64
+//! Min length of literals worth searching
+#define SEARCH_LITERAL_MIN      2
+
+//! Shorter declaration of search_literal structure
+typedef struct search_literal search_literal_t;
+//! Shorter declaration of search structure
+typedef struct search search_t;
+
+/**
+ * @brief Text required by an expression alternative
+ */
+struct search_literal {
+    //! Literal text, lowercase for case insensitive searches
+    char str[SEARCH_LITERAL_LEN];
+    //! Literal length
+    uint32_t len;
+};
+
+/**
+ * @brief Literals required by a compiled expression
+ */
+struct search {
+    //! Number of literals, 0 if expression can not be prefiltered
+    int count;
+    //! Compare literals ignoring ASCII case
+    bool caseless;
+    //! Literals of each top level alternative
+    search_literal_t literals[SEARCH_MAX_LITERALS];
+};
+
+/**
+ * @brief Extract literals required by a regular expression
+ *
+ * Only literals that are surely required are extracted. If that can not
+ * be determined for every alternative, the search matches any data.
+ *
+ * @param search Search to fill
+ * @param expr Regular expression (PCRE or POSIX extended syntax)
+ * @param caseless Expression is matched ignoring case
+ */
+void
+search_compile(search_t *search, const char *expr, bool caseless);
+
+/**
+ * @brief Check if data may match the compiled expression
+ *
+ * @param search Compiled search
+ * @param data Data to check (not required to be null-terminated)
+ * @param len Data length
+ * @return true if data contains any of the literals or there are none
+ */
+bool
+search_candidate(const search_t *search, const char *data, size_t len);
+
+#endif /* __SNGREP_SEARCH_H */
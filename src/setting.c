@@ -55,11 +55,25 @@ setting_t settings[SETTING_COUNT] = {
     { SETTING_CAPTURE_EEP,        "capture.eep",        SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
 #endif
     { SETTING_CAPTURE_RTP,        "capture.rtp",        SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_CAPTURE_RTPMODE,    "capture.rtpmode",    SETTING_FMT_ENUM,    "full",      SETTING_ENUM_RTPMODE },
     { SETTING_CAPTURE_STORAGE,    "capture.storage",    SETTING_FMT_ENUM,    "memory",    SETTING_ENUM_STORAGE },
+    { SETTING_CAPTURE_DISKPATH,   "capture.diskpath",   SETTING_FMT_STRING,  "/tmp",      NULL },
+#ifdef WITH_ZLIB
+    { SETTING_CAPTURE_COMPRESS,   "capture.compress",   SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+#endif
     { SETTING_CAPTURE_ROTATE,     "capture.rotate",     SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_CAPTURE_EXPIRE,     "capture.expire",     SETTING_FMT_NUMBER,  "0",         NULL },
+    { SETTING_CAPTURE_MAXMEMORY,  "capture.maxmemory",  SETTING_FMT_NUMBER,  "0",         NULL },
+    { SETTING_CAPTURE_SHARDS,     "capture.shards",     SETTING_FMT_NUMBER,  "1",         NULL },
+    { SETTING_CAPTURE_INDEX,      "capture.index",      SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_CAPTURE_INDEXDIR,   "capture.indexdir",   SETTING_FMT_STRING,  "",          NULL },
+    { SETTING_CAPTURE_DEDUP,      "capture.dedup",      SETTING_FMT_NUMBER,  "0",         NULL },
     { SETTING_SIP_NOINCOMPLETE,   "sip.noincomplete",   SETTING_FMT_ENUM,    SETTING_ON,  SETTING_ENUM_ONOFF },
     { SETTING_SIP_HEADER_X_CID,   "sip.xcid",           SETTING_FMT_STRING,  "X-Call-ID|X-CID", NULL },
     { SETTING_SIP_CALLS,          "sip.calls",          SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_SIP_INDEX,          "sip.index",          SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
+    { SETTING_SIP_REJECTCACHE,    "sip.rejectcache",    SETTING_FMT_NUMBER,  "0",         NULL },
+    { SETTING_SIP_LAZYPARSE,      "sip.lazyparse",      SETTING_FMT_ENUM,    SETTING_ON,  SETTING_ENUM_ONOFF },
     { SETTING_SAVEPATH,           "savepath",           SETTING_FMT_STRING,  "",          NULL },
     { SETTING_SAVEPATH_EDITABLE,  "savepatheditable",   SETTING_FMT_ENUM,    SETTING_ON,  SETTING_ENUM_ONOFF },
     { SETTING_DISPLAY_ALIAS,      "displayalias",       SETTING_FMT_ENUM,    SETTING_OFF, SETTING_ENUM_ONOFF },
@@ -58,7 +58,8 @@ typedef struct setting_option setting_t;
 #define SETTING_ENUM_COLORMODE   (const char *[]){ "request", "cseq", "callid", NULL }
 #define SETTING_ENUM_HIGHLIGHT   (const char *[]){ "bold", "reverse", "reversebold", NULL }
 #define SETTING_ENUM_SDP_INFO    (const char *[]){ "off", "first", "full", "compressed", NULL}
-#define SETTING_ENUM_STORAGE     (const char *[]){ "none", "memory", NULL }
+#define SETTING_ENUM_STORAGE     (const char *[]){ "none", "memory", "disk", NULL }
+#define SETTING_ENUM_RTPMODE     (const char *[]){ "stats", "headers", "full", NULL }
 #define SETTING_ENUM_HEPVERSION  (const char *[]){ "2", "3", NULL }
 #define SETTING_ENUM_MEDIA       (const char *[]){ "off", "on", "active", NULL }
 
@@ -91,11 +92,25 @@ enum setting_id {
     SETTING_CAPTURE_EEP,
 #endif
     SETTING_CAPTURE_RTP,
+    SETTING_CAPTURE_RTPMODE,
     SETTING_CAPTURE_STORAGE,
+    SETTING_CAPTURE_DISKPATH,
+#ifdef WITH_ZLIB
+    SETTING_CAPTURE_COMPRESS,
+#endif
     SETTING_CAPTURE_ROTATE,
+    SETTING_CAPTURE_EXPIRE,
+    SETTING_CAPTURE_MAXMEMORY,
+    SETTING_CAPTURE_SHARDS,
+    SETTING_CAPTURE_INDEX,
+    SETTING_CAPTURE_INDEXDIR,
+    SETTING_CAPTURE_DEDUP,
     SETTING_SIP_NOINCOMPLETE,
     SETTING_SIP_HEADER_X_CID,
     SETTING_SIP_CALLS,
+    SETTING_SIP_INDEX,
+    SETTING_SIP_REJECTCACHE,
+    SETTING_SIP_LAZYPARSE,
     SETTING_SAVEPATH,
     SETTING_SAVEPATH_EDITABLE,
     SETTING_DISPLAY_ALIAS,
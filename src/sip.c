@@ -36,6 +36,11 @@
 #include "option.h"
 #include "setting.h"
 #include "filter.h"
+#include "profile.h"
+#include "metrics.h"
+#include "sip_counters.h"
+#include "intern.h"
+#include "sip_index.h"
 
 /**
  * @brief Linked list of parsed calls
@@ -46,6 +51,9 @@
 sip_call_list_t calls =
 { 0 };
 
+//! Parsing expressions used by current thread
+static __thread sip_parser_t *sip_local_parser = NULL;
+
 /* @brief list of methods and responses */
 sip_code_t sip_codes[] = {
     { SIP_METHOD_REGISTER,  "REGISTER" },
@@ -137,13 +145,124 @@ sip_code_t sip_codes[] = {
     { -1 , NULL },
 };
 
-void
-sip_init(int limit, int only_calls, int no_incomplete)
+/**
+ * @brief Compile payload parsing expressions
+ *
+ * @param parser Expressions to compile
+ * @param verbose Report invalid settings
+ */
+static void
+sip_parser_init(sip_parser_t *parser, bool verbose)
 {
     int match_flags, reg_rule_len, reg_rule_err;
     char reg_rule[SIP_ATTR_MAXLEN];
     const char *setting = NULL;
 
+    match_flags = REG_EXTENDED | REG_ICASE | REG_NEWLINE;
+    regcomp(&parser->reg_method, "^([a-zA-Z]+) [a-zA-Z]+:.* SIP/2.0[ ]*\r", match_flags & ~REG_NEWLINE);
+    regcomp(&parser->reg_callid, "^(Call-ID|i):[ ]*([^ ]+)[ ]*\r$", match_flags);
+    setting = setting_get_value(SETTING_SIP_HEADER_X_CID);
+    reg_rule_len = strlen(setting) + 22;
+    if (reg_rule_len >= SIP_ATTR_MAXLEN) {
+        setting = "X-Call-ID|X-CID";
+        reg_rule_len = strlen(setting) + 22;
+        if (verbose)
+            fprintf(stderr, "%s setting too long, using default.\n",
+                setting_name(SETTING_SIP_HEADER_X_CID));
+    }
+    snprintf(reg_rule, reg_rule_len, "^(%s):[ ]*([^ ]+)[ ]*\r$", setting);
+    reg_rule_err = regcomp(&parser->reg_xcallid, reg_rule, match_flags);
+    if(reg_rule_err != 0) {
+        regerror(reg_rule_err, &parser->reg_xcallid, reg_rule, SIP_ATTR_MAXLEN);
+        regfree(&parser->reg_xcallid);
+        if (verbose)
+            fprintf(stderr, "%s setting produces regex compilation error: %s"
+                "using default value instead\n",
+                setting_name(SETTING_SIP_HEADER_X_CID), reg_rule);
+        regcomp(&parser->reg_xcallid,
+            "^(X-Call-ID|X-CID):[ ]*([^ ]+)[ ]*\r$", match_flags);
+    }
+    regcomp(&parser->reg_response, "^SIP/2.0[ ]*(([0-9]{3}) [^\r]*)[ ]*\r", match_flags & ~REG_NEWLINE);
+    regcomp(&parser->reg_cseq, "^CSeq:[ ]*([0-9]{1,10}) .+\r$", match_flags);
+    regcomp(&parser->reg_from, "^(From|f):[ ]*[^:]*:(([^@>]+)@?[^\r>;]+)", match_flags);
+    regcomp(&parser->reg_to, "^(To|t):[ ]*[^:]*:(([^@>]+)@?[^\r>;]+)", match_flags);
+    regcomp(&parser->reg_contact, "^(Contact|m):[ ]*[^:]*:(([^@>]+)@?[^\r>;]+)", match_flags);
+    regcomp(&parser->reg_valid, "^([A-Z]+ [a-zA-Z]+:|SIP/2.0 [0-9]{3})", match_flags & ~REG_NEWLINE);
+    regcomp(&parser->reg_cl, "^(Content-Length|l):[ ]*([0-9]+)[ ]*\r$", match_flags);
+    regcomp(&parser->reg_body, "\r\n\r\n(.*)", match_flags & ~REG_NEWLINE);
+    regcomp(&parser->reg_reason, "Reason:[ ]*[^\r]*;text=\"([^\r]+)\"", match_flags);
+    regcomp(&parser->reg_warning, "Warning:[ ]*([0-9]*)", match_flags);
+}
+
+/**
+ * @brief Free payload parsing expressions
+ */
+static void
+sip_parser_free(sip_parser_t *parser)
+{
+    regfree(&parser->reg_method);
+    regfree(&parser->reg_callid);
+    regfree(&parser->reg_xcallid);
+    regfree(&parser->reg_response);
+    regfree(&parser->reg_cseq);
+    regfree(&parser->reg_from);
+    regfree(&parser->reg_to);
+    regfree(&parser->reg_contact);
+    regfree(&parser->reg_valid);
+    regfree(&parser->reg_cl);
+    regfree(&parser->reg_body);
+    regfree(&parser->reg_reason);
+    regfree(&parser->reg_warning);
+}
+
+/**
+ * @brief Get parsing expressions for current thread
+ */
+static sip_parser_t *
+sip_parser()
+{
+    return (sip_local_parser) ? sip_local_parser : &calls.parser;
+}
+
+/**
+ * @brief Get where a call stores its position in calls list
+ */
+static int *
+sip_list_position(void *item)
+{
+    return &((sip_call_t *) item)->list_position;
+}
+
+/**
+ * @brief Get where a call stores its position in active calls list
+ */
+static int *
+sip_active_position(void *item)
+{
+    return &((sip_call_t *) item)->active_position;
+}
+
+/**
+ * @brief Create calls list and active calls list
+ *
+ * Both vectors are read by the interface without lock.
+ */
+static void
+sip_calls_vectors_create(vector_t **list, vector_t **active)
+{
+    *list = vector_create(200, 50);
+    vector_set_lockless(*list);
+    vector_set_position(*list, sip_list_position);
+    *active = vector_create(10, 10);
+    vector_set_lockless(*active);
+    vector_set_position(*active, sip_active_position);
+}
+
+void
+sip_init(int limit, int only_calls, int no_incomplete)
+{
+    int i;
+
     // Store capture limit
     calls.limit = limit;
     calls.only_calls = only_calls;
@@ -151,14 +270,14 @@ sip_init(int limit, int only_calls, int no_incomplete)
     calls.last_index = 0;
     calls.call_count_unrotated = 0;
 
-    // Create a vector to store calls
-    calls.list = vector_create(200, 50);
+    // Store dialogs eviction limits
+    calls.expire = setting_get_intvalue(SETTING_CAPTURE_EXPIRE);
+    calls.max_memory = (size_t) setting_get_intvalue(SETTING_CAPTURE_MAXMEMORY) * 1024 * 1024;
+
+    // Create a vector to store calls, read by the interface without lock
+    sip_calls_vectors_create(&calls.list, &calls.active);
     vector_set_destroyer(calls.list, call_destroyer);
     vector_set_sorter(calls.list, sip_list_sorter);
-    calls.active = vector_create(10, 10);
-
-    // Create hash table for callid search
-    calls.callids = htable_create(calls.limit);
 
     // Set default sorting field
     if (sip_attr_from_name(setting_get_value(SETTING_CL_SORTFIELD)) >= 0) {
@@ -171,75 +290,68 @@ sip_init(int limit, int only_calls, int no_incomplete)
     }
 
     // Initialize payload parsing regexp
-    match_flags = REG_EXTENDED | REG_ICASE | REG_NEWLINE;
-    regcomp(&calls.reg_method, "^([a-zA-Z]+) [a-zA-Z]+:.* SIP/2.0[ ]*\r", match_flags & ~REG_NEWLINE);
-    regcomp(&calls.reg_callid, "^(Call-ID|i):[ ]*([^ ]+)[ ]*\r$", match_flags);
-    setting = setting_get_value(SETTING_SIP_HEADER_X_CID);
-    reg_rule_len = strlen(setting) + 22;
-    if (reg_rule_len >= SIP_ATTR_MAXLEN) {
-        setting = "X-Call-ID|X-CID";
-        reg_rule_len = strlen(setting) + 22;
-        fprintf(stderr, "%s setting too long, using default.\n",
-            setting_name(SETTING_SIP_HEADER_X_CID));
+    sip_parser_init(&calls.parser, true);
+
+    // Create correlation shards, each with its own Call-ID table
+    calls.shard_count = setting_get_intvalue(SETTING_CAPTURE_SHARDS);
+    if (calls.shard_count < 1)
+        calls.shard_count = 1;
+    if (calls.shard_count > SIP_MAX_SHARDS)
+        calls.shard_count = SIP_MAX_SHARDS;
+    calls.shards = sng_malloc(sizeof(sip_shard_t) * calls.shard_count);
+    for (i = 0; i < calls.shard_count; i++) {
+        calls.shards[i].callids = htable_create(calls.limit);
+        pthread_mutex_init(&calls.shards[i].lock, NULL);
+        pthread_mutex_init(&calls.shards[i].calls_lock, NULL);
+        // Regular expressions can not be used by several threads at once
+        sip_parser_init(&calls.shards[i].parser, false);
+        // Remember rejected dialogs if configured
+        sip_reject_init(&calls.shards[i].rejected, setting_get_intvalue(SETTING_SIP_REJECTCACHE));
     }
-    snprintf(reg_rule, reg_rule_len, "^(%s):[ ]*([^ ]+)[ ]*\r$", setting);
-    reg_rule_err = regcomp(&calls.reg_xcallid, reg_rule, match_flags);
-    if(reg_rule_err != 0) {
-        regerror(reg_rule_err, &calls.reg_xcallid, reg_rule, SIP_ATTR_MAXLEN);
-        regfree(&calls.reg_xcallid);
-        fprintf(stderr, "%s setting produces regex compilation error: %s"
-            "using default value instead\n",
-            setting_name(SETTING_SIP_HEADER_X_CID), reg_rule);
-        regcomp(&calls.reg_xcallid,
-            "^(X-Call-ID|X-CID):[ ]*([^ ]+)[ ]*\r$", match_flags);
-    }
-    regcomp(&calls.reg_response, "^SIP/2.0[ ]*(([0-9]{3}) [^\r]*)[ ]*\r", match_flags & ~REG_NEWLINE);
-    regcomp(&calls.reg_cseq, "^CSeq:[ ]*([0-9]{1,10}) .+\r$", match_flags);
-    regcomp(&calls.reg_from, "^(From|f):[ ]*[^:]*:(([^@>]+)@?[^\r>;]+)", match_flags);
-    regcomp(&calls.reg_to, "^(To|t):[ ]*[^:]*:(([^@>]+)@?[^\r>;]+)", match_flags);
-    regcomp(&calls.reg_contact, "^(Contact|m):[ ]*[^:]*:(([^@>]+)@?[^\r>;]+)", match_flags);
-    regcomp(&calls.reg_valid, "^([A-Z]+ [a-zA-Z]+:|SIP/2.0 [0-9]{3})", match_flags & ~REG_NEWLINE);
-    regcomp(&calls.reg_cl, "^(Content-Length|l):[ ]*([0-9]+)[ ]*\r$", match_flags);
-    regcomp(&calls.reg_body, "\r\n\r\n(.*)", match_flags & ~REG_NEWLINE);
-    regcomp(&calls.reg_reason, "Reason:[ ]*[^\r]*;text=\"([^\r]+)\"", match_flags);
-    regcomp(&calls.reg_warning, "Warning:[ ]*([0-9]*)", match_flags);
 
+    // Index dialogs attributes for display filters if configured
+    sip_index_init();
+
+    // Export stored dialogs counters
+    metrics_add_collector(sip_metrics_collect);
+    metrics_add_writer(sip_counters_write_metrics);
 }
 
 void
 sip_deinit()
 {
+    int i;
+
     // Remove all calls
     sip_calls_clear();
-    // Remove Call-id hash table
-    htable_destroy(calls.callids);
+    // Remove shards Call-id hash tables
+    for (i = 0; i < calls.shard_count; i++) {
+        htable_destroy(calls.shards[i].callids);
+        pthread_mutex_destroy(&calls.shards[i].lock);
+        pthread_mutex_destroy(&calls.shards[i].calls_lock);
+        sip_parser_free(&calls.shards[i].parser);
+        sip_reject_free(&calls.shards[i].rejected);
+    }
+    sng_free(calls.shards);
     // Remove calls vector
     vector_destroy(calls.list);
     vector_destroy(calls.active);
     // Deallocate regular expressions
-    regfree(&calls.reg_method);
-    regfree(&calls.reg_callid);
-    regfree(&calls.reg_xcallid);
-    regfree(&calls.reg_response);
-    regfree(&calls.reg_cseq);
-    regfree(&calls.reg_from);
-    regfree(&calls.reg_to);
-    regfree(&calls.reg_contact);
-    regfree(&calls.reg_valid);
-    regfree(&calls.reg_cl);
-    regfree(&calls.reg_body);
-    regfree(&calls.reg_reason);
-    regfree(&calls.reg_warning);
+    sip_parser_free(&calls.parser);
+    sip_filter_free(calls.filter);
+    // Deallocate dialogs index
+    sip_index_deinit();
 }
 
 
 char *
 sip_get_callid(const char* payload, char *callid)
 {
+    sip_parser_t *parser = sip_parser();
     regmatch_t pmatch[3];
 
     // Try to get Call-ID from payload
-    if (regexec(&calls.reg_callid, payload, 3, pmatch, 0) == 0) {
+    if (regexec(&parser->reg_callid, payload, 3, pmatch, 0) == 0) {
         int input_len = pmatch[2].rm_eo - pmatch[2].rm_so;
 
         // Ensure the copy length does not exceed MAX_CALLID_SIZE - 1
@@ -248,7 +360,7 @@ sip_get_callid(const char* payload, char *callid)
         }
 
         // Copy the matching part of payload
-        sng_strncpy(callid, payload + pmatch[2].rm_so, input_len);
+        sng_strncpy(callid, payload + pmatch[2].rm_so, input_len + 1);
     }
 
     return callid;
@@ -257,18 +369,19 @@ sip_get_callid(const char* payload, char *callid)
 char *
 sip_get_xcallid(const char *payload, char *xcallid)
 {
+    sip_parser_t *parser = sip_parser();
     regmatch_t pmatch[3];
 
     // Try to get X-Call-ID from payload
-    if (regexec(&calls.reg_xcallid, (const char *)payload, 3, pmatch, 0) == 0) {
+    if (regexec(&parser->reg_xcallid, (const char *)payload, 3, pmatch, 0) == 0) {
         int input_len = pmatch[2].rm_eo - pmatch[2].rm_so;
 
-        // Ensure the copy length does not exceed MAX_XCALLID_SIZE
-        if (input_len > MAX_XCALLID_SIZE) {
-            input_len = MAX_XCALLID_SIZE;
+        // Ensure the copy length does not exceed MAX_XCALLID_SIZE - 1
+        if (input_len > MAX_XCALLID_SIZE - 1) {
+            input_len = MAX_XCALLID_SIZE - 1;
         }
 
-        sng_strncpy(xcallid, (const char *)payload +  pmatch[2].rm_so, input_len);
+        sng_strncpy(xcallid, (const char *)payload +  pmatch[2].rm_so, input_len + 1);
     }
 
     return xcallid;
@@ -277,6 +390,7 @@ sip_get_xcallid(const char *payload, char *xcallid)
 int
 sip_validate_packet(packet_t *packet)
 {
+    sip_parser_t *parser = sip_parser();
     uint32_t plen = packet_payloadlen(packet);
     u_char payload[MAX_SIP_PAYLOAD];
     regmatch_t pmatch[4];
@@ -296,13 +410,13 @@ sip_validate_packet(packet_t *packet)
     memset(cl_header, 0, sizeof(cl_header));
 
     // Check if the first line follows SIP request or response format
-    if (regexec(&calls.reg_valid, (const char *) payload, 2, pmatch, 0) != 0) {
+    if (regexec(&parser->reg_valid, (const char *) payload, 2, pmatch, 0) != 0) {
         // Not a SIP message AT ALL
         return VALIDATE_NOT_SIP;
     }
 
     // Check if we have Content Length header
-    if (regexec(&calls.reg_cl, (const char *) payload, 4, pmatch, 0) != 0) {
+    if (regexec(&parser->reg_cl, (const char *) payload, 4, pmatch, 0) != 0) {
         // Not a SIP message or not complete
         return VALIDATE_PARTIAL_SIP;
     }
@@ -318,7 +432,7 @@ sip_validate_packet(packet_t *packet)
     content_len = atoi(cl_header);
 
     // Check if we have Body separator field
-    if (regexec(&calls.reg_body, (const char *) payload, 2, pmatch, 0) != 0) {
+    if (regexec(&parser->reg_body, (const char *) payload, 2, pmatch, 0) != 0) {
         // Not a SIP message or not complete
         return VALIDATE_PARTIAL_SIP;
     }
@@ -346,148 +460,518 @@ sip_validate_packet(packet_t *packet)
     return VALIDATE_COMPLETE_SIP;
 }
 
+/**
+ * @brief Get the shard owning dialogs with given Call-ID
+ */
+static sip_shard_t *
+sip_shard(const char *callid)
+{
+    return &calls.shards[sip_shard_id(callid, strlen(callid))];
+}
+
+/**
+ * @brief Add a call to the Call-ID hash table of its shard
+ */
+static void
+sip_shard_insert(sip_call_t *call)
+{
+    sip_shard_t *shard = sip_shard(call->callid);
+
+    pthread_mutex_lock(&shard->lock);
+    htable_insert(shard->callids, call->callid, call);
+    // Dialog is no longer rejected
+    sip_reject_remove(&shard->rejected, call->callid);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ * @brief Copy packet payload into a null terminated buffer
+ */
+static void
+sip_copy_payload(packet_t *packet, u_char *payload)
+{
+    memcpy(payload, packet_payload(packet), packet_payloadlen(packet));
+    payload[packet_payloadlen(packet)] = '\0';
+}
+
+/**
+ * @brief Check if given request method or response code can start a new dialog
+ */
+static bool
+sip_check_new_call_method(int reqresp)
+{
+    // User requested only INVITE starting dialogs
+    if (calls.only_calls && reqresp != SIP_METHOD_INVITE)
+        return false;
+
+    // Only create a new call if the first msg
+    // is a request message in the following gorup
+    if (calls.ignore_incomplete && reqresp > SIP_METHOD_MESSAGE)
+        return false;
+
+    return true;
+}
+
+/**
+ * @brief Check if given message can start a new dialog
+ */
+static bool
+sip_check_new_call(packet_t *packet, sip_msg_t *msg, const u_char *payload)
+{
+    // Check if payload matches expression
+    if (!sip_check_match_expression((const char*) payload))
+        return false;
+
+    // Check if message method can start a dialog
+    if (!sip_check_new_call_method(msg->reqresp))
+        return false;
+
+    // Check if message matches dialogs filter
+    if (calls.filter && !sip_filter_check(calls.filter, packet, msg, (const char *) payload)) {
+        metrics_inc(METRIC_DROP_FILTER);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Get request method or response code from the first payload line
+ *
+ * Unlike sip_get_msg_reqresp, the first line is not validated.
+ */
+static int
+sip_get_reqresp_fast(const u_char *payload)
+{
+    char method[SIP_ATTR_MAXLEN];
+    size_t len;
+
+    // Response code
+    if (!strncmp((const char *) payload, "SIP/2.0 ", 8))
+        return atoi((const char *) payload + 8);
+
+    // Request method
+    len = strcspn((const char *) payload, " \r\n");
+    if (len >= sizeof(method))
+        return 0;
+    memcpy(method, payload, len);
+    method[len] = '\0';
+    return sip_method_from_str(method);
+}
+
+/**
+ * @brief Check if message belongs to a dialog rejected before
+ *
+ * Dialogs rejected by their first message method are checked again with
+ * the method of this message, so only messages that would be rejected
+ * anyway are discarded. Dialogs that did not match the match expression
+ * or filter are not checked again.
+ */
+static bool
+sip_check_rejected(const char *callid, const u_char *payload)
+{
+    sip_shard_t *shard = sip_shard(callid);
+    enum sip_reject_reason reason;
+
+    if (!shard->rejected.entries)
+        return false;
+
+    pthread_mutex_lock(&shard->lock);
+    reason = sip_reject_find(&shard->rejected, callid);
+    pthread_mutex_unlock(&shard->lock);
+
+    switch (reason) {
+        case SIP_REJECT_METHOD:
+            return !sip_check_new_call_method(sip_get_reqresp_fast(payload));
+        case SIP_REJECT_MATCH:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Remember a rejected dialog
+ */
+static void
+sip_add_rejected(const char *callid, sip_msg_t *msg)
+{
+    sip_shard_t *shard = sip_shard(callid);
+    enum sip_reject_reason reason;
+
+    if (!shard->rejected.entries)
+        return;
+
+    reason = sip_check_new_call_method(msg->reqresp) ? SIP_REJECT_MATCH : SIP_REJECT_METHOD;
+
+    pthread_mutex_lock(&shard->lock);
+    sip_reject_add(&shard->rejected, callid, reason);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ * @brief Get the body of messages with SDP content
+ *
+ * Multipart bodies are also returned, as they may contain SDP.
+ *
+ * @return message body or NULL if there is no SDP content
+ */
+static const u_char *
+sip_get_msg_sdp(const u_char *payload)
+{
+    const char *line = (const char *) payload, *value;
+    bool sdp = false;
+
+    // Skip request or response line
+    line += strcspn(line, "\n");
+
+    while (*line == '\n') {
+        line++;
+
+        // Empty line, body starts after it
+        if (*line == '\r' || *line == '\n') {
+            line += (*line == '\r');
+            line += (*line == '\n');
+            return (sdp && *line) ? (const u_char *) line : NULL;
+        }
+
+        // Content-Type header, or its compact form
+        if (!strncasecmp(line, "Content-Type", 12)) {
+            value = line + 12;
+        } else if (*line == 'c' || *line == 'C') {
+            value = line + 1;
+        } else {
+            value = NULL;
+        }
+
+        if (value) {
+            value += strspn(value, " \t");
+            if (*value == ':') {
+                value += strspn(value + 1, " \t") + 1;
+                sdp = !strncasecmp(value, "application/sdp", 15)
+                      || !strncasecmp(value, "multipart/", 10);
+            }
+        }
+
+        line += strcspn(line, "\n");
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Parse first message of a new dialog
+ */
+static void
+sip_prepare_new_call(sip_prepared_t *prep, const u_char *payload)
+{
+    // Get the X-Call-ID of this message
+    sip_get_xcallid((const char*) payload, prep->xcallid);
+
+    // Always parse first call message, unless deferred until used
+    if (!calls.lazy_parse)
+        sip_parse_msg_payload(prep->msg, payload);
+}
+
 sip_msg_t *
 sip_check_packet(packet_t *packet)
 {
+    sip_prepared_t prep;
     sip_msg_t *msg;
-    sip_call_t *call;
-    char callid[MAX_CALLID_SIZE], xcallid[MAX_XCALLID_SIZE];
-    u_char payload[MAX_SIP_PAYLOAD];
-    bool newcall = false;
 
-    // Max SIP payload allowed
-    if (packet->payload_len > MAX_SIP_PAYLOAD)
+    if (sip_prepare_packet(packet, &prep) != 0)
         return NULL;
 
-    // Initialize local variables
-    memset(callid, 0, sizeof(callid));
-    memset(xcallid, 0, sizeof(xcallid));
+    if ((msg = sip_correlate_packet(packet, &prep)))
+        sip_publish_msg(msg);
+
+    return msg;
+}
+
+int
+sip_prepare_packet(packet_t *packet, sip_prepared_t *prep)
+{
+    u_char payload[MAX_SIP_PAYLOAD + 1];
+
+    prep->msg = NULL;
+    prep->callid[0] = prep->xcallid[0] = '\0';
+    prep->newcall = false;
+
+    // Max SIP payload allowed
+    if (packet->payload_len > MAX_SIP_PAYLOAD)
+        return 1;
 
     // Get payload from packet(s)
-    memset(payload, 0, MAX_SIP_PAYLOAD);
-    memcpy(payload, packet_payload(packet), packet_payloadlen(packet));
+    sip_copy_payload(packet, payload);
 
     // Get the Call-ID of this message
-    if (!sip_get_callid((const char*) payload, callid))
-        return NULL;
+    if (!sip_get_callid((const char*) payload, prep->callid))
+        return 1;
+
+    // Discard messages of rejected dialogs without parsing them
+    if (sip_check_rejected(prep->callid, payload)) {
+        metrics_inc(METRIC_DROP_REJECTED);
+        return 1;
+    }
 
     // Create a new message from this data
-    if (!(msg = msg_create()))
-        return NULL;
+    if (!(prep->msg = msg_create()))
+        return 1;
 
     // Get Method and request for the following checks
     // There is no need to parse all payload at this point
     // If no response or request code is found, this is not a SIP message
-    if (!sip_get_msg_reqresp(msg, payload)) {
-        // Deallocate message memory
-        msg_destroy(msg);
-        return NULL;
+    if (!sip_get_msg_reqresp(prep->msg, payload)) {
+        sip_prepared_clear(prep);
+        return 1;
     }
 
-    // Find the call for this msg
-    if (!(call = sip_find_by_callid(callid))) {
+    // Dialogs are only created by the worker of their shard, so it's
+    // safe to check here if this message will start a new one
+    PROFILE_START(prof_lookup);
+    prep->newcall = (sip_find_by_callid(prep->callid) == NULL);
+    PROFILE_END(PROFILE_CALLID_LOOKUP, prof_lookup);
+
+    if (prep->newcall) {
+        if (!sip_check_new_call(packet, prep->msg, payload)) {
+            sip_add_rejected(prep->callid, prep->msg);
+            sip_prepared_clear(prep);
+            return 1;
+        }
+        sip_prepare_new_call(prep, payload);
+    }
 
-        // Check if payload matches expression
-        if (!sip_check_match_expression((const char*) payload))
-            goto skip_message;
+    return 0;
+}
 
-        // User requested only INVITE starting dialogs
-        if (calls.only_calls && msg->reqresp != SIP_METHOD_INVITE)
-            goto skip_message;
+sip_msg_t *
+sip_correlate_packet(packet_t *packet, sip_prepared_t *prep)
+{
+    sip_msg_t *msg = prep->msg;
+    sip_shard_t *shard;
+    sip_call_t *call;
+    u_char payload[MAX_SIP_PAYLOAD + 1];
+    const u_char *body;
+    bool copied = false;
 
-        // Only create a new call if the first msg
-        // is a request message in the following gorup
-        if (calls.ignore_incomplete && msg->reqresp > SIP_METHOD_MESSAGE)
-            goto skip_message;
+    // Packet was not prepared as a SIP message
+    if (!msg)
+        return NULL;
 
-        // Get the Call-ID of this message
-        sip_get_xcallid((const char*) payload, xcallid);
+    // Dialogs of other shards can be updated meanwhile
+    shard = sip_shard(prep->callid);
+    pthread_mutex_lock(&shard->calls_lock);
 
-        // Rotate call list if limit has been reached
-        if (calls.limit == sip_calls_count())
-            sip_calls_rotate();
+    // Find the call for this msg
+    if (!(call = sip_find_by_callid(prep->callid))) {
+
+        // Dialog has been removed since this message was prepared
+        if (!prep->newcall) {
+            sip_copy_payload(packet, payload);
+            copied = true;
+            if (!sip_check_new_call(packet, msg, payload))
+                goto skip_message;
+            sip_prepare_new_call(prep, payload);
+        }
 
-        // Create the call if not found
-        if (!(call = call_create(callid, xcallid)))
+        // Create the call if not found, it is stored once published
+        if (!(call = call_create(prep->callid, prep->xcallid)))
             goto skip_message;
 
-        // Add this Call-Id to hash table
-        htable_insert(calls.callids, call->callid, call);
-
-        // Set call index
-        call->index = ++calls.last_index;
-
-        // Mark this as a new call
-        newcall = true;
+        metrics_inc(METRIC_CALLS_CREATED);
+        sip_calls_add_memory(call, sizeof(sip_call_t));
     }
 
     // At this point we know we're handling an interesting SIP Packet
     msg->packet = packet;
 
     // Always parse first call message
-    if (call_msg_count(call) == 0) {
-        // Parse SIP payload
+    if (call_msg_count(call) == 0 && !msg->sip_from && !calls.lazy_parse) {
+        sip_copy_payload(packet, payload);
+        copied = true;
         sip_parse_msg_payload(msg, payload);
-        // If this call has X-Call-Id, append it to the parent call
-        if (strlen(call->xcallid)) {
-            call_add_xcall(sip_find_by_callid(call->xcallid), call);
-        }
     }
 
     // Add the message to the call
     call_add_message(call, msg);
+    prep->msg = NULL;
 
     // check if message is a retransmission
     call_msg_retrans_check(msg);
 
     if (call_is_invite(call)) {
-        // Parse media data
-        sip_parse_msg_media(msg, payload);
+        if (!copied)
+            sip_copy_payload(packet, payload);
+        // Parse media data, only from SDP bodies if parsing is deferred
+        PROFILE_START(prof_sdp);
+        body = (calls.lazy_parse) ? sip_get_msg_sdp(payload) : payload;
+        if (body)
+            sip_parse_msg_media(msg, body);
+        PROFILE_END(PROFILE_SDP_PARSE, prof_sdp);
         // Update Call State
         call_update_state(call, msg);
-        // Parse extra fields
-        sip_parse_extra_headers(msg, payload);
-        // Check if this call should be in active call list
-        if (call_is_active(call)) {
-            if (!sip_call_is_active(call)) {
-                vector_append(calls.active, call);
-            }
-        } else {
-            vector_remove(calls.active, call);
-        }
+        // Parse extra fields, unless deferred until used
+        if (!calls.lazy_parse)
+            sip_parse_extra_headers(msg, payload);
     }
 
-    if (newcall) {
+    pthread_mutex_unlock(&shard->calls_lock);
+
+    // Return the loaded message
+    sip_prepared_clear(prep);
+    return msg;
+
+skip_message:
+    pthread_mutex_unlock(&shard->calls_lock);
+    // Deallocate message memory
+    sip_prepared_clear(prep);
+    return NULL;
+}
+
+void
+sip_publish_msg(sip_msg_t *msg)
+{
+    sip_call_t *call = msg->call, *parent;
+
+    // Dialog removed while this message was being added
+    if (call->removed)
+        return;
+
+    // New dialogs have no index until they are stored
+    if (!call->index) {
+        // Rotate call list if limit has been reached
+        if (calls.limit == sip_calls_count())
+            sip_calls_rotate();
+
+        // Add this Call-Id to its shard hash table
+        sip_shard_insert(call);
+
+        // Set call index
+        call->index = ++calls.last_index;
+
+        // If this call has X-Call-Id, append it to the parent call
+        if (strlen(call->xcallid) && (parent = sip_find_by_callid(call->xcallid))) {
+            sip_call_lock(parent);
+            call_add_xcall(parent, call);
+            sip_call_unlock(parent);
+        }
+
         // Append this call to the call list
         vector_append(calls.list, call);
         ++calls.call_count_unrotated;
+        // Index its attributes for display filters
+        sip_index_add_call(call);
+    }
+
+    // Check if this call should be in active call list
+    if (call_is_active(call)) {
+        if (!call->active) {
+            vector_append(calls.active, call);
+            call->active = true;
+        }
+    } else if (call->active) {
+        vector_remove(calls.active, call);
+        call->active = false;
     }
 
+    // Check if this dialog has finished with this message
+    if (calls.expire || calls.max_memory)
+        sip_calls_update_finished(call, msg);
+
     // Mark the list as changed
     calls.changed = true;
+}
 
-    // Return the loaded message
-    return msg;
+void
+sip_prepared_clear(sip_prepared_t *prep)
+{
+    if (prep->msg)
+        msg_destroy(prep->msg);
+    prep->msg = NULL;
+}
 
-skip_message:
-    // Deallocate message memory
-    msg_destroy(msg);
-    return NULL;
+int
+sip_shard_count()
+{
+    return calls.shard_count;
+}
+
+int
+sip_shard_id(const char *callid, size_t len)
+{
+    // FNV-1a hash of Call-ID value
+    uint32_t hash = 2166136261u;
+
+    while (len--) {
+        hash ^= (u_char) *callid++;
+        hash *= 16777619u;
+    }
+
+    return hash % calls.shard_count;
+}
+
+int
+sip_shard_from_payload(const u_char *payload, uint32_t len)
+{
+    const u_char *line, *eol, *value, *end = payload + len;
+    size_t vlen;
+
+    for (line = payload; line < end; line = eol + 1) {
+        if (!(eol = memchr(line, '\n', end - line)))
+            eol = end;
+
+        // Call-ID header, in long or compact form
+        if (eol - line > 8 && !strncasecmp((const char *) line, "Call-ID:", 8)) {
+            value = line + 8;
+        } else if (eol - line > 2 && !strncasecmp((const char *) line, "i:", 2)) {
+            value = line + 2;
+        } else {
+            continue;
+        }
+
+        // Same value sip_get_callid would extract
+        while (value < eol && *value == ' ')
+            value++;
+        for (vlen = 0; value + vlen < eol && value[vlen] != ' ' && value[vlen] != '\r'; vlen++);
+        if (vlen > MAX_CALLID_SIZE - 1)
+            vlen = MAX_CALLID_SIZE - 1;
+        for (line = value + vlen; line < eol && *line == ' '; line++);
+        if (vlen && line == eol - 1 && *line == '\r')
+            return sip_shard_id((const char *) value, vlen);
+    }
+
+    return -1;
+}
+
+void
+sip_shard_attach(int id)
+{
+    sip_local_parser = &calls.shards[id].parser;
+}
 
+void
+sip_call_lock(sip_call_t *call)
+{
+    pthread_mutex_lock(&sip_shard(call->callid)->calls_lock);
+}
+
+void
+sip_call_unlock(sip_call_t *call)
+{
+    pthread_mutex_unlock(&sip_shard(call->callid)->calls_lock);
 }
 
 bool
 sip_calls_has_changed()
 {
-    bool changed = calls.changed;
-    calls.changed = false;
-    return changed;
+    // Interface can query this while capture thread is parsing
+    return __atomic_exchange_n(&calls.changed, false, __ATOMIC_ACQ_REL);
 }
 
 int
 sip_calls_count()
 {
-    return vector_count(calls.list);
+    return vector_count(sip_calls_vector());
 }
 
 int
@@ -496,6 +980,12 @@ sip_calls_count_unrotated()
     return calls.call_count_unrotated;
 }
 
+unsigned int
+sip_calls_count_removed()
+{
+    return __atomic_load_n(&calls.call_count_removed, __ATOMIC_ACQUIRE);
+}
+
 vector_iter_t
 sip_calls_iterator()
 {
@@ -511,26 +1001,27 @@ sip_active_calls_iterator()
 bool
 sip_call_is_active(sip_call_t *call)
 {
-    return vector_index(calls.active, call) != -1;
+    return call->active;
 }
 
 vector_t *
 sip_calls_vector()
 {
-    return calls.list;
+    // Interface can query this while calls are being filtered
+    return __atomic_load_n(&calls.list, __ATOMIC_ACQUIRE);
 }
 
 vector_t *
 sip_active_calls_vector()
 {
-    return calls.active;
+    return __atomic_load_n(&calls.active, __ATOMIC_ACQUIRE);
 }
 
 sip_stats_t
 sip_calls_stats()
 {
     sip_stats_t stats;
-    vector_iter_t it = vector_iterator(calls.list);
+    vector_iter_t it = vector_iterator(sip_calls_vector());
 
     // Total number of calls without filtering
     stats.total = vector_iterator_count(&it);
@@ -549,12 +1040,20 @@ sip_find_by_index(int index)
 sip_call_t *
 sip_find_by_callid(const char *callid)
 {
-    return htable_find(calls.callids, callid);
+    sip_shard_t *shard = sip_shard(callid);
+    sip_call_t *call;
+
+    pthread_mutex_lock(&shard->lock);
+    call = htable_find(shard->callids, callid);
+    pthread_mutex_unlock(&shard->lock);
+
+    return call;
 }
 
 int
 sip_get_msg_reqresp(sip_msg_t *msg, const u_char *payload)
 {
+    sip_parser_t *parser = sip_parser();
     regmatch_t pmatch[3];
     char resp_str[SIP_ATTR_MAXLEN];
     char reqresp[SIP_ATTR_MAXLEN];
@@ -570,7 +1069,7 @@ sip_get_msg_reqresp(sip_msg_t *msg, const u_char *payload)
     if (!msg->reqresp) {
 
         // Method & CSeq
-        if (regexec(&calls.reg_method, (const char *)payload, 2, pmatch, 0) == 0) {
+        if (regexec(&parser->reg_method, (const char *)payload, 2, pmatch, 0) == 0) {
             if ((int)(pmatch[1].rm_eo - pmatch[1].rm_so) >= SIP_ATTR_MAXLEN) {
                 sng_strncpy(reqresp, "<malformed>", 12);
             } else {
@@ -579,14 +1078,14 @@ sip_get_msg_reqresp(sip_msg_t *msg, const u_char *payload)
         }
 
         // CSeq
-        if (regexec(&calls.reg_cseq, (char*)payload, 2, pmatch, 0) == 0) {
+        if (regexec(&parser->reg_cseq, (char*)payload, 2, pmatch, 0) == 0) {
             sprintf(cseq, "%.*s", (int)(pmatch[1].rm_eo - pmatch[1].rm_so), payload + pmatch[1].rm_so);
             msg->cseq = atoi(cseq);
         }
 
 
         // Response code
-        if (regexec(&calls.reg_response, (const char *)payload, 3, pmatch, 0) == 0) {
+        if (regexec(&parser->reg_response, (const char *)payload, 3, pmatch, 0) == 0) {
             if ((int)(pmatch[1].rm_eo - pmatch[1].rm_so) >= SIP_ATTR_MAXLEN) {
                 sng_strncpy(resp_str, "<malformed>", 12);
             } else {
@@ -634,36 +1133,42 @@ sip_parse_msg(sip_msg_t *msg)
     return msg;
 }
 
+sip_msg_t *
+sip_parse_msg_deferred(sip_msg_t *msg)
+{
+    const char *payload;
+
+    if (msg && calls.lazy_parse && !msg->sip_from && (payload = msg_get_payload(msg))) {
+        sip_parse_msg_payload(msg, (const u_char *) payload);
+    }
+    return msg;
+}
+
 int
 sip_parse_msg_payload(sip_msg_t *msg, const u_char *payload)
 {
+    sip_parser_t *parser = sip_parser();
     regmatch_t pmatch[4];
 
     // From
-    if (regexec(&calls.reg_from, (const char *)payload, 4, pmatch, 0) == 0) {
-        msg->sip_from = sng_malloc((int)pmatch[2].rm_eo - pmatch[2].rm_so + 1);
-        sng_strncpy(msg->sip_from, (const char *)payload +  pmatch[2].rm_so, (int)pmatch[2].rm_eo - pmatch[2].rm_so);
+    if (regexec(&parser->reg_from, (const char *)payload, 4, pmatch, 0) == 0) {
+        msg->sip_from = intern_string((const char *)payload + pmatch[2].rm_so, pmatch[2].rm_eo - pmatch[2].rm_so);
     } else {
         // Malformed From Header
-        msg->sip_from = sng_malloc(12);
-        sng_strncpy(msg->sip_from, "<malformed>", 12);
+        msg->sip_from = intern_string("<malformed>", 11);
     }
 
     // To
-    if (regexec(&calls.reg_to, (const char *)payload, 4, pmatch, 0) == 0) {
-        msg->sip_to = sng_malloc((int)pmatch[2].rm_eo - pmatch[2].rm_so + 1);
-        sng_strncpy(msg->sip_to, (const char *)payload +  pmatch[2].rm_so, (int)pmatch[2].rm_eo - pmatch[2].rm_so);
+    if (regexec(&parser->reg_to, (const char *)payload, 4, pmatch, 0) == 0) {
+        msg->sip_to = intern_string((const char *)payload + pmatch[2].rm_so, pmatch[2].rm_eo - pmatch[2].rm_so);
     } else {
         // Malformed To Header
-        msg->sip_to = sng_malloc(12);
-        sng_strncpy(msg->sip_to, "<malformed>", 12);
+        msg->sip_to = intern_string("<malformed>", 11);
     }
 
     // Contact
-    if (regexec(&calls.reg_contact, (const char *)payload, 3, pmatch, 0) == 0) {
-        int len = (int)pmatch[2].rm_eo - pmatch[2].rm_so;
-        msg->sip_contact = sng_malloc(len + 1);
-        sng_strncpy(msg->sip_contact, (const char *)payload + pmatch[2].rm_so, len + 1);
+    if (regexec(&parser->reg_contact, (const char *)payload, 3, pmatch, 0) == 0) {
+        msg->sip_contact = intern_string((const char *)payload + pmatch[2].rm_so, pmatch[2].rm_eo - pmatch[2].rm_so);
     }
 
     return 0;
@@ -691,7 +1196,9 @@ sip_parse_msg_media(sip_msg_t *msg, const u_char *payload)
     uint32_t media_fmt_pref;
     uint32_t media_fmt_code;
     sdp_media_t *media = NULL;
-    char *payload2, *tofree, *line;
+    const char *next = (const char *) payload;
+    char line[SDP_LINE_MAXLEN];
+    size_t len;
     sip_call_t *call = msg_get_call(msg);
 
     // If message is retrans, there's no need to parse the payload again
@@ -702,8 +1209,23 @@ sip_parse_msg_media(sip_msg_t *msg, const u_char *payload)
     }
 
     // Parse each line of payload looking for sdp information
-    tofree = payload2 = strdup((char*)payload);
-    while ((line = strsep(&payload2, "\r\n")) != NULL) {
+    while (*next) {
+        len = strcspn(next, "\r\n");
+
+        // Only copy lines with sdp information
+        if (len < 2 || next[1] != '=') {
+            next += len;
+            next += strspn(next, "\r\n");
+            continue;
+        }
+
+        if (len >= sizeof(line))
+            len = sizeof(line) - 1;
+        memcpy(line, next, len);
+        line[len] = '\0';
+        next += strcspn(next, "\r\n");
+        next += strspn(next, "\r\n");
+
         // Check if we have a media string
         if (!strncmp(line, "m=", 2)) {
             if (sscanf(line, "m=%" STRINGIFY(MEDIATYPELEN) "s %hu RTP/%*s %u", media_type, &dst.port, &media_fmt_pref) == 3
@@ -775,25 +1297,24 @@ sip_parse_msg_media(sip_msg_t *msg, const u_char *payload)
     ADD_STREAM(rtp_stream);
     ADD_STREAM(rtcp_stream);
 
-    sng_free(tofree);
-
 #undef ADD_STREAM
 }
 
 void
 sip_parse_extra_headers(sip_msg_t *msg, const u_char *payload)
 {
+    sip_parser_t *parser = sip_parser();
     regmatch_t pmatch[4];
     char warning[MAX_WARNING_SIZE];
 
      // Reason text
-     if (regexec(&calls.reg_reason, (const char *)payload, 2, pmatch, 0) == 0) {
+     if (regexec(&parser->reg_reason, (const char *)payload, 2, pmatch, 0) == 0) {
          msg->call->reasontxt = sng_malloc((int)pmatch[1].rm_eo - pmatch[1].rm_so + 1);
          sng_strncpy(msg->call->reasontxt, (const char *)payload +  pmatch[1].rm_so, (int)pmatch[1].rm_eo - pmatch[1].rm_so);
      }
 
      // Warning code
-     if (regexec(&calls.reg_warning, (const char *)payload, 2, pmatch, 0) == 0) {
+     if (regexec(&parser->reg_warning, (const char *)payload, 2, pmatch, 0) == 0) {
 
         // Ensure the copy length does not exceed MAX_WARNING_SIZE
         int warning_match_len = pmatch[1].rm_eo - pmatch[1].rm_so;
@@ -808,37 +1329,149 @@ sip_parse_extra_headers(sip_msg_t *msg, const u_char *payload)
     }
 }
 
+void
+sip_parse_call_deferred(sip_call_t *call)
+{
+    sip_msg_t *msg;
+    const char *payload;
+    char *reasontxt;
+
+    if (!calls.lazy_parse || !call_is_invite(call))
+        return;
+
+    // Parse messages added since last call, in the order they were added
+    while (call->extra_parsed < call_msg_count(call)) {
+        msg = vector_item(call->msgs, call->extra_parsed++);
+        if (!(payload = msg_get_payload(msg)))
+            continue;
+        reasontxt = call->reasontxt;
+        sip_parse_extra_headers(msg, (const u_char *) payload);
+        // Only the last reason text is kept
+        if (reasontxt != call->reasontxt)
+            sng_free(reasontxt);
+    }
+}
+
+/**
+ * @brief Lock or unlock dialogs of every shard
+ */
+static void
+sip_shards_lock(bool lock)
+{
+    int i;
+
+    for (i = 0; i < calls.shard_count; i++) {
+        if (lock) {
+            pthread_mutex_lock(&calls.shards[i].calls_lock);
+        } else {
+            pthread_mutex_unlock(&calls.shards[i].calls_lock);
+        }
+    }
+}
+
+/**
+ * @brief Create again the Call-ID hash table of every shard
+ */
+static void
+sip_shards_clear()
+{
+    int i;
+
+    for (i = 0; i < calls.shard_count; i++) {
+        pthread_mutex_lock(&calls.shards[i].lock);
+        htable_destroy(calls.shards[i].callids);
+        calls.shards[i].callids = htable_create(calls.limit);
+        pthread_mutex_unlock(&calls.shards[i].lock);
+    }
+}
+
 void
 sip_calls_clear()
 {
-    // Create again the callid hash table
-    htable_destroy(calls.callids);
-    calls.callids = htable_create(calls.limit);
+    // Wait until no dialog is being updated
+    sip_shards_lock(true);
+
+    // Create again the callid hash tables
+    sip_shards_clear();
 
     // Remove all items from vector
     vector_clear(calls.list);
     vector_clear(calls.active);
+
+    // Remove all dialogs from the index
+    sip_index_clear();
+
+    sip_shards_lock(false);
+}
+
+/**
+ * @brief Stop finding a call by its Call-ID or from its related call
+ */
+static void
+sip_calls_unlink(sip_call_t *call)
+{
+    sip_call_t *parent;
+    sip_shard_t *shard;
+
+    // Remove from callids hash
+    shard = sip_shard(call->callid);
+    pthread_mutex_lock(&shard->lock);
+    htable_remove(shard->callids, call->callid);
+    pthread_mutex_unlock(&shard->lock);
+    // Remove from parent call related calls
+    if (strlen(call->xcallid) && (parent = sip_find_by_callid(call->xcallid)))
+        vector_remove(parent->xcalls, call);
 }
 
 void
 sip_calls_clear_soft()
 {
-        // Create again the callid hash table
-        htable_destroy(calls.callids);
-        calls.callids = htable_create(calls.limit);
-
-        // Repopulate list applying current filter
-        calls.list = vector_copy_if(sip_calls_vector(), filter_check_call);
-        calls.active = vector_copy_if(sip_active_calls_vector(), filter_check_call);
+    sip_call_t *call;
+    vector_t *list, *active, *dropped;
+    vector_iter_t it;
 
-        // Repopulate callids based on filtered list
-        sip_call_t *call;
-        vector_iter_t it = vector_iterator(calls.list);
+    // Wait until no dialog is being updated
+    sip_shards_lock(true);
 
-        while ((call = vector_iterator_next(&it)))
-        {
-                htable_insert(calls.callids, call->callid, call);
+    // Split dialogs between kept and dropped, keeping their order
+    sip_calls_vectors_create(&list, &active);
+    dropped = vector_create(0, 50);
+    it = vector_iterator(calls.list);
+    while ((call = vector_iterator_next(&it))) {
+        if (filter_check_call(call)) {
+            vector_append(list, call);
+        } else {
+            vector_append(dropped, call);
         }
+    }
+    it = vector_iterator(calls.active);
+    vector_iterator_set_filter(&it, filter_check_call);
+    while ((call = vector_iterator_next(&it)))
+        vector_append(active, call);
+    vector_set_destroyer(list, call_destroyer);
+    vector_set_sorter(list, sip_list_sorter);
+
+    // Replace the lists while the interface may be reading them
+    vector_retire(__atomic_exchange_n(&calls.list, list, __ATOMIC_ACQ_REL));
+    vector_retire(__atomic_exchange_n(&calls.active, active, __ATOMIC_ACQ_REL));
+
+    // Dropped dialogs are removed as any other removed dialog
+    it = vector_iterator(dropped);
+    while ((call = vector_iterator_next(&it))) {
+        sip_calls_unlink(call);
+        call_destroy(call);
+    }
+    vector_destroy(dropped);
+
+    sip_shards_lock(false);
+}
+
+void
+sip_metrics_collect()
+{
+    metrics_set(METRIC_CALLS, vector_count(sip_calls_vector()));
+    metrics_set(METRIC_CALLS_ACTIVE, vector_count(sip_active_calls_vector()));
+    metrics_set(METRIC_MEM_DIALOGS, __atomic_load_n(&calls.memory, __ATOMIC_RELAXED));
 }
 
 void
@@ -848,56 +1481,218 @@ sip_calls_rotate()
     vector_iter_t it = vector_iterator(calls.list);
     while ((call = vector_iterator_next(&it))) {
         if (!call->locked) {
-            // Remove from callids hash
-            htable_remove(calls.callids, call->callid);
-            // Remove first call from active and call lists
-            vector_remove(calls.active, call);
-            vector_remove(calls.list, call);
+            // Remove first unlocked call
+            sip_calls_remove(call);
+            metrics_inc(METRIC_CALLS_ROTATED);
             return;
         }
     }
 }
 
+void
+sip_calls_remove(sip_call_t *call)
+{
+    sip_shard_t *shard = sip_shard(call->callid);
+
+    // Wait until its correlation worker is not updating the call
+    pthread_mutex_lock(&shard->calls_lock);
+    sip_calls_unlink(call);
+    // Remove from active and call lists (call is destroyed here)
+    if (call->active)
+        vector_remove(calls.active, call);
+    vector_remove(calls.list, call);
+    pthread_mutex_unlock(&shard->calls_lock);
+}
+
+void
+sip_calls_add_memory(sip_call_t *call, size_t bytes)
+{
+    // Removed dialogs memory is no longer accounted
+    if (call->removed)
+        return;
+
+    call->memory += bytes;
+    // Dialogs of several shards can be updated at the same time
+    __atomic_add_fetch(&calls.memory, bytes, __ATOMIC_RELAXED);
+}
+
+void
+sip_calls_untrack(sip_call_t *call)
+{
+    sip_calls_finished_remove(call);
+    __atomic_sub_fetch(&calls.memory, call->memory, __ATOMIC_RELAXED);
+    call->removed = true;
+    __atomic_add_fetch(&calls.call_count_removed, 1, __ATOMIC_RELEASE);
+}
+
+void
+sip_calls_finished_remove(sip_call_t *call)
+{
+    // Not in finished dialogs list
+    if (!call->finished_prev && calls.finished_first != call)
+        return;
+
+    if (call->finished_prev) {
+        call->finished_prev->finished_next = call->finished_next;
+    } else {
+        calls.finished_first = call->finished_next;
+    }
+
+    if (call->finished_next) {
+        call->finished_next->finished_prev = call->finished_prev;
+    } else {
+        calls.finished_last = call->finished_prev;
+    }
+
+    call->finished_prev = call->finished_next = NULL;
+}
+
+void
+sip_calls_update_finished(sip_call_t *call, sip_msg_t *msg)
+{
+    sip_call_t *prev;
+
+    if (call->state) {
+        // INVITE dialogs finish when the call is no longer in progress
+        if (call_is_active(call)) {
+            sip_calls_finished_remove(call);
+            return;
+        }
+    } else if (msg->reqresp < 200 && msg->reqresp != SIP_METHOD_ACK) {
+        // Other dialogs wait for a final response to their last request
+        if (msg->reqresp < 100)
+            sip_calls_finished_remove(call);
+        return;
+    }
+
+    // Move the dialog to its place in finished list, sorted by finish time.
+    // Packets from several devices, sources or files may not be parsed in
+    // time order, but they are close to it, so look from the end
+    sip_calls_finished_remove(call);
+    call->finished = packet_time(msg->packet).tv_sec;
+    for (prev = calls.finished_last; prev && prev->finished > call->finished; prev = prev->finished_prev);
+
+    call->finished_prev = prev;
+    call->finished_next = (prev) ? prev->finished_next : calls.finished_first;
+    if (call->finished_next) {
+        call->finished_next->finished_prev = call;
+    } else {
+        calls.finished_last = call;
+    }
+    if (prev) {
+        prev->finished_next = call;
+    } else {
+        calls.finished_first = call;
+    }
+}
+
+void
+sip_calls_expire(struct timeval now)
+{
+    sip_call_t *call, *next;
+    vector_iter_t it;
+
+    // Nothing to do if no limit is configured
+    if (!calls.expire && !calls.max_memory)
+        return;
+
+    // Remove dialogs finished more than expire seconds ago
+    if (calls.expire) {
+        for (call = calls.finished_first; call; call = next) {
+            if (call->finished + calls.expire > now.tv_sec)
+                break;
+            next = call->finished_next;
+            if (!call->locked) {
+                sip_calls_remove(call);
+                metrics_inc(METRIC_CALLS_EXPIRED);
+                calls.changed = true;
+            }
+        }
+    }
+
+    // Remove oldest dialogs while memory limit is exceeded
+    while (calls.max_memory && __atomic_load_n(&calls.memory, __ATOMIC_RELAXED) > calls.max_memory) {
+        // Oldest finished dialogs first
+        for (call = calls.finished_first; call && call->locked; call = call->finished_next);
+
+        // Then oldest dialogs still in progress
+        if (!call) {
+            it = vector_iterator(calls.list);
+            while ((call = vector_iterator_next(&it)) && call->locked);
+        }
+
+        // All remaining dialogs are locked
+        if (!call)
+            break;
+
+        sip_calls_remove(call);
+        metrics_inc(METRIC_CALLS_EVICTED);
+        calls.changed = true;
+    }
+}
+
+bool
+sip_calls_expire_pending(struct timeval now)
+{
+    sip_call_t *first;
+
+    // Memory limit exceeded
+    if (calls.max_memory && __atomic_load_n(&calls.memory, __ATOMIC_RELAXED) > calls.max_memory)
+        return true;
+
+    // Oldest finished dialog has expired. It can not be released while
+    // the caller is in a read section, even if removed meanwhile
+    first = __atomic_load_n(&calls.finished_first, __ATOMIC_ACQUIRE);
+    return calls.expire && first && first->finished + calls.expire <= now.tv_sec;
+}
+
 int
 sip_set_match_expression(const char *expr, int insensitive, int invert)
 {
+    int flags = REGEXP_DOTALL;
+
     // Store expression text
     calls.match_expr = expr;
     // Set invert flag
     calls.match_invert = invert;
+    // Set case insensitive flag
+    calls.match_insensitive = insensitive;
 
-#ifdef WITH_PCRE
-    const char *re_err = NULL;
-    int32_t err_offset;
-    int32_t pflags = PCRE_UNGREEDY | PCRE_DOTALL;
-
+    // Case insensitive requested
     if (insensitive)
-        pflags |= PCRE_CASELESS;
+        flags |= REGEXP_CASELESS;
 
-    // Check if we have a valid expression
-    calls.match_regex = pcre_compile(expr, pflags, &re_err, &err_offset, 0);
-    return calls.match_regex == NULL;
-#elif defined(WITH_PCRE2)
-    int re_err = 0;
-    PCRE2_SIZE err_offset = 0;
-    uint32_t pflags = PCRE2_UNGREEDY | PCRE2_CASELESS;
+    // Extract literal text to skip payloads that can not match
+    search_compile(&calls.match_search, expr, insensitive);
 
-    if (insensitive)
-        pflags |= PCRE2_CASELESS;
+    // Check the expresion is a compilable regexp
+    return regexp_compile(&calls.match_regex, expr, flags);
+}
+
+void
+sip_set_lazy_parse(bool lazy)
+{
+    calls.lazy_parse = lazy;
+}
 
-    // Check if we have a valid expression
-    calls.match_regex = pcre2_compile((PCRE2_SPTR) expr, PCRE2_ZERO_TERMINATED, pflags, &re_err, &err_offset, NULL);
-    return calls.match_regex == NULL;
-#else
-    int cflags = REG_EXTENDED;
+int
+sip_set_filter_expression(const char *expr, char *error, size_t errlen)
+{
+    sip_filter_t *filter;
 
-    // Case insensitive requested
-    if (insensitive)
-        cflags |= REG_ICASE;
+    if (!(filter = sip_filter_compile(expr, error, errlen)))
+        return 1;
 
-    // Check the expresion is a compilable regexp
-    return regcomp(&calls.match_regex, expr, cflags) != 0;
-#endif
+    sip_filter_free(calls.filter);
+    calls.filter = filter;
+    calls.filter_expr = expr;
+    return 0;
+}
+
+const char *
+sip_get_filter_expression()
+{
+    return calls.filter_expr;
 }
 
 const char *
@@ -906,34 +1701,29 @@ sip_get_match_expression()
     return calls.match_expr;
 }
 
+void
+sip_get_match_flags(int *insensitive, int *invert)
+{
+    *insensitive = calls.match_insensitive;
+    *invert = calls.match_invert;
+}
+
 int
 sip_check_match_expression(const char *payload)
 {
+    size_t len;
+
     // Everything matches when there is no match
     if (!calls.match_expr)
         return 1;
 
-#ifdef WITH_PCRE
-    switch (pcre_exec(calls.match_regex, 0, payload, strlen(payload), 0, 0, 0, 0)) {
-        case PCRE_ERROR_NOMATCH:
-            return 1 == calls.match_invert;
-    }
-
-    return 0 == calls.match_invert;
-#elif defined(WITH_PCRE2)
-    pcre2_match_data *match_data = pcre2_match_data_create_from_pattern(calls.match_regex, NULL);
-    int ret = pcre2_match(calls.match_regex, (PCRE2_SPTR) payload, (PCRE2_SIZE) strlen(payload), 0, 0, match_data, NULL);
-    pcre2_match_data_free(match_data);
-
-    if (ret == PCRE2_ERROR_NOMATCH) {
-        return 1 == calls.match_invert;
-    }
+    // Payloads without any required literal can not match
+    len = strlen(payload);
+    if (!search_candidate(&calls.match_search, payload, len))
+        return calls.match_invert != 0;
 
-    return 0 == calls.match_invert;
-#else
     // Check if payload matches the given expresion
-    return (regexec(&calls.match_regex, payload, 0, NULL, 0) == calls.match_invert);
-#endif
+    return regexp_match(&calls.match_regex, payload, len) == (calls.match_invert == 0);
 }
 
 const char *
@@ -1014,44 +1804,34 @@ sip_sort_options()
     return calls.sort;
 }
 
-void
-sip_sort_list()
+/**
+ * @brief Compare two calls of the list using current sort options
+ *
+ * Calls with the same attribute value are kept in creation order,
+ * whatever the sort direction.
+ */
+static int
+sip_list_compare(const void *one, const void *two)
 {
-    // Cloning the vector automatically sorts it
-    vector_t *clone = vector_clone(calls.list);
+    sip_call_t *onecall = *(sip_call_t **) one;
+    sip_call_t *twocall = *(sip_call_t **) two;
+    int cmp;
 
-    // FIXME FIXME FIXME
-    // There should be a way to destroy the vector without calling the
-    // vector destroyer for each item...
-    vector_set_destroyer(calls.list, NULL);
-    vector_destroy(calls.list);
+    if ((cmp = call_attr_compare(onecall, twocall, calls.sort.by)))
+        return (calls.sort.asc) ? cmp : -cmp;
 
-    // The new sorted list
-    calls.list = clone;
+    return (onecall->index > twocall->index) - (onecall->index < twocall->index);
 }
 
 void
-sip_list_sorter(vector_t *vector, void *item)
+sip_sort_list()
 {
-    sip_call_t *prev, *cur = (sip_call_t *)item;
-    int count = vector_count(vector);
-    int i;
-
-    // First item is alway sorted
-    if (vector_count(vector) == 1)
-        return;
-
-    for (i = count - 2 ; i >= 0; i--) {
-        // Get previous item
-        prev = vector_item(vector, i);
-        // Check if the item is already in a sorted position
-        int cmp = call_attr_compare(cur, prev, calls.sort.by);
-        if ((calls.sort.asc && cmp > 0) || (!calls.sort.asc && cmp < 0)) {
-            vector_insert(vector, item, i + 1);
-            return;
-        }
-    }
+    vector_sort(calls.list, sip_list_compare);
+}
 
-    // Put this item at the begining of the vector
-    vector_insert(vector, item, 0);
+void
+sip_list_sorter(vector_t *vector, void *item)
+{
+    // Move the item to its sorted position, unless already there
+    vector_insert(vector, item, vector_sorted_position(vector, item, sip_list_compare));
 }
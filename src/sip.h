@@ -34,21 +34,24 @@
 
 #include "config.h"
 #include <stdbool.h>
+#include <pthread.h>
 #include <regex.h>
-#ifdef WITH_PCRE
-#include <pcre.h>
-#elif defined(WITH_PCRE2)
-#include <pcre2.h>
-#endif
 #include "sip_call.h"
 #include "vector.h"
 #include "hash.h"
+#include "regexp.h"
+#include "search.h"
+#include "sip_filter.h"
+#include "sip_reject.h"
 
 #define MAX_SIP_PAYLOAD 10240
 #define MAX_CALLID_SIZE 1024
 #define MAX_XCALLID_SIZE 1024
 #define MAX_CONTENT_LENGTH_SIZE 10
 #define MAX_WARNING_SIZE 10
+#define SDP_LINE_MAXLEN 1024
+//! Max number of correlation shards
+#define SIP_MAX_SHARDS 64
 
 //! Shorter declaration of sip_call_list structure
 typedef struct sip_call_list sip_call_list_t;
@@ -58,6 +61,12 @@ typedef struct sip_code sip_code_t;
 typedef struct sip_stats sip_stats_t;
 //! Shorter declaration of sip sort
 typedef struct sip_sort sip_sort_t;
+//! Shorter declaration of sip_parser structure
+typedef struct sip_parser sip_parser_t;
+//! Shorter declaration of sip_shard structure
+typedef struct sip_shard sip_shard_t;
+//! Shorter declaration of sip_prepared structure
+typedef struct sip_prepared sip_prepared_t;
 
 //! SIP Methods
 enum sip_methods {
@@ -117,6 +126,65 @@ struct sip_sort
     bool asc;
 };
 
+/**
+ * @brief Compiled expressions for payload parsing
+ *
+ * POSIX regexec serializes matches of the same compiled expression, so
+ * each correlation worker uses its own copy.
+ */
+struct sip_parser {
+    regex_t reg_method;
+    regex_t reg_callid;
+    regex_t reg_xcallid;
+    regex_t reg_response;
+    regex_t reg_cseq;
+    regex_t reg_from;
+    regex_t reg_to;
+    regex_t reg_contact;
+    regex_t reg_valid;
+    regex_t reg_cl;
+    regex_t reg_body;
+    regex_t reg_reason;
+    regex_t reg_warning;
+};
+
+/**
+ * @brief Correlation shard
+ *
+ * Dialogs are assigned to a shard using their Call-ID hash. Each shard
+ * owns the Call-ID table of its dialogs.
+ *
+ * Dialogs are updated holding the lock of their shard, so workers of
+ * different shards update their dialogs at the same time. Code that
+ * also needs capture lock must take it before any shard lock.
+ */
+struct sip_shard {
+    //! Call-Ids hash table of this shard dialogs
+    htable_t *callids;
+    //! Payload parsing expressions for this shard worker
+    sip_parser_t parser;
+    //! Call-Ids of this shard rejected dialogs
+    sip_reject_t rejected;
+    //! Lock for Call-Ids hash table and rejected Call-Ids
+    pthread_mutex_t lock;
+    //! Lock held while this shard dialogs are updated or removed
+    pthread_mutex_t calls_lock;
+};
+
+/**
+ * @brief SIP message headers extracted before looking for its dialog
+ */
+struct sip_prepared {
+    //! Message created from packet payload
+    sip_msg_t *msg;
+    //! Call-ID header value
+    char callid[MAX_CALLID_SIZE];
+    //! X-Call-ID header value
+    char xcallid[MAX_XCALLID_SIZE];
+    //! No dialog existed for this Call-ID when prepared
+    bool newcall;
+};
+
 /**
  * @brief call structures head list
  *
@@ -133,11 +201,15 @@ struct sip_call_list {
     sip_sort_t sort;
     //! Last created id
     int last_index;
-    //! Call-Ids hash table
-    htable_t *callids;
+    //! Correlation shards
+    sip_shard_t *shards;
+    //! Number of correlation shards
+    int shard_count;
 
     //! Full count of all captured calls, regardless of rotation
     int call_count_unrotated;
+    //! Count of removed calls, to detect outdated copies of the list
+    unsigned int call_count_removed;
     // Max call limit
     int limit;
     //! Only store dialogs starting with INVITE
@@ -146,33 +218,32 @@ struct sip_call_list {
     int ignore_incomplete;
     //! match expression text
     const char *match_expr;
-#ifdef WITH_PCRE
     //! Compiled match expression
-    pcre *match_regex;
-#elif defined(WITH_PCRE2)
-    //! Compiled match expression
-    pcre2_code *match_regex;
-#else
-    //! Compiled match expression
-    regex_t match_regex;
-#endif
+    regexp_t match_regex;
+    //! Literals required to match the expression
+    search_t match_search;
+    //! Case insensitive match expression
+    int match_insensitive;
     //! Invert match expression result
     int match_invert;
+    //! Dialogs filter expression text
+    const char *filter_expr;
+    //! Compiled dialogs filter expression
+    sip_filter_t *filter;
+    //! Defer parsing headers not required for correlation
+    bool lazy_parse;
+
+    //! Remove dialogs finished more than these seconds ago (0 disabled)
+    int expire;
+    //! Max memory in bytes used by stored dialogs (0 disabled)
+    size_t max_memory;
+    //! Memory in bytes used by stored dialogs
+    size_t memory;
+    //! Finished dialogs list, sorted by finish time
+    sip_call_t *finished_first, *finished_last;
 
     //! Regexp for payload matching
-    regex_t reg_method;
-    regex_t reg_callid;
-    regex_t reg_xcallid;
-    regex_t reg_response;
-    regex_t reg_cseq;
-    regex_t reg_from;
-    regex_t reg_to;
-    regex_t reg_contact;
-    regex_t reg_valid;
-    regex_t reg_cl;
-    regex_t reg_body;
-    regex_t reg_reason;
-    regex_t reg_warning;
+    sip_parser_t parser;
 };
 
 /**
@@ -240,12 +311,118 @@ sip_validate_packet(packet_t *packet);
  * Use this function to convert raw data into call and message
  * structures. This is mainly used to load data from a file or
  *
+ * @note This function must be called with the capture lock held
+ *
  * @param packet Packet structure pointer
  * @return a SIP msg structure pointer
  */
 sip_msg_t *
 sip_check_packet(packet_t *packet);
 
+/**
+ * @brief Extract SIP message headers from packet payload
+ *
+ * First half of sip_check_packet that does not modify any dialog, so it
+ * can be run by correlation workers without holding capture lock.
+ *
+ * @param packet Packet structure pointer
+ * @param prep Filled with extracted message data
+ * @return 0 if packet contains an interesting SIP message, 1 otherwise
+ */
+int
+sip_prepare_packet(packet_t *packet, sip_prepared_t *prep);
+
+/**
+ * @brief Add a prepared SIP message to its dialog
+ *
+ * Second part of sip_check_packet. The dialog is updated holding only
+ * its shard lock, so this can be run by correlation workers without
+ * capture lock. New dialogs are not stored until the message is
+ * published. Prepared data is released.
+ *
+ * @param packet Packet structure pointer
+ * @param prep Message data from sip_prepare_packet
+ * @return a SIP msg structure pointer
+ */
+sip_msg_t *
+sip_correlate_packet(packet_t *packet, sip_prepared_t *prep);
+
+/**
+ * @brief Store the dialog of a correlated message
+ *
+ * Last part of sip_check_packet. New dialogs are added to Call-ID tables
+ * and calls list, and the dialog active and finished states are updated.
+ * Nothing is done if the dialog has been removed since the message was
+ * added to it.
+ *
+ * @note This function must be called with the capture lock held
+ *
+ * @param msg Message returned by sip_correlate_packet
+ */
+void
+sip_publish_msg(sip_msg_t *msg);
+
+/**
+ * @brief Release prepared message data not added to any dialog
+ */
+void
+sip_prepared_clear(sip_prepared_t *prep);
+
+/**
+ * @brief Get the number of correlation shards
+ */
+int
+sip_shard_count();
+
+/**
+ * @brief Get the shard owning dialogs with given Call-ID
+ *
+ * @param callid Call-ID header value
+ * @param len Call-ID length
+ * @return shard index
+ */
+int
+sip_shard_id(const char *callid, size_t len);
+
+/**
+ * @brief Get the shard owning the dialog of given payload
+ *
+ * Call-ID header is found without regular expressions, so this can be
+ * used to route packets before parsing them.
+ *
+ * @param payload SIP message payload
+ * @param len Payload length
+ * @return shard index or -1 if payload has no Call-ID header
+ */
+int
+sip_shard_from_payload(const u_char *payload, uint32_t len);
+
+/**
+ * @brief Use shard parsing expressions in current thread
+ *
+ * @param id Shard index
+ */
+void
+sip_shard_attach(int id);
+
+/**
+ * @brief Lock the shard of a dialog before updating it
+ *
+ * Capture lock, if required, must be held before calling this.
+ *
+ * @param call Dialog to be updated
+ */
+void
+sip_call_lock(sip_call_t *call);
+
+/**
+ * @brief Unlock the shard of a dialog after updating it
+ *
+ * @param call Updated dialog
+ */
+void
+sip_call_unlock(sip_call_t *call);
+
 /**
  * @brief Return if the call list has changed
  *
@@ -274,6 +451,18 @@ sip_calls_count();
 int
 sip_calls_count_unrotated();
 
+/**
+ * @brief Getter for count of removed calls since program start
+ *
+ * Calls are removed by rotation, eviction or clearing the list. Copies
+ * of the calls list taken with a different count may contain calls that
+ * are being released.
+ *
+ * @return number of removed calls
+ */
+unsigned int
+sip_calls_count_removed();
+
 /**
  * @brief Return an iterator of call list
  */
@@ -351,6 +540,19 @@ sip_find_by_callid(const char *callid);
 void
 sip_parse_extra_headers(sip_msg_t *msg, const u_char *payload);
 
+/**
+ * @brief Parse extra fields of dialog messages deferred while capturing
+ *
+ * Only required when lazy parsing is enabled. Messages are only
+ * parsed once, so this can be called each time the fields are used.
+ *
+ * @note This function must be called with the capture lock held
+ *
+ * @param call SIP call structure
+ */
+void
+sip_parse_call_deferred(sip_call_t *call);
+
 /**
  * @brief Remove al calls
  *
@@ -369,6 +571,14 @@ sip_calls_clear();
 void
 sip_calls_clear_soft();
 
+/**
+ * @brief Update stored dialogs metrics
+ *
+ * This function is registered as metrics collector in sip_init.
+ */
+void
+sip_metrics_collect();
+
 /**
  * @brief Remove first call in the call list
  *
@@ -378,6 +588,87 @@ sip_calls_clear_soft();
 void
 sip_calls_rotate();
 
+/**
+ * @brief Remove a call from the call list
+ *
+ * Call is removed from Call-Id hash table, active calls and its parent
+ * related calls, and then destroyed.
+ *
+ * @param call Call to be removed
+ */
+void
+sip_calls_remove(sip_call_t *call);
+
+/**
+ * @brief Account memory used by a stored dialog
+ *
+ * All dialogs memory is checked against capture.maxmemory setting
+ * each time a new packet is parsed.
+ *
+ * @param call Dialog using the memory
+ * @param bytes Memory in bytes
+ */
+void
+sip_calls_add_memory(sip_call_t *call, size_t bytes);
+
+/**
+ * @brief Stop tracking a dialog for eviction
+ *
+ * Remove dialog memory from stored dialogs memory and unlink it from
+ * finished dialogs list. This is called when a dialog is destroyed.
+ *
+ * @param call Dialog being destroyed
+ */
+void
+sip_calls_untrack(sip_call_t *call);
+
+/**
+ * @brief Remove a dialog from finished dialogs list
+ *
+ * Nothing is done if the dialog is not in the list.
+ */
+void
+sip_calls_finished_remove(sip_call_t *call);
+
+/**
+ * @brief Update dialog finish status after adding a message
+ *
+ * INVITE dialogs finish when the call state is no longer active. Other
+ * dialogs finish when a final response is received and are in progress
+ * again with any new request. Finished dialogs are inserted in the
+ * finished dialogs list, sorted by the message timestamp.
+ *
+ * @param call Dialog of the message
+ * @param msg Last added message
+ */
+void
+sip_calls_update_finished(sip_call_t *call, sip_msg_t *msg);
+
+/**
+ * @brief Remove finished dialogs and enforce memory limit
+ *
+ * Dialogs finished before now - capture.expire are removed. While
+ * stored dialogs memory exceeds capture.maxmemory, oldest finished
+ * dialogs are removed, then oldest dialogs. Locked dialogs are
+ * never removed.
+ *
+ * @param now Current packet timestamp
+ */
+void
+sip_calls_expire(struct timeval now);
+
+/**
+ * @brief Check if there are dialogs to be removed by sip_calls_expire
+ *
+ * This can be called without capture lock, to avoid taking it when
+ * nothing is to be removed.
+ *
+ * @param now Current packet timestamp
+ * @return true if sip_calls_expire must be called
+ */
+bool
+sip_calls_expire_pending(struct timeval now);
+
 /**
  * @brief Get message Request/Response code
  *
@@ -410,6 +701,20 @@ sip_get_msg_reqresp_str(sip_msg_t *msg);
 sip_msg_t *
 sip_parse_msg(sip_msg_t *msg);
 
+/**
+ * @brief Parse SIP Message headers deferred while capturing
+ *
+ * Only required when lazy parsing is enabled, where From, To and
+ * Contact headers are parsed the first time they are used.
+ *
+ * @note This function must be called with the capture lock held
+ *
+ * @param msg SIP message structure
+ * @return parsed message
+ */
+sip_msg_t *
+sip_parse_msg_deferred(sip_msg_t *msg);
+
 /**
  * @brief Parse SIP Message payload to fill sip_msg structe
  *
@@ -452,6 +757,15 @@ sip_set_match_expression(const char *expr, int insensitive, int invert);
 const char *
 sip_get_match_expression();
 
+/**
+ * @brief Get Capture Matching expression flags
+ *
+ * @param insensitive Filled with 1 for case insensitive matching
+ * @param invert Filled with 1 for reverse matching
+ */
+void
+sip_get_match_flags(int *insensitive, int *invert);
+
 /**
  * @brief Checks if a given payload matches expression
  *
@@ -461,6 +775,38 @@ sip_get_match_expression();
 int
 sip_check_match_expression(const char *payload);
 
+/**
+ * @brief Parse only headers required for correlation while capturing
+ *
+ * Payloads are parsed again when other headers are used. As this requires
+ * the capture lock, lazy parsing can not be used with the interface.
+ *
+ * @param lazy true to defer parsing headers
+ */
+void
+sip_set_lazy_parse(bool lazy);
+
+/**
+ * @brief Set dialogs filter expression
+ *
+ * Only messages matching the filter expression can start a new dialog.
+ *
+ * @param expr Filter expression text
+ * @param error Buffer to store the reason of invalid expressions
+ * @param errlen Error buffer size
+ * @return 0 if expression is valid, 1 otherwise
+ */
+int
+sip_set_filter_expression(const char *expr, char *error, size_t errlen);
+
+/**
+ * @brief Get dialogs filter expression
+ *
+ * @return String containing filter expression
+ */
+const char *
+sip_get_filter_expression();
+
 /**
  * @brief Get String value for a Method
  *
@@ -32,29 +32,32 @@
 #include "sip_call.h"
 #include "sip.h"
 #include "setting.h"
+#include "metrics.h"
+#include "intern.h"
+#include "sip_counters.h"
+#include "epoch.h"
+#include "report.h"
+#include "sip_index.h"
 
 sip_call_t *
-call_create(char *callid, char *xcallid)
+call_create(const char *callid, const char *xcallid)
 {
     sip_call_t *call;
 
     // Initialize a new call structure
     if (!(call = sng_malloc(sizeof(sip_call_t))))
         return NULL;
+    metrics_add(METRIC_MEM_CALLS, sizeof(sip_call_t));
 
-    // Create a vector to store call messages
+    // Create a vector to store call messages, read by the interface without lock
     call->msgs = vector_create(2, 2);
+    vector_set_lockless(call->msgs);
     vector_set_destroyer(call->msgs, msg_destroyer);
 
-    // Create an empty vector to store rtp packets
-    if (setting_enabled(SETTING_CAPTURE_RTP)) {
-        call->rtp_packets = vector_create(0, 40);
-        vector_set_destroyer(call->rtp_packets, packet_destroyer);
-    }
-
-    // Create an empty vector to strore stream data
+    // Create an empty vector to strore stream data, read by the interface without lock
     call->streams = vector_create(0, 2);
-    vector_set_destroyer(call->streams, vector_generic_destroyer);
+    vector_set_lockless(call->streams);
+    vector_set_destroyer(call->streams, stream_destroyer);
 
     // Create an empty vector to store x-calls
     call->xcalls = vector_create(0, 1);
@@ -63,28 +66,95 @@ call_create(char *callid, char *xcallid)
     call->filtered = -1;
 
     // Set message callid
-    call->callid = strdup(callid);
-    call->xcallid = strdup(xcallid);
+    call->callid = intern_string(callid, strlen(callid));
+    call->xcallid = intern_string(xcallid, strlen(xcallid));
 
     return call;
 }
 
-void
-call_destroy(sip_call_t *call)
+/**
+ * @brief Check if an attribute text is an interned header value
+ *
+ * Header values repeated in many calls are shared through the intern
+ * table. Other attributes are formatted for each call (dates, durations,
+ * counters) and their texts are owned by the call keys.
+ */
+static bool
+call_attr_shared(enum sip_attr_id id)
+{
+    switch (id) {
+        case SIP_ATTR_CALLID:
+        case SIP_ATTR_XCALLID:
+        case SIP_ATTR_SIPFROM:
+        case SIP_ATTR_SIPTO:
+        case SIP_ATTR_CONTACT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Free cached sorting and display keys of a call
+ */
+static void
+call_keys_destroy(void *item)
 {
+    sip_call_keys_t *keys = (sip_call_keys_t *) item;
+    int i;
+
+    for (i = 0; i < SIP_ATTR_COUNT; i++) {
+        if (call_attr_shared(i)) {
+            intern_release(keys->text[i]);
+        } else {
+            sng_free((char *) keys->text[i]);
+        }
+    }
+    sng_free(keys);
+}
+
+/**
+ * @brief Free call memory once no reader can reach it
+ */
+static void
+call_free(void *item)
+{
+    sip_call_t *call = (sip_call_t *) item;
+
     // Remove all call messages
     vector_destroy(call->msgs);
     // Remove all call streams
+    metrics_add(METRIC_RTP_STREAMS, -vector_count(call->streams));
+    metrics_add(METRIC_MEM_STREAMS, -vector_count(call->streams) * (int64_t) sizeof(rtp_stream_t));
     vector_destroy(call->streams);
-    // Remove all call rtp packets
-    vector_destroy(call->rtp_packets);
     // Remove all xcalls
     vector_destroy(call->xcalls);
+    // Remove cached keys
+    if (call->keys)
+        call_keys_destroy(call->keys);
     // Deallocate call memory
-    sng_free(call->callid);
-    sng_free(call->xcallid);
+    intern_release(call->callid);
+    intern_release(call->xcallid);
     sng_free(call->reasontxt);
     sng_free(call);
+    metrics_add(METRIC_MEM_CALLS, -(int64_t) sizeof(sip_call_t));
+}
+
+void
+call_destroy(sip_call_t *call)
+{
+    // Account call in batch report before it's gone
+    report_add_call(call);
+    // Remove call from dialogs statistics
+    sip_counters_remove_call(call);
+    // Remove call from dialogs eviction
+    sip_calls_untrack(call);
+    // Stop matching RTP packets with this call streams
+    rtp_index_remove_call(call);
+    // Display filters no longer need to find this call
+    sip_index_remove_call(call);
+    // Interface may still be drawing this call
+    epoch_retire(call, call_free, sizeof(sip_call_t) + call->memory);
 }
 
 void
@@ -106,8 +176,10 @@ call_add_message(sip_call_t *call, sip_msg_t *msg)
     msg->call = call;
     // Put this msg at the end of the msg list
     msg->index = vector_append(call->msgs, msg);
+    sip_counters_add_msg(msg);
     // Flag this call as changed
     call->changed = true;
+    call->version++;
 }
 
 void
@@ -115,16 +187,20 @@ call_add_stream(sip_call_t *call, rtp_stream_t *stream)
 {
     // Store stream
     vector_append(call->streams, stream);
-    // Flag this call as changed
+    rtp_index_add(stream);
+    metrics_inc(METRIC_RTP_STREAMS);
+    metrics_add(METRIC_MEM_STREAMS, sizeof(rtp_stream_t));
+    sip_calls_add_memory(call, sizeof(rtp_stream_t));
+    // Flag this call as changed, media is not part of cached keys
     call->changed = true;
 }
 
 void
-call_add_rtp_packet(sip_call_t *call, packet_t *packet)
+call_add_rtp_packet(sip_call_t *call, rtp_stream_t *stream, packet_t *packet)
 {
-    // Store packet
-    vector_append(call->rtp_packets, packet);
-    // Flag this call as changed
+    // Retain packet data in the stream
+    sip_calls_add_memory(call, rtp_store_packet(&stream->store, packet, stream->type == PACKET_RTCP));
+    // Flag this call as changed, media is not part of cached keys
     call->changed = true;
 }
 
@@ -155,6 +231,8 @@ call_msg_retrans_check(sip_msg_t *msg)
 {
     sip_msg_t *prev = NULL;
     vector_iter_t it;
+    u_char payload[MAX_SIP_PAYLOAD + 1], prev_payload[MAX_SIP_PAYLOAD + 1];
+    const u_char *one, *two;
 
     // Get previous message in call with same origin and destination
     it = vector_iterator(msg->call->msgs);
@@ -165,8 +243,15 @@ call_msg_retrans_check(sip_msg_t *msg)
             break;
     }
 
+    if (!prev || packet_payloadlen(prev->packet) != packet_payloadlen(msg->packet))
+        return;
+
+    // Dialog is updated without capture lock, so payloads cache can not be used
+    one = packet_payload_copy(msg->packet, payload);
+    two = packet_payload_copy(prev->packet, prev_payload);
+
     // Store the flag that determines if message is retrans
-    if (prev && !strcasecmp(msg_get_payload(msg), msg_get_payload(prev))) {
+    if (one && two && !strcasecmp((const char *) one, (const char *) two)) {
         msg->retrans = prev;
     }
 }
@@ -196,7 +281,7 @@ call_msg_with_media(sip_call_t *call, address_t dst)
 void
 call_update_state(sip_call_t *call, sip_msg_t *msg)
 {
-    int reqresp;
+    int reqresp, old_state = call->state;
 
     if (!call_is_invite(call))
         return;
@@ -234,14 +319,136 @@ call_update_state(sip_call_t *call, sip_msg_t *msg)
             // Call is being setup (after proper authentication)
             call->invitecseq = msg->cseq;
             call->state = SIP_CALLSTATE_CALLSETUP;
+            call->csetup_msg = msg;
         }
     } else {
         // This is actually a call
         if (reqresp == SIP_METHOD_INVITE) {
             call->invitecseq = msg->cseq;
             call->state = SIP_CALLSTATE_CALLSETUP;
+            call->csetup_msg = msg;
         }
     }
+
+    // Update dialogs statistics
+    sip_counters_update_call(call, msg, old_state);
+
+    // Refresh cached keys if state has changed
+    if (call->state != old_state)
+        call->version++;
+}
+
+/**
+ * @brief Get call keys, computing them again if the call has changed
+ */
+static sip_call_keys_t *
+call_get_keys(sip_call_t *call)
+{
+    sip_call_keys_t *keys, *current;
+    struct timeval start, end;
+    uint32_t version = call->version;
+
+    // Keys are never modified once published, so they can be read without
+    // capture lock. Outdated keys are replaced by a new record
+    current = __atomic_load_n(&call->keys, __ATOMIC_ACQUIRE);
+    if (current && current->version == version)
+        return current;
+
+    if (!(keys = sng_malloc(sizeof(sip_call_keys_t))))
+        return NULL;
+
+    // Numeric keys are computed with the call, texts when requested
+    keys->version = version;
+    keys->start = msg_get_time(vector_first(call->msgs));
+
+    keys->convdur = keys->totaldur = -1;
+    start = msg_get_time(call->cstart_msg);
+    end = msg_get_time(call->cend_msg);
+    if (start.tv_sec && end.tv_sec)
+        keys->convdur = end.tv_sec - start.tv_sec;
+    end = msg_get_time(vector_last(call->msgs));
+    if (keys->start.tv_sec && end.tv_sec)
+        keys->totaldur = end.tv_sec - keys->start.tv_sec;
+
+    // Other thread may have replaced the keys meanwhile
+    if (!__atomic_compare_exchange_n(&call->keys, &current, keys, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        call_keys_destroy(keys);
+        return current;
+    }
+
+    if (current)
+        epoch_retire(current, call_keys_destroy, sizeof(sip_call_keys_t));
+    return keys;
+}
+
+const char *
+call_get_attribute_text(sip_call_t *call, enum sip_attr_id id)
+{
+    sip_call_keys_t *keys;
+    sip_msg_t *first;
+    char value[SIP_ATTR_MAXLEN];
+    const char *text = NULL;
+    bool shared = call_attr_shared(id);
+
+    if (!call || id < 0 || id >= SIP_ATTR_COUNT || !(keys = call_get_keys(call)))
+        return NULL;
+
+    if (__atomic_load_n(&keys->valid, __ATOMIC_ACQUIRE) & (1u << id))
+        return __atomic_load_n(&keys->text[id], __ATOMIC_ACQUIRE);
+
+    // Interned attributes can be shared without formatting them, other
+    // attributes are formatted into a text owned by these keys
+    first = vector_first(call->msgs);
+    switch (id) {
+        case SIP_ATTR_CALLID:
+            text = call->callid;
+            break;
+        case SIP_ATTR_XCALLID:
+            text = call->xcallid;
+            break;
+        case SIP_ATTR_SIPFROM:
+            text = (first) ? sip_parse_msg_deferred(first)->sip_from : NULL;
+            break;
+        case SIP_ATTR_SIPTO:
+            text = (first) ? sip_parse_msg_deferred(first)->sip_to : NULL;
+            break;
+        case SIP_ATTR_CONTACT:
+            text = (first) ? sip_parse_msg_deferred(first)->sip_contact : NULL;
+            break;
+        default:
+            memset(value, 0, sizeof(value));
+            if (call_get_attribute(call, id, value))
+                text = strdup(value);
+            break;
+    }
+
+    // Empty values are stored as NULL, like call_get_attribute returns them
+    if (text && !*text) {
+        if (!shared)
+            sng_free((char *) text);
+        text = NULL;
+    }
+
+    // Shared values need their own reference
+    if (text && shared)
+        intern_ref(text);
+
+    // Store the text unless other thread has already done it
+    if (text) {
+        const char *stored = NULL;
+        if (!__atomic_compare_exchange_n(&keys->text[id], &stored, text, false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            if (shared) {
+                intern_release(text);
+            } else {
+                sng_free((char *) text);
+            }
+            text = stored;
+        }
+    }
+    __atomic_fetch_or(&keys->valid, 1u << id, __ATOMIC_RELEASE);
+    return text;
 }
 
 const char *
@@ -281,10 +488,12 @@ call_get_attribute(sip_call_t *call, enum sip_attr_id id, char *value)
             timeval_to_duration(msg_get_time(first), msg_get_time(last), value);
             break;
         case SIP_ATTR_REASON_TXT:
+            sip_parse_call_deferred(call);
             if (call->reasontxt)
                 sprintf(value, "%.*s", SIP_ATTR_MAXLEN - 1, call->reasontxt);
             break;
         case SIP_ATTR_WARNING:
+            sip_parse_call_deferred(call);
             if (call->warning)
                 sprintf(value, "%d", call->warning);
             break;
@@ -321,9 +530,13 @@ call_state_to_str(int state)
 int
 call_attr_compare(sip_call_t *one, sip_call_t *two, enum sip_attr_id id)
 {
-    char onevalue[256], twovalue[256];
+    sip_call_keys_t *onekeys, *twokeys;
+    const char *onevalue, *twovalue;
     int oneintvalue, twointvalue;
-    int comparetype; /* TODO 0 = string compare, 1 = int comprare */
+    int comparetype; /* 0 = string compare, 1 = int comprare */
+
+    if (!(onekeys = call_get_keys(one)) || !(twokeys = call_get_keys(two)))
+        return 0;
 
     switch (id) {
         case SIP_ATTR_CALLINDEX:
@@ -336,23 +549,45 @@ call_attr_compare(sip_call_t *one, sip_call_t *two, enum sip_attr_id id)
             twointvalue = call_msg_count(two);
             comparetype = 1;
             break;
+        case SIP_ATTR_WARNING:
+            sip_parse_call_deferred(one);
+            sip_parse_call_deferred(two);
+            oneintvalue = one->warning;
+            twointvalue = two->warning;
+            comparetype = 1;
+            break;
+        case SIP_ATTR_CONVDUR:
+            oneintvalue = onekeys->convdur;
+            twointvalue = twokeys->convdur;
+            comparetype = 1;
+            break;
+        case SIP_ATTR_TOTALDUR:
+            oneintvalue = onekeys->totaldur;
+            twointvalue = twokeys->totaldur;
+            comparetype = 1;
+            break;
+        case SIP_ATTR_DATE:
+        case SIP_ATTR_TIME:
+            // Compare first message timestamps
+            if (timercmp(&onekeys->start, &twokeys->start, ==))
+                return 0;
+            return timercmp(&onekeys->start, &twokeys->start, >) ? 1 : -1;
         default:
-            // Get attribute values
-            memset(onevalue, 0, sizeof(onevalue));
-            memset(twovalue, 0, sizeof(twovalue));
-            call_get_attribute(one, id, onevalue);
-            call_get_attribute(two, id, twovalue);
+            // Get cached attribute values
+            onevalue = call_get_attribute_text(one, id);
+            twovalue = call_get_attribute_text(two, id);
             comparetype = 0;
             break;
     }
 
     switch (comparetype) {
         case 0:
-            if (strlen(twovalue) == 0 && strlen(onevalue) == 0)
+            // Interned strings are equal only if they are the same pointer
+            if (onevalue == twovalue)
                 return 0;
-            if (strlen(twovalue) == 0)
+            if (!twovalue)
                 return 1;
-            if (strlen(onevalue) == 0)
+            if (!onevalue)
                 return -1;
             return strcmp(onevalue, twovalue);
         case 1:
@@ -371,7 +606,7 @@ call_add_xcall(sip_call_t *call, sip_call_t *xcall)
     if (!call || !xcall)
         return;
 
-    // Mark this call as changed
+    // Mark this call as changed, related calls are not part of cached keys
     call->changed = true;
     // Add the xcall to the list
     vector_append(call->xcalls, xcall);
@@ -39,6 +39,8 @@
 
 //! Shorter declaration of sip_call structure
 typedef struct sip_call sip_call_t;
+//! Shorter declaration of sip_call_keys structure
+typedef struct sip_call_keys sip_call_keys_t;
 
 //! SIP Call State
 enum call_state
@@ -52,6 +54,27 @@ enum call_state
     SIP_CALLSTATE_COMPLETED
 };
 
+/**
+ * @brief Cached call attributes for sorting and display
+ *
+ * Keys are computed the first time they are requested and refreshed
+ * only after the call has changed, so the call list does not need to
+ * format the same attributes on each comparison or redraw.
+ */
+struct sip_call_keys {
+    //! Call version when keys were computed
+    uint32_t version;
+    //! Timestamp of the first call message
+    struct timeval start;
+    //! Conversation and total duration in seconds (-1 if unknown)
+    int convdur, totaldur;
+    //! Bitmask of attribute texts computed for this version
+    uint32_t valid;
+    //! Attribute values rendered for display (interned header values,
+    //! other values are owned by these keys)
+    const char *text[SIP_ATTR_COUNT];
+};
+
 /**
  * @brief Contains all information of a call and its messages
  *
@@ -62,22 +85,34 @@ enum call_state
 struct sip_call {
     // Call index in the call list
     int index;
-    // Call identifier
-    char *callid;
-    //! Related Call identifier
-    char *xcallid;
+    // Call identifier (interned)
+    const char *callid;
+    //! Related Call identifier (interned)
+    const char *xcallid;
     //! Flag this call as filtered so won't be displayed
     signed char filtered;
     //! Call State. For dialogs starting with an INVITE method
     int state;
     //! Changed flag. For interface optimal updates
     bool changed;
+    //! Number of changes to attributes of cached keys, used to refresh them
+    uint32_t version;
+    //! Cached sorting and display attributes
+    sip_call_keys_t *keys;
     //! Locked flag. Calls locked are never deleted
     bool locked;
+    //! Call is in the active calls list
+    bool active;
+    //! Position in calls list and active calls list
+    int list_position, active_position;
+    //! Call has been removed from calls list
+    bool removed;
     //! Last reason text value for this call
     char *reasontxt;
     //! Last warning text value for this call
     int warning;
+    //! Messages whose extra fields have been parsed (lazy parsing)
+    int extra_parsed;
     //! List of calls with with this call as X-Call-Id
     vector_t *xcalls;
     //! Cseq from invite startint the call
@@ -86,10 +121,18 @@ struct sip_call {
     vector_t *msgs;
     //! Message when conversation started and ended
     sip_msg_t *cstart_msg, *cend_msg;
+    //! INVITE message that started the call setup
+    sip_msg_t *csetup_msg;
+    //! Microseconds until 2xx and 18x responses (0 if not received)
+    uint64_t setup_time, pdd_time;
     //! RTP streams for this call (rtp_stream_t *)
     vector_t *streams;
-    //! RTP packets for this call (capture_packet_t *)
-    vector_t *rtp_packets;
+    //! Memory used by this call messages, packets and streams
+    size_t memory;
+    //! Packet time (in seconds) when this dialog finished
+    time_t finished;
+    //! Previous and next dialogs in finished dialogs list
+    sip_call_t *finished_prev, *finished_next;
 };
 
 /**
@@ -103,7 +146,7 @@ struct sip_call {
  * @return pointer to the sip_call created
  */
 sip_call_t *
-call_create(char *callid, char *xcallid);
+call_create(const char *callid, const char *xcallid);
 
 /**
  * @brief Free all related memory from a call and remove from call list
@@ -162,11 +205,15 @@ call_add_stream(sip_call_t *call, rtp_stream_t *stream);
 /**
  * @brief Append a new RTP packet to the call
  *
+ * Packet data is retained in the stream depending on capture.rtpmode
+ * setting, packet itself is not stored.
+ *
  * @param call pointer to the call owner of the stream
+ * @param stream stream the packet belongs to
  * @param packet new RTP packet from call rtp streams
  */
 void
-call_add_rtp_packet(sip_call_t *call, packet_t *packet);
+call_add_rtp_packet(sip_call_t *call, rtp_stream_t *stream, packet_t *packet);
 
 /**
  * @brief Getter for call messages linked list size
@@ -241,6 +288,20 @@ call_update_state(sip_call_t *call, sip_msg_t *msg);
 const char *
 call_get_attribute(struct sip_call *call, enum sip_attr_id id, char *value);
 
+/**
+ * @brief Return a cached call attribute value
+ *
+ * Same as call_get_attribute, but the value is only formatted again
+ * after the call has changed. Returned string is valid until the next
+ * call change.
+ *
+ * @param call SIP call structure
+ * @param id Attribute id
+ * @return Attribute value or NULL if not found
+ */
+const char *
+call_get_attribute_text(sip_call_t *call, enum sip_attr_id id);
+
 /**
  * @brief Return the string represtation of a call state
  *
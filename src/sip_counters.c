@@ -0,0 +1,297 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file sip_counters.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in sip_counters.h
+ *
+ */
+#include "config.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sip_counters.h"
+#include "sip.h"
+
+//! Stored dialogs statistics
+static sip_counters_t counters;
+//! Lock for stored dialogs statistics changes
+static pthread_mutex_t counters_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const sip_counters_t *
+sip_counters()
+{
+    return &counters;
+}
+
+int
+sip_counters_responses(const sip_counters_t *stats, int class)
+{
+    int code, total = 0;
+
+    if (class < 1 || class > 9)
+        return 0;
+
+    for (code = class * 100; code < class * 100 + 100; code++)
+        total += stats->responses[code];
+
+    return total;
+}
+
+/**
+ * @brief Add a message to counters
+ *
+ * @param stats Counters to update
+ * @param msg SIP message
+ * @param value 1 to add the message, -1 to remove it
+ */
+static void
+sip_counters_msg(sip_counters_t *stats, sip_msg_t *msg, int value)
+{
+    stats->messages += value;
+
+    if (msg->reqresp > 0 && msg->reqresp < SIP_COUNTERS_METHODS) {
+        stats->methods[msg->reqresp] += value;
+    } else if (msg->reqresp >= 100 && msg->reqresp < SIP_COUNTERS_CODES) {
+        stats->responses[msg->reqresp] += value;
+    }
+
+    if (msg->packet && msg->packet->type < SIP_COUNTERS_TRANSPORTS)
+        stats->transports[msg->packet->type] += value;
+}
+
+/**
+ * @brief Add a call state to counters
+ */
+static void
+sip_counters_state(sip_counters_t *stats, int state, int value)
+{
+    if (state <= 0 || state >= SIP_COUNTERS_STATES)
+        return;
+
+    stats->states[state] += value;
+}
+
+/**
+ * @brief Microseconds elapsed between two messages
+ */
+static uint64_t
+sip_counters_elapsed(sip_msg_t *start, sip_msg_t *end)
+{
+    struct timeval tstart = msg_get_time(start);
+    struct timeval tend = msg_get_time(end);
+    int64_t elapsed;
+
+    elapsed = (int64_t) (tend.tv_sec - tstart.tv_sec) * 1000000
+              + (tend.tv_usec - tstart.tv_usec);
+
+    // Zero is reserved for not measured times
+    return (elapsed > 0) ? (uint64_t) elapsed : 1;
+}
+
+void
+sip_counters_add_msg(sip_msg_t *msg)
+{
+    pthread_mutex_lock(&counters_lock);
+    sip_counters_msg(&counters, msg, 1);
+    pthread_mutex_unlock(&counters_lock);
+}
+
+/**
+ * @brief Update call state counters and setup times
+ */
+static void
+sip_counters_call(sip_call_t *call, sip_msg_t *msg, int old_state)
+{
+    // Update calls by state
+    if (call->state != old_state) {
+        if (!old_state)
+            counters.calls++;
+        sip_counters_state(&counters, old_state, -1);
+        sip_counters_state(&counters, call->state, 1);
+    }
+
+    // Only measure responses to the INVITE being setup
+    if (old_state != SIP_CALLSTATE_CALLSETUP || !call->csetup_msg)
+        return;
+    if (msg->reqresp < 100 || msg->cseq != call->invitecseq)
+        return;
+
+    if (msg->reqresp >= 180 && msg->reqresp < 190 && !call->pdd_time) {
+        // Post dial delay
+        call->pdd_time = sip_counters_elapsed(call->csetup_msg, msg);
+        histogram_add(&counters.pdd, call->pdd_time);
+    } else if (msg->reqresp >= 200 && msg->reqresp < 300 && !call->setup_time) {
+        // Call setup time
+        call->setup_time = sip_counters_elapsed(call->csetup_msg, msg);
+        histogram_add(&counters.setup, call->setup_time);
+    }
+}
+
+void
+sip_counters_update_call(sip_call_t *call, sip_msg_t *msg, int old_state)
+{
+    pthread_mutex_lock(&counters_lock);
+    sip_counters_call(call, msg, old_state);
+    pthread_mutex_unlock(&counters_lock);
+}
+
+void
+sip_counters_account_call(sip_counters_t *stats, sip_call_t *call)
+{
+    sip_msg_t *msg;
+    vector_iter_t it = vector_iterator(call->msgs);
+
+    while ((msg = vector_iterator_next(&it)))
+        sip_counters_msg(stats, msg, 1);
+
+    if (call->state) {
+        stats->calls++;
+        sip_counters_state(stats, call->state, 1);
+    }
+    if (call->pdd_time)
+        histogram_add(&stats->pdd, call->pdd_time);
+    if (call->setup_time)
+        histogram_add(&stats->setup, call->setup_time);
+}
+
+void
+sip_counters_add_call(sip_call_t *call)
+{
+    pthread_mutex_lock(&counters_lock);
+    sip_counters_account_call(&counters, call);
+    pthread_mutex_unlock(&counters_lock);
+}
+
+void
+sip_counters_remove_call(sip_call_t *call)
+{
+    sip_msg_t *msg;
+    vector_iter_t it = vector_iterator(call->msgs);
+
+    pthread_mutex_lock(&counters_lock);
+    while ((msg = vector_iterator_next(&it)))
+        sip_counters_msg(&counters, msg, -1);
+
+    if (call->state) {
+        counters.calls--;
+        sip_counters_state(&counters, call->state, -1);
+    }
+    if (call->pdd_time)
+        histogram_remove(&counters.pdd, call->pdd_time);
+    if (call->setup_time)
+        histogram_remove(&counters.setup, call->setup_time);
+    pthread_mutex_unlock(&counters_lock);
+}
+
+void
+sip_counters_merge(sip_counters_t *stats, const sip_counters_t *other)
+{
+    int i;
+
+    stats->messages += other->messages;
+    stats->calls += other->calls;
+    for (i = 0; i < SIP_COUNTERS_METHODS; i++)
+        stats->methods[i] += other->methods[i];
+    for (i = 0; i < SIP_COUNTERS_CODES; i++)
+        stats->responses[i] += other->responses[i];
+    for (i = 0; i < SIP_COUNTERS_STATES; i++)
+        stats->states[i] += other->states[i];
+    for (i = 0; i < SIP_COUNTERS_TRANSPORTS; i++)
+        stats->transports[i] += other->transports[i];
+    histogram_merge(&stats->setup, &other->setup);
+    histogram_merge(&stats->pdd, &other->pdd);
+}
+
+void
+sip_counters_clear()
+{
+    pthread_mutex_lock(&counters_lock);
+    memset(&counters, 0, sizeof(counters));
+    pthread_mutex_unlock(&counters_lock);
+}
+
+/**
+ * @brief Print a time histogram as Prometheus summary
+ */
+static void
+sip_counters_write_summary(FILE *out, const char *name, const char *help, const histogram_t *histogram)
+{
+    static const double quantiles[] = { 0.5, 0.9, 0.99 };
+    int i;
+
+    fprintf(out, "# HELP %s %s\n", name, help);
+    fprintf(out, "# TYPE %s summary\n", name);
+    for (i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+        fprintf(out, "%s{quantile=\"%g\"} %.6f\n", name, quantiles[i],
+                histogram_percentile(histogram, quantiles[i] * 100) / 1e6);
+    }
+    fprintf(out, "%s_sum %.6f\n", name, histogram->sum / 1e6);
+    fprintf(out, "%s_count %lu\n", name, (unsigned long) histogram->count);
+}
+
+void
+sip_counters_write_metrics(FILE *out)
+{
+    sip_counters_t *stats;
+    int i;
+
+    // Take a consistent copy of current counters
+    if (!(stats = malloc(sizeof(sip_counters_t))))
+        return;
+    pthread_mutex_lock(&counters_lock);
+    memcpy(stats, &counters, sizeof(sip_counters_t));
+    pthread_mutex_unlock(&counters_lock);
+
+    fprintf(out, "# HELP sngrep_sip_requests Stored SIP requests by method\n");
+    fprintf(out, "# TYPE sngrep_sip_requests gauge\n");
+    for (i = 1; i < SIP_COUNTERS_METHODS; i++) {
+        fprintf(out, "sngrep_sip_requests{method=\"%s\"} %d\n", sip_method_str(i), stats->methods[i]);
+    }
+
+    fprintf(out, "# HELP sngrep_sip_responses Stored SIP responses by code\n");
+    fprintf(out, "# TYPE sngrep_sip_responses gauge\n");
+    for (i = 100; i < SIP_COUNTERS_CODES; i++) {
+        if (stats->responses[i])
+            fprintf(out, "sngrep_sip_responses{code=\"%d\"} %d\n", i, stats->responses[i]);
+    }
+
+    fprintf(out, "# HELP sngrep_sip_messages Stored SIP messages by transport\n");
+    fprintf(out, "# TYPE sngrep_sip_messages gauge\n");
+    for (i = 0; i < SIP_COUNTERS_TRANSPORTS; i++) {
+        fprintf(out, "sngrep_sip_messages{transport=\"%s\"} %d\n", sip_transport_str(i), stats->transports[i]);
+    }
+
+    fprintf(out, "# HELP sngrep_calls_state Stored dialogs starting with INVITE by state\n");
+    fprintf(out, "# TYPE sngrep_calls_state gauge\n");
+    for (i = 1; i < SIP_COUNTERS_STATES; i++) {
+        fprintf(out, "sngrep_calls_state{state=\"%s\"} %d\n", call_state_to_str(i), stats->states[i]);
+    }
+
+    sip_counters_write_summary(out, "sngrep_call_setup_seconds",
+                               "Time between INVITE and 2xx response", &stats->setup);
+    sip_counters_write_summary(out, "sngrep_call_pdd_seconds",
+                               "Time between INVITE and first 18x response", &stats->pdd);
+
+    free(stats);
+}
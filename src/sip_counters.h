@@ -0,0 +1,154 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file sip_counters.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to manage stored dialogs statistics
+ *
+ * Counters are updated when messages are added to a call, when the call
+ * state changes and when the call is destroyed, so they always describe
+ * the stored dialogs without walking the call list.
+ *
+ * Dialogs of several shards are updated at the same time, so counters
+ * are modified holding their own lock.
+ *
+ */
+#ifndef __SNGREP_SIP_COUNTERS_H
+#define __SNGREP_SIP_COUNTERS_H
+
+#include "config.h"
+#include <stdio.h>
+#include "sip.h"
+#include "histogram.h"
+#include "packet.h"
+
+//! Number of method counters (indexed by sip_methods)
+#define SIP_COUNTERS_METHODS        (SIP_METHOD_PRACK + 1)
+//! Number of response counters (indexed by response code)
+#define SIP_COUNTERS_CODES          1000
+//! Number of call state counters (indexed by call_state)
+#define SIP_COUNTERS_STATES         (SIP_CALLSTATE_COMPLETED + 1)
+//! Number of transport counters (indexed by packet_type)
+#define SIP_COUNTERS_TRANSPORTS     (PACKET_SIP_WSS + 1)
+
+//! Shorter declaration of sip counters structure
+typedef struct sip_counters sip_counters_t;
+
+/**
+ * @brief Stored dialogs statistics
+ */
+struct sip_counters {
+    //! Number of stored messages
+    int messages;
+    //! Number of dialogs starting with INVITE
+    int calls;
+    //! Requests by method
+    int methods[SIP_COUNTERS_METHODS];
+    //! Responses by code
+    int responses[SIP_COUNTERS_CODES];
+    //! Calls by state
+    int states[SIP_COUNTERS_STATES];
+    //! Messages by transport
+    int transports[SIP_COUNTERS_TRANSPORTS];
+    //! Time between INVITE and 2xx response (in microseconds)
+    histogram_t setup;
+    //! Time between INVITE and first 18x response (in microseconds)
+    histogram_t pdd;
+};
+
+/**
+ * @brief Get current dialogs statistics
+ */
+const sip_counters_t *
+sip_counters();
+
+/**
+ * @brief Get the number of responses of a class
+ *
+ * @param counters Dialogs statistics
+ * @param class First digit of the response code (1 to 9)
+ */
+int
+sip_counters_responses(const sip_counters_t *counters, int class);
+
+/**
+ * @brief Account a new message added to a call
+ */
+void
+sip_counters_add_msg(sip_msg_t *msg);
+
+/**
+ * @brief Account the state change and setup times of a call
+ *
+ * @param call Call whose state has been updated
+ * @param msg Message that triggered the update
+ * @param old_state Call state before the update
+ */
+void
+sip_counters_update_call(sip_call_t *call, sip_msg_t *msg, int old_state);
+
+/**
+ * @brief Account all messages and state of an existing call
+ */
+void
+sip_counters_add_call(sip_call_t *call);
+
+/**
+ * @brief Account all messages and state of a call in the given counters
+ *
+ * @param stats Counters to update
+ * @param call Call to account
+ */
+void
+sip_counters_account_call(sip_counters_t *stats, sip_call_t *call);
+
+/**
+ * @brief Remove all messages and state of a call from statistics
+ */
+void
+sip_counters_remove_call(sip_call_t *call);
+
+/**
+ * @brief Add counters of other statistics
+ *
+ * @param stats Counters to update
+ * @param other Counters to add
+ */
+void
+sip_counters_merge(sip_counters_t *stats, const sip_counters_t *other);
+
+/**
+ * @brief Reset all counters
+ */
+void
+sip_counters_clear();
+
+/**
+ * @brief Print dialogs statistics in Prometheus text format
+ *
+ * This function is registered as metrics writer in sip_init.
+ */
+void
+sip_counters_write_metrics(FILE *out);
+
+#endif /* __SNGREP_SIP_COUNTERS_H */
@@ -0,0 +1,668 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file sip_filter.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in sip_filter.h
+ *
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "sip_filter.h"
+#include "sip.h"
+#include "util.h"
+
+/**
+ * @brief Types of checked values
+ */
+enum sip_filter_value {
+    SIP_FILTER_VALUE_METHOD = 0,
+    SIP_FILTER_VALUE_TEXT,
+    SIP_FILTER_VALUE_ADDRESS,
+    SIP_FILTER_VALUE_PORT,
+};
+
+/**
+ * @brief Headers located in message payload
+ */
+enum sip_filter_header {
+    SIP_FILTER_HDR_CALLID = 0,
+    SIP_FILTER_HDR_FROM,
+    SIP_FILTER_HDR_TO,
+    SIP_FILTER_HDR_COUNT
+};
+
+/**
+ * @brief Field names available in filter expressions
+ */
+static struct {
+    const char *name;
+    enum sip_filter_field field;
+    enum sip_filter_value value;
+} sip_filter_fields[] = {
+    { "method",         SIP_FILTER_METHOD,      SIP_FILTER_VALUE_METHOD },
+    { "callid",         SIP_FILTER_CALLID,      SIP_FILTER_VALUE_TEXT },
+    { "from",           SIP_FILTER_FROM,        SIP_FILTER_VALUE_TEXT },
+    { "from.user",      SIP_FILTER_FROM_USER,   SIP_FILTER_VALUE_TEXT },
+    { "from.domain",    SIP_FILTER_FROM_DOMAIN, SIP_FILTER_VALUE_TEXT },
+    { "to",             SIP_FILTER_TO,          SIP_FILTER_VALUE_TEXT },
+    { "to.user",        SIP_FILTER_TO_USER,     SIP_FILTER_VALUE_TEXT },
+    { "to.domain",      SIP_FILTER_TO_DOMAIN,   SIP_FILTER_VALUE_TEXT },
+    { "src",            SIP_FILTER_SRC,         SIP_FILTER_VALUE_ADDRESS },
+    { "dst",            SIP_FILTER_DST,         SIP_FILTER_VALUE_ADDRESS },
+    { "src.port",       SIP_FILTER_SRC_PORT,    SIP_FILTER_VALUE_PORT },
+    { "dst.port",       SIP_FILTER_DST_PORT,    SIP_FILTER_VALUE_PORT },
+    { NULL }
+};
+
+//! Operator names, in sip_filter_op order
+static const char *sip_filter_ops[] = { "=", "!=", "~", "!~", "in" };
+
+/**
+ * @brief Expression parsing state
+ */
+struct sip_filter_parser {
+    //! Current position in expression text
+    const char *pos;
+    //! Buffer to store the reason of invalid expressions
+    char *error;
+    //! Error buffer size
+    size_t errlen;
+};
+
+/**
+ * @brief Message being checked
+ */
+struct sip_filter_data {
+    //! Packet containing the message
+    packet_t *packet;
+    //! Message with its request method or response code
+    sip_msg_t *msg;
+    //! Null-terminated message payload
+    const char *payload;
+    //! Headers already located in payload
+    bool located[SIP_FILTER_HDR_COUNT];
+    //! Located header values
+    const char *hdr[SIP_FILTER_HDR_COUNT];
+    //! Located header values length
+    size_t hdrlen[SIP_FILTER_HDR_COUNT];
+};
+
+static sip_filter_t *
+sip_filter_parse_or(struct sip_filter_parser *parser);
+
+/**
+ * @brief Store the reason of an invalid expression
+ */
+static sip_filter_t *
+sip_filter_error(struct sip_filter_parser *parser, const char *reason)
+{
+    if (*parser->pos) {
+        snprintf(parser->error, parser->errlen, "%s near '%s'", reason, parser->pos);
+    } else {
+        snprintf(parser->error, parser->errlen, "%s at end of expression", reason);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Skip whitespaces in expression text
+ */
+static void
+sip_filter_skip_spaces(struct sip_filter_parser *parser)
+{
+    while (isspace((unsigned char) *parser->pos))
+        parser->pos++;
+}
+
+/**
+ * @brief Consume a keyword if it is next in expression text
+ */
+static bool
+sip_filter_keyword(struct sip_filter_parser *parser, const char *keyword)
+{
+    size_t len = strlen(keyword);
+    char next;
+
+    sip_filter_skip_spaces(parser);
+    if (strncasecmp(parser->pos, keyword, len) != 0)
+        return false;
+
+    // Keywords must be followed by a separator
+    next = parser->pos[len];
+    if (next && next != '(' && !isspace((unsigned char) next))
+        return false;
+
+    parser->pos += len;
+    return true;
+}
+
+/**
+ * @brief Create a node joining one or two operands
+ *
+ * Operands of and and or nodes are sorted so the cheapest is checked first.
+ */
+static sip_filter_t *
+sip_filter_node(struct sip_filter_parser *parser, enum sip_filter_type type,
+                sip_filter_t *left, sip_filter_t *right)
+{
+    sip_filter_t *node;
+
+    if (!(node = sng_malloc(sizeof(sip_filter_t)))) {
+        sip_filter_free(left);
+        sip_filter_free(right);
+        return sip_filter_error(parser, "Out of memory");
+    }
+
+    node->type = type;
+    if (right && right->cost < left->cost) {
+        node->left = right;
+        node->right = left;
+    } else {
+        node->left = left;
+        node->right = right;
+    }
+    node->cost = left->cost + (right ? right->cost : 0);
+    return node;
+}
+
+/**
+ * @brief Convert a condition value to the message representation
+ */
+static sip_filter_t *
+sip_filter_cond(struct sip_filter_parser *parser, int f, enum sip_filter_op op,
+                const char *value, size_t len)
+{
+    sip_filter_t *node;
+    char text[SIP_FILTER_VALUE_LEN];
+    char *end;
+    long num;
+
+    if (len >= sizeof(text))
+        return sip_filter_error(parser, "Value too long");
+    memcpy(text, value, len);
+    text[len] = '\0';
+
+    if (!(node = sng_malloc(sizeof(sip_filter_t))))
+        return sip_filter_error(parser, "Out of memory");
+
+    node->type = SIP_FILTER_COND;
+    node->field = sip_filter_fields[f].field;
+
+    switch (sip_filter_fields[f].value) {
+        case SIP_FILTER_VALUE_METHOD:
+            if (op != SIP_FILTER_EQ && op != SIP_FILTER_NE)
+                goto invalid_op;
+            if ((node->method = sip_method_from_str(text)) <= 0)
+                goto invalid_value;
+            node->cost = 1;
+            break;
+        case SIP_FILTER_VALUE_PORT:
+            if (op != SIP_FILTER_EQ && op != SIP_FILTER_NE)
+                goto invalid_op;
+            num = strtol(text, &end, 10);
+            if (*end || num <= 0 || num > 65535)
+                goto invalid_value;
+            node->port = num;
+            node->cost = 1;
+            break;
+        case SIP_FILTER_VALUE_ADDRESS:
+            if (op != SIP_FILTER_EQ && op != SIP_FILTER_NE && op != SIP_FILTER_IN)
+                goto invalid_op;
+            if (address_prefix_from_str(text, &node->prefix) != 0)
+                goto invalid_value;
+            node->cost = 2;
+            break;
+        case SIP_FILTER_VALUE_TEXT:
+            if (op == SIP_FILTER_IN)
+                goto invalid_op;
+            if (!(node->value = strdup(text))) {
+                sip_filter_free(node);
+                return sip_filter_error(parser, "Out of memory");
+            }
+            node->len = len;
+            node->cost = 4;
+            if (op == SIP_FILTER_MATCH || op == SIP_FILTER_NOMATCH) {
+                if (regexp_compile(&node->regex, text, 0) != 0)
+                    goto invalid_value;
+                node->cost = 8;
+            }
+            break;
+    }
+
+    // Set once the value is valid, so only compiled expressions are freed
+    node->op = op;
+    return node;
+
+invalid_op:
+    snprintf(parser->error, parser->errlen, "Operator %s can not be used with %s",
+             sip_filter_ops[op], sip_filter_fields[f].name);
+    sip_filter_free(node);
+    return NULL;
+
+invalid_value:
+    snprintf(parser->error, parser->errlen, "Invalid %s value '%.*s'",
+             sip_filter_fields[f].name, (int) len, value);
+    sip_filter_free(node);
+    return NULL;
+}
+
+/**
+ * @brief Parse a condition: field, operator and value
+ *
+ * Values can be quoted to include whitespaces. Unquoted values end at the
+ * first whitespace or at a closing parenthesis that has not been opened
+ * within the value, so expressions with groups can be used unquoted.
+ */
+static sip_filter_t *
+sip_filter_parse_cond(struct sip_filter_parser *parser)
+{
+    const char *name, *value;
+    size_t len;
+    enum sip_filter_op op;
+    int f, depth = 0;
+    char quote;
+
+    // Field name
+    sip_filter_skip_spaces(parser);
+    name = parser->pos;
+    while (isalnum((unsigned char) *parser->pos) || *parser->pos == '.' || *parser->pos == '_')
+        parser->pos++;
+    if (!(len = parser->pos - name))
+        return sip_filter_error(parser, "Expected condition");
+
+    for (f = 0; sip_filter_fields[f].name; f++) {
+        if (strlen(sip_filter_fields[f].name) == len
+            && !strncasecmp(sip_filter_fields[f].name, name, len))
+            break;
+    }
+    if (!sip_filter_fields[f].name) {
+        parser->pos = name;
+        return sip_filter_error(parser, "Unknown field");
+    }
+
+    // Operator
+    sip_filter_skip_spaces(parser);
+    if (!strncmp(parser->pos, "==", 2)) {
+        op = SIP_FILTER_EQ;
+        parser->pos += 2;
+    } else if (!strncmp(parser->pos, "!=", 2)) {
+        op = SIP_FILTER_NE;
+        parser->pos += 2;
+    } else if (!strncmp(parser->pos, "!~", 2)) {
+        op = SIP_FILTER_NOMATCH;
+        parser->pos += 2;
+    } else if (*parser->pos == '=') {
+        op = SIP_FILTER_EQ;
+        parser->pos++;
+    } else if (*parser->pos == '~') {
+        op = SIP_FILTER_MATCH;
+        parser->pos++;
+    } else if (sip_filter_keyword(parser, "in")) {
+        op = SIP_FILTER_IN;
+    } else {
+        return sip_filter_error(parser, "Expected operator");
+    }
+
+    // Value
+    sip_filter_skip_spaces(parser);
+    if (*parser->pos == '"' || *parser->pos == '\'') {
+        quote = *parser->pos++;
+        value = parser->pos;
+        while (*parser->pos && *parser->pos != quote)
+            parser->pos++;
+        if (!*parser->pos)
+            return sip_filter_error(parser, "Unterminated quoted value");
+        len = parser->pos++ - value;
+    } else {
+        value = parser->pos;
+        for (; *parser->pos && !isspace((unsigned char) *parser->pos); parser->pos++) {
+            if (*parser->pos == '(') {
+                depth++;
+            } else if (*parser->pos == ')' && depth-- == 0) {
+                break;
+            }
+        }
+        if (!(len = parser->pos - value))
+            return sip_filter_error(parser, "Expected value");
+    }
+
+    return sip_filter_cond(parser, f, op, value, len);
+}
+
+/**
+ * @brief Parse a negated condition, a parenthesized expression or a condition
+ */
+static sip_filter_t *
+sip_filter_parse_unary(struct sip_filter_parser *parser)
+{
+    sip_filter_t *node;
+
+    if (sip_filter_keyword(parser, "not")) {
+        if (!(node = sip_filter_parse_unary(parser)))
+            return NULL;
+        return sip_filter_node(parser, SIP_FILTER_NOT, node, NULL);
+    }
+
+    sip_filter_skip_spaces(parser);
+    if (*parser->pos != '(')
+        return sip_filter_parse_cond(parser);
+
+    parser->pos++;
+    if (!(node = sip_filter_parse_or(parser)))
+        return NULL;
+
+    sip_filter_skip_spaces(parser);
+    if (*parser->pos != ')') {
+        sip_filter_free(node);
+        return sip_filter_error(parser, "Expected )");
+    }
+    parser->pos++;
+    return node;
+}
+
+/**
+ * @brief Parse conditions joined with and
+ */
+static sip_filter_t *
+sip_filter_parse_and(struct sip_filter_parser *parser)
+{
+    sip_filter_t *left, *right;
+
+    if (!(left = sip_filter_parse_unary(parser)))
+        return NULL;
+
+    while (sip_filter_keyword(parser, "and")) {
+        if (!(right = sip_filter_parse_unary(parser))) {
+            sip_filter_free(left);
+            return NULL;
+        }
+        if (!(left = sip_filter_node(parser, SIP_FILTER_AND, left, right)))
+            return NULL;
+    }
+
+    return left;
+}
+
+/**
+ * @brief Parse conditions joined with or
+ */
+static sip_filter_t *
+sip_filter_parse_or(struct sip_filter_parser *parser)
+{
+    sip_filter_t *left, *right;
+
+    if (!(left = sip_filter_parse_and(parser)))
+        return NULL;
+
+    while (sip_filter_keyword(parser, "or")) {
+        if (!(right = sip_filter_parse_and(parser))) {
+            sip_filter_free(left);
+            return NULL;
+        }
+        if (!(left = sip_filter_node(parser, SIP_FILTER_OR, left, right)))
+            return NULL;
+    }
+
+    return left;
+}
+
+sip_filter_t *
+sip_filter_compile(const char *expr, char *error, size_t errlen)
+{
+    struct sip_filter_parser parser = { expr, error, errlen };
+    sip_filter_t *filter;
+
+    if (!(filter = sip_filter_parse_or(&parser)))
+        return NULL;
+
+    // The whole expression must have been parsed
+    sip_filter_skip_spaces(&parser);
+    if (*parser.pos) {
+        sip_filter_free(filter);
+        return sip_filter_error(&parser, "Unexpected text");
+    }
+
+    return filter;
+}
+
+/**
+ * @brief Get the value of a header if the line contains it
+ */
+static const char *
+sip_filter_header_value(const char *line, const char *name)
+{
+    size_t len = strlen(name);
+
+    if (strncasecmp(line, name, len) != 0)
+        return NULL;
+
+    for (line += len; *line == ' ' || *line == '\t'; line++);
+    if (*line++ != ':')
+        return NULL;
+    for (; *line == ' ' || *line == '\t'; line++);
+    return line;
+}
+
+/**
+ * @brief Locate a header in message payload the first time it is needed
+ */
+static const char *
+sip_filter_header(struct sip_filter_data *data, enum sip_filter_header hdr, size_t *len)
+{
+    static const char *names[SIP_FILTER_HDR_COUNT][2] = {
+        { "Call-ID", "i" }, { "From", "f" }, { "To", "t" }
+    };
+    const char *line, *value = NULL;
+
+    if (!data->located[hdr]) {
+        data->located[hdr] = true;
+        // Headers start after the request or status line and end at the first empty line
+        for (line = strchr(data->payload, '\n'); line; line = strchr(line, '\n')) {
+            line++;
+            if (*line == '\r' || *line == '\n' || *line == '\0')
+                break;
+            if ((value = sip_filter_header_value(line, names[hdr][0]))
+                || (value = sip_filter_header_value(line, names[hdr][1])))
+                break;
+        }
+        if (value) {
+            data->hdr[hdr] = value;
+            data->hdrlen[hdr] = strcspn(value, "\r\n");
+        }
+    }
+
+    *len = data->hdrlen[hdr];
+    return data->hdr[hdr];
+}
+
+/**
+ * @brief Get the text of a field from message payload
+ *
+ * From and To fields contain the header URI without scheme and parameters,
+ * the same value displayed for SIP From and SIP To attributes.
+ */
+static const char *
+sip_filter_text(struct sip_filter_data *data, enum sip_filter_field field, size_t *len)
+{
+    const char *value, *at;
+    size_t vlen;
+
+    switch (field) {
+        case SIP_FILTER_CALLID:
+            if (!(value = sip_filter_header(data, SIP_FILTER_HDR_CALLID, &vlen)))
+                break;
+            *len = strcspn(value, " \t\r\n");
+            return value;
+        case SIP_FILTER_FROM:
+        case SIP_FILTER_FROM_USER:
+        case SIP_FILTER_FROM_DOMAIN:
+        case SIP_FILTER_TO:
+        case SIP_FILTER_TO_USER:
+        case SIP_FILTER_TO_DOMAIN:
+            if (field <= SIP_FILTER_FROM_DOMAIN) {
+                value = sip_filter_header(data, SIP_FILTER_HDR_FROM, &vlen);
+            } else {
+                value = sip_filter_header(data, SIP_FILTER_HDR_TO, &vlen);
+            }
+            if (!value || !(at = memchr(value, ':', vlen)))
+                break;
+            // URI without scheme up to parameters or closing bracket
+            vlen -= (at + 1 - value);
+            value = at + 1;
+            vlen = strcspn(value, ">;\r\n") < vlen ? strcspn(value, ">;\r\n") : vlen;
+
+            if (field == SIP_FILTER_FROM || field == SIP_FILTER_TO) {
+                *len = vlen;
+                return value;
+            }
+
+            at = memchr(value, '@', vlen);
+            if (field == SIP_FILTER_FROM_USER || field == SIP_FILTER_TO_USER) {
+                *len = at ? (size_t) (at - value) : 0;
+                return value;
+            }
+
+            // Domain without port
+            if (at) {
+                vlen -= (at + 1 - value);
+                value = at + 1;
+            }
+            *len = strcspn(value, ":>;\r\n") < vlen ? strcspn(value, ":>;\r\n") : vlen;
+            return value;
+        default:
+            break;
+    }
+
+    *len = 0;
+    return "";
+}
+
+/**
+ * @brief Check a text condition
+ */
+static bool
+sip_filter_check_text(const sip_filter_t *node, struct sip_filter_data *data)
+{
+    char text[SIP_FILTER_VALUE_LEN];
+    const char *value;
+    size_t len;
+    bool match;
+
+    value = sip_filter_text(data, node->field, &len);
+
+    if (node->op == SIP_FILTER_MATCH || node->op == SIP_FILTER_NOMATCH) {
+        // Expressions require null-terminated values
+        if (len >= sizeof(text))
+            len = sizeof(text) - 1;
+        memcpy(text, value, len);
+        text[len] = '\0';
+        match = regexp_match(&node->regex, text, len);
+        return (node->op == SIP_FILTER_MATCH) ? match : !match;
+    }
+
+    // Domains are case insensitive
+    match = len == node->len;
+    if (match && (node->field == SIP_FILTER_FROM_DOMAIN || node->field == SIP_FILTER_TO_DOMAIN)) {
+        match = !strncasecmp(value, node->value, len);
+    } else if (match) {
+        match = !memcmp(value, node->value, len);
+    }
+    return (node->op == SIP_FILTER_NE) ? !match : match;
+}
+
+/**
+ * @brief Check a filter node against a message
+ */
+static bool
+sip_filter_check_node(const sip_filter_t *node, struct sip_filter_data *data)
+{
+    bool match;
+
+    switch (node->type) {
+        case SIP_FILTER_AND:
+            return sip_filter_check_node(node->left, data)
+                && sip_filter_check_node(node->right, data);
+        case SIP_FILTER_OR:
+            return sip_filter_check_node(node->left, data)
+                || sip_filter_check_node(node->right, data);
+        case SIP_FILTER_NOT:
+            return !sip_filter_check_node(node->left, data);
+        case SIP_FILTER_COND:
+            break;
+    }
+
+    switch (node->field) {
+        case SIP_FILTER_METHOD:
+            match = data->msg->reqresp == node->method;
+            break;
+        case SIP_FILTER_SRC:
+            match = address_in_prefix(data->packet->src, &node->prefix);
+            break;
+        case SIP_FILTER_DST:
+            match = address_in_prefix(data->packet->dst, &node->prefix);
+            break;
+        case SIP_FILTER_SRC_PORT:
+            match = data->packet->src.port == node->port;
+            break;
+        case SIP_FILTER_DST_PORT:
+            match = data->packet->dst.port == node->port;
+            break;
+        default:
+            return sip_filter_check_text(node, data);
+    }
+
+    return (node->op == SIP_FILTER_NE) ? !match : match;
+}
+
+bool
+sip_filter_check(const sip_filter_t *filter, packet_t *packet, sip_msg_t *msg,
+                 const char *payload)
+{
+    struct sip_filter_data data;
+
+    memset(&data, 0, sizeof(data));
+    data.packet = packet;
+    data.msg = msg;
+    data.payload = payload;
+
+    return sip_filter_check_node(filter, &data);
+}
+
+void
+sip_filter_free(sip_filter_t *filter)
+{
+    if (!filter)
+        return;
+
+    sip_filter_free(filter->left);
+    sip_filter_free(filter->right);
+    if (filter->op == SIP_FILTER_MATCH || filter->op == SIP_FILTER_NOMATCH)
+        regexp_free(&filter->regex);
+    free(filter->value);
+    sng_free(filter);
+}
@@ -0,0 +1,159 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file sip_filter.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to filter dialogs while they are captured
+ *
+ * Filter expressions are made of conditions over the first message of each
+ * dialog, joined with and, or, not and parentheses:
+ *
+ *   method=INVITE and from.user~^34 and src in 10.0.0.0/8
+ *
+ * Expressions are compiled once into a tree of conditions. Values are
+ * converted to the message representation when compiled (method codes,
+ * binary addresses, ports) so checking a message requires no formatting.
+ * Headers are only located in the payload when a condition needs them.
+ *
+ * Messages not matching the expression do not create a dialog, so they are
+ * discarded before any dialog memory is allocated.
+ *
+ */
+#ifndef __SNGREP_SIP_FILTER_H
+#define __SNGREP_SIP_FILTER_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "address.h"
+#include "packet.h"
+#include "regexp.h"
+#include "sip_msg.h"
+
+//! Max length of header values checked against expressions
+#define SIP_FILTER_VALUE_LEN    256
+
+//! Shorter declaration of sip_filter structure
+typedef struct sip_filter sip_filter_t;
+
+/**
+ * @brief Filter tree node types
+ */
+enum sip_filter_type {
+    SIP_FILTER_AND = 0,
+    SIP_FILTER_OR,
+    SIP_FILTER_NOT,
+    SIP_FILTER_COND,
+};
+
+/**
+ * @brief Message fields that can be checked
+ */
+enum sip_filter_field {
+    SIP_FILTER_METHOD = 0,
+    SIP_FILTER_CALLID,
+    SIP_FILTER_FROM,
+    SIP_FILTER_FROM_USER,
+    SIP_FILTER_FROM_DOMAIN,
+    SIP_FILTER_TO,
+    SIP_FILTER_TO_USER,
+    SIP_FILTER_TO_DOMAIN,
+    SIP_FILTER_SRC,
+    SIP_FILTER_DST,
+    SIP_FILTER_SRC_PORT,
+    SIP_FILTER_DST_PORT,
+};
+
+/**
+ * @brief Condition operators
+ */
+enum sip_filter_op {
+    SIP_FILTER_EQ = 0,
+    SIP_FILTER_NE,
+    SIP_FILTER_MATCH,
+    SIP_FILTER_NOMATCH,
+    SIP_FILTER_IN,
+};
+
+/**
+ * @brief Compiled filter expression node
+ */
+struct sip_filter {
+    //! Node type
+    enum sip_filter_type type;
+    //! Operands of and, or and not nodes
+    sip_filter_t *left, *right;
+    //! Estimated cost of checking this node
+    int cost;
+    //! Checked field of conditions
+    enum sip_filter_field field;
+    //! Operator of conditions
+    enum sip_filter_op op;
+    //! Method or response code
+    int method;
+    //! Text value
+    char *value;
+    //! Text value length
+    size_t len;
+    //! Compiled expression for match operators
+    regexp_t regex;
+    //! Network prefix for address conditions
+    address_prefix_t prefix;
+    //! Port number
+    uint16_t port;
+};
+
+/**
+ * @brief Compile a filter expression
+ *
+ * @param expr Expression text
+ * @param error Buffer to store the reason of invalid expressions
+ * @param errlen Error buffer size
+ * @return compiled filter or NULL if expression is not valid
+ */
+sip_filter_t *
+sip_filter_compile(const char *expr, char *error, size_t errlen);
+
+/**
+ * @brief Check if a message matches a compiled filter
+ *
+ * This function can be called from multiple threads with the same filter.
+ *
+ * @param filter Compiled filter
+ * @param packet Packet containing the message
+ * @param msg Message with its request method or response code already parsed
+ * @param payload Null-terminated message payload
+ * @return true if message matches the filter, false otherwise
+ */
+bool
+sip_filter_check(const sip_filter_t *filter, packet_t *packet, sip_msg_t *msg,
+                 const char *payload);
+
+/**
+ * @brief Free a compiled filter
+ */
+void
+sip_filter_free(sip_filter_t *filter);
+
+#endif /* __SNGREP_SIP_FILTER_H */
@@ -0,0 +1,563 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file sip_index.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in sip_index.h
+ *
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "sip_index.h"
+#include "sip_call.h"
+#include "setting.h"
+#include "hash.h"
+#include "vector.h"
+
+//! Shorter declaration of sip_index_addr structure
+typedef struct sip_index_addr sip_index_addr_t;
+
+/**
+ * @brief Dialogs using an address
+ */
+struct sip_index_addr {
+    //! Address as displayed in SOURCE and DESTINATION attributes
+    char key[SIP_ATTR_MAXLEN];
+    //! Address
+    address_t addr;
+    //! Dialogs using this address
+    sip_index_list_t list;
+};
+
+/**
+ * @brief Dialogs index status
+ */
+struct sip_index {
+    //! Index is enabled
+    bool enabled;
+    //! Lock for index lists, updated by capture and read by interface
+    pthread_mutex_t lock;
+    //! Trigram lists of SIP From and SIP To
+    sip_index_list_t *grams[SIP_INDEX_SRC];
+    //! Address lists of source and destination, by address text
+    htable_t *addrs[SIP_INDEX_FIELDS - SIP_INDEX_SRC];
+    //! Address lists of source and destination
+    vector_t *addr_list[SIP_INDEX_FIELDS - SIP_INDEX_SRC];
+    //! Dialogs still stored
+    sip_index_set_t stored;
+    //! Number of dialogs still stored
+    int stored_count;
+    //! Number of removed dialogs still in lists
+    int removed_count;
+    //! Last added dialog index
+    int last;
+};
+
+//! Dialogs index status
+static struct sip_index dindex = {
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+/**
+ * @brief Get the bucket of a lowercase trigram
+ */
+static inline uint32_t
+sip_index_gram(const char *text)
+{
+    uint32_t gram = 0;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        gram <<= 8;
+        gram |= (text[i] >= 'A' && text[i] <= 'Z') ? text[i] | 0x20 : (uint8_t) text[i];
+    }
+
+    return ((gram * 2654435761u) >> 8) & (SIP_INDEX_BUCKETS - 1);
+}
+
+/**
+ * @brief Append a dialog index to a list
+ */
+static void
+sip_index_list_add(sip_index_list_t *list, int id)
+{
+    uint32_t delta = id - list->last;
+    uint8_t *data;
+
+    // Dialog is already in the list
+    if (list->count && !delta)
+        return;
+
+    // Make room for the largest delta
+    if (list->len + 5 > list->size) {
+        if (!(data = realloc(list->data, list->size ? list->size * 2 : 16)))
+            return;
+        list->data = data;
+        list->size = list->size ? list->size * 2 : 16;
+    }
+
+    while (delta >= 0x80) {
+        list->data[list->len++] = (delta & 0x7F) | 0x80;
+        delta >>= 7;
+    }
+    list->data[list->len++] = delta;
+    list->last = id;
+    list->count++;
+}
+
+/**
+ * @brief Decode next dialog index of a list
+ */
+static inline int
+sip_index_list_next(const sip_index_list_t *list, uint32_t *pos, int id)
+{
+    uint32_t delta = 0;
+    int shift = 0;
+    uint8_t byte;
+
+    do {
+        byte = list->data[(*pos)++];
+        delta |= (uint32_t) (byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    return id + delta;
+}
+
+/**
+ * @brief Check if a dialog index is in a set bitmap
+ */
+static inline bool
+sip_index_set_test(const sip_index_set_t *set, int id)
+{
+    if (id < set->base || (size_t) (id - set->base) / 64 >= set->words)
+        return false;
+    return set->bits[(id - set->base) / 64] & (1ULL << ((id - set->base) % 64));
+}
+
+/**
+ * @brief Add all dialogs of a list to a set
+ */
+static void
+sip_index_set_add_list(sip_index_set_t *set, const sip_index_list_t *list)
+{
+    uint32_t pos = 0;
+    int id = 0;
+
+    while (pos < list->len) {
+        id = sip_index_list_next(list, &pos, id);
+        if (id >= set->base && id <= set->last)
+            set->bits[(id - set->base) / 64] |= 1ULL << ((id - set->base) % 64);
+    }
+}
+
+/**
+ * @brief Drop removed dialogs from a list
+ *
+ * Deltas between kept dialogs never take more bytes than the ones they
+ * replace, so the list is rewritten in place.
+ */
+static void
+sip_index_list_compact(sip_index_list_t *list)
+{
+    uint32_t pos = 0, delta;
+    int id = 0, last = 0;
+    sip_index_list_t kept = { list->data, 0, list->size, 0, 0 };
+
+    while (pos < list->len) {
+        id = sip_index_list_next(list, &pos, id);
+        if (!sip_index_set_test(&dindex.stored, id))
+            continue;
+        for (delta = id - last; delta >= 0x80; delta >>= 7)
+            kept.data[kept.len++] = (delta & 0x7F) | 0x80;
+        kept.data[kept.len++] = delta;
+        kept.count++;
+        last = id;
+    }
+    kept.last = last;
+
+    if (!kept.count) {
+        free(list->data);
+        memset(list, 0, sizeof(sip_index_list_t));
+    } else {
+        *list = kept;
+    }
+}
+
+/**
+ * @brief Drop removed dialogs from all lists
+ */
+static void
+sip_index_compact()
+{
+    sip_index_addr_t *entry;
+    size_t first;
+    int f, i;
+
+    // Lists contain the stored dialogs bitmap
+    for (f = 0; f < SIP_INDEX_SRC; f++) {
+        for (i = 0; i < SIP_INDEX_BUCKETS; i++) {
+            if (dindex.grams[f][i].count)
+                sip_index_list_compact(&dindex.grams[f][i]);
+        }
+    }
+
+    // Remove addresses no longer used by any dialog
+    for (f = 0; f < SIP_INDEX_FIELDS - SIP_INDEX_SRC; f++) {
+        for (i = vector_count(dindex.addr_list[f]) - 1; i >= 0; i--) {
+            entry = vector_item(dindex.addr_list[f], i);
+            sip_index_list_compact(&entry->list);
+            if (!entry->list.count) {
+                htable_remove(dindex.addrs[f], entry->key);
+                vector_remove(dindex.addr_list[f], entry);
+            }
+        }
+    }
+
+    // Start stored dialogs bitmap from the first stored dialog
+    for (first = 0; first < dindex.stored.words && !dindex.stored.bits[first]; first++);
+    if (first == dindex.stored.words)
+        first = (dindex.last + 1 - dindex.stored.base) / 64;
+    memmove(dindex.stored.bits, dindex.stored.bits + first,
+            (dindex.stored.words - first) * sizeof(uint64_t));
+    memset(dindex.stored.bits + dindex.stored.words - first, 0, first * sizeof(uint64_t));
+    dindex.stored.base += first * 64;
+    dindex.removed_count = 0;
+}
+
+void
+sip_index_init()
+{
+    int f;
+
+    if (!setting_enabled(SETTING_SIP_INDEX))
+        return;
+
+    for (f = 0; f < SIP_INDEX_SRC; f++) {
+        if (!(dindex.grams[f] = calloc(SIP_INDEX_BUCKETS, sizeof(sip_index_list_t))))
+            return;
+    }
+
+    for (f = 0; f < SIP_INDEX_FIELDS - SIP_INDEX_SRC; f++) {
+        dindex.addrs[f] = htable_create(1024);
+        dindex.addr_list[f] = vector_create(64, 64);
+        vector_set_destroyer(dindex.addr_list[f], vector_generic_destroyer);
+    }
+
+    dindex.enabled = true;
+}
+
+void
+sip_index_deinit()
+{
+    int f;
+
+    if (!dindex.enabled)
+        return;
+
+    sip_index_clear();
+    dindex.enabled = false;
+
+    for (f = 0; f < SIP_INDEX_SRC; f++)
+        free(dindex.grams[f]);
+    for (f = 0; f < SIP_INDEX_FIELDS - SIP_INDEX_SRC; f++) {
+        htable_destroy(dindex.addrs[f]);
+        vector_destroy(dindex.addr_list[f]);
+    }
+    free(dindex.stored.bits);
+}
+
+bool
+sip_index_enabled()
+{
+    return dindex.enabled;
+}
+
+/**
+ * @brief Add a dialog to the lists of all trigrams of a text
+ */
+static void
+sip_index_add_text(enum sip_index_field field, int id, const char *text)
+{
+    size_t i, len = strlen(text);
+
+    for (i = 0; i + 3 <= len; i++)
+        sip_index_list_add(&dindex.grams[field][sip_index_gram(text + i)], id);
+}
+
+/**
+ * @brief Add a dialog to the list of an address
+ */
+static void
+sip_index_add_address(enum sip_index_field field, int id, const char *key, address_t addr)
+{
+    sip_index_addr_t *entry;
+    int f = field - SIP_INDEX_SRC;
+
+    if (!(entry = htable_find(dindex.addrs[f], key))) {
+        if (!(entry = sng_malloc(sizeof(sip_index_addr_t))))
+            return;
+        sng_strncpy(entry->key, key, sizeof(entry->key));
+        entry->addr = addr;
+        htable_insert(dindex.addrs[f], entry->key, entry);
+        vector_append(dindex.addr_list[f], entry);
+    }
+
+    sip_index_list_add(&entry->list, id);
+}
+
+void
+sip_index_add_call(sip_call_t *call)
+{
+    char value[SIP_ATTR_MAXLEN];
+    sip_msg_t *first;
+    uint64_t *bits;
+    size_t word, words;
+
+    if (!dindex.enabled || !(first = vector_first(call->msgs)))
+        return;
+
+    pthread_mutex_lock(&dindex.lock);
+
+    // Mark dialog as stored, making room in the bitmap if required
+    if (!dindex.stored_count && !dindex.removed_count)
+        dindex.stored.base = call->index & ~63;
+    word = (call->index - dindex.stored.base) / 64;
+    if (word >= dindex.stored.words) {
+        words = (dindex.stored.words) ? dindex.stored.words * 2 : 1024;
+        if (words <= word)
+            words = word + 1;
+        if (!(bits = realloc(dindex.stored.bits, words * sizeof(uint64_t)))) {
+            pthread_mutex_unlock(&dindex.lock);
+            return;
+        }
+        memset(bits + dindex.stored.words, 0, (words - dindex.stored.words) * sizeof(uint64_t));
+        dindex.stored.bits = bits;
+        dindex.stored.words = words;
+    }
+    dindex.stored.bits[word] |= 1ULL << ((call->index - dindex.stored.base) % 64);
+    dindex.stored_count++;
+    dindex.last = dindex.stored.last = call->index;
+
+    // Index the same values displayed and filtered
+    sip_index_add_text(SIP_INDEX_FROM, call->index, call_get_attribute(call, SIP_ATTR_SIPFROM, value));
+    sip_index_add_text(SIP_INDEX_TO, call->index, call_get_attribute(call, SIP_ATTR_SIPTO, value));
+    sip_index_add_address(SIP_INDEX_SRC, call->index, call_get_attribute(call, SIP_ATTR_SRC, value),
+                          first->packet->src);
+    sip_index_add_address(SIP_INDEX_DST, call->index, call_get_attribute(call, SIP_ATTR_DST, value),
+                          first->packet->dst);
+
+    pthread_mutex_unlock(&dindex.lock);
+}
+
+void
+sip_index_remove_call(sip_call_t *call)
+{
+    if (!dindex.enabled)
+        return;
+
+    pthread_mutex_lock(&dindex.lock);
+
+    if (sip_index_set_test(&dindex.stored, call->index)) {
+        dindex.stored.bits[(call->index - dindex.stored.base) / 64] &=
+            ~(1ULL << ((call->index - dindex.stored.base) % 64));
+        dindex.stored_count--;
+        dindex.removed_count++;
+
+        // Compact lists when most of their dialogs have been removed
+        if (dindex.removed_count >= SIP_INDEX_COMPACT_MIN && dindex.removed_count > dindex.stored_count)
+            sip_index_compact();
+    }
+
+    pthread_mutex_unlock(&dindex.lock);
+}
+
+void
+sip_index_clear()
+{
+    int f, i;
+
+    if (!dindex.enabled)
+        return;
+
+    pthread_mutex_lock(&dindex.lock);
+
+    for (f = 0; f < SIP_INDEX_SRC; f++) {
+        for (i = 0; i < SIP_INDEX_BUCKETS; i++)
+            free(dindex.grams[f][i].data);
+        memset(dindex.grams[f], 0, SIP_INDEX_BUCKETS * sizeof(sip_index_list_t));
+    }
+
+    for (f = 0; f < SIP_INDEX_FIELDS - SIP_INDEX_SRC; f++) {
+        htable_destroy(dindex.addrs[f]);
+        dindex.addrs[f] = htable_create(1024);
+        vector_clear(dindex.addr_list[f]);
+    }
+
+    memset(dindex.stored.bits, 0, dindex.stored.words * sizeof(uint64_t));
+    dindex.stored_count = dindex.removed_count = 0;
+
+    pthread_mutex_unlock(&dindex.lock);
+}
+
+/**
+ * @brief Create an empty set for all dialogs in the index
+ */
+static sip_index_set_t *
+sip_index_set_create()
+{
+    sip_index_set_t *set;
+
+    if (!(set = malloc(sizeof(sip_index_set_t))))
+        return NULL;
+
+    set->base = dindex.stored.base;
+    set->last = dindex.last;
+    set->words = (set->last >= set->base) ? (size_t) (set->last - set->base) / 64 + 1 : 1;
+    if (!(set->bits = calloc(set->words, sizeof(uint64_t)))) {
+        free(set);
+        return NULL;
+    }
+
+    return set;
+}
+
+/**
+ * @brief Sort trigram lists by number of dialogs
+ */
+static int
+sip_index_list_cmp(const void *one, const void *two)
+{
+    const sip_index_list_t *l1 = *(const sip_index_list_t **) one;
+    const sip_index_list_t *l2 = *(const sip_index_list_t **) two;
+    return (l1->count > l2->count) - (l1->count < l2->count);
+}
+
+sip_index_set_t *
+sip_index_find_text(enum sip_index_field field, const search_t *search)
+{
+    sip_index_list_t *lists[SEARCH_LITERAL_LEN];
+    sip_index_set_t *set, *found, *list;
+    const search_literal_t *literal;
+    size_t n, i, w;
+    int l;
+
+    if (!dindex.enabled || !search->count)
+        return NULL;
+
+    // Literals shorter than a trigram can not be searched
+    for (l = 0; l < search->count; l++) {
+        if (search->literals[l].len < 3)
+            return NULL;
+    }
+
+    pthread_mutex_lock(&dindex.lock);
+    set = sip_index_set_create();
+    found = sip_index_set_create();
+    list = sip_index_set_create();
+    if (!set || !found || !list) {
+        pthread_mutex_unlock(&dindex.lock);
+        sip_index_set_free(set);
+        sip_index_set_free(found);
+        sip_index_set_free(list);
+        return NULL;
+    }
+
+    for (l = 0; l < search->count; l++) {
+        literal = &search->literals[l];
+
+        // Intersect the lists of all literal trigrams, shortest first
+        for (n = 0; n + 3 <= literal->len; n++)
+            lists[n] = &dindex.grams[field][sip_index_gram(literal->str + n)];
+        qsort(lists, n, sizeof(sip_index_list_t *), sip_index_list_cmp);
+
+        memset(found->bits, 0, found->words * sizeof(uint64_t));
+        sip_index_set_add_list(found, lists[0]);
+        for (i = 1; i < n && lists[0]->count; i++) {
+            memset(list->bits, 0, list->words * sizeof(uint64_t));
+            sip_index_set_add_list(list, lists[i]);
+            for (w = 0; w < found->words; w++)
+                found->bits[w] &= list->bits[w];
+        }
+
+        // Dialogs may match if they contain any of the literals
+        for (w = 0; w < set->words; w++)
+            set->bits[w] |= found->bits[w];
+    }
+
+    pthread_mutex_unlock(&dindex.lock);
+    sip_index_set_free(found);
+    sip_index_set_free(list);
+    return set;
+}
+
+sip_index_set_t *
+sip_index_find_address(enum sip_index_field field, const regexp_t *regex,
+                       const address_prefix_t *prefix)
+{
+    sip_index_set_t *set;
+    sip_index_addr_t *entry;
+    vector_iter_t it;
+    bool match;
+
+    if (!dindex.enabled)
+        return NULL;
+
+    pthread_mutex_lock(&dindex.lock);
+    if ((set = sip_index_set_create())) {
+        // Check each distinct address instead of each dialog
+        it = vector_iterator(dindex.addr_list[field - SIP_INDEX_SRC]);
+        while ((entry = vector_iterator_next(&it))) {
+            if (regex) {
+                match = regexp_match(regex, entry->key, strlen(entry->key));
+            } else {
+                match = address_in_prefix(entry->addr, prefix);
+            }
+            if (match)
+                sip_index_set_add_list(set, &entry->list);
+        }
+    }
+    pthread_mutex_unlock(&dindex.lock);
+
+    return set;
+}
+
+bool
+sip_index_set_contains(const sip_index_set_t *set, int id)
+{
+    // Dialogs added later have not been searched
+    if (id > set->last)
+        return true;
+    return sip_index_set_test(set, id);
+}
+
+void
+sip_index_set_free(sip_index_set_t *set)
+{
+    if (!set)
+        return;
+    free(set->bits);
+    free(set);
+}
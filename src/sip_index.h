@@ -0,0 +1,197 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file sip_index.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to index dialogs attributes for display filters
+ *
+ * Display filters are regular expressions checked against each dialog
+ * attributes. With hundred of thousands of dialogs, checking all of them
+ * each time the filters change takes seconds.
+ *
+ * When enabled, dialogs are added to an inverted index when they are
+ * created:
+ *
+ *  - SIP From and SIP To values are split in lowercase trigrams, and each
+ *    trigram has a list of the dialogs containing it. Dialogs that may match
+ *    a filter are the ones containing all trigrams of any of the literals
+ *    required by the filter expression.
+ *
+ *  - Source and destination addresses have a list of the dialogs using
+ *    them. Filters are checked against each distinct address instead of
+ *    each dialog, or compared with a network prefix.
+ *
+ * Lists contain dialog indexes in increasing order, stored as variable
+ * length deltas. Trigram hashes share table buckets, so sets found in the
+ * index may contain dialogs not matching the filter, but never miss one
+ * that does. Removed dialogs are dropped from the lists once they are more
+ * than the dialogs still stored.
+ *
+ */
+#ifndef __SNGREP_SIP_INDEX_H
+#define __SNGREP_SIP_INDEX_H
+
+#include "config.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include "address.h"
+#include "regexp.h"
+#include "search.h"
+
+//! Number of trigram buckets of each indexed text attribute
+#define SIP_INDEX_BUCKETS       65536
+//! Min removed dialogs before compacting index lists
+#define SIP_INDEX_COMPACT_MIN   4096
+
+struct sip_call;
+
+//! Shorter declaration of sip_index_list structure
+typedef struct sip_index_list sip_index_list_t;
+//! Shorter declaration of sip_index_set structure
+typedef struct sip_index_set sip_index_set_t;
+
+/**
+ * @brief Indexed dialog attributes
+ */
+enum sip_index_field {
+    SIP_INDEX_FROM = 0,
+    SIP_INDEX_TO,
+    SIP_INDEX_SRC,
+    SIP_INDEX_DST,
+    SIP_INDEX_FIELDS
+};
+
+/**
+ * @brief Dialog indexes containing a trigram or address
+ */
+struct sip_index_list {
+    //! Dialog index deltas
+    uint8_t *data;
+    //! Used bytes of data
+    uint32_t len;
+    //! Allocated bytes of data
+    uint32_t size;
+    //! Number of dialogs in the list
+    uint32_t count;
+    //! Last dialog index in the list
+    int last;
+};
+
+/**
+ * @brief Set of dialogs found in the index
+ */
+struct sip_index_set {
+    //! Dialog index of the first bit
+    int base;
+    //! Last indexed dialog when set was found
+    int last;
+    //! Number of bitmap words
+    size_t words;
+    //! Bitmap of dialogs in the set
+    uint64_t *bits;
+};
+
+/**
+ * @brief Enable dialogs index if configured
+ */
+void
+sip_index_init();
+
+/**
+ * @brief Free dialogs index memory
+ */
+void
+sip_index_deinit();
+
+/**
+ * @brief Check if dialogs index is enabled
+ */
+bool
+sip_index_enabled();
+
+/**
+ * @brief Add a new dialog to the index
+ *
+ * Dialogs must be added in increasing index order, with their first
+ * message already parsed.
+ *
+ * @param call New dialog
+ */
+void
+sip_index_add_call(struct sip_call *call);
+
+/**
+ * @brief Mark a dialog as removed from the index
+ *
+ * @param call Removed dialog
+ */
+void
+sip_index_remove_call(struct sip_call *call);
+
+/**
+ * @brief Remove all dialogs from the index
+ */
+void
+sip_index_clear();
+
+/**
+ * @brief Find dialogs whose From or To attribute may match an expression
+ *
+ * @param field SIP_INDEX_FROM or SIP_INDEX_TO
+ * @param search Literals required by the expression
+ * @return set of dialogs or NULL if index can not be used for this expression
+ */
+sip_index_set_t *
+sip_index_find_text(enum sip_index_field field, const search_t *search);
+
+/**
+ * @brief Find dialogs whose source or destination matches a filter
+ *
+ * @param field SIP_INDEX_SRC or SIP_INDEX_DST
+ * @param regex Expression to check against IP:PORT addresses or NULL
+ * @param prefix Network prefix to check addresses if no expression is given
+ * @return set of dialogs or NULL if index is not enabled
+ */
+sip_index_set_t *
+sip_index_find_address(enum sip_index_field field, const regexp_t *regex,
+                       const address_prefix_t *prefix);
+
+/**
+ * @brief Check if a dialog may be in a found set
+ *
+ * Dialogs added after the set was found are always considered part of it.
+ *
+ * @param set Found set
+ * @param index Dialog index
+ * @return false if dialog is surely not in the set, true otherwise
+ */
+bool
+sip_index_set_contains(const sip_index_set_t *set, int index);
+
+/**
+ * @brief Free a found set
+ */
+void
+sip_index_set_free(sip_index_set_t *set);
+
+#endif /* __SNGREP_SIP_INDEX_H */
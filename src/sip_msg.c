@@ -31,6 +31,8 @@
 #include "sip_msg.h"
 #include "media.h"
 #include "sip.h"
+#include "metrics.h"
+#include "intern.h"
 
 sip_msg_t *
 msg_create()
@@ -38,6 +40,7 @@ msg_create()
     sip_msg_t *msg;
     if (!(msg = sng_malloc(sizeof(sip_msg_t))))
         return NULL;
+    metrics_add(METRIC_MEM_CALLS, sizeof(sip_msg_t));
     return msg;
 }
 
@@ -52,10 +55,11 @@ msg_destroy(sip_msg_t *msg)
     packet_destroy(msg->packet);
     // Free all memory
     sng_free(msg->resp_str);
-    sng_free(msg->sip_from);
-    sng_free(msg->sip_to);
-    sng_free(msg->sip_contact);
+    intern_release(msg->sip_from);
+    intern_release(msg->sip_to);
+    intern_release(msg->sip_contact);
     sng_free(msg);
+    metrics_add(METRIC_MEM_CALLS, -(int64_t) sizeof(sip_msg_t));
 }
 
 void
@@ -140,17 +144,21 @@ msg_get_attribute(sip_msg_t *msg, int id, char *value)
             sprintf(value, "%.*s", SIP_ATTR_MAXLEN - 1, sip_get_msg_reqresp_str(msg));
             break;
         case SIP_ATTR_SIPFROM:
+            sip_parse_msg_deferred(msg);
             sprintf(value, "%.*s", SIP_ATTR_MAXLEN - 1, msg->sip_from);
             break;
         case SIP_ATTR_SIPTO:
+            sip_parse_msg_deferred(msg);
             sprintf(value, "%.*s", SIP_ATTR_MAXLEN - 1, msg->sip_to);
             break;
         case SIP_ATTR_SIPFROMUSER:
+            sip_parse_msg_deferred(msg);
             if (msg->sip_from && (ar = strchr(msg->sip_from, '@'))) {
                 sng_strncpy(value, msg->sip_from, ar - msg->sip_from);
             }
             break;
         case SIP_ATTR_SIPTOUSER:
+            sip_parse_msg_deferred(msg);
             if (msg->sip_to && (ar = strchr(msg->sip_to, '@'))) {
                 sng_strncpy(value, msg->sip_to, ar - msg->sip_to);
             }
@@ -162,6 +170,7 @@ msg_get_attribute(sip_msg_t *msg, int id, char *value)
             timeval_to_time(msg_get_time(msg), value);
             break;
         case SIP_ATTR_CONTACT:
+            sip_parse_msg_deferred(msg);
             if (msg->sip_contact) {
                 sprintf(value, "%.*s", SIP_ATTR_MAXLEN - 1, msg->sip_contact);
             }
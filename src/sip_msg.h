@@ -56,12 +56,12 @@ struct sip_msg {
     char *resp_str;
     //! Message Cseq
     uint32_t cseq;
-    //! SIP From Header
-    char *sip_from;
-    //! SIP To Header
-    char *sip_to;
-    //! SIP Contact Header
-    char *sip_contact;
+    //! SIP From Header (interned)
+    const char *sip_from;
+    //! SIP To Header (interned)
+    const char *sip_to;
+    //! SIP Contact Header (interned)
+    const char *sip_contact;
     //! SDP payload information (sdp_media_t *)
     vector_t *medias;
     //! Captured packet for this message
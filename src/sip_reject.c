@@ -0,0 +1,144 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file sip_reject.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in sip_reject.h
+ *
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include "sip_reject.h"
+
+/**
+ * @brief FNV-1a 64 bits hash of a Call-ID
+ */
+static uint64_t
+sip_reject_hash(const char *callid)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    while (*callid) {
+        hash ^= (unsigned char) *callid++;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Get the entry of a Call-ID hash, if stored
+ */
+static sip_reject_entry_t *
+sip_reject_lookup(sip_reject_t *cache, uint64_t hash)
+{
+    sip_reject_entry_t *bucket;
+    int i;
+
+    bucket = cache->entries + (hash & (cache->buckets - 1)) * SIP_REJECT_BUCKET_SIZE;
+    for (i = 0; i < SIP_REJECT_BUCKET_SIZE; i++) {
+        if (bucket[i].reason != SIP_REJECT_NONE && bucket[i].hash == hash)
+            return &bucket[i];
+    }
+
+    return NULL;
+}
+
+int
+sip_reject_init(sip_reject_t *cache, int size)
+{
+    memset(cache, 0, sizeof(sip_reject_t));
+
+    if (size <= 0)
+        return 0;
+
+    // Round up to a power of two number of buckets
+    for (cache->buckets = 1; cache->buckets * SIP_REJECT_BUCKET_SIZE < (size_t) size; cache->buckets <<= 1);
+
+    if (!(cache->entries = calloc(cache->buckets * SIP_REJECT_BUCKET_SIZE, sizeof(sip_reject_entry_t)))) {
+        cache->buckets = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+void
+sip_reject_free(sip_reject_t *cache)
+{
+    free(cache->entries);
+    memset(cache, 0, sizeof(sip_reject_t));
+}
+
+enum sip_reject_reason
+sip_reject_find(sip_reject_t *cache, const char *callid)
+{
+    sip_reject_entry_t *entry;
+
+    if (!cache->entries)
+        return SIP_REJECT_NONE;
+
+    if (!(entry = sip_reject_lookup(cache, sip_reject_hash(callid))))
+        return SIP_REJECT_NONE;
+
+    // Keep Call-IDs still receiving messages
+    entry->stamp = ++cache->stamp;
+    return entry->reason;
+}
+
+void
+sip_reject_add(sip_reject_t *cache, const char *callid, enum sip_reject_reason reason)
+{
+    sip_reject_entry_t *bucket, *entry;
+    uint64_t hash;
+    int i;
+
+    if (!cache->entries)
+        return;
+
+    hash = sip_reject_hash(callid);
+    if (!(entry = sip_reject_lookup(cache, hash))) {
+        // Use a free entry or replace the least recently used one
+        bucket = cache->entries + (hash & (cache->buckets - 1)) * SIP_REJECT_BUCKET_SIZE;
+        entry = &bucket[0];
+        for (i = 0; i < SIP_REJECT_BUCKET_SIZE && entry->reason != SIP_REJECT_NONE; i++) {
+            if (bucket[i].reason == SIP_REJECT_NONE
+                || (int32_t) (bucket[i].stamp - entry->stamp) < 0)
+                entry = &bucket[i];
+        }
+        entry->hash = hash;
+    }
+
+    entry->reason = reason;
+    entry->stamp = ++cache->stamp;
+}
+
+void
+sip_reject_remove(sip_reject_t *cache, const char *callid)
+{
+    sip_reject_entry_t *entry;
+
+    if (cache->entries && (entry = sip_reject_lookup(cache, sip_reject_hash(callid))))
+        entry->reason = SIP_REJECT_NONE;
+}
@@ -0,0 +1,136 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file sip_reject.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to remember Call-IDs of rejected dialogs
+ *
+ * Messages not belonging to a stored dialog are fully checked to see if
+ * they can start a new one. When dialogs are rejected (only INVITE dialogs,
+ * incomplete dialogs, match expression or filter), all their messages are
+ * checked again the same way.
+ *
+ * Rejected Call-IDs are remembered with the reason they were rejected, so
+ * following messages of the same dialog can be discarded right after
+ * extracting their Call-ID. Call-IDs are stored as 64 bits hashes in a fixed
+ * size table of buckets. When a bucket is full, the least recently used
+ * Call-ID is replaced.
+ *
+ */
+#ifndef __SNGREP_SIP_REJECT_H
+#define __SNGREP_SIP_REJECT_H
+
+#include "config.h"
+#include <stddef.h>
+#include <stdint.h>
+
+//! Call-IDs in each bucket
+#define SIP_REJECT_BUCKET_SIZE  8
+
+//! Shorter declaration of sip_reject_entry structure
+typedef struct sip_reject_entry sip_reject_entry_t;
+//! Shorter declaration of sip_reject structure
+typedef struct sip_reject sip_reject_t;
+
+/**
+ * @brief Reasons dialogs have been rejected
+ */
+enum sip_reject_reason {
+    //! Call-ID has not been rejected
+    SIP_REJECT_NONE = 0,
+    //! First message method can not start a dialog
+    SIP_REJECT_METHOD,
+    //! First message did not match the match expression or filter
+    SIP_REJECT_MATCH,
+};
+
+/**
+ * @brief Rejected Call-ID
+ */
+struct sip_reject_entry {
+    //! Call-ID hash
+    uint64_t hash;
+    //! Last time this entry was used
+    uint32_t stamp;
+    //! Reason the dialog was rejected
+    uint32_t reason;
+};
+
+/**
+ * @brief Rejected Call-IDs table
+ */
+struct sip_reject {
+    //! Table entries, grouped in buckets
+    sip_reject_entry_t *entries;
+    //! Number of buckets (power of two)
+    size_t buckets;
+    //! Use counter to find least recently used entries
+    uint32_t stamp;
+};
+
+/**
+ * @brief Create the rejected Call-IDs table
+ *
+ * @param cache Table to initialize
+ * @param size Number of Call-IDs to remember (0 to disable)
+ * @return 0 if table has been created or disabled, 1 otherwise
+ */
+int
+sip_reject_init(sip_reject_t *cache, int size);
+
+/**
+ * @brief Free rejected Call-IDs table
+ */
+void
+sip_reject_free(sip_reject_t *cache);
+
+/**
+ * @brief Get the reason a dialog was rejected
+ *
+ * @param cache Rejected Call-IDs table
+ * @param callid Call-ID of the dialog
+ * @return reason dialog was rejected or SIP_REJECT_NONE
+ */
+enum sip_reject_reason
+sip_reject_find(sip_reject_t *cache, const char *callid);
+
+/**
+ * @brief Remember a rejected dialog
+ *
+ * @param cache Rejected Call-IDs table
+ * @param callid Call-ID of the dialog
+ * @param reason Reason the dialog was rejected
+ */
+void
+sip_reject_add(sip_reject_t *cache, const char *callid, enum sip_reject_reason reason);
+
+/**
+ * @brief Forget a rejected dialog
+ *
+ * @param cache Rejected Call-IDs table
+ * @param callid Call-ID of the dialog
+ */
+void
+sip_reject_remove(sip_reject_t *cache, const char *callid);
+
+#endif /* __SNGREP_SIP_REJECT_H */
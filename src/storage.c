@@ -0,0 +1,264 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file storage.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Source of functions defined in storage.h
+ *
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "storage.h"
+#include "metrics.h"
+
+/**
+ * @brief Disk storage status
+ */
+struct storage_status {
+    //! Directory for segment files
+    char path[PATH_MAX];
+    //! Segment where new frames are appended
+    storage_segment_t *current;
+    //! Mapped segments, most recently used first
+    storage_segment_t *lru_first, *lru_last;
+    //! Number of mapped segments
+    int mapped;
+    //! Lock for segments access from capture and interface threads
+    pthread_mutex_t lock;
+};
+
+//! Disk storage status
+static struct storage_status storage = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+int
+storage_init(const char *path)
+{
+    // Check we can create files in the given directory
+    if (access(path, W_OK | X_OK) != 0) {
+        fprintf(stderr, "Unable to use %s for disk storage: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    // Check segment file names fit in a path
+    if (strlen(path) + strlen("/" STORAGE_SEGMENT_TEMPLATE) >= sizeof(storage.path)) {
+        fprintf(stderr, "Unable to use %s for disk storage: path is too long\n", path);
+        return 1;
+    }
+
+    snprintf(storage.path, sizeof(storage.path), "%s", path);
+    return 0;
+}
+
+/**
+ * @brief Create a new empty segment file
+ */
+static storage_segment_t *
+storage_segment_create()
+{
+    storage_segment_t *segment;
+    char filename[PATH_MAX];
+    int fd;
+
+    // Create a new segment file
+    if (snprintf(filename, sizeof(filename), "%s/" STORAGE_SEGMENT_TEMPLATE, storage.path) >= (int) sizeof(filename))
+        return NULL;
+    if ((fd = mkstemp(filename)) == -1)
+        return NULL;
+
+    // Remove the file name, data will be available until closed
+    unlink(filename);
+
+    if (!(segment = malloc(sizeof(storage_segment_t)))) {
+        close(fd);
+        return NULL;
+    }
+
+    memset(segment, 0, sizeof(storage_segment_t));
+    segment->fd = fd;
+    metrics_inc(METRIC_STORAGE_SEGMENTS);
+    return segment;
+}
+
+/**
+ * @brief Unmap a segment and remove it from mapped segments list
+ */
+static void
+storage_segment_unmap(storage_segment_t *segment)
+{
+    if (!segment->map)
+        return;
+
+    munmap(segment->map, segment->maplen);
+    segment->map = NULL;
+    segment->maplen = 0;
+
+    if (segment->lru_prev) {
+        segment->lru_prev->lru_next = segment->lru_next;
+    } else {
+        storage.lru_first = segment->lru_next;
+    }
+
+    if (segment->lru_next) {
+        segment->lru_next->lru_prev = segment->lru_prev;
+    } else {
+        storage.lru_last = segment->lru_prev;
+    }
+
+    segment->lru_prev = segment->lru_next = NULL;
+    storage.mapped--;
+}
+
+/**
+ * @brief Close a segment file, reclaiming its disk space
+ */
+static void
+storage_segment_destroy(storage_segment_t *segment)
+{
+    storage_segment_unmap(segment);
+    close(segment->fd);
+    metrics_dec(METRIC_STORAGE_SEGMENTS);
+    metrics_add(METRIC_STORAGE_BYTES, -(int64_t) segment->size);
+    free(segment);
+}
+
+void
+storage_deinit()
+{
+    pthread_mutex_lock(&storage.lock);
+    // Stop appending to current segment
+    if (storage.current && storage.current->frames == 0)
+        storage_segment_destroy(storage.current);
+    storage.current = NULL;
+    pthread_mutex_unlock(&storage.lock);
+}
+
+storage_segment_t *
+storage_write(const u_char *data, uint32_t len, off_t *offset)
+{
+    storage_segment_t *segment;
+    ssize_t written;
+    size_t pos;
+
+    pthread_mutex_lock(&storage.lock);
+
+    // Start a new segment if the current one is full
+    if (storage.current && storage.current->size + len > STORAGE_SEGMENT_SIZE) {
+        if (storage.current->frames == 0)
+            storage_segment_destroy(storage.current);
+        storage.current = NULL;
+    }
+
+    if (!storage.current && !(storage.current = storage_segment_create())) {
+        pthread_mutex_unlock(&storage.lock);
+        return NULL;
+    }
+
+    // Append data at the end of the segment
+    segment = storage.current;
+    for (pos = 0; pos < len; pos += written) {
+        written = pwrite(segment->fd, data + pos, len - pos, segment->size + pos);
+        if (written <= 0) {
+            if (written < 0 && errno == EINTR) {
+                written = 0;
+                continue;
+            }
+            pthread_mutex_unlock(&storage.lock);
+            return NULL;
+        }
+    }
+
+    *offset = segment->size;
+    segment->size += len;
+    segment->frames++;
+    metrics_add(METRIC_STORAGE_BYTES, len);
+
+    pthread_mutex_unlock(&storage.lock);
+    return segment;
+}
+
+const u_char *
+storage_read(storage_segment_t *segment, off_t offset, uint32_t len)
+{
+    void *map;
+
+    pthread_mutex_lock(&storage.lock);
+
+    // Map segment again if data was written after being mapped
+    if (segment->map && offset + len > segment->maplen)
+        storage_segment_unmap(segment);
+
+    if (!segment->map) {
+        // Unmap least recently used segments
+        while (storage.mapped >= STORAGE_MAX_MAPPED)
+            storage_segment_unmap(storage.lru_last);
+
+        map = mmap(NULL, segment->size, PROT_READ, MAP_SHARED, segment->fd, 0);
+        if (map == MAP_FAILED) {
+            pthread_mutex_unlock(&storage.lock);
+            return NULL;
+        }
+        segment->map = map;
+        segment->maplen = segment->size;
+        storage.mapped++;
+    } else if (segment != storage.lru_first) {
+        // Remove from current position in mapped list
+        segment->lru_prev->lru_next = segment->lru_next;
+        if (segment->lru_next) {
+            segment->lru_next->lru_prev = segment->lru_prev;
+        } else {
+            storage.lru_last = segment->lru_prev;
+        }
+    }
+
+    // Move segment to the start of mapped list
+    if (segment != storage.lru_first) {
+        segment->lru_prev = NULL;
+        segment->lru_next = storage.lru_first;
+        if (storage.lru_first) {
+            storage.lru_first->lru_prev = segment;
+        } else {
+            storage.lru_last = segment;
+        }
+        storage.lru_first = segment;
+    }
+
+    pthread_mutex_unlock(&storage.lock);
+    return segment->map + offset;
+}
+
+void
+storage_release(storage_segment_t *segment)
+{
+    pthread_mutex_lock(&storage.lock);
+    // Close the segment after its last frame, unless still being written
+    if (--segment->frames == 0 && segment != storage.current)
+        storage_segment_destroy(segment);
+    pthread_mutex_unlock(&storage.lock);
+}
@@ -0,0 +1,130 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file storage.h
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Functions to store captured frames data on disk
+ *
+ * When capture.storage is set to disk, frames data is appended to segment
+ * files instead of being kept in memory. Frames only keep the segment and
+ * offset where their data was written.
+ *
+ * Segment files are removed from the filesystem as soon as they are
+ * created, so they don't survive sngrep. Each segment counts its stored
+ * frames and it's closed when the last one is released.
+ *
+ * Stored data is read by mapping segments into memory. Only a limited
+ * number of segments are mapped at the same time, unmapping the least
+ * recently used ones when required.
+ *
+ */
+#ifndef __SNGREP_STORAGE_H
+#define __SNGREP_STORAGE_H
+
+#include "config.h"
+#include <stdint.h>
+#include <sys/types.h>
+
+//! Max size of each segment file
+#define STORAGE_SEGMENT_SIZE    (64 * 1024 * 1024)
+//! Max number of segments mapped at the same time
+#define STORAGE_MAX_MAPPED      8
+//! Segment file name template
+#define STORAGE_SEGMENT_TEMPLATE "sngrep-XXXXXX"
+
+//! Shorter declaration of storage_segment structure
+typedef struct storage_segment storage_segment_t;
+
+/**
+ * @brief Segment file storing frames data
+ */
+struct storage_segment {
+    //! Segment file descriptor
+    int fd;
+    //! Bytes written to the segment file
+    size_t size;
+    //! Number of frames stored in this segment
+    int frames;
+    //! Mapped segment data
+    u_char *map;
+    //! Bytes of the segment file currently mapped
+    size_t maplen;
+    //! Previous and next segments in mapped segments list
+    storage_segment_t *lru_prev, *lru_next;
+};
+
+/**
+ * @brief Initialize disk storage
+ *
+ * @param path Directory where segment files will be created
+ * @return 0 if directory can be used for storage, 1 otherwise
+ */
+int
+storage_init(const char *path);
+
+/**
+ * @brief Stop storing data on disk
+ *
+ * Segments still containing frames will be closed when their last
+ * frame is released.
+ */
+void
+storage_deinit();
+
+/**
+ * @brief Append frame data to current segment
+ *
+ * @param data Frame data
+ * @param len Frame data length
+ * @param offset Filled with the data position in the segment
+ * @return segment where data has been stored or NULL on error
+ */
+storage_segment_t *
+storage_write(const u_char *data, uint32_t len, off_t *offset);
+
+/**
+ * @brief Get frame data stored in a segment
+ *
+ * Returned pointer is valid until the next storage function call, as
+ * the segment can be unmapped to map a different one.
+ *
+ * @param segment Segment where data was stored
+ * @param offset Data position in the segment
+ * @param len Data length
+ * @return pointer to stored data or NULL on error
+ */
+const u_char *
+storage_read(storage_segment_t *segment, off_t offset, uint32_t len);
+
+/**
+ * @brief Release a frame stored in a segment
+ *
+ * The segment is closed and its disk space reclaimed after its last
+ * frame has been released.
+ *
+ * @param segment Segment where data was stored
+ */
+void
+storage_release(storage_segment_t *segment);
+
+#endif /* __SNGREP_STORAGE_H */
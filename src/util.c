@@ -196,6 +196,49 @@ timeval_to_delta(struct timeval start, struct timeval end, char *out)
     sprintf(out, "%c%d.%06d", sign, abs(nsec), nusec);
     return out;
 }
+
+int
+timeval_from_string(const char *str, struct timeval *time)
+{
+    struct tm tm;
+    char *end;
+    int len = 0, digits;
+    long usec = 0;
+    time_t sec;
+
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(str, "%4d%*1[-/]%2d%*1[-/]%2d%*1[ T]%2d:%2d:%2d%n",
+               &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &len) == 6 && len) {
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        tm.tm_isdst = -1;
+        if ((sec = mktime(&tm)) == -1)
+            return 1;
+        end = (char *) str + len;
+    } else {
+        if (!isdigit(*str))
+            return 1;
+        sec = strtol(str, &end, 10);
+    }
+
+    // Optional fractional seconds, up to microseconds
+    if (*end == '.') {
+        for (end++, digits = 0; isdigit(*end); end++, digits++) {
+            if (digits < 6)
+                usec = usec * 10 + (*end - '0');
+        }
+        for (; digits < 6; digits++)
+            usec *= 10;
+    }
+
+    if (*end != '\0')
+        return 1;
+
+    time->tv_sec = sec;
+    time->tv_usec = usec;
+    return 0;
+}
+
 char *
 strtrim(char *str)
 {
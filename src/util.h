@@ -99,6 +99,20 @@ timeval_to_duration(struct timeval start, struct timeval end, char *out);
 const char *
 timeval_to_delta(struct timeval start, struct timeval end, char *out);
 
+/**
+ * @brief Parse a timestamp given in command line
+ *
+ * Accepted formats are seconds since epoch or local date and time in
+ * yyyy/mm/dd HH:MM:SS format (or yyyy-mm-dd), both with optional
+ * fractional seconds.
+ *
+ * @param str Timestamp text
+ * @param time Filled with parsed timestamp
+ * @return 0 if timestamp is valid, 1 otherwise
+ */
+int
+timeval_from_string(const char *str, struct timeval *time);
+
 /**
  * @brief Return a given string without trailing spaces
  */
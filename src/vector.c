@@ -31,6 +31,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "util.h"
+#include "epoch.h"
+
+//! Mark of removed positions in lists of vectors read without capture lock
+static char vector_removed;
+#define VECTOR_REMOVED ((void *) &vector_removed)
 
 vector_t *
 vector_create(int limit, int step)
@@ -43,13 +48,181 @@ vector_create(int limit, int step)
     v->count = 0;
     v->limit = limit;
     v->step = step;
+    v->lockless = false;
+    v->removed = 0;
+    v->first = 0;
     v->list = NULL;
     v->sorter = NULL;
     v->destroyer = NULL;
+    v->position = NULL;
 
     return v;
 }
 
+/**
+ * @brief Allocate an empty list for the vector
+ *
+ * Lists of vectors read without capture lock have an extra empty position,
+ * so readers can walk a list until its first empty position.
+ */
+static void **
+vector_list_create(vector_t *vector, uint32_t limit)
+{
+    return calloc(limit + vector->lockless, sizeof(void *));
+}
+
+/**
+ * @brief Replace the list of a vector read without capture lock
+ *
+ * Published lists are never modified again, other than appending items in
+ * their empty positions and marking removed positions.
+ *
+ * @return replaced list, to be retired by the caller
+ */
+static void **
+vector_list_publish(vector_t *vector, void **list, uint32_t limit, uint32_t count)
+{
+    void **old = vector->list;
+
+    __atomic_store_n(&vector->list, list, __ATOMIC_RELEASE);
+    __atomic_store_n(&vector->count, count, __ATOMIC_RELEASE);
+    vector->limit = limit;
+    return old;
+}
+
+/**
+ * @brief Release a replaced list once no reader can be using it
+ */
+static void
+vector_list_retire(void **list, uint32_t limit)
+{
+    if (list)
+        epoch_retire(list, free, sizeof(void *) * (limit + 1));
+}
+
+/**
+ * @brief Store the position of an item of a vector read without capture lock
+ */
+static void
+vector_position_set(vector_t *vector, void *item, int pos)
+{
+    if (vector->lockless && vector->position)
+        *vector->position(item) = pos;
+}
+
+/**
+ * @brief Copy the items of a vector read without capture lock to a new list
+ *
+ * Removed positions are not copied.
+ *
+ * @param item Item to move to the given position, if any
+ * @param count Filled with the number of items in the returned list
+ */
+static void **
+vector_list_compact(vector_t *vector, uint32_t limit, void *item, uint32_t pos, uint32_t *count)
+{
+    void **list = vector_list_create(vector, limit);
+    uint32_t i;
+
+    for (*count = 0, i = 0; i < vector->count; i++) {
+        if (item && i == pos)
+            list[(*count)++] = item;
+        if (vector->list[i] != VECTOR_REMOVED && vector->list[i] != item)
+            list[(*count)++] = vector->list[i];
+    }
+    return list;
+}
+
+/**
+ * @brief Replace the list of a vector read without capture lock with a
+ * list without removed positions
+ */
+static void
+vector_list_replace(vector_t *vector, void **list, uint32_t limit, uint32_t count)
+{
+    uint32_t old_limit = vector->limit, i;
+
+    for (i = 0; i < count; i++)
+        vector_position_set(vector, list[i], i);
+
+    // Removed positions are gone before readers can count the new list items
+    vector->removed = 0;
+    vector->first = 0;
+    vector_list_retire(vector_list_publish(vector, list, limit, count), old_limit);
+}
+
+/**
+ * @brief Remove the item in a position of a vector read without capture lock
+ *
+ * The position is marked as removed, so readers skip it. The list is only
+ * replaced when most of its positions have been removed, so each removal
+ * costs the same whatever the vector size.
+ */
+static void
+vector_list_remove(vector_t *vector, uint32_t pos)
+{
+    void **list;
+    uint32_t count;
+
+    vector_position_set(vector, vector->list[pos], -1);
+    __atomic_store_n(&vector->list[pos], VECTOR_REMOVED, __ATOMIC_RELEASE);
+    vector->removed++;
+
+    // Removed positions at the end of the list can be used again
+    while (vector->count && vector->list[vector->count - 1] == VECTOR_REMOVED) {
+        __atomic_store_n(&vector->list[vector->count - 1], NULL, __ATOMIC_RELEASE);
+        vector->removed--;
+        __atomic_store_n(&vector->count, vector->count - 1, __ATOMIC_RELEASE);
+    }
+
+    // Skip removed positions at the start of the list
+    if (vector->first > vector->count)
+        vector->first = vector->count;
+    while (vector->first < vector->count && vector->list[vector->first] == VECTOR_REMOVED)
+        vector->first++;
+
+    // Replace the list once most of its positions have been removed
+    if (vector->removed * 2 > vector->count) {
+        list = vector_list_compact(vector, vector->limit, NULL, 0, &count);
+        vector_list_replace(vector, list, vector->limit, count);
+    }
+}
+
+/**
+ * @brief Get the current list of a vector read without capture lock
+ *
+ * Removed positions of the list must be skipped by the caller.
+ *
+ * @param count Filled with the number of positions in the returned list
+ */
+static void **
+vector_list_snapshot(vector_t *vector, uint32_t *count)
+{
+    void **list;
+
+    if (!vector->lockless) {
+        *count = vector->count;
+        return vector->list;
+    }
+
+    // Items are added to the list before the count is updated
+    list = __atomic_load_n(&vector->list, __ATOMIC_ACQUIRE);
+    for (*count = 0; list && list[*count]; (*count)++);
+    return list;
+}
+
+void
+vector_set_lockless(vector_t *vector)
+{
+    vector->lockless = true;
+}
+
+void
+vector_set_position(vector_t *vector, int *(*position) (void *item))
+{
+    vector->position = position;
+}
+
 void
 vector_destroy(vector_t *vector)
 {
@@ -81,12 +254,29 @@ vector_destroy_items(vector_t *vector)
     free(vector);
 }
 
+/**
+ * @brief Free a retired vector
+ */
+static void
+vector_release(void *vector)
+{
+    sng_free(((vector_t *) vector)->list);
+    sng_free(vector);
+}
+
+void
+vector_retire(vector_t *vector)
+{
+    if (vector)
+        epoch_retire(vector, vector_release, sizeof(vector_t) + sizeof(void *) * (vector->limit + 1));
+}
+
 vector_t *
 vector_clone(vector_t *original)
 {
     vector_t *clone;
-    vector_iter_t it;
-    void *item;
+    void **list;
+    uint32_t count, i;
 
     // Check we have a valid vector pointer
     if (!original)
@@ -98,9 +288,11 @@ vector_clone(vector_t *original)
     vector_set_sorter(clone, original->sorter);
 
     // Fill the clone vector with the same elements
-    it = vector_iterator(original);
-    while ((item = vector_iterator_next(&it)))
-        vector_append(clone, item);
+    list = vector_list_snapshot(original, &count);
+    for (i = 0; i < count; i++) {
+        if (list[i] != VECTOR_REMOVED)
+            vector_append(clone, list[i]);
+    }
 
     // Return the cloned vector
     return clone;
@@ -110,8 +302,8 @@ vector_t *
 vector_copy_if(vector_t *original, int (*filter)(void *item))
 {
     vector_t *clone;
-    vector_iter_t it;
-    void *item;
+    void **list;
+    uint32_t count, i;
 
     // Check we have a valid vector pointer
     if (!original)
@@ -120,10 +312,10 @@ vector_copy_if(vector_t *original, int (*filter)(void *item))
     // Create a new vector structure
     clone = vector_create(0, 1);
     // Fill the clone vector with the same elements applying filter
-    it = vector_iterator(original);
-    vector_iterator_set_filter(&it, filter);
-    while ((item = vector_iterator_next(&it))) {
-        vector_append(clone, item);
+    list = vector_list_snapshot(original, &count);
+    for (i = 0; i < count; i++) {
+        if (list[i] != VECTOR_REMOVED && (!filter || filter(list[i])))
+            vector_append(clone, list[i]);
     }
     // Return the cloned vector
     return clone;
@@ -132,9 +324,32 @@ vector_copy_if(vector_t *original, int (*filter)(void *item))
 void
 vector_clear(vector_t *vector)
 {
+    int i, count = vector->count;
+    uint32_t limit = vector->limit;
+    void **old;
+
+    // Replace the list before destroying its items
+    if (vector->lockless && vector->list) {
+        vector->removed = 0;
+        vector->first = 0;
+        old = vector_list_publish(vector, vector_list_create(vector, limit), limit, 0);
+        for (i = 0; i < count; i++) {
+            if (vector->destroyer && old[i] != VECTOR_REMOVED)
+                vector->destroyer(old[i]);
+        }
+        vector_list_retire(old, limit);
+        return;
+    }
+
+    // Empty the vector before destroying its items
+    vector->count = 0;
+
     // Remove all items in the vector
-    while (vector_first(vector))
-        vector_remove(vector, vector_first(vector));
+    for (i = 0; i < count; i++) {
+        if (vector->destroyer)
+            vector->destroyer(vector->list[i]);
+        vector->list[i] = NULL;
+    }
 }
 
 int
@@ -146,22 +361,34 @@ vector_append(vector_t *vector, void *item)
 
     // Check if the vector has been initializated
     if (!vector->list) {
-        vector->list = malloc(sizeof(void *) * vector->limit);
-        memset(vector->list, 0, sizeof(void *) * vector->limit);
+        vector->list = vector_list_create(vector, vector->limit);
     }
 
     // Check if we need to increase vector size
     if (vector->count == vector->limit) {
-        // Increase vector size
-        vector->limit += vector->step;
-        // Add more memory to the list
-        vector->list = realloc(vector->list, sizeof(void *) * vector->limit);
-        // Initialize new allocated memory
-        memset(vector->list + vector->limit - vector->step, 0, vector->step);
+        // Grow at least as much as the vector size, so copying the items
+        // doesn't get more expensive as the vector grows
+        int step = (vector->limit > vector->step) ? vector->limit : vector->step;
+        if (vector->lockless) {
+            // Copy items to a bigger list. The old list can still be in use by
+            // threads reading without capture lock, so release it after them
+            uint32_t count;
+            void **list = vector_list_compact(vector, vector->limit + step, NULL, 0, &count);
+            vector_list_replace(vector, list, vector->limit + step, count);
+        } else {
+            // Add more memory to the list
+            vector->list = realloc(vector->list, sizeof(void *) * (vector->limit + step));
+            // Initialize new allocated memory
+            memset(vector->list + vector->limit, 0, sizeof(void *) * step);
+            // Increase vector size
+            vector->limit += step;
+        }
     }
 
     // Add item to the end of the list
-    vector->list[vector->count++] = item;
+    vector->list[vector->count] = item;
+    vector_position_set(vector, item, vector->count);
+    __atomic_store_n(&vector->count, vector->count + 1, __ATOMIC_RELEASE);
 
     // Check if vector has a sorter
     if (vector->sorter) {
@@ -199,6 +426,31 @@ vector_insert(vector_t *vector, void *item, int pos)
     if (vector->list[pos] == item)
         return vector->count;
 
+    if (vector->lockless) {
+        uint32_t count;
+        void **list;
+
+        // Use a removed position next to the item position
+        if (pos > 0 && vector->list[pos] != VECTOR_REMOVED && vector->list[pos - 1] == VECTOR_REMOVED)
+            pos--;
+        if (vector->list[pos] == VECTOR_REMOVED) {
+            // Readers may miss the item while it's moved, but never find it twice
+            __atomic_store_n(&vector->list[vector->count - 1], NULL, __ATOMIC_RELEASE);
+            vector->removed--;
+            __atomic_store_n(&vector->count, vector->count - 1, __ATOMIC_RELEASE);
+            __atomic_store_n(&vector->list[pos], item, __ATOMIC_RELEASE);
+            vector_position_set(vector, item, pos);
+            if (vector->first > pos)
+                vector->first = pos;
+            return vector->count;
+        }
+
+        // Build a new list with the item in its position
+        list = vector_list_compact(vector, vector->limit, item, pos, &count);
+        vector_list_replace(vector, list, vector->limit, count);
+        return vector->count;
+    }
+
     // If possition is occupied, move the other position
     if (vector->list[pos]) {
         memmove(vector->list + pos + 1, vector->list + pos,
@@ -220,6 +472,14 @@ vector_remove(vector_t *vector, void *item)
     if (idx == -1)
         return;
 
+    // Mark the item position as removed, destroying it once readers skip it
+    if (vector->lockless) {
+        vector_list_remove(vector, idx);
+        if (vector->destroyer)
+            vector->destroyer(item);
+        return;
+    }
+
     // Decrease item counter
     vector->count--;
     // Move the rest of the elements one position up
@@ -245,6 +505,47 @@ vector_set_sorter(vector_t *vector, void (*sorter) (vector_t *vector, void *item
     vector->sorter = sorter;
 }
 
+void
+vector_sort(vector_t *vector, int (*cmp) (const void *one, const void *two))
+{
+    uint32_t count;
+    void **list;
+
+    if (!vector || vector->count <= 1)
+        return;
+
+    // Sort a copy of the list and replace the current one
+    if (vector->lockless) {
+        list = vector_list_compact(vector, vector->limit, NULL, 0, &count);
+        qsort(list, count, sizeof(void *), cmp);
+        vector_list_replace(vector, list, vector->limit, count);
+        return;
+    }
+
+    qsort(vector->list, vector->count, sizeof(void *), cmp);
+}
+
+int
+vector_sorted_position(vector_t *vector, void *item, int (*cmp) (const void *one, const void *two))
+{
+    uint32_t low = vector->first, high = vector->count, mid, cur;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        // Compare with the first item from the middle position
+        for (cur = mid; cur < high; cur++) {
+            if (vector->list[cur] != VECTOR_REMOVED && vector->list[cur] != item)
+                break;
+        }
+        if (cur < high && cmp(&vector->list[cur], &item) < 0) {
+            low = cur + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
 void
 vector_generic_destroyer(void *item)
 {
@@ -254,9 +555,12 @@ vector_generic_destroyer(void *item)
 void *
 vector_item(vector_t *vector, int index)
 {
+    void *item;
+
     if (!vector || index >= vector->count || index < 0)
         return NULL;
-    return vector->list[index];
+    item = vector->list[index];
+    return (item == VECTOR_REMOVED) ? NULL : item;
 }
 
 void
@@ -270,20 +574,30 @@ vector_set_item(vector_t *vector, int index, void *item)
 void *
 vector_first(vector_t *vector)
 {
-    return vector_item(vector, 0);
+    vector_iter_t it = vector_iterator(vector);
+    return vector_iterator_next(&it);
 }
 
 void *
 vector_last(vector_t *vector)
 {
-    return vector_item(vector, vector_count(vector) - 1);
+    vector_iter_t it = vector_iterator(vector);
+    vector_iterator_set_last(&it);
+    return vector_iterator_prev(&it);
 }
 
 int
 vector_index(vector_t *vector, void *item)
 {
-    // FIXME Bad perfomance
     int i;
+
+    // Items store their position in vectors read without capture lock
+    if (vector->lockless && vector->position) {
+        i = *vector->position(item);
+        return (i >= 0 && i < vector->count && vector->list[i] == item) ? i : -1;
+    }
+
+    // FIXME Bad perfomance
     for (i = 0; i < vector->count; i++) {
         if (vector->list[i] == item)
             return i;
@@ -294,7 +608,15 @@ vector_index(vector_t *vector, void *item)
 int
 vector_count(vector_t *vector)
 {
-    return (vector) ? vector->count : 0;
+    uint32_t count, removed;
+
+    if (!vector)
+        return 0;
+
+    // Removed positions are not items
+    count = __atomic_load_n(&vector->count, __ATOMIC_ACQUIRE);
+    removed = vector->removed;
+    return (count > removed) ? count - removed : 0;
 }
 
 vector_iter_t
@@ -339,10 +661,17 @@ vector_iterator_next(vector_iter_t *it)
 {
     void *item;
 
-    if (!it || it->current >= vector_count(it->vector))
+    if (!it || !it->vector)
         return NULL;
 
-    while ((item = vector_item(it->vector, ++it->current))) {
+    // Positions before the first item have been removed
+    if (it->current < (int) it->vector->first)
+        it->current = it->vector->first - 1;
+
+    while (it->current < (int) it->vector->count) {
+        // Skip removed positions
+        if (!(item = vector_item(it->vector, ++it->current)))
+            continue;
         if (it->filter) {
             if (it->filter(item)) {
                 return item;
@@ -359,10 +688,13 @@ vector_iterator_prev(vector_iter_t *it)
 {
     void *item;
 
-    if (it->current == -1)
+    if (!it->vector)
         return NULL;
 
-    while ((item = vector_item(it->vector, --it->current))) {
+    while (it->current > -1) {
+        // Skip removed positions
+        if (!(item = vector_item(it->vector, --it->current)))
+            continue;
         if (it->filter) {
             if (it->filter(item)) {
                 return item;
@@ -390,7 +722,7 @@ vector_iterator_set_current(vector_iter_t *it, int current)
 void
 vector_iterator_set_last(vector_iter_t *it)
 {
-    it->current = vector_count(it->vector);
+    it->current = (it->vector) ? it->vector->count : 0;
 }
 
 int
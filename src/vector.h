@@ -33,6 +33,7 @@
 
 #include "config.h"
 #include <stdint.h>
+#include <stdbool.h>
 
 //! Shorter declaration of vector structure
 typedef struct vector vector_t;
@@ -49,12 +50,20 @@ struct vector {
     uint32_t limit;
     //! Number of new spaces to be reallocated
     uint8_t step;
+    //! List can be read without capture lock
+    bool lockless;
+    //! Number of removed positions in list (lockless vectors)
+    uint32_t removed;
+    //! Position of the first item, previous positions have been removed
+    uint32_t first;
     //! Elements of the vector
     void **list;
     //! Function to destroy one item
     void (*destroyer) (void *item);
     //! Function to sort each appended/inserted item
     void (*sorter) (vector_t *vector, void *item);
+    //! Function to get where each item stores its position (lockless vectors)
+    int *(*position) (void *item);
 };
 
 struct vector_iter {
@@ -77,6 +86,30 @@ struct vector_iter {
 vector_t *
 vector_create(int limit, int step);
 
+/**
+ * @brief Allow reading the vector without capture lock
+ *
+ * Items of these vectors are never moved in place. Removed items leave
+ * their position marked as removed, and readers skip it. Once more than
+ * half of the positions have been removed, or a change requires moving
+ * items, a new list is built and replaces the current one, which is
+ * released once no reader can be using it.
+ *
+ * Must be called before adding any item.
+ */
+void
+vector_set_lockless(vector_t *vector);
+
+/**
+ * @brief Set where vector items store their position
+ *
+ * Vectors read without capture lock keep each item position updated
+ * using this function, so items can be found and removed at once.
+ * Each vector must use its own position in the item.
+ */
+void
+vector_set_position(vector_t *vector, int *(*position) (void *item));
+
 /**
  * @brief Free vector memory
  */
@@ -89,6 +122,14 @@ vector_destroy(vector_t *vector);
 void
 vector_destroy_items(vector_t *vector);
 
+/**
+ * @brief Free vector memory once no reader can be using it
+ *
+ * Vector items are not destroyed.
+ */
+void
+vector_retire(vector_t *vector);
+
 /**
  * @brief Clone a vector container
  *
@@ -170,6 +211,26 @@ vector_set_destroyer(vector_t *vector, void (*destroyer) (void *item));
 void
 vector_set_sorter(vector_t *vector, void (*sorter) (vector_t *vector, void *item));
 
+/**
+ * @brief Sort all vector items at once
+ *
+ * The compare function receives pointers to two vector items,
+ * as qsort does.
+ */
+void
+vector_sort(vector_t *vector, int (*cmp) (const void *one, const void *two));
+
+/**
+ * @brief Get the position of an item in a sorted vector
+ *
+ * The compare function receives pointers to two vector items,
+ * as qsort does. The item itself is ignored if already in vector.
+ *
+ * @return position after the last item lower than the given one
+ */
+int
+vector_sorted_position(vector_t *vector, void *item, int (*cmp) (const void *one, const void *two));
+
 /**
  * @brief A generic item destroyer
  *
@@ -183,7 +244,8 @@ vector_generic_destroyer(void *item);
  * @brief Get an item from vector
  *
  * Return the item at given index, or NULL
- * if index is out of the vector bounds
+ * if index is out of the vector bounds or
+ * its item has been removed
  *
  */
 void *
@@ -0,0 +1,330 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file bench_search.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Payload filter matching benchmark
+ *
+ * Store a set of generated SIP messages and check a list of filter
+ * expressions against all of them:
+ *
+ *  - Copying each payload and running the regular expression like payload
+ *    filters used to do: Perl compatible expressions are not JIT compiled
+ *    and PCRE2 match data is allocated for each match.
+ *  - Running expressions compiled with regexp.h on stored payloads, with
+ *    JIT and per thread match data.
+ *  - Using the literal prefilter from search.h before regexp.h.
+ *
+ * All methods must find the same matching messages, otherwise the
+ * benchmark fails.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <time.h>
+#ifdef WITH_PCRE
+#include <pcre.h>
+#elif defined(WITH_PCRE2)
+#include <pcre2.h>
+#else
+#include <regex.h>
+#endif
+#include "../src/regexp.h"
+#include "../src/search.h"
+
+//! Payload copy buffer size, same as MAX_SIP_PAYLOAD
+#define BENCH_COPY_LEN      10240
+//! Max generated message size
+#define BENCH_MAX_MSG       2048
+
+//! Expressions checked when none are given
+static const char *bench_default_exprs[] = {
+    "600123456",
+    "pbx7\\.example\\.com",
+    "alice|bob",
+    "INVITE sip:",
+    "Call-ID: 00a1",
+    "c=IN IP4 10\\.1\\.[0-9]+\\.[0-9]+",
+    "[0-9]{9}@",
+    NULL
+};
+
+//! Display names of generated users
+static const char *bench_names[] = {
+    "Alice", "Bob", "Carol", "Dave", "Erin", "Frank", "Grace", "Heidi",
+    "Ivan", "Judy", "Mallory", "Niaj", "Olivia", "Peggy", "Rupert", "Sybil"
+};
+
+/**
+ * @brief Expression compiled like filters used to do
+ */
+struct bench_regex {
+#ifdef WITH_PCRE
+    pcre *regex;
+#elif defined(WITH_PCRE2)
+    pcre2_code *regex;
+#else
+    regex_t regex;
+#endif
+};
+
+//! PRNG state
+static uint64_t bench_seed = 1;
+
+/**
+ * @brief xorshift64 PRNG, same output for the same seed
+ */
+static uint32_t
+bench_rand()
+{
+    bench_seed ^= bench_seed << 13;
+    bench_seed ^= bench_seed >> 7;
+    bench_seed ^= bench_seed << 17;
+    return (uint32_t) (bench_seed >> 16);
+}
+
+/**
+ * @brief Milliseconds elapsed since the given time
+ */
+static double
+bench_elapsed(struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/**
+ * @brief Write a SIP message with random users, domains and Call-ID
+ *
+ * @return message length
+ */
+static int
+bench_message(char *msg)
+{
+    const char *methods[] = { "INVITE", "ACK", "BYE", "REGISTER", "OPTIONS" };
+    const char *method = methods[bench_rand() % 5];
+    uint32_t from = 600000000 + bench_rand() % 1000000, to = 600000000 + bench_rand() % 1000000;
+    uint32_t domain = bench_rand() % 50, callid = bench_rand(), cseq = bench_rand() % 100;
+    const char *name = bench_names[bench_rand() % 16];
+    int len, sdp = !strcmp(method, "INVITE");
+    char body[512] = "";
+
+    if (sdp) {
+        snprintf(body, sizeof(body),
+                 "v=0\r\no=- %u %u IN IP4 10.1.%u.%u\r\ns=-\r\nc=IN IP4 10.1.%u.%u\r\nt=0 0\r\n"
+                 "m=audio %u RTP/AVP 0 8 101\r\na=rtpmap:0 PCMU/8000\r\na=rtpmap:8 PCMA/8000\r\n"
+                 "a=rtpmap:101 telephone-event/8000\r\na=sendrecv\r\n",
+                 callid, cseq, domain, from % 250, domain, from % 250, 10000 + (from % 20000) * 2);
+    }
+
+    // Half of the responses
+    if (bench_rand() % 2) {
+        len = snprintf(msg, BENCH_MAX_MSG, "SIP/2.0 200 OK\r\n");
+    } else {
+        len = snprintf(msg, BENCH_MAX_MSG, "%s sip:%u@pbx%u.example.com SIP/2.0\r\n", method, to, domain);
+    }
+
+    len += snprintf(msg + len, BENCH_MAX_MSG - len,
+                    "Via: SIP/2.0/UDP 10.2.%u.%u:5060;branch=z9hG4bK%08x\r\n"
+                    "Max-Forwards: 70\r\n"
+                    "From: \"%s\" <sip:%u@pbx%u.example.com>;tag=%08x\r\n"
+                    "To: <sip:%u@pbx%u.example.com>\r\n"
+                    "Call-ID: %08x@10.2.%u.%u\r\n"
+                    "CSeq: %u %s\r\n"
+                    "Contact: <sip:%u@10.2.%u.%u:5060>\r\n"
+                    "User-Agent: bench-search\r\n"
+                    "Content-Type: application/sdp\r\n"
+                    "Content-Length: %zu\r\n\r\n%s",
+                    domain, from % 250, bench_rand(), name, from, domain, bench_rand(), to, domain,
+                    callid, domain, from % 250, cseq, method, from, domain, from % 250, strlen(body), body);
+    return len;
+}
+
+static int
+bench_compile(struct bench_regex *re, const char *expr)
+{
+#ifdef WITH_PCRE
+    const char *re_err = NULL;
+    int32_t err_offset;
+    return !(re->regex = pcre_compile(expr, PCRE_UNGREEDY | PCRE_CASELESS, &re_err, &err_offset, 0));
+#elif defined(WITH_PCRE2)
+    int re_err = 0;
+    PCRE2_SIZE err_offset = 0;
+    return !(re->regex = pcre2_compile((PCRE2_SPTR) expr, PCRE2_ZERO_TERMINATED, PCRE2_UNGREEDY | PCRE2_CASELESS,
+                                       &re_err, &err_offset, NULL));
+#else
+    return regcomp(&re->regex, expr, REG_EXTENDED | REG_ICASE) != 0;
+#endif
+}
+
+static bool
+bench_match(struct bench_regex *re, const char *data, size_t len)
+{
+#ifdef WITH_PCRE
+    return pcre_exec(re->regex, 0, data, len, 0, 0, 0, 0) >= 0;
+#elif defined(WITH_PCRE2)
+    pcre2_match_data *match_data = pcre2_match_data_create_from_pattern(re->regex, NULL);
+    int ret = pcre2_match(re->regex, (PCRE2_SPTR) data, len, 0, 0, match_data, NULL);
+    pcre2_match_data_free(match_data);
+    return ret >= 0;
+#else
+    (void) len;
+    return regexec(&re->regex, data, 0, NULL, 0) == 0;
+#endif
+}
+
+static void
+bench_free(struct bench_regex *re)
+{
+#ifdef WITH_PCRE
+    pcre_free(re->regex);
+#elif defined(WITH_PCRE2)
+    pcre2_code_free(re->regex);
+#else
+    regfree(&re->regex);
+#endif
+}
+
+void
+usage()
+{
+    printf("Usage: bench-search [options] [expression ...]\n\n"
+           "    -h --help\t\t This usage\n"
+           "    -n --messages\t Number of stored messages (default: 1000000)\n"
+           "    -s --seed\t\t PRNG seed (default: 1)\n"
+           "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char **exprs = bench_default_exprs;
+    char **messages, *copy, msg[BENCH_MAX_MSG];
+    size_t count = 1000000, i, len, bytes = 0, legacy_match, regexp_match_count, search_match, candidates;
+    struct bench_regex legacy;
+    regexp_t re;
+    struct timespec start;
+    double legacy_time, regexp_time, search_time;
+    search_t search;
+    int opt, idx, e, failed = 0;
+
+    struct option long_options[] = {
+        { "help", no_argument, 0, 'h' },
+        { "messages", required_argument, 0, 'n' },
+        { "seed", required_argument, 0, 's' },
+        { 0, 0, 0, 0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "hn:s:", long_options, &idx)) != -1) {
+        switch (opt) {
+            case 'n':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                bench_seed = strtoull(optarg, NULL, 10) | 1;
+                break;
+            default:
+                usage();
+                return (opt == 'h') ? 0 : 1;
+        }
+    }
+
+    if (optind < argc)
+        exprs = (const char **) argv + optind;
+
+    // Store messages the way captured payloads are stored
+    if (!(messages = malloc(count * sizeof(char *))) || !(copy = malloc(BENCH_COPY_LEN))) {
+        fprintf(stderr, "Can't allocate memory for messages!\n");
+        return 1;
+    }
+    for (i = 0; i < count; i++) {
+        len = bench_message(msg);
+        if (!(messages[i] = malloc(len + 1))) {
+            fprintf(stderr, "Can't allocate memory for messages!\n");
+            return 1;
+        }
+        memcpy(messages[i], msg, len + 1);
+        bytes += len;
+    }
+
+    printf("%zu messages, %zu MB\n\n", count, bytes >> 20);
+    printf("%-36s %8s %10s %10s %10s %10s %8s\n", "Expression", "Literals", "Matches",
+           "Legacy ms", "Regexp ms", "Search ms", "Speedup");
+
+    for (e = 0; exprs[e]; e++) {
+        if (bench_compile(&legacy, exprs[e]) != 0 || regexp_compile(&re, exprs[e], REGEXP_CASELESS) != 0) {
+            fprintf(stderr, "Invalid expression %s\n", exprs[e]);
+            return 1;
+        }
+        search_compile(&search, exprs[e], true);
+
+        // Copy each payload and run the regular expression
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0, legacy_match = 0; i < count; i++) {
+            strncpy(copy, messages[i], BENCH_COPY_LEN - 1);
+            copy[BENCH_COPY_LEN - 1] = '\0';
+            legacy_match += bench_match(&legacy, copy, strlen(copy));
+        }
+        legacy_time = bench_elapsed(&start);
+
+        // Run the compiled expression on stored payloads
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0, regexp_match_count = 0; i < count; i++) {
+            regexp_match_count += regexp_match(&re, messages[i], strlen(messages[i]));
+        }
+        regexp_time = bench_elapsed(&start);
+
+        // Run the compiled expression only on payloads with literals
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0, search_match = 0, candidates = 0; i < count; i++) {
+            len = strlen(messages[i]);
+            if (search_candidate(&search, messages[i], len)) {
+                candidates++;
+                search_match += regexp_match(&re, messages[i], len);
+            }
+        }
+        search_time = bench_elapsed(&start);
+
+        printf("%-36s %8d %10zu %10.1f %10.1f %10.1f %7.1fx\n", exprs[e], search.count, search_match,
+               legacy_time, regexp_time, search_time, legacy_time / search_time);
+
+        if (legacy_match != regexp_match_count || legacy_match != search_match) {
+            fprintf(stderr, "%s: %zu legacy matches, %zu with regexp, %zu with search (%zu candidates)\n",
+                    exprs[e], legacy_match, regexp_match_count, search_match, candidates);
+            failed = 1;
+        }
+        bench_free(&legacy);
+        regexp_free(&re);
+    }
+
+    for (i = 0; i < count; i++)
+        free(messages[i]);
+    free(messages);
+    free(copy);
+    return failed;
+}
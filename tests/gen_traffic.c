@@ -0,0 +1,1249 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file gen_traffic.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * @brief Synthetic SIP and RTP traffic generator
+ *
+ * Write a pcap file with generated SIP dialogs (INVITE/180/200/ACK/BYE with
+ * SDP, optional re-INVITEs and rejected calls), REGISTER transactions and
+ * 20ms RTP streams for each call leg. SIP can be sent over UDP, fragmented
+ * UDP, TCP or WebSocket.
+ *
+ * Generated packets are stored in packet_t/frame_t structures and written
+ * frame by frame, the same way capture dump_packet() does. The output only
+ * depends on the given parameters and seed, so the same command line always
+ * produces the same file.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include "../src/packet.h"
+#include "../src/util.h"
+
+//! Ethernet + IPv4 + TCP headers
+#define GEN_ETH_LEN     14
+#define GEN_IP_LEN      20
+#define GEN_UDP_LEN     8
+#define GEN_TCP_LEN     20
+//! Max generated frame size
+#define GEN_MAX_FRAME   65535
+//! Max SIP payload size (including SDP)
+#define GEN_MAX_SIP     4096
+//! RTP packetization time (microseconds)
+#define GEN_PTIME       20000
+//! Registrar address 10.0.0.1
+#define GEN_REGISTRAR   0x0A000001
+
+//! Shorter declaration of generator structures
+typedef struct gen_codec gen_codec_t;
+typedef struct gen_config gen_config_t;
+typedef struct gen_dialog gen_dialog_t;
+typedef struct gen_event gen_event_t;
+
+/**
+ * @brief Transports used for SIP messages
+ */
+enum gen_transport {
+    GEN_TRANSPORT_UDP = 0,
+    GEN_TRANSPORT_FRAG,
+    GEN_TRANSPORT_TCP,
+    GEN_TRANSPORT_WS,
+    GEN_TRANSPORT_COUNT
+};
+
+/**
+ * @brief Dialog state machine steps
+ */
+enum gen_state {
+    GEN_INVITE = 0,
+    GEN_RINGING,
+    GEN_ANSWER,
+    GEN_ACK,
+    GEN_REJECT,
+    GEN_REJECT_ACK,
+    GEN_REINVITE,
+    GEN_REINVITE_OK,
+    GEN_REINVITE_ACK,
+    GEN_BYE,
+    GEN_BYE_OK,
+    GEN_REGISTER,
+    GEN_REGISTER_401,
+    GEN_REGISTER_AUTH,
+    GEN_REGISTER_OK,
+    GEN_DONE
+};
+
+/**
+ * @brief Heap event types
+ */
+enum gen_event_type {
+    GEN_EVENT_DIALOG = 0,
+    GEN_EVENT_CALL_SPAWN,
+    GEN_EVENT_REG_SPAWN,
+};
+
+/**
+ * @brief Audio codec description
+ */
+struct gen_codec {
+    //! Name used in codec mix parameter
+    const char *name;
+    //! RTP payload type
+    uint8_t pt;
+    //! SDP rtpmap encoding
+    const char *rtpmap;
+    //! RTP timestamp increment for each packet
+    uint32_t step;
+    //! RTP payload size for each packet
+    uint16_t size;
+    //! Payload filler byte (silence)
+    u_char fill;
+};
+
+/**
+ * @brief Generator parameters
+ */
+struct gen_config {
+    //! Output pcap file
+    const char *outfile;
+    //! PRNG seed
+    uint64_t seed;
+    //! New calls per second
+    double cps;
+    //! Seconds generating new calls and registers
+    double duration;
+    //! Mean call hold time in seconds
+    double hold;
+    //! REGISTER transactions per second
+    double rps;
+    //! Percentage of calls with a re-INVITE
+    double reinvite;
+    //! Percentage of calls rejected with 486
+    double busy;
+    //! Percentage of RTP packets lost
+    double loss;
+    //! Max RTP jitter in microseconds
+    uint32_t jitter;
+    //! Number of different user agents on each side
+    uint32_t users;
+    //! Max IP fragment size for fragmented UDP
+    uint32_t mtu;
+    //! Generate RTP packets
+    bool rtp;
+    //! First packet timestamp
+    uint64_t start;
+    //! Codec mix weights
+    uint32_t codec_weight[8];
+    //! Transport mix weights
+    uint32_t transport_weight[GEN_TRANSPORT_COUNT];
+};
+
+/**
+ * @brief Generated dialog (call or registration)
+ */
+struct gen_dialog {
+    //! Dialog number
+    uint32_t id;
+    //! Current state
+    enum gen_state state;
+    //! SIP transport
+    enum gen_transport transport;
+    //! Audio codec index
+    int codec;
+    //! Call-ID header value
+    char callid[48];
+    //! From and To tags
+    char tag[2][16];
+    //! Current transaction branch
+    uint32_t branch;
+    //! Current transaction direction (0: caller, 1: callee)
+    int txdir;
+    //! Current transaction CSeq number and method
+    uint32_t cseq;
+    const char *method;
+    //! Caller and callee users
+    char user[2][16];
+    //! Caller and callee addresses (host order)
+    uint32_t ip[2];
+    //! Caller and callee SIP ports
+    uint16_t port[2];
+    //! Caller and callee RTP ports
+    uint16_t rtp_port[2];
+    //! TCP sequence numbers in each direction
+    uint32_t tcp_seq[2];
+    //! SDP session version in each side
+    uint32_t sdp_version[2];
+    //! RTP sequence, timestamp and SSRC of each leg
+    uint16_t rtp_seq[2];
+    uint32_t rtp_ts[2];
+    uint32_t rtp_ssrc[2];
+    //! Next RTP leg to be sent
+    int rtp_leg;
+    //! RTP is flowing
+    bool rtp_active;
+    //! Nominal time of the next RTP tick
+    uint64_t rtp_tick;
+    //! Time of the next RTP packet
+    uint64_t rtp_next;
+    //! Time of the next SIP message
+    uint64_t sip_next;
+    //! Time to send the BYE
+    uint64_t hold_end;
+    //! This call will be re-INVITEd
+    bool reinvite;
+};
+
+/**
+ * @brief Event in the timeline heap
+ */
+struct gen_event {
+    //! Event timestamp (microseconds)
+    uint64_t time;
+    //! Insertion order, to break ties deterministically
+    uint64_t order;
+    //! Event type
+    enum gen_event_type type;
+    //! Dialog for dialog events
+    gen_dialog_t *dialog;
+};
+
+//! Available codecs
+static gen_codec_t gen_codecs[] = {
+    { "pcmu",  0,   "PCMU/8000",    160, 160, 0xff },
+    { "pcma",  8,   "PCMA/8000",    160, 160, 0xd5 },
+    { "g722",  9,   "G722/8000",    160, 160, 0x00 },
+    { "g729",  18,  "G729/8000",    160, 20,  0x00 },
+    { "opus",  111, "opus/48000/2", 960, 80,  0x00 },
+};
+#define GEN_CODEC_COUNT (int)(sizeof(gen_codecs) / sizeof(gen_codecs[0]))
+
+//! Transport names used in transport mix parameter
+static const char *gen_transport_names[GEN_TRANSPORT_COUNT] = {
+    "udp", "frag", "tcp", "ws"
+};
+
+//! Generator parameters
+static gen_config_t cfg;
+//! PRNG state
+static uint64_t rand_state;
+//! Event heap
+static gen_event_t *heap;
+static uint32_t heap_count, heap_size;
+static uint64_t heap_order;
+//! Output file
+static pcap_dumper_t *pd;
+//! IP identification counter
+static uint16_t ip_id;
+//! Generation counters
+static struct {
+    uint64_t calls;
+    uint64_t registers;
+    uint64_t packets;
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t rtp;
+    uint64_t rtp_lost;
+    uint32_t active;
+    uint32_t max_active;
+} stats;
+
+/**
+ * @brief Deterministic PRNG (xorshift64*)
+ */
+static uint64_t
+gen_rand()
+{
+    rand_state ^= rand_state >> 12;
+    rand_state ^= rand_state << 25;
+    rand_state ^= rand_state >> 27;
+    return rand_state * 2685821657736338717ULL;
+}
+
+static uint32_t
+gen_rand_range(uint32_t min, uint32_t max)
+{
+    if (max <= min)
+        return min;
+    return min + (uint32_t) (gen_rand() % (max - min + 1));
+}
+
+static bool
+gen_rand_percent(double percent)
+{
+    return percent > 0 && (gen_rand() % 1000000) < (uint64_t) (percent * 10000);
+}
+
+static int
+gen_rand_weighted(const uint32_t *weights, int count)
+{
+    uint32_t total = 0, pick;
+    int i;
+
+    for (i = 0; i < count; i++)
+        total += weights[i];
+    if (total == 0)
+        return 0;
+
+    pick = gen_rand() % total;
+    for (i = 0; i < count; i++) {
+        if (pick < weights[i])
+            return i;
+        pick -= weights[i];
+    }
+    return 0;
+}
+
+static bool
+gen_event_before(const gen_event_t *a, const gen_event_t *b)
+{
+    if (a->time != b->time)
+        return a->time < b->time;
+    return a->order < b->order;
+}
+
+static void
+gen_event_push(uint64_t time, enum gen_event_type type, gen_dialog_t *dialog)
+{
+    gen_event_t tmp;
+    uint32_t pos, parent;
+
+    if (heap_count == heap_size) {
+        heap_size = heap_size ? heap_size * 2 : 1024;
+        if (!(heap = realloc(heap, heap_size * sizeof(gen_event_t)))) {
+            fprintf(stderr, "Unable to allocate event heap\n");
+            exit(1);
+        }
+    }
+
+    pos = heap_count++;
+    heap[pos].time = time;
+    heap[pos].order = heap_order++;
+    heap[pos].type = type;
+    heap[pos].dialog = dialog;
+
+    // Sift up
+    while (pos > 0) {
+        parent = (pos - 1) / 2;
+        if (!gen_event_before(&heap[pos], &heap[parent]))
+            break;
+        tmp = heap[parent];
+        heap[parent] = heap[pos];
+        heap[pos] = tmp;
+        pos = parent;
+    }
+}
+
+static gen_event_t
+gen_event_pop()
+{
+    gen_event_t top = heap[0], tmp;
+    uint32_t pos = 0, child;
+
+    heap[0] = heap[--heap_count];
+
+    // Sift down
+    while ((child = pos * 2 + 1) < heap_count) {
+        if (child + 1 < heap_count && gen_event_before(&heap[child + 1], &heap[child]))
+            child++;
+        if (!gen_event_before(&heap[child], &heap[pos]))
+            break;
+        tmp = heap[child];
+        heap[child] = heap[pos];
+        heap[pos] = tmp;
+        pos = child;
+    }
+
+    return top;
+}
+
+static u_char *
+gen_put16(u_char *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xff;
+    return p + 2;
+}
+
+static u_char *
+gen_put32(u_char *p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = (value >> 16) & 0xff;
+    p[2] = (value >> 8) & 0xff;
+    p[3] = value & 0xff;
+    return p + 4;
+}
+
+static uint32_t
+gen_checksum_add(uint32_t sum, const u_char *data, uint32_t len)
+{
+    uint32_t i;
+    for (i = 0; i + 1 < len; i += 2)
+        sum += (data[i] << 8) | data[i + 1];
+    if (len & 1)
+        sum += data[len - 1] << 8;
+    return sum;
+}
+
+static uint16_t
+gen_checksum_fold(uint32_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return ~sum & 0xffff;
+}
+
+static void
+gen_address(uint32_t ip, uint16_t port, address_t *addr)
+{
+    snprintf(addr->ip, ADDRESSLEN, "%u.%u.%u.%u",
+             ip >> 24, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff);
+    addr->port = port;
+}
+
+/**
+ * @brief Write all frames of a generated packet
+ *
+ * Same as capture dump_packet() but without flushing after each packet,
+ * as generated files can have millions of packets.
+ */
+static void
+gen_dump_packet(packet_t *packet)
+{
+    vector_iter_t it = vector_iterator(packet->frames);
+    frame_t *frame;
+
+    while ((frame = vector_iterator_next(&it))) {
+        pcap_dump((u_char *) pd, frame->header, frame->data);
+        stats.frames++;
+        stats.bytes += frame->header->caplen;
+    }
+    stats.packets++;
+}
+
+/**
+ * @brief Fill Ethernet and IPv4 headers of a frame
+ */
+static u_char *
+gen_ip_header(u_char *frame, uint32_t src, uint32_t dst, uint8_t proto,
+              uint16_t id, uint16_t offset, bool more, uint16_t len)
+{
+    u_char *ip = frame + GEN_ETH_LEN;
+    u_char *p = frame;
+
+    // Ethernet: locally administered MACs derived from the addresses
+    *p++ = 0x02; *p++ = 0x00;
+    p = gen_put32(p, dst);
+    *p++ = 0x02; *p++ = 0x00;
+    p = gen_put32(p, src);
+    p = gen_put16(p, 0x0800);
+
+    // IPv4 header without options
+    *p++ = 0x45;
+    *p++ = 0x00;
+    p = gen_put16(p, GEN_IP_LEN + len);
+    p = gen_put16(p, id);
+    p = gen_put16(p, (more ? 0x2000 : 0) | (offset / 8));
+    *p++ = 64;
+    *p++ = proto;
+    p = gen_put16(p, 0);
+    p = gen_put32(p, src);
+    p = gen_put32(p, dst);
+    gen_put16(ip + 10, gen_checksum_fold(gen_checksum_add(0, ip, GEN_IP_LEN)));
+
+    return p;
+}
+
+/**
+ * @brief Create a packet with one or more frames and write it
+ *
+ * @param src, dst Source and destination addresses in host order
+ * @param sport, dport Source and destination ports
+ * @param proto IPPROTO_UDP or IPPROTO_TCP
+ * @param seq TCP sequence pointer (updated), NULL for UDP
+ * @param mtu If not zero, fragment the IP payload in chunks of this size
+ */
+static void
+gen_send(uint64_t time, uint32_t src, uint16_t sport, uint32_t dst, uint16_t dport,
+         uint8_t proto, uint32_t *seq, const u_char *payload, uint32_t len, uint32_t mtu)
+{
+    static u_char l4[GEN_MAX_FRAME], frame[GEN_MAX_FRAME];
+    struct pcap_pkthdr header;
+    address_t saddr, daddr;
+    packet_t *packet;
+    uint32_t l4len, offset, chunk, sum;
+    u_char pseudo[12];
+    u_char *p;
+
+    // Build transport header + payload
+    p = l4;
+    p = gen_put16(p, sport);
+    p = gen_put16(p, dport);
+    if (proto == IPPROTO_TCP) {
+        l4len = GEN_TCP_LEN + len;
+        p = gen_put32(p, *seq);
+        p = gen_put32(p, 1);
+        *p++ = (GEN_TCP_LEN / 4) << 4;
+        *p++ = 0x18;            // PSH + ACK
+        p = gen_put16(p, 65535);
+        p = gen_put16(p, 0);    // checksum
+        p = gen_put16(p, 0);    // urgent pointer
+        *seq += len;
+    } else {
+        l4len = GEN_UDP_LEN + len;
+        p = gen_put16(p, l4len);
+        p = gen_put16(p, 0);    // checksum is optional over IPv4
+    }
+    memcpy(p, payload, len);
+
+    if (proto == IPPROTO_TCP) {
+        gen_put32(pseudo, src);
+        gen_put32(pseudo + 4, dst);
+        pseudo[8] = 0;
+        pseudo[9] = proto;
+        gen_put16(pseudo + 10, l4len);
+        sum = gen_checksum_add(gen_checksum_add(0, pseudo, sizeof(pseudo)), l4, l4len);
+        gen_put16(l4 + 16, gen_checksum_fold(sum));
+    }
+
+    gen_address(src, sport, &saddr);
+    gen_address(dst, dport, &daddr);
+    packet = packet_create(4, proto, saddr, daddr, ++ip_id);
+
+    memset(&header, 0, sizeof(header));
+    header.ts.tv_sec = cfg.start + time / 1000000;
+    header.ts.tv_usec = time % 1000000;
+
+    // Fragments must carry a multiple of 8 bytes (but the last one)
+    if (!mtu || l4len <= mtu)
+        mtu = l4len;
+    else
+        mtu &= ~7U;
+
+    for (offset = 0; offset < l4len; offset += chunk) {
+        chunk = (l4len - offset > mtu) ? mtu : l4len - offset;
+        p = gen_ip_header(frame, src, dst, proto, ip_id, offset, offset + chunk < l4len, chunk);
+        memcpy(p, l4 + offset, chunk);
+        header.caplen = header.len = GEN_ETH_LEN + GEN_IP_LEN + chunk;
+        packet_add_frame(packet, &header, frame);
+    }
+
+    gen_dump_packet(packet);
+    packet_destroy(packet);
+}
+
+/**
+ * @brief Send a SIP message of the given dialog in the given direction
+ */
+static void
+gen_send_sip(uint64_t time, gen_dialog_t *dialog, int dir, const char *msg, uint32_t len)
+{
+    u_char ws[GEN_MAX_SIP + 8];
+    uint32_t mask, i, wslen;
+    int src = dir, dst = !dir;
+
+    switch (dialog->transport) {
+        case GEN_TRANSPORT_UDP:
+            gen_send(time, dialog->ip[src], dialog->port[src], dialog->ip[dst],
+                     dialog->port[dst], IPPROTO_UDP, NULL, (const u_char *) msg, len, 0);
+            break;
+        case GEN_TRANSPORT_FRAG:
+            gen_send(time, dialog->ip[src], dialog->port[src], dialog->ip[dst],
+                     dialog->port[dst], IPPROTO_UDP, NULL, (const u_char *) msg, len, cfg.mtu);
+            break;
+        case GEN_TRANSPORT_TCP:
+            gen_send(time, dialog->ip[src], dialog->port[src], dialog->ip[dst],
+                     dialog->port[dst], IPPROTO_TCP, &dialog->tcp_seq[src],
+                     (const u_char *) msg, len, 0);
+            break;
+        case GEN_TRANSPORT_WS:
+            // Text frame with the shortest length encoding. Client frames are masked
+            wslen = 0;
+            ws[wslen++] = 0x81;
+            if (len < 126) {
+                ws[wslen++] = (src == 0 ? 0x80 : 0x00) | len;
+            } else {
+                ws[wslen++] = (src == 0 ? 0x80 : 0x00) | 126;
+                gen_put16(ws + wslen, len);
+                wslen += 2;
+            }
+            if (src == 0) {
+                mask = (uint32_t) gen_rand();
+                gen_put32(ws + wslen, mask);
+                wslen += 4;
+                for (i = 0; i < len; i++)
+                    ws[wslen + i] = msg[i] ^ ws[wslen - 4 + (i % 4)];
+            } else {
+                memcpy(ws + wslen, msg, len);
+            }
+            wslen += len;
+            gen_send(time, dialog->ip[src], dialog->port[src], dialog->ip[dst],
+                     dialog->port[dst], IPPROTO_TCP, &dialog->tcp_seq[src], ws, wslen, 0);
+            break;
+        default:
+            break;
+    }
+}
+
+static const char *
+gen_via_transport(gen_dialog_t *dialog)
+{
+    switch (dialog->transport) {
+        case GEN_TRANSPORT_TCP:
+            return "TCP";
+        case GEN_TRANSPORT_WS:
+            return "WS";
+        default:
+            return "UDP";
+    }
+}
+
+static int
+gen_sdp(gen_dialog_t *dialog, int side, char *out, size_t size)
+{
+    gen_codec_t *codec = &gen_codecs[dialog->codec];
+    uint32_t ip = dialog->ip[side];
+
+    return snprintf(out, size,
+                    "v=0\r\n"
+                    "o=- %u %u IN IP4 %u.%u.%u.%u\r\n"
+                    "s=sngrep\r\n"
+                    "c=IN IP4 %u.%u.%u.%u\r\n"
+                    "t=0 0\r\n"
+                    "m=audio %u RTP/AVP %u 101\r\n"
+                    "a=rtpmap:%u %s\r\n"
+                    "a=rtpmap:101 telephone-event/8000\r\n"
+                    "a=fmtp:101 0-16\r\n"
+                    "a=ptime:20\r\n"
+                    "a=sendrecv\r\n",
+                    dialog->id, dialog->sdp_version[side]++,
+                    ip >> 24, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff,
+                    ip >> 24, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff,
+                    dialog->rtp_port[side], codec->pt, codec->pt, codec->rtpmap);
+}
+
+/**
+ * @brief Send a SIP request starting a new transaction
+ *
+ * @param dir Request sender (0: caller, 1: callee)
+ * @param newtx Create a new branch (false for ACK of non-2xx responses)
+ */
+static void
+gen_request(uint64_t time, gen_dialog_t *dialog, int dir, const char *method,
+            uint32_t cseq, bool sdp, bool newtx, const char *extra)
+{
+    char msg[GEN_MAX_SIP], body[1024] = "";
+    int len, blen = 0;
+    uint32_t lip = dialog->ip[dir], rip = dialog->ip[!dir];
+
+    if (newtx)
+        dialog->branch = (uint32_t) gen_rand();
+    dialog->txdir = dir;
+    dialog->cseq = cseq;
+    dialog->method = method;
+
+    if (sdp)
+        blen = gen_sdp(dialog, dir, body, sizeof(body));
+
+    len = snprintf(msg, sizeof(msg),
+                   "%s sip:%s@%u.%u.%u.%u:%u SIP/2.0\r\n"
+                   "Via: SIP/2.0/%s %u.%u.%u.%u:%u;branch=z9hG4bK%08x%u\r\n"
+                   "Max-Forwards: 70\r\n"
+                   "From: <sip:%s@%u.%u.%u.%u>;tag=%s\r\n"
+                   "To: <sip:%s@%u.%u.%u.%u>%s%s\r\n"
+                   "Call-ID: %s\r\n"
+                   "CSeq: %u %s\r\n"
+                   "Contact: <sip:%s@%u.%u.%u.%u:%u>\r\n"
+                   "User-Agent: sngrep-gen\r\n"
+                   "%s"
+                   "%s"
+                   "Content-Length: %d\r\n"
+                   "\r\n"
+                   "%s",
+                   method, dialog->user[!dir],
+                   rip >> 24, (rip >> 16) & 0xff, (rip >> 8) & 0xff, rip & 0xff, dialog->port[!dir],
+                   gen_via_transport(dialog),
+                   lip >> 24, (lip >> 16) & 0xff, (lip >> 8) & 0xff, lip & 0xff, dialog->port[dir],
+                   dialog->branch, dialog->id,
+                   dialog->user[dir],
+                   lip >> 24, (lip >> 16) & 0xff, (lip >> 8) & 0xff, lip & 0xff, dialog->tag[dir],
+                   dialog->user[!dir],
+                   rip >> 24, (rip >> 16) & 0xff, (rip >> 8) & 0xff, rip & 0xff,
+                   *dialog->tag[!dir] ? ";tag=" : "", dialog->tag[!dir],
+                   dialog->callid, cseq, method,
+                   dialog->user[dir],
+                   lip >> 24, (lip >> 16) & 0xff, (lip >> 8) & 0xff, lip & 0xff, dialog->port[dir],
+                   extra ? extra : "",
+                   sdp ? "Content-Type: application/sdp\r\n" : "",
+                   blen, body);
+
+    gen_send_sip(time, dialog, dir, msg, len);
+}
+
+/**
+ * @brief Send a SIP response for the current transaction
+ */
+static void
+gen_response(uint64_t time, gen_dialog_t *dialog, int code, const char *reason,
+             bool sdp, const char *extra)
+{
+    char msg[GEN_MAX_SIP], body[1024] = "";
+    int len, blen = 0;
+    int dir = dialog->txdir;
+    uint32_t lip = dialog->ip[dir], rip = dialog->ip[!dir];
+    uint32_t cip = dialog->ip[!dir];
+
+    if (sdp)
+        blen = gen_sdp(dialog, !dir, body, sizeof(body));
+
+    len = snprintf(msg, sizeof(msg),
+                   "SIP/2.0 %d %s\r\n"
+                   "Via: SIP/2.0/%s %u.%u.%u.%u:%u;branch=z9hG4bK%08x%u\r\n"
+                   "From: <sip:%s@%u.%u.%u.%u>;tag=%s\r\n"
+                   "To: <sip:%s@%u.%u.%u.%u>;tag=%s\r\n"
+                   "Call-ID: %s\r\n"
+                   "CSeq: %u %s\r\n"
+                   "Contact: <sip:%s@%u.%u.%u.%u:%u>\r\n"
+                   "Server: sngrep-gen\r\n"
+                   "%s"
+                   "%s"
+                   "Content-Length: %d\r\n"
+                   "\r\n"
+                   "%s",
+                   code, reason,
+                   gen_via_transport(dialog),
+                   lip >> 24, (lip >> 16) & 0xff, (lip >> 8) & 0xff, lip & 0xff, dialog->port[dir],
+                   dialog->branch, dialog->id,
+                   dialog->user[dir],
+                   lip >> 24, (lip >> 16) & 0xff, (lip >> 8) & 0xff, lip & 0xff, dialog->tag[dir],
+                   dialog->user[!dir],
+                   rip >> 24, (rip >> 16) & 0xff, (rip >> 8) & 0xff, rip & 0xff, dialog->tag[!dir],
+                   dialog->callid, dialog->cseq, dialog->method,
+                   dialog->user[!dir],
+                   cip >> 24, (cip >> 16) & 0xff, (cip >> 8) & 0xff, cip & 0xff, dialog->port[!dir],
+                   extra ? extra : "",
+                   sdp ? "Content-Type: application/sdp\r\n" : "",
+                   blen, body);
+
+    gen_send_sip(time, dialog, !dir, msg, len);
+}
+
+/**
+ * @brief Send next RTP packet of a call
+ */
+static void
+gen_rtp(uint64_t time, gen_dialog_t *dialog)
+{
+    gen_codec_t *codec = &gen_codecs[dialog->codec];
+    u_char rtp[12 + 256];
+    int leg = dialog->rtp_leg;
+    u_char *p = rtp;
+
+    // Version 2, marker on first packet
+    *p++ = 0x80;
+    *p++ = (dialog->rtp_seq[leg] == 0 ? 0x80 : 0x00) | codec->pt;
+    p = gen_put16(p, dialog->rtp_seq[leg]);
+    p = gen_put32(p, dialog->rtp_ts[leg]);
+    p = gen_put32(p, dialog->rtp_ssrc[leg]);
+    memset(p, codec->fill, codec->size);
+
+    // Lost packets still consume sequence and timestamp
+    if (gen_rand_percent(cfg.loss)) {
+        stats.rtp_lost++;
+    } else {
+        gen_send(time, dialog->ip[leg], dialog->rtp_port[leg], dialog->ip[!leg],
+                 dialog->rtp_port[!leg], IPPROTO_UDP, NULL, rtp, 12 + codec->size, 0);
+        stats.rtp++;
+    }
+
+    dialog->rtp_seq[leg]++;
+    dialog->rtp_ts[leg] += codec->step;
+}
+
+static void
+gen_rtp_start(uint64_t time, gen_dialog_t *dialog)
+{
+    if (!cfg.rtp)
+        return;
+
+    dialog->rtp_active = true;
+    dialog->rtp_leg = 0;
+    dialog->rtp_tick = time + GEN_PTIME;
+    dialog->rtp_next = dialog->rtp_tick + gen_rand_range(0, cfg.jitter);
+}
+
+/**
+ * @brief Schedule the next RTP packet keeping timestamps monotonic
+ */
+static void
+gen_rtp_next(gen_dialog_t *dialog, uint64_t now)
+{
+    if (dialog->rtp_leg == 0) {
+        dialog->rtp_leg = 1;
+    } else {
+        dialog->rtp_leg = 0;
+        dialog->rtp_tick += GEN_PTIME;
+    }
+    dialog->rtp_next = dialog->rtp_tick + gen_rand_range(0, cfg.jitter);
+    if (dialog->rtp_next < now)
+        dialog->rtp_next = now;
+}
+
+static gen_dialog_t *
+gen_dialog_create(uint32_t id, bool registration)
+{
+    gen_dialog_t *dialog;
+    uint32_t a, b;
+
+    if (!(dialog = calloc(1, sizeof(gen_dialog_t)))) {
+        fprintf(stderr, "Unable to allocate dialog\n");
+        exit(1);
+    }
+
+    dialog->id = id;
+    dialog->transport = gen_rand_weighted(cfg.transport_weight, GEN_TRANSPORT_COUNT);
+    dialog->codec = gen_rand_weighted(cfg.codec_weight, GEN_CODEC_COUNT);
+    snprintf(dialog->callid, sizeof(dialog->callid), "%08x%08x-%u@sngrep",
+             (uint32_t) gen_rand(), (uint32_t) gen_rand(), id);
+    snprintf(dialog->tag[0], sizeof(dialog->tag[0]), "%08x", (uint32_t) gen_rand());
+
+    a = gen_rand() % cfg.users;
+    b = gen_rand() % cfg.users;
+    snprintf(dialog->user[0], sizeof(dialog->user[0]), "34%07u", a);
+    snprintf(dialog->user[1], sizeof(dialog->user[1]), "44%07u", b);
+    dialog->ip[0] = 0x0A010000 | ((a / 250) << 8) | (a % 250 + 1);
+    dialog->ip[1] = 0x0A020000 | ((b / 250) << 8) | (b % 250 + 1);
+
+    if (registration) {
+        // UA to registrar, To is the registered user
+        dialog->ip[1] = GEN_REGISTRAR;
+        strcpy(dialog->user[1], dialog->user[0]);
+        dialog->state = GEN_REGISTER;
+    } else {
+        dialog->state = GEN_INVITE;
+    }
+
+    // Connection oriented transports use an ephemeral client port
+    if (dialog->transport == GEN_TRANSPORT_TCP || dialog->transport == GEN_TRANSPORT_WS) {
+        dialog->port[0] = 32768 + id % 28000;
+        dialog->port[1] = (dialog->transport == GEN_TRANSPORT_WS) ? 8080 : 5060;
+        dialog->tcp_seq[0] = (uint32_t) gen_rand();
+        dialog->tcp_seq[1] = (uint32_t) gen_rand();
+    } else {
+        dialog->port[0] = dialog->port[1] = 5060;
+    }
+
+    dialog->rtp_port[0] = 10000 + 2 * (id % 25000);
+    dialog->rtp_port[1] = 10000 + 2 * ((id + 12500) % 25000);
+    dialog->rtp_ssrc[0] = (uint32_t) gen_rand();
+    dialog->rtp_ssrc[1] = (uint32_t) gen_rand();
+    dialog->rtp_ts[0] = (uint32_t) gen_rand();
+    dialog->rtp_ts[1] = (uint32_t) gen_rand();
+    dialog->sdp_version[0] = dialog->sdp_version[1] = 1;
+    dialog->reinvite = gen_rand_percent(cfg.reinvite);
+
+    stats.active++;
+    if (stats.active > stats.max_active)
+        stats.max_active = stats.active;
+
+    return dialog;
+}
+
+/**
+ * @brief Send the next SIP message of a dialog and move its state machine
+ *
+ * @return false if the dialog has finished
+ */
+static bool
+gen_dialog_step(uint64_t now, gen_dialog_t *dialog)
+{
+    uint64_t hold;
+
+    switch (dialog->state) {
+        case GEN_INVITE:
+            gen_request(now, dialog, 0, "INVITE", 1, true, true, NULL);
+            dialog->state = GEN_RINGING;
+            dialog->sip_next = now + gen_rand_range(50000, 1500000);
+            break;
+        case GEN_RINGING:
+            snprintf(dialog->tag[1], sizeof(dialog->tag[1]), "%08x", (uint32_t) gen_rand());
+            gen_response(now, dialog, 180, "Ringing", false, NULL);
+            dialog->state = gen_rand_percent(cfg.busy) ? GEN_REJECT : GEN_ANSWER;
+            dialog->sip_next = now + gen_rand_range(1000000, 6000000);
+            break;
+        case GEN_REJECT:
+            gen_response(now, dialog, 486, "Busy Here", false, NULL);
+            dialog->state = GEN_REJECT_ACK;
+            dialog->sip_next = now + gen_rand_range(10000, 80000);
+            break;
+        case GEN_REJECT_ACK:
+            // ACK for non-2xx responses belongs to the INVITE transaction
+            gen_request(now, dialog, 0, "ACK", 1, false, false, NULL);
+            return false;
+        case GEN_ANSWER:
+            gen_response(now, dialog, 200, "OK", true, NULL);
+            dialog->state = GEN_ACK;
+            dialog->sip_next = now + gen_rand_range(10000, 80000);
+            break;
+        case GEN_ACK:
+            gen_request(now, dialog, 0, "ACK", 1, false, true, NULL);
+            gen_rtp_start(now, dialog);
+            hold = (uint64_t) (cfg.hold * 1000000);
+            dialog->hold_end = now + gen_rand_range(hold / 2, hold + hold / 2);
+            if (dialog->reinvite) {
+                dialog->state = GEN_REINVITE;
+                dialog->sip_next = now + (dialog->hold_end - now) / 2;
+            } else {
+                dialog->state = GEN_BYE;
+                dialog->sip_next = dialog->hold_end;
+            }
+            break;
+        case GEN_REINVITE:
+            gen_request(now, dialog, 0, "INVITE", 2, true, true, NULL);
+            dialog->state = GEN_REINVITE_OK;
+            dialog->sip_next = now + gen_rand_range(10000, 80000);
+            break;
+        case GEN_REINVITE_OK:
+            gen_response(now, dialog, 200, "OK", true, NULL);
+            dialog->state = GEN_REINVITE_ACK;
+            dialog->sip_next = now + gen_rand_range(10000, 80000);
+            break;
+        case GEN_REINVITE_ACK:
+            gen_request(now, dialog, 0, "ACK", 2, false, true, NULL);
+            dialog->state = GEN_BYE;
+            dialog->sip_next = (dialog->hold_end > now) ? dialog->hold_end : now;
+            break;
+        case GEN_BYE:
+            // Any side can hangup the call
+            gen_request(now, dialog, gen_rand() % 2, "BYE", dialog->reinvite ? 3 : 2,
+                        false, true, NULL);
+            dialog->rtp_active = false;
+            dialog->state = GEN_BYE_OK;
+            dialog->sip_next = now + gen_rand_range(10000, 80000);
+            break;
+        case GEN_BYE_OK:
+            gen_response(now, dialog, 200, "OK", false, NULL);
+            return false;
+        case GEN_REGISTER:
+            gen_request(now, dialog, 0, "REGISTER", 1, false, true, "Expires: 3600\r\n");
+            dialog->state = GEN_REGISTER_401;
+            dialog->sip_next = now + gen_rand_range(1000, 20000);
+            break;
+        case GEN_REGISTER_401:
+            snprintf(dialog->tag[1], sizeof(dialog->tag[1]), "%08x", (uint32_t) gen_rand());
+            gen_response(now, dialog, 401, "Unauthorized", false,
+                         "WWW-Authenticate: Digest realm=\"sngrep\", nonce=\"0123456789abcdef\"\r\n");
+            dialog->tag[1][0] = '\0';
+            dialog->state = GEN_REGISTER_AUTH;
+            dialog->sip_next = now + gen_rand_range(1000, 20000);
+            break;
+        case GEN_REGISTER_AUTH:
+            gen_request(now, dialog, 0, "REGISTER", 2, false, true,
+                        "Expires: 3600\r\n"
+                        "Authorization: Digest username=\"sngrep\", realm=\"sngrep\", "
+                        "nonce=\"0123456789abcdef\", response=\"00000000000000000000000000000000\"\r\n");
+            dialog->state = GEN_REGISTER_OK;
+            dialog->sip_next = now + gen_rand_range(1000, 20000);
+            break;
+        case GEN_REGISTER_OK:
+            snprintf(dialog->tag[1], sizeof(dialog->tag[1]), "%08x", (uint32_t) gen_rand());
+            gen_response(now, dialog, 200, "OK", false, "Expires: 3600\r\n");
+            return false;
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Process the next due event of a dialog and reschedule it
+ */
+static void
+gen_dialog_event(uint64_t now, gen_dialog_t *dialog)
+{
+    if (dialog->rtp_active && dialog->rtp_next < dialog->sip_next) {
+        gen_rtp(now, dialog);
+        gen_rtp_next(dialog, now);
+    } else if (!gen_dialog_step(now, dialog)) {
+        stats.active--;
+        free(dialog);
+        return;
+    }
+
+    if (dialog->rtp_active && dialog->rtp_next < dialog->sip_next) {
+        gen_event_push(dialog->rtp_next, GEN_EVENT_DIALOG, dialog);
+    } else {
+        gen_event_push(dialog->sip_next, GEN_EVENT_DIALOG, dialog);
+    }
+}
+
+/**
+ * @brief Parse a "name:weight,name:weight" mix parameter
+ *
+ * @return 0 on success, -1 if any name is unknown
+ */
+static int
+gen_parse_mix(const char *spec, const char **names, int count, size_t stride, uint32_t *weights)
+{
+    char *copy, *item, *saveptr = NULL, *sep;
+    const char *name;
+    int i, found;
+
+    memset(weights, 0, sizeof(uint32_t) * count);
+    if (!(copy = strdup(spec)))
+        return -1;
+
+    for (item = strtok_r(copy, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr)) {
+        if ((sep = strchr(item, ':')))
+            *sep++ = '\0';
+        found = 0;
+        for (i = 0; i < count; i++) {
+            name = *(const char **) ((const char *) names + i * stride);
+            if (!strcasecmp(item, name)) {
+                weights[i] = sep ? (uint32_t) atoi(sep) : 1;
+                found = 1;
+                break;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Unknown mix entry '%s'\n", item);
+            free(copy);
+            return -1;
+        }
+    }
+
+    free(copy);
+    return 0;
+}
+
+void
+usage()
+{
+    printf("Usage: gen-traffic -o output.pcap [options]\n\n"
+           "    -h --help\t\t This usage\n"
+           "    -o --output\t\t Write generated packets to pcap file\n"
+           "    -s --seed\t\t PRNG seed (default: 1)\n"
+           "    -c --cps\t\t New calls per second (default: 10)\n"
+           "    -d --duration\t Seconds generating new calls (default: 60)\n"
+           "    -H --hold\t\t Mean call hold time in seconds (default: 30)\n"
+           "    -r --registers\t REGISTER transactions per second (default: 0)\n"
+           "    -i --reinvite\t Percentage of calls with re-INVITE (default: 0)\n"
+           "    -b --busy\t\t Percentage of calls rejected with 486 (default: 0)\n"
+           "    -C --codecs\t\t Codec mix (default: pcmu:60,pcma:30,g729:10)\n"
+           "    \t\t\t Available: pcmu, pcma, g722, g729, opus\n"
+           "    -t --transports\t Transport mix (default: udp:100)\n"
+           "    \t\t\t Available: udp, frag, tcp, ws\n"
+           "    -m --mtu\t\t IP fragment size for frag transport (default: 512)\n"
+           "    -l --loss\t\t Percentage of lost RTP packets (default: 0)\n"
+           "    -j --jitter\t\t Max RTP jitter in milliseconds (default: 0)\n"
+           "    -u --users\t\t Number of user agents on each side (default: 1000)\n"
+           "    -n --no-rtp\t\t Do not generate RTP packets\n"
+           "    -T --start\t\t Epoch of first packet (default: 1700000000)\n"
+           "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *codecs = "pcmu:60,pcma:30,g729:10";
+    const char *transports = "udp:100";
+    uint64_t call_id = 0, reg_id = 0;
+    uint64_t calls_total, regs_total;
+    gen_event_t event;
+    pcap_t *pcap;
+    int opt, idx;
+
+    static struct option long_options[] = {
+        { "help", no_argument, 0, 'h' },
+        { "output", required_argument, 0, 'o' },
+        { "seed", required_argument, 0, 's' },
+        { "cps", required_argument, 0, 'c' },
+        { "duration", required_argument, 0, 'd' },
+        { "hold", required_argument, 0, 'H' },
+        { "registers", required_argument, 0, 'r' },
+        { "reinvite", required_argument, 0, 'i' },
+        { "busy", required_argument, 0, 'b' },
+        { "codecs", required_argument, 0, 'C' },
+        { "transports", required_argument, 0, 't' },
+        { "mtu", required_argument, 0, 'm' },
+        { "loss", required_argument, 0, 'l' },
+        { "jitter", required_argument, 0, 'j' },
+        { "users", required_argument, 0, 'u' },
+        { "no-rtp", no_argument, 0, 'n' },
+        { "start", required_argument, 0, 'T' },
+        { 0, 0, 0, 0 }
+    };
+
+    // Default parameters
+    cfg.seed = 1;
+    cfg.cps = 10;
+    cfg.duration = 60;
+    cfg.hold = 30;
+    cfg.users = 1000;
+    cfg.mtu = 512;
+    cfg.rtp = true;
+    cfg.start = 1700000000;
+
+    while ((opt = getopt_long(argc, argv, "ho:s:c:d:H:r:i:b:C:t:m:l:j:u:nT:", long_options, &idx)) != -1) {
+        switch (opt) {
+            case 'h':
+                usage();
+                return 0;
+            case 'o':
+                cfg.outfile = optarg;
+                break;
+            case 's':
+                cfg.seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'c':
+                cfg.cps = atof(optarg);
+                break;
+            case 'd':
+                cfg.duration = atof(optarg);
+                break;
+            case 'H':
+                cfg.hold = atof(optarg);
+                break;
+            case 'r':
+                cfg.rps = atof(optarg);
+                break;
+            case 'i':
+                cfg.reinvite = atof(optarg);
+                break;
+            case 'b':
+                cfg.busy = atof(optarg);
+                break;
+            case 'C':
+                codecs = optarg;
+                break;
+            case 't':
+                transports = optarg;
+                break;
+            case 'm':
+                cfg.mtu = atoi(optarg);
+                break;
+            case 'l':
+                cfg.loss = atof(optarg);
+                break;
+            case 'j':
+                cfg.jitter = atoi(optarg) * 1000;
+                break;
+            case 'u':
+                cfg.users = atoi(optarg);
+                break;
+            case 'n':
+                cfg.rtp = false;
+                break;
+            case 'T':
+                cfg.start = strtoull(optarg, NULL, 10);
+                break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    if (!cfg.outfile) {
+        usage();
+        return 1;
+    }
+
+    if (cfg.users == 0 || cfg.users > 250 * 250) {
+        fprintf(stderr, "Users must be between 1 and %d\n", 250 * 250);
+        return 1;
+    }
+
+    if (cfg.mtu < 64) {
+        fprintf(stderr, "Fragment size must be at least 64 bytes\n");
+        return 1;
+    }
+
+    if (gen_parse_mix(codecs, &gen_codecs[0].name, GEN_CODEC_COUNT,
+                      sizeof(gen_codec_t), cfg.codec_weight) != 0)
+        return 1;
+
+    if (gen_parse_mix(transports, gen_transport_names, GEN_TRANSPORT_COUNT,
+                      sizeof(const char *), cfg.transport_weight) != 0)
+        return 1;
+
+    // Seed 0 would stall xorshift
+    rand_state = cfg.seed ? cfg.seed : 0x9E3779B97F4A7C15ULL;
+
+    pcap = pcap_open_dead(DLT_EN10MB, GEN_MAX_FRAME);
+    if (!(pd = pcap_dump_open(pcap, cfg.outfile))) {
+        fprintf(stderr, "Unable to open output file: %s\n", pcap_geterr(pcap));
+        pcap_close(pcap);
+        return 1;
+    }
+
+    calls_total = (uint64_t) (cfg.cps * cfg.duration + 0.5);
+    regs_total = (uint64_t) (cfg.rps * cfg.duration + 0.5);
+    if (calls_total)
+        gen_event_push(0, GEN_EVENT_CALL_SPAWN, NULL);
+    if (regs_total)
+        gen_event_push(0, GEN_EVENT_REG_SPAWN, NULL);
+
+    // Process all events in timestamp order
+    while (heap_count) {
+        event = gen_event_pop();
+        switch (event.type) {
+            case GEN_EVENT_CALL_SPAWN:
+                gen_dialog_event(event.time, gen_dialog_create(call_id + reg_id, false));
+                stats.calls++;
+                if (++call_id < calls_total)
+                    gen_event_push((uint64_t) (call_id * 1000000 / cfg.cps), GEN_EVENT_CALL_SPAWN, NULL);
+                break;
+            case GEN_EVENT_REG_SPAWN:
+                gen_dialog_event(event.time, gen_dialog_create(call_id + reg_id, true));
+                stats.registers++;
+                if (++reg_id < regs_total)
+                    gen_event_push((uint64_t) (reg_id * 1000000 / cfg.rps), GEN_EVENT_REG_SPAWN, NULL);
+                break;
+            case GEN_EVENT_DIALOG:
+                gen_dialog_event(event.time, event.dialog);
+                break;
+        }
+    }
+
+    pcap_dump_close(pd);
+    pcap_close(pcap);
+    free(heap);
+
+    fprintf(stderr,
+            "Calls: %" PRIu64 " Registers: %" PRIu64 " Max concurrent dialogs: %u\n"
+            "Packets: %" PRIu64 " Frames: %" PRIu64 " Bytes: %" PRIu64 "\n"
+            "RTP packets: %" PRIu64 " RTP lost: %" PRIu64 "\n",
+            stats.calls, stats.registers, stats.max_active,
+            stats.packets, stats.frames, stats.bytes,
+            stats.rtp, stats.rtp_lost);
+
+    return 0;
+}
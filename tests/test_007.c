@@ -32,9 +32,51 @@
 #include "../src/vector.h"
 #include "../src/util.h"
 
+//! Test item stored in a lockless vector
+typedef struct {
+    int value;
+    int position;
+} item_t;
+
+static int *
+item_position(void *item)
+{
+    return &((item_t *) item)->position;
+}
+
+static int
+item_compare(const void *one, const void *two)
+{
+    return (*(item_t **) one)->value - (*(item_t **) two)->value;
+}
+
+static void
+item_sorter(vector_t *vector, void *item)
+{
+    vector_insert(vector, item, vector_sorted_position(vector, item, item_compare));
+}
+
+//! Check the vector items are the given values, in order
+static void
+check_items(vector_t *vector, const int *values, int count)
+{
+    vector_iter_t it = vector_iterator(vector);
+    item_t *item;
+    int i = 0;
+
+    assert(vector_count(vector) == count);
+    while ((item = vector_iterator_next(&it))) {
+        assert(i < count && item->value == values[i++]);
+        assert(vector_index(vector, item) == item->position);
+    }
+    assert(i == count);
+}
+
 int main ()
 {
     vector_t *vector;
+    item_t items[10];
+    int i;
 
     // Basic Vector append/remove test
     vector = vector_create(10, 10);
@@ -75,6 +117,59 @@ int main ()
     vector_set_destroyer(vector, vector_generic_destroyer);
     vector_remove(vector, vector_item(vector, 12));
     assert(vector_count(vector) == 15);
+    vector_destroy(vector);
+
+    // Lockless vector removes items in place and keeps their positions
+    vector = vector_create(10, 10);
+    vector_set_lockless(vector);
+    vector_set_position(vector, item_position);
+    for (i = 0; i < 10; i++) {
+        items[i].value = i * 10;
+        vector_append(vector, &items[i]);
+    }
+    vector_remove(vector, &items[0]);
+    vector_remove(vector, &items[4]);
+    check_items(vector, (int[]) { 10, 20, 30, 50, 60, 70, 80, 90 }, 8);
+    assert(vector_first(vector) == &items[1]);
+    assert(vector_item(vector, 4) == NULL);
+    assert(vector_index(vector, &items[4]) == -1);
+    // Removing the last item does not leave a removed position
+    vector_remove(vector, &items[9]);
+    assert(vector_last(vector) == &items[8]);
+    check_items(vector, (int[]) { 10, 20, 30, 50, 60, 70, 80 }, 7);
+
+    // Sorted items use removed positions next to their sorted position
+    vector_set_sorter(vector, item_sorter);
+    items[4].value = 45;
+    vector_append(vector, &items[4]);
+    assert(vector_item(vector, 4) == &items[4]);
+    check_items(vector, (int[]) { 10, 20, 30, 45, 50, 60, 70, 80 }, 8);
+    items[0].value = 5;
+    vector_append(vector, &items[0]);
+    check_items(vector, (int[]) { 5, 10, 20, 30, 45, 50, 60, 70, 80 }, 9);
+    items[9].value = 25;
+    vector_append(vector, &items[9]);
+    check_items(vector, (int[]) { 5, 10, 20, 25, 30, 45, 50, 60, 70, 80 }, 10);
+    vector_set_sorter(vector, NULL);
+
+    // List is compacted once most of its positions are removed
+    for (i = 1; i < 9; i += 2)
+        vector_remove(vector, &items[i]);
+    check_items(vector, (int[]) { 5, 20, 25, 45, 60, 80 }, 6);
+    vector_remove(vector, &items[2]);
+    check_items(vector, (int[]) { 5, 25, 45, 60, 80 }, 5);
+    assert(vector_item(vector, 1) == NULL);
+    vector_remove(vector, &items[6]);
+    check_items(vector, (int[]) { 5, 25, 45, 80 }, 4);
+    assert(vector_item(vector, 1) == &items[9]);
+
+    // Sorting also removes the removed positions
+    vector_remove(vector, &items[4]);
+    items[0].value = 100;
+    vector_sort(vector, item_compare);
+    check_items(vector, (int[]) { 25, 80, 100 }, 3);
+    assert(vector_item(vector, 2) == &items[0]);
+    vector_destroy(vector);
 
     return 0;
 }
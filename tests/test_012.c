@@ -57,6 +57,18 @@ call_add_stream(sip_call_t *call, rtp_stream_t *stream)
     (void) stream;
 }
 
+void
+sip_call_lock(sip_call_t *call)
+{
+    (void) call;
+}
+
+void
+sip_call_unlock(sip_call_t *call)
+{
+    (void) call;
+}
+
 const char *
 media_get_format(sdp_media_t *media, uint32_t code)
 {
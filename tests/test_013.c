@@ -0,0 +1,119 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file test_013.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * Basic testing of deferred memory release
+ */
+
+#include "config.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../src/epoch.h"
+
+//! Number of released objects
+static int released = 0;
+//! Reader thread state: 0 starting, 1 reading, 2 must leave, 3 left
+static int state = 0;
+
+static void
+release(void *item)
+{
+    (void) item;
+    __atomic_add_fetch(&released, 1, __ATOMIC_SEQ_CST);
+}
+
+static void
+wait_state(int value)
+{
+    while (__atomic_load_n(&state, __ATOMIC_SEQ_CST) != value)
+        usleep(1000);
+}
+
+static void
+wait_released(int count)
+{
+    int i;
+
+    // Reclaimer checks retired objects every few milliseconds
+    for (i = 0; i < 5000 && __atomic_load_n(&released, __ATOMIC_SEQ_CST) != count; i++)
+        usleep(1000);
+    assert(__atomic_load_n(&released, __ATOMIC_SEQ_CST) == count);
+}
+
+static void *
+reader(void *data)
+{
+    (void) data;
+
+    epoch_enter();
+    epoch_enter();
+    __atomic_store_n(&state, 1, __ATOMIC_SEQ_CST);
+    wait_state(2);
+    // Leaving a nested section does not leave the read section
+    epoch_leave();
+    usleep(50000);
+    assert(__atomic_load_n(&released, __ATOMIC_SEQ_CST) == 1);
+    epoch_leave();
+    __atomic_store_n(&state, 3, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+int main ()
+{
+    pthread_t thread;
+    int item;
+
+    // Without readers nor reclaimer objects are released at once
+    epoch_retire(&item, release, sizeof(item));
+    assert(released == 1);
+
+    // Objects retired while a thread is reading wait until it leaves
+    assert(epoch_init() == 0);
+    assert(pthread_create(&thread, NULL, reader, NULL) == 0);
+    wait_state(1);
+    epoch_retire(&item, release, sizeof(item));
+    usleep(100000);
+    assert(__atomic_load_n(&released, __ATOMIC_SEQ_CST) == 1);
+    __atomic_store_n(&state, 2, __ATOMIC_SEQ_CST);
+    wait_state(3);
+    wait_released(2);
+    pthread_join(thread, NULL);
+
+    // Without readers the reclaimer releases them soon
+    epoch_retire(&item, release, sizeof(item));
+    wait_released(3);
+
+    // Objects still pending are released on exit
+    epoch_enter();
+    epoch_retire(&item, release, sizeof(item));
+    usleep(50000);
+    assert(__atomic_load_n(&released, __ATOMIC_SEQ_CST) == 3);
+    epoch_leave();
+    epoch_deinit();
+    assert(released == 4);
+
+    return 0;
+}
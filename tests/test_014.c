@@ -0,0 +1,387 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file test_014.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * Basic testing of pcap files loaded in chunks
+ *
+ * A file of several chunks is loaded without scanner threads and with
+ * several of them, and the found records must be the same records written.
+ * The record crossing the first chunk limit contains valid looking records
+ * at the limit, so the guessed start of the second chunk is wrong, and the
+ * records decoded from it must be decoded again.
+ */
+
+#include "config.h"
+#ifdef WITH_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#endif
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/capture_loader.c"
+
+//! Timestamp of the first record
+#define TEST_FIRST_SEC      1700000000
+//! Number of chunks of the test file
+#define TEST_CHUNKS         3
+
+void
+call_add_stream(sip_call_t *call, rtp_stream_t *stream)
+{
+    (void) call;
+    (void) stream;
+}
+
+const char *
+capture_callid()
+{
+    return NULL;
+}
+
+const char *
+capture_keyfile()
+{
+    return NULL;
+}
+
+void
+capture_lock()
+{
+}
+
+void
+capture_unlock()
+{
+}
+
+void
+capture_notify()
+{
+}
+
+int
+capture_sources_count()
+{
+    return 1;
+}
+
+bool
+capture_time_window(struct timeval *from, struct timeval *to)
+{
+    (void) from;
+    (void) to;
+    return false;
+}
+
+void
+correlator_drain()
+{
+}
+
+void
+rtp_index_remove_call(struct sip_call *call)
+{
+    (void) call;
+}
+
+int
+setting_enabled(int id)
+{
+    (void) id;
+    return 0;
+}
+
+const char *
+setting_get_value(int id)
+{
+    (void) id;
+    return NULL;
+}
+
+void
+sip_calls_add_memory(sip_call_t *call, size_t bytes)
+{
+    (void) call;
+    (void) bytes;
+}
+
+void
+sip_calls_expire(struct timeval now)
+{
+    (void) now;
+}
+
+vector_iter_t
+sip_calls_iterator()
+{
+    vector_iter_t it;
+    memset(&it, 0, sizeof(it));
+    return it;
+}
+
+sip_call_t *
+sip_find_by_callid(const char *callid)
+{
+    (void) callid;
+    return NULL;
+}
+
+const char *
+sip_get_filter_expression()
+{
+    return NULL;
+}
+
+const char *
+sip_get_match_expression()
+{
+    return NULL;
+}
+
+void
+sip_get_match_flags(int *insensitive, int *invert)
+{
+    *insensitive = *invert = 0;
+}
+
+rtp_stream_t *
+stream_create(sdp_media_t *media, address_t dst, int type)
+{
+    (void) media;
+    (void) dst;
+    (void) type;
+    return NULL;
+}
+
+void
+stream_destroyer(void *stream)
+{
+    (void) stream;
+}
+
+void
+parse_packet(u_char *info, const struct pcap_pkthdr *header, const u_char *packet)
+{
+    (void) info;
+    (void) header;
+    (void) packet;
+}
+
+void
+capture_packet_process(capture_info_t *capinfo, const struct pcap_pkthdr *header, packet_t *pkt)
+{
+    (void) capinfo;
+    (void) header;
+    (void) pkt;
+}
+
+packet_t *
+capture_packet_decode(capture_info_t *capinfo, const struct pcap_pkthdr *header,
+                      const u_char *packet, size_t record)
+{
+    (void) capinfo;
+    (void) header;
+    (void) packet;
+    // Decoded packets are identified by their record
+    return (packet_t *) record;
+}
+
+void
+packet_destroy(packet_t *packet)
+{
+    (void) packet;
+}
+
+static void
+write_uint32(u_char *data, uint32_t value)
+{
+    memcpy(data, &value, sizeof(value));
+}
+
+static void
+write_record(u_char *data, uint32_t sec, uint32_t usec, uint32_t caplen)
+{
+    write_uint32(data, sec);
+    write_uint32(data + 4, usec);
+    write_uint32(data + 8, caplen);
+    write_uint32(data + 12, caplen);
+}
+
+/**
+ * @brief Write a pcap file with records crossing every chunk limit
+ *
+ * @return number of written records, with their offsets in records
+ */
+static size_t
+write_file(const char *path, size_t *records, size_t max)
+{
+    size_t size = LOADER_FILE_HDR_LEN + TEST_CHUNKS * LOADER_CHUNK_SIZE - 1000;
+    size_t offset, limit, count = 0;
+    uint32_t caplen;
+    u_char *data;
+    FILE *fp;
+    int k = 1, i;
+
+    assert((data = calloc(1, size)));
+    write_uint32(data, 0xa1b2c3d4);
+    data[4] = 2;
+    data[6] = 4;
+    write_uint32(data + 16, 65535);
+    write_uint32(data + 20, 1);
+
+    for (offset = LOADER_FILE_HDR_LEN; offset + 2000 < size; offset += LOADER_RECORD_HDR_LEN + caplen) {
+        assert(count < max);
+        caplen = 100 + (count * 37) % 1400;
+
+        // Cross the next chunk limit with a bigger record
+        limit = LOADER_FILE_HDR_LEN + (size_t) k * LOADER_CHUNK_SIZE;
+        if (k < TEST_CHUNKS && limit - offset < 2000) {
+            caplen = limit - offset - LOADER_RECORD_HDR_LEN + 4096;
+            // Valid records inside the first one, where the second chunk is guessed
+            for (i = 0; k == 1 && i < LOADER_SYNC_RECORDS + 2; i++)
+                write_record(data + limit + i * 32, TEST_FIRST_SEC, 0, 16);
+            k++;
+        }
+
+        write_record(data + offset, TEST_FIRST_SEC + count / 100, (count * 10007) % 1000000, caplen);
+        write_uint32(data + offset + LOADER_RECORD_HDR_LEN, count);
+        records[count++] = offset;
+    }
+    assert(k == TEST_CHUNKS);
+
+    assert((fp = fopen(path, "w")));
+    assert(fwrite(data, 1, offset, fp) == offset);
+    fclose(fp);
+    free(data);
+    return count;
+}
+
+/**
+ * @brief Load a file with the given number of scanner threads
+ *
+ * @return number of found records, with their offsets in records
+ */
+static size_t
+load_file(const char *path, int threads, size_t *records, size_t max)
+{
+    capture_info_t capinfo;
+    struct pcap_pkthdr header;
+    loader_file_t *file;
+    const u_char *data;
+    size_t count = 0;
+
+    memset(&capinfo, 0, sizeof(capinfo));
+    capinfo.infile = path;
+    assert(capture_loader_open(&capinfo) == 0);
+    file = capinfo.loader;
+    assert(file->chunk_count == TEST_CHUNKS);
+
+    pthread_mutex_lock(&loader.lock);
+    loader.stop = false;
+    for (loader.thread_count = 0; loader.thread_count < threads; loader.thread_count++)
+        assert(pthread_create(&loader.threads[loader.thread_count], NULL, loader_scanner, NULL) == 0);
+    pthread_mutex_unlock(&loader.lock);
+
+    loader_chunk_enter(file);
+    while ((data = loader_file_peek(file, &header))) {
+        assert(count < max);
+        records[count++] = data - file->map - LOADER_RECORD_HDR_LEN;
+        assert(loader_file_packet(file) == (packet_t *) (records[count - 1] + 1));
+        file->parse_record++;
+    }
+    assert(file->loaded == file->size);
+
+    loader_stop(NULL);
+    capture_loader_deinit();
+    return count;
+}
+
+/**
+ * @brief Check guessed chunk starts of the written file
+ */
+static void
+check_guess(const char *path, size_t *records, size_t count)
+{
+    loader_file_t file;
+    size_t limit, i;
+    FILE *fp;
+
+    memset(&file, 0, sizeof(file));
+    assert((fp = fopen(path, "r")));
+    fseek(fp, 0, SEEK_END);
+    file.size = ftell(fp);
+    assert((file.map = malloc(file.size)));
+    fseek(fp, 0, SEEK_SET);
+    assert(fread((u_char *) file.map, 1, file.size, fp) == file.size);
+    fclose(fp);
+    file.first_sec = TEST_FIRST_SEC;
+
+    // Valid looking records at the first limit are inside a record
+    limit = LOADER_FILE_HDR_LEN + LOADER_CHUNK_SIZE;
+    assert(loader_chunk_start(&file, 1) == limit);
+    for (i = 0; i < count && records[i] < limit; i++);
+    assert(records[i] != limit);
+
+    // Second limit is followed by the record crossing it
+    limit += LOADER_CHUNK_SIZE;
+    for (; i < count && records[i] < limit; i++);
+    assert(loader_chunk_start(&file, 2) == records[i]);
+
+    free((u_char *) file.map);
+}
+
+int main ()
+{
+    char path[] = "test_014.XXXXXX";
+    size_t max = 2 * TEST_CHUNKS * LOADER_CHUNK_SIZE / 100;
+    size_t *written, *found;
+    size_t count;
+    int fd;
+
+    assert((written = calloc(max, sizeof(size_t))));
+    assert((found = calloc(max, sizeof(size_t))));
+    assert((fd = mkstemp(path)) != -1);
+    close(fd);
+
+    count = write_file(path, written, max);
+
+    // The second chunk start is wrongly guessed, the third one is not
+    check_guess(path, written, count);
+
+    // Chunks scanned while parsing
+    assert(load_file(path, 0, found, max) == count);
+    assert(!memcmp(found, written, count * sizeof(size_t)));
+
+    // Chunks scanned by several threads
+    memset(found, 0, max * sizeof(size_t));
+    assert(load_file(path, 4, found, max) == count);
+    assert(!memcmp(found, written, count * sizeof(size_t)));
+
+    unlink(path);
+    free(written);
+    free(found);
+    return 0;
+}
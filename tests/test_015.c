@@ -0,0 +1,115 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file test_015.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * Basic testing of duplicated packets detection
+ */
+
+#include "config.h"
+#include <assert.h>
+#include <string.h>
+#include <netinet/in.h>
+#include "../src/dedup.c"
+
+//! Time of checked packets, in milliseconds
+static uint64_t packet_msecs;
+
+struct timeval
+packet_time(packet_t *packet)
+{
+    struct timeval ts;
+
+    (void) packet;
+    ts.tv_sec = packet_msecs / 1000;
+    ts.tv_usec = (packet_msecs % 1000) * 1000;
+    return ts;
+}
+
+static bool
+check(uint32_t id, const char *payload, uint64_t msecs)
+{
+    address_t src = { "10.0.0.1", 5060 };
+    address_t dst = { "10.0.0.2", 5060 };
+    packet_t packet;
+
+    memset(&packet, 0, sizeof(packet));
+    packet.proto = IPPROTO_UDP;
+    packet.ip_id = id;
+    packet.src = src;
+    packet.dst = dst;
+    packet.payload = (u_char *) payload;
+    packet.payload_len = strlen(payload);
+    packet_msecs = msecs;
+    return dedup_check(&packet);
+}
+
+int main ()
+{
+    uint64_t start = 1700000000000ULL, wrap;
+
+    // Disabled without window
+    assert(dedup_init(0) == 0);
+    assert(!dedup_enabled());
+    assert(dedup_init(100) == 0);
+    assert(dedup_enabled());
+
+    // Same packet inside the window
+    assert(!check(1, "INVITE", start));
+    assert(check(1, "INVITE", start + 50));
+    assert(check(1, "INVITE", start + 100));
+    // Other packets are not duplicates
+    assert(!check(2, "INVITE", start + 10));
+    assert(!check(1, "ACK", start + 10));
+
+    // Same packet outside the window is stored again
+    assert(!check(1, "INVITE", start + 300));
+    assert(check(1, "INVITE", start + 350));
+
+    // Older copy received after the newer one
+    assert(!check(3, "BYE", start + 1100));
+    assert(check(3, "BYE", start + 1040));
+    assert(check(3, "BYE", start + 1000));
+    assert(!check(3, "BYE", start + 900));
+
+    // Stored times wrap around the time mask
+    assert(dedup_age(5, DEDUP_TIME_MASK - 4) == 10);
+    assert(dedup_age(DEDUP_TIME_MASK - 4, 5) == 10);
+    assert(dedup_age(DEDUP_TIME_MASK, 0) == 1);
+    assert(dedup_age(100, 40) == 60);
+    assert(dedup_age(40, 100) == 60);
+    assert(dedup_age(DEDUP_TIME_MASK >> 1, 0) == DEDUP_TIME_MASK >> 1);
+
+    // Copies at both sides of the wrap are duplicates, in any order
+    wrap = (start | DEDUP_TIME_MASK) + 1;
+    assert(!check(4, "CANCEL", wrap - 20));
+    assert(check(4, "CANCEL", wrap + 40));
+    assert(!check(5, "CANCEL", wrap + 30));
+    assert(check(5, "CANCEL", wrap - 30));
+    assert(!check(6, "CANCEL", wrap - 60));
+    assert(!check(6, "CANCEL", wrap + 60));
+
+    dedup_deinit();
+    assert(!dedup_enabled());
+    return 0;
+}
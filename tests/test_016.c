@@ -0,0 +1,162 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file test_016.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * Basic testing of dialog filter expressions
+ */
+
+#include "config.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/sip_filter.h"
+#include "../src/sip.h"
+
+static const char *payload =
+    "INVITE sip:bob@example.com SIP/2.0\r\n"
+    "Via: SIP/2.0/UDP 10.1.2.3:5060;branch=z9hG4bK1\r\n"
+    "From: \"Alice\" <sip:alice@Example.com>;tag=1\r\n"
+    "t: <sip:bob@example.com:5070>\r\n"
+    "Call-ID: abc123@host\r\n"
+    "CSeq: 1 INVITE\r\n"
+    "\r\n";
+
+int
+sip_method_from_str(const char *method)
+{
+    if (!strcmp(method, "REGISTER"))
+        return SIP_METHOD_REGISTER;
+    if (!strcmp(method, "INVITE"))
+        return SIP_METHOD_INVITE;
+    if (!strcmp(method, "BYE"))
+        return SIP_METHOD_BYE;
+    return atoi(method);
+}
+
+static bool
+check(const char *expr, int method, const char *src, uint16_t port)
+{
+    char error[256] = "";
+    sip_filter_t *filter;
+    packet_t packet;
+    sip_msg_t msg;
+    bool match;
+
+    memset(&packet, 0, sizeof(packet));
+    memset(&msg, 0, sizeof(msg));
+    strcpy(packet.src.ip, src);
+    packet.src.port = port;
+    strcpy(packet.dst.ip, "192.168.1.1");
+    packet.dst.port = 5070;
+    msg.reqresp = method;
+
+    filter = sip_filter_compile(expr, error, sizeof(error));
+    assert(filter);
+    assert(error[0] == '\0');
+    match = sip_filter_check(filter, &packet, &msg, payload);
+    sip_filter_free(filter);
+    return match;
+}
+
+static void
+check_error(const char *expr, const char *expected)
+{
+    char error[256] = "";
+
+    assert(!sip_filter_compile(expr, error, sizeof(error)));
+    assert(!strcmp(error, expected));
+}
+
+int main ()
+{
+    // And has higher precedence than or
+    assert(check("method=INVITE or method=BYE and src.port=5060", SIP_METHOD_INVITE, "10.1.2.3", 1000));
+    assert(!check("method=INVITE or method=BYE and src.port=5060", SIP_METHOD_BYE, "10.1.2.3", 1000));
+    assert(check("method=BYE and src.port=5060 or method=INVITE", SIP_METHOD_INVITE, "10.1.2.3", 1000));
+    // Parentheses group conditions
+    assert(!check("(method=INVITE or method=BYE) and src.port=5060", SIP_METHOD_INVITE, "10.1.2.3", 1000));
+    assert(check("(method=INVITE or method=BYE) and src.port=5060", SIP_METHOD_BYE, "10.1.2.3", 5060));
+    assert(check("((method=BYE))or(method=INVITE)", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    // Not only applies to the next condition or group
+    assert(!check("not method=INVITE and src.port=5060", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    assert(check("not method=INVITE and src.port=5060", SIP_METHOD_BYE, "10.1.2.3", 5060));
+    assert(check("not (method=INVITE and src.port=5060)", SIP_METHOD_INVITE, "10.1.2.3", 1000));
+    assert(check("not not method=INVITE", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    // Keywords are case insensitive
+    assert(check("METHOD=INVITE AND Not src.port=1000", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+
+    // Quoted and unquoted values
+    assert(check("from.user=alice and to.user==bob", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    assert(check("from.user=\"alice\" and to.user='bob'", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    assert(check("from='alice@Example.com' and to=\"bob@example.com:5070\"", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    assert(!check("from.user=\"alice \"", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    assert(check("callid=abc123@host and callid!=abc123", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    // Domains are case insensitive, users are not
+    assert(check("from.domain=example.com and to.domain=EXAMPLE.COM", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    assert(!check("from.user=Alice", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+
+    // Network prefixes
+    assert(check("src in 10.0.0.0/8", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    assert(!check("src in 10.1.3.0/24", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    assert(check("src in 10.1.2.0/23 and dst in 192.168.0.0/16", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    assert(check("src=10.1.2.3 and dst!=192.168.1.2", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    assert(check("src in 2001:db8::/32", SIP_METHOD_INVITE, "2001:db8::1", 5060));
+    assert(!check("src in 2001:db8::/32", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+
+    // Regular expression operands
+    assert(check("from.user~^al", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    assert(!check("from.user!~^al", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    assert(check("callid!~^xyz and to~:5070$", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    // Unquoted expressions can contain groups, even inside parentheses
+    assert(check("(from.user~^(al|bo)ice)", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+    assert(check("to.user~\"^(al|bo)b$\" and from.user~'a l|ice'", SIP_METHOD_INVITE, "10.1.2.3", 5060));
+
+    // Syntax errors
+    check_error("", "Expected condition at end of expression");
+    check_error("foo=bar", "Unknown field near 'foo=bar'");
+    check_error("method", "Expected operator at end of expression");
+    check_error("method INVITE", "Expected operator near 'INVITE'");
+    check_error("method=", "Expected value at end of expression");
+    check_error("from.user=\"alice", "Unterminated quoted value at end of expression");
+    check_error("(method=INVITE", "Expected ) at end of expression");
+    check_error("method=INVITE foo", "Unexpected text near 'foo'");
+    check_error("method=INVITE and", "Expected condition at end of expression");
+    check_error("not", "Expected condition at end of expression");
+
+    // Operators not valid for field type
+    check_error("method~INV", "Operator ~ can not be used with method");
+    check_error("method in INVITE", "Operator in can not be used with method");
+    check_error("src.port!~50", "Operator !~ can not be used with src.port");
+    check_error("dst~^10", "Operator ~ can not be used with dst");
+    check_error("from in 10.0.0.0/8", "Operator in can not be used with from");
+
+    // Values not valid for field type
+    check_error("method=FOO", "Invalid method value 'FOO'");
+    check_error("src.port=70000", "Invalid src.port value '70000'");
+    check_error("dst.port=50a", "Invalid dst.port value '50a'");
+    check_error("src in 10.0.0.300/8", "Invalid src value '10.0.0.300/8'");
+    check_error("from.user~\"(\"", "Invalid from.user value '('");
+
+    return 0;
+}
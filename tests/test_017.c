@@ -0,0 +1,100 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file test_017.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * Basic testing of rejected Call-IDs table
+ */
+
+#include "config.h"
+#include <assert.h>
+#include <stdio.h>
+#include "../src/sip_reject.h"
+
+int main ()
+{
+    sip_reject_t cache;
+    char callid[SIP_REJECT_BUCKET_SIZE + 1][32];
+    int i;
+
+    // Disabled table does not remember anything
+    assert(sip_reject_init(&cache, 0) == 0);
+    sip_reject_add(&cache, "disabled@host", SIP_REJECT_MATCH);
+    assert(sip_reject_find(&cache, "disabled@host") == SIP_REJECT_NONE);
+    sip_reject_free(&cache);
+
+    // Size is rounded up to a power of two number of buckets
+    assert(sip_reject_init(&cache, SIP_REJECT_BUCKET_SIZE * 3) == 0);
+    assert(cache.buckets == 4);
+    sip_reject_free(&cache);
+
+    // Insert and lookup
+    assert(sip_reject_init(&cache, SIP_REJECT_BUCKET_SIZE) == 0);
+    assert(cache.buckets == 1);
+    for (i = 0; i < SIP_REJECT_BUCKET_SIZE; i++) {
+        sprintf(callid[i], "callid-%d@host", i);
+        sip_reject_add(&cache, callid[i], (i % 2) ? SIP_REJECT_MATCH : SIP_REJECT_METHOD);
+    }
+    for (i = 0; i < SIP_REJECT_BUCKET_SIZE; i++)
+        assert(sip_reject_find(&cache, callid[i]) == ((i % 2) ? SIP_REJECT_MATCH : SIP_REJECT_METHOD));
+    assert(sip_reject_find(&cache, "unknown@host") == SIP_REJECT_NONE);
+
+    // Full table replaces the least recently used Call-ID
+    for (i = SIP_REJECT_BUCKET_SIZE - 1; i >= 0; i--) {
+        if (i != 2)
+            assert(sip_reject_find(&cache, callid[i]) != SIP_REJECT_NONE);
+    }
+    sprintf(callid[SIP_REJECT_BUCKET_SIZE], "callid-%d@host", SIP_REJECT_BUCKET_SIZE);
+    sip_reject_add(&cache, callid[SIP_REJECT_BUCKET_SIZE], SIP_REJECT_MATCH);
+    assert(sip_reject_find(&cache, callid[2]) == SIP_REJECT_NONE);
+    for (i = 0; i <= SIP_REJECT_BUCKET_SIZE; i++) {
+        if (i != 2)
+            assert(sip_reject_find(&cache, callid[i]) != SIP_REJECT_NONE);
+    }
+
+    // Dialogs rejected by method are checked again with each message:
+    // a message that can start the dialog but does not match replaces
+    // the reason in place, and a message that creates it forgets it
+    assert(sip_reject_find(&cache, callid[0]) == SIP_REJECT_METHOD);
+    sip_reject_add(&cache, callid[0], SIP_REJECT_MATCH);
+    assert(sip_reject_find(&cache, callid[0]) == SIP_REJECT_MATCH);
+    assert(sip_reject_find(&cache, callid[4]) == SIP_REJECT_METHOD);
+    sip_reject_remove(&cache, callid[4]);
+    assert(sip_reject_find(&cache, callid[4]) == SIP_REJECT_NONE);
+    for (i = 0; i <= SIP_REJECT_BUCKET_SIZE; i++) {
+        if (i != 2 && i != 4)
+            assert(sip_reject_find(&cache, callid[i]) != SIP_REJECT_NONE);
+    }
+
+    // Forgotten entries are reused before replacing any other
+    sip_reject_add(&cache, callid[2], SIP_REJECT_METHOD);
+    assert(sip_reject_find(&cache, callid[2]) == SIP_REJECT_METHOD);
+    for (i = 0; i <= SIP_REJECT_BUCKET_SIZE; i++) {
+        if (i != 4)
+            assert(sip_reject_find(&cache, callid[i]) != SIP_REJECT_NONE);
+    }
+
+    sip_reject_free(&cache);
+    assert(sip_reject_find(&cache, callid[0]) == SIP_REJECT_NONE);
+    return 0;
+}
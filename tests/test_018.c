@@ -0,0 +1,139 @@
+/**************************************************************************
+ **
+ ** sngrep - SIP Messages flow viewer
+ **
+ ** Copyright (C) 2013-2026 Ivan Alonso (Kaian)
+ ** Copyright (C) 2013-2026 Irontec SL. All rights reserved.
+ **
+ ** This program is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **
+ ****************************************************************************/
+/**
+ * @file test_018.c
+ * @author Ivan Alonso [aka Kaian] <kaian@irontec.com>
+ *
+ * Basic testing of compressed payloads released by the reclaimer thread
+ *
+ * Compressed packets are retired while another thread requests payloads,
+ * so the uncompressed payloads cache is used from both threads at once.
+ */
+
+#include "config.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "../src/epoch.h"
+#include "../src/packet.h"
+
+#ifdef WITH_ZLIB
+
+//! Number of packets retired by main thread
+#define RETIRED_PACKETS 20000
+//! Number of packets read by reader thread
+#define READ_PACKETS    (PACKET_PAYLOAD_CACHE * 2)
+
+//! Held while using payloads, like capture lock does
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+//! Reader thread must stop
+static int done = 0;
+
+static packet_t *
+compressed_packet(int index)
+{
+    address_t src = { "10.0.0.1", 5060 };
+    address_t dst = { "10.0.0.2", 5060 };
+    char payload[512];
+    packet_t *packet = packet_create(4, IPPROTO_UDP, src, dst, index);
+
+    snprintf(payload, sizeof(payload),
+             "OPTIONS sip:alice@10.0.0.2 SIP/2.0\r\n"
+             "Via: SIP/2.0/UDP 10.0.0.1:5060;branch=z9hG4bK-%d\r\n"
+             "From: <sip:bob@10.0.0.1>;tag=%d\r\n"
+             "To: <sip:alice@10.0.0.2>\r\n"
+             "Call-ID: %d@10.0.0.1\r\n"
+             "CSeq: 1 OPTIONS\r\n"
+             "Content-Length: 0\r\n\r\n", index, index, index);
+
+    packet_set_payload(packet, (u_char *) payload, strlen(payload));
+    assert(packet_compress_payload(packet) == 0);
+    return packet;
+}
+
+static void *
+reader(void *info)
+{
+    packet_t **packets = info;
+    char expected[64];
+    u_char *payload;
+    int i;
+
+    while (!__atomic_load_n(&done, __ATOMIC_SEQ_CST)) {
+        for (i = 0; i < READ_PACKETS; i++) {
+            snprintf(expected, sizeof(expected), "Call-ID: %d@", i);
+            pthread_mutex_lock(&lock);
+            assert((payload = packet_payload(packets[i])));
+            assert(strstr((char *) payload, expected));
+            pthread_mutex_unlock(&lock);
+        }
+    }
+
+    return NULL;
+}
+
+int
+main()
+{
+    packet_t *packets[READ_PACKETS], *packet;
+    pthread_t thread;
+    int i;
+
+    assert(epoch_init() == 0);
+
+    for (i = 0; i < READ_PACKETS; i++) {
+        packets[i] = compressed_packet(i);
+        packet_release_payload(packets[i]);
+    }
+
+    assert(pthread_create(&thread, NULL, reader, packets) == 0);
+
+    // Retired packets leave their payload in the cache
+    for (i = READ_PACKETS; i < RETIRED_PACKETS; i++) {
+        packet = compressed_packet(i);
+        pthread_mutex_lock(&lock);
+        packet_release_payload(packet);
+        pthread_mutex_unlock(&lock);
+        epoch_retire(packet, packet_destroyer, 0);
+    }
+
+    __atomic_store_n(&done, 1, __ATOMIC_SEQ_CST);
+    pthread_join(thread, NULL);
+    epoch_deinit();
+
+    for (i = 0; i < READ_PACKETS; i++)
+        packet_destroy(packets[i]);
+
+    return 0;
+}
+
+#else
+
+int
+main()
+{
+    // Payloads are never compressed without zlib
+    return 0;
+}
+
+#endif
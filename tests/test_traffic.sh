@@ -0,0 +1,29 @@
+#!/bin/sh
+#
+# Load a seeded synthetic capture through pcap loader and SIP correlation
+#
+# All generated calls must be found in sngrep report, including those
+# sent in IP fragments, TCP segments and WebSocket frames.
+#
+# Usage: test_traffic.sh [gen-traffic path] [sngrep path]
+#
+
+GEN=${1:-./gen-traffic}
+SNGREP=${2:-../src/sngrep}
+PCAP=$(mktemp "${TMPDIR:-/tmp}/sngrep-traffic.XXXXXX") || exit 1
+trap 'rm -f "$PCAP" "$PCAP.sngidx"' EXIT
+
+GENERATED=$("$GEN" -o "$PCAP" -s 7 -c 20 -d 5 -H 10 -b 10 -i 10 \
+                   -t udp:40,frag:20,tcp:20,ws:20 -l 1 -j 5 2>&1 >/dev/null) || exit 1
+EXPECTED=$(echo "$GENERATED" | sed -n 's/^Calls: \([0-9]*\) .*/\1/p')
+
+REPORT=$("$SNGREP" -F --report - -I "$PCAP") || exit 1
+FOUND=$(echo "$REPORT" | sed -n 's/^Calls: \([0-9]*\)$/\1/p')
+
+if [ -z "$EXPECTED" ] || [ "$EXPECTED" != "$FOUND" ]; then
+    echo "Generated calls: $EXPECTED, found calls: $FOUND"
+    echo "$REPORT"
+    exit 1
+fi
+
+exit 0